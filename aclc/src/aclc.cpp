@@ -1,3 +1,4 @@
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <filesystem>
@@ -5,11 +6,17 @@
 #include <initializer_list>
 #include <iostream>
 
+#include "ast_json.hpp"
+#include "ast_serializer.hpp"
 #include "exceptions.hpp"
+#include "file_index.hpp"
 #include "invariant_types.hpp"
-#include "lexer.hpp"
-#include "parser.hpp"
-#include "resolver.hpp"
+#include "json_util.hpp"
+#include "module_archive.hpp"
+#include "module_cache.hpp"
+#include "module_graph.hpp"
+#include "profiler.hpp"
+#include "server.hpp"
 
 #define ACLC_VERSION "1.0.0a"
 
@@ -32,6 +39,14 @@
 	"the "                                                                     \
 	"JSON file "                                                               \
 	"detailing the custom C++ compiler to use\n"                               \
+	"    --binary-ast                                 Dump the ASTs in the "   \
+	"binary AST format\n"                                                      \
+	"    --cache-dir <path>                           Specify the directory "  \
+	"of the module cache\n"                                                    \
+	"    --compact-ast                                Dump the ASTs without "  \
+	"any whitespace\n"                                                         \
+	"    --connect <socket>                           Compile on the compile " \
+	"server listening on the socket, if there is one\n"                       \
 	"    --dump-ast <path>                            Specify the directory "  \
 	"to "                                                                      \
 	"store the generated module ASTs\n"                                        \
@@ -43,16 +58,40 @@
 	"information\n"                                                            \
 	"    -I, --import-dir <path>                      Specify additional "     \
 	"import directory\n"                                                       \
+	"    -j, --jobs <count>                           Specify the number of "  \
+	"modules to compile in parallel\n"                                         \
+	"    --load-ast <path>                            Read the ASTs of the "   \
+	"modules from their dumps in the directory instead of parsing them\n"     \
+	"    --loadable-ast                               Dump the ASTs so that "  \
+	"they can be read back in\n"                                               \
+	"    --max-diagnostics <count>                    Specify the maximum "    \
+	"number of diagnostics to show\n"                                         \
+	"    --mem-report                                 Show the memory used "   \
+	"by the data structures of each module\n"                                  \
+	"    --no-cache                                   Disable the module "     \
+	"cache\n"                                                                  \
 	"    -o, --output-dest <path>                     Specify the output "     \
 	"file "                                                                    \
 	"or directory\n"                                                           \
 	"    -p, --platform <platform>                    Specify the platform "   \
 	"to "                                                                      \
 	"target\n"                                                                 \
+	"    --sarif <path>                               Write the diagnostics "  \
+	"to the file in the SARIF format instead of showing them\n"               \
+	"    --server <socket>                            Run a compile server "   \
+	"listening on the socket\n"                                                \
 	"    -t, --target <target>                        Specify the output "     \
 	"type\n"                                                                   \
+	"    --time-report                                Show the time spent on " \
+	"each phase of each module\n"                                              \
+	"    --trace <path>                               Write a trace of the "   \
+	"phases to the file in the Chrome trace format\n"                          \
 	"    -v, --version                                Output the compiler "    \
 	"version\n"                                                                \
+	"    --write-archive <path>                       Write the modules in "   \
+	"the directory to a module archive next to it\n"                           \
+	"    --write-index <path>                         Write an index of the "  \
+	"files in the directory so that imports are located without listing it\n" \
 	"    -V, --verbose                                Output verbose "         \
 	"information during compilation"
 
@@ -136,7 +175,31 @@
 /*
 --dump-ast <dest> = Dump the AST of the input modules to the specified
 directory. Each module AST will be dumped into a JSON file with the filename
-format "<module_name>.ast.json".
+format "<module_name>.ast.json". The dumps are written while the modules are
+compiled and are indented unless "--compact-ast" is given.
+
+--compact-ast = Dump the ASTs (see "--dump-ast") without any whitespace, which
+makes them a fraction of the size.
+
+--loadable-ast = Dump the ASTs (see "--dump-ast") with everything that is needed
+to read them back in (see "--load-ast"). The global scope is then wrapped in an
+object that records the path and hash of the source ("sourcePath",
+"sourceHash" and "ast"), and every node records its location ("line", "col" and
+"pos") and the fields that only matter to the parser. Binary dumps can always
+be read back in.
+
+--binary-ast = Dump the ASTs (see "--dump-ast") in the binary format of module
+definition files instead of JSON, into files with the filename format
+"<module_name>.ast". Unlike definitions, the dumps hold the complete AST. They
+are several times smaller than even compact JSON dumps and much faster to read
+back in (see "--load-ast"), but only by the same version of the compiler.
+
+--load-ast <dir> = Read the AST of every module that was dumped to the specified
+directory (see "--dump-ast") from its dump instead of parsing the module, and
+go straight to resolving it. A dump is only used if it is loadable (see
+"--loadable-ast" and "--binary-ast") and was written for the same file with the
+same content, which the dumps record; other modules are parsed as usual. Binary
+dumps are preferred over JSON dumps.
 
 -o, --output-dest <dest> = Specify the output destination. Whether this should
 be a file or a directory depends on the output type (specified by "-t").
@@ -150,6 +213,44 @@ directory will always be searched last.
 any number of additional import directories. The order in which these
 directories will be searched during module compilation is arbitrary.
 
+-j, --jobs <count> = Specify the number of modules to compile in parallel. If
+the count is 0, the number of hardware threads is used. By default, modules are
+compiled one at a time.
+
+--cache-dir <dir> = Enable the module cache and specify its directory. The
+interfaces of imported modules are stored in this directory so that they don't
+have to be parsed again on later runs. The directory is created if it doesn't
+exist. By default, there is no module cache and imported modules are always
+parsed. A compile server only keeps the modules of a request if the request
+uses the module cache.
+
+--no-cache = Disable the module cache, even if "--cache-dir" is specified.
+
+--max-diagnostics <count> = Specify the maximum number of diagnostics to show.
+Diagnostics are shown once the compilation is done, ordered by module and
+position, and identical diagnostics are only shown once. If the count is 0,
+which is the default, all diagnostics are shown.
+
+--sarif <path> = Write the diagnostics to the specified file as a SARIF 2.1.0
+log instead of showing them, for tools such as code scanning in CI.
+
+--time-report = Show the wall and CPU time spent on reading, lexing, parsing,
+loading the AST from a dump or the module cache, handling imports, each stage
+of resolution and dumping the AST, for every module and in total, along with
+the number of tokens and nodes produced per second. The time of a module is
+split between the threads it was compiled on.
+
+--mem-report = Show the peak resident set size of the compiler, along with the
+objects and memory allocated for source text, tokens, AST nodes, type refs,
+symbol tables and diagnostics in every phase (see "--time-report") of every
+module and in total, and the nodes allocated by kind. The memory is counted by
+the compiler itself as it allocates these data structures.
+
+--trace <path> = Write the phases of the compilation (see "--time-report") to
+the specified file in the Chrome trace event format, as one span per phase per
+module on the thread it ran on. The file can be opened in chrome://tracing or
+Perfetto to see how well the modules are compiled in parallel.
+
 -a, --arch <arch> = Specify the target architecture. If the architecture is not
 specified, it will be whatever the machine is that is running the compiler.
 
@@ -176,7 +277,10 @@ Available targets:
 exec - Binary executable. This is the default option.
 dlib, dynamic_lib - Dynamically-linked library.
 slib, static_lib - Statically-linked library.
-def - Module definition files.
+def - Module definition files. A module definition file (.acldef) holds the
+declarations of a module without any function bodies and can be imported in
+place of the module. One file is written for each input module into the
+output directory.
 cpp - C++ header and source files.
 obj - Object files.
 
@@ -353,6 +457,7 @@ void displayHelp();
 void displayUsage();
 void setOutputDest(const acl::String& dest);
 void enableDumpAst(const acl::String& dest);
+void setLoadAstDir(const acl::String& dir);
 void setGlobalImportDir(const acl::String& dir);
 void addImportDir(const acl::String& dir);
 void setArch(const acl::String& arch);
@@ -360,11 +465,22 @@ void setPlatform(const Platform& platform);
 void setTarget(const OutputTarget& target);
 void setCppCompiler(const CppCompiler& compiler);
 void addInputFile(const acl::String& file);
+void setJobs(const acl::String& jobs);
+void setCacheDir(const acl::String& dir);
+void setMaxDiagnostics(const acl::String& count);
+void writeIndex(const acl::String& dir);
+void writeArchive(const acl::String& dir);
+int run(int argc, char* argv[]);
 void parseArgs(int argc, char* argv[]);
 void compile();
-void compileModule(acl::CompilerContext& ctx,
-				   const std::filesystem::path& path);
+void runServer();
 void dumpAst(const acl::Module& m, const std::filesystem::path& destDir);
+void dumpBinaryAst(const acl::Module& m,
+				   const std::filesystem::path& destDir);
+void writeDefinition(const acl::Module& m,
+					 const std::filesystem::path& destDir);
+void writeProfile(const acl::Profiler& profiler);
+std::filesystem::path getOutputDir();
 void setDefaultGlobalImportDir();
 
 struct AclcOptions {
@@ -379,15 +495,50 @@ struct AclcOptions {
 	std::filesystem::path outputDest;
 	std::filesystem::path astDest;
 	bool dumpAst = false;
+	bool compactAst = false;
+	bool binaryAst = false;
+	bool loadableAst = false;
+	std::filesystem::path loadAstDir;
 	bool verbose = false;
+	unsigned jobs = 1;
+	std::filesystem::path cacheDir;
+	bool useCache = false;
+	std::filesystem::path serverSocket;
+	std::size_t maxDiagnostics = 0;
+	std::filesystem::path sarifPath;
+	bool timeReport = false;
+	bool memReport = false;
+	std::filesystem::path tracePath;
 };
 
 AclcOptions compilerOptions;
+
+// Only set while this process is a compile server (or was forked from one)
+acl::CompileServer* activeServer = nullptr;
 }  // namespace
 
 int main(int argc, char* argv[]) {
 	using namespace acl;
 
+	// The rest of the arguments are compiled by the server if it can be
+	// reached, and by this process otherwise
+	for (int i = 1; i + 1 < argc; i++) {
+		if (strcmp(argv[i], "--connect") != 0) continue;
+
+		List<String> args;
+		for (int j = 1; j < argc; j++)
+			if (j != i && j != i + 1) args.push_back(argv[j]);
+
+		int exitCode = 0;
+		if (sendCompileRequest(argv[i + 1], args, exitCode)) return exitCode;
+		break;
+	}
+
+	return run(argc, argv);
+}
+
+namespace {
+int run(int argc, char* argv[]) {
 	if (argc < 2) {
 		displayBasicInfo();
 		return 0;
@@ -403,11 +554,11 @@ int main(int argc, char* argv[]) {
 	return 0;
 }
 
-namespace {
 void parseArgs(int argc, char* argv[]) {
 	bool foundHelp = false;
 	bool foundVersion = false;
 	bool runCompiler = true;
+	bool noCache = false;
 	for (int i = 1; i < argc; i++) {
 		if ((strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0) &&
 			!foundHelp) {
@@ -436,6 +587,79 @@ void parseArgs(int argc, char* argv[]) {
 					"option");
 			addImportDir(argv[i + 1]);
 			i++;
+		} else if (strcmp(argv[i], "-j") == 0 ||
+				   strcmp(argv[i], "--jobs") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected job count following \"-j\" or \"--jobs\" "
+					"option");
+			setJobs(argv[i + 1]);
+			i++;
+		} else if (strcmp(argv[i], "--cache-dir") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected directory following \"--cache-dir\" option");
+			setCacheDir(argv[i + 1]);
+			i++;
+		} else if (strcmp(argv[i], "--load-ast") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected directory following \"--load-ast\" option");
+			setLoadAstDir(argv[i + 1]);
+			i++;
+		} else if (strcmp(argv[i], "--no-cache") == 0) {
+			noCache = true;
+		} else if (strcmp(argv[i], "--max-diagnostics") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected count following \"--max-diagnostics\" option");
+			setMaxDiagnostics(argv[i + 1]);
+			i++;
+		} else if (strcmp(argv[i], "--sarif") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected path following \"--sarif\" option");
+			compilerOptions.sarifPath = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "--time-report") == 0) {
+			compilerOptions.timeReport = true;
+		} else if (strcmp(argv[i], "--mem-report") == 0) {
+			compilerOptions.memReport = true;
+		} else if (strcmp(argv[i], "--trace") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected path following \"--trace\" option");
+			compilerOptions.tracePath = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "--write-archive") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected directory following \"--write-archive\" option");
+			writeArchive(argv[i + 1]);
+			runCompiler = false;
+			i++;
+		} else if (strcmp(argv[i], "--write-index") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected directory following \"--write-index\" option");
+			writeIndex(argv[i + 1]);
+			runCompiler = false;
+			i++;
+		} else if (strcmp(argv[i], "--server") == 0) {
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected socket following \"--server\" option");
+			if (activeServer)
+				throw ArgumentException(
+					"A compile server can't be started by a compile request");
+			compilerOptions.serverSocket = argv[i + 1];
+			i++;
+		} else if (strcmp(argv[i], "--connect") == 0) {
+			// Only reached if the compile server couldn't be reached
+			if (i + 1 >= argc)
+				throw ArgumentException(
+					"Expected socket following \"--connect\" option");
+			i++;
 		} else if (strcmp(argv[i], "-a") == 0 ||
 				   strcmp(argv[i], "--arch") == 0) {
 			if (i + 1 >= argc)
@@ -477,6 +701,12 @@ void parseArgs(int argc, char* argv[]) {
 					"option");
 			setOutputDest(argv[i + 1]);
 			i++;
+		} else if (strcmp(argv[i], "--compact-ast") == 0) {
+			compilerOptions.compactAst = true;
+		} else if (strcmp(argv[i], "--binary-ast") == 0) {
+			compilerOptions.binaryAst = true;
+		} else if (strcmp(argv[i], "--loadable-ast") == 0) {
+			compilerOptions.loadableAst = true;
 		} else if (strcmp(argv[i], "--dump-ast") == 0) {
 			if (i + 1 >= argc)
 				throw ArgumentException(
@@ -496,6 +726,13 @@ void parseArgs(int argc, char* argv[]) {
 		}
 	}
 
+	if (noCache) compilerOptions.useCache = false;
+
+	if (runCompiler && !compilerOptions.serverSocket.empty()) {
+		runServer();
+		return;
+	}
+
 	if (runCompiler) {
 		if (compilerOptions.inputModules.empty()) {
 			acl::log::error(std::cout, "No input modules provided");
@@ -521,90 +758,110 @@ void compile() {
 		ctx.additionalImportDirs.push_back(p);
 
 	ctx.globalImportDir = compilerOptions.globalImportPath;
-
-	for (const auto& p : compilerOptions.inputModules) {
-		bool shouldCompile = true;
-		for (const auto& m : ctx.modules) {
-			if (p == m->moduleInfo.path) {
-				shouldCompile = false;
-				break;
-			}
+	ctx.jobs = compilerOptions.jobs;
+	ctx.astDir = compilerOptions.loadAstDir;
+
+	std::ofstream sarifFile;
+	if (!compilerOptions.sarifPath.empty()) {
+		sarifFile.open(compilerOptions.sarifPath);
+		if (!sarifFile) {
+			StringBuffer sb;
+			sb << "Unable to write the SARIF log \""
+			   << compilerOptions.sarifPath.string() << "\"";
+			throw ArgumentException(sb.str());
 		}
+	}
 
-		if (shouldCompile) {
-			compileModule(ctx, p);
+	DiagnosticSink diagnostics(
+		sarifFile.is_open() ? static_cast<std::ostream&>(sarifFile) : std::cout,
+		sarifFile.is_open() ? DiagnosticFormat::SARIF : DiagnosticFormat::TEXT,
+		compilerOptions.maxDiagnostics, ACLC_VERSION);
+	ctx.diagnostics = &diagnostics;
+
+	ModuleCache cache(compilerOptions.cacheDir, ACLC_VERSION);
+	if (compilerOptions.useCache) ctx.moduleCache = &cache;
+
+	// The global import directory only changes when packages are installed,
+	// so it may come with an index of its own (see writeIndex())
+	FileIndex fileIndex(ACLC_VERSION);
+	fileIndex.loadManifest(ctx.globalImportDir);
+	ctx.fileIndex = &fileIndex;
+
+	// The input modules are always read again, since they are the ones which
+	// are most likely to have changed
+	List<Module*> heldModules;
+	if (activeServer) {
+		for (auto& m : activeServer->getModules()) {
+			bool input = false;
+			for (auto& p : compilerOptions.inputModules)
+				if (std::filesystem::absolute(p).string() == m->moduleInfo.path)
+					input = true;
+			if (!input) heldModules.push_back(ctx.addModule(m));
 		}
 	}
 
-	for (auto& m : ctx.modules) delete m;
-}
-
-static acl::String getModuleDir(const std::filesystem::path& path) {
-	return path.parent_path();
-}
-
-static acl::String getModuleName(const std::filesystem::path& path) {
-	return path.stem();
-}
-
-static acl::ModuleInfo getModuleInfo(const std::filesystem::path& path) {
-	auto p = std::filesystem::absolute(path);
-	return {getModuleDir(p), p, getModuleName(p)};
-}
-
-void compileModule(acl::CompilerContext& ctx,
-				   const std::filesystem::path& path) {
-	std::ifstream ifs(path);
-
-	if (!ifs) throw ArgumentException("Invalid input module");
-
-	acl::StringBuffer sb;
-	sb << ifs.rdbuf();
-	ifs.close();
-
-	acl::String str = sb.str();
-
-	acl::StringBuffer lexerBuf;
-	lexerBuf << str;
-
-	// TODO: A .accele file and a .acldef file should be parsed and resolved
-	// differently. Also, .acldef files cannot be translated to C++ source or
-	// OBJ files. They can only be used to reference a library.
-
-	auto moduleInfo = getModuleInfo(path);
-
-	acl::StringBuffer linesBuf;
-	linesBuf << str;
-
-	acl::List<acl::String> lines;
-	while (linesBuf) {
-		acl::String line;
-		std::getline(linesBuf, line);
-		lines.push_back(line);
+	Profiler profiler(compilerOptions.memReport);
+	if (compilerOptions.timeReport || compilerOptions.memReport ||
+		!compilerOptions.tracePath.empty())
+		ctx.profiler = &profiler;
+
+	ThreadPool pool(compilerOptions.jobs);
+	ctx.pool = &pool;
+	ModuleGraph graph(ctx);
+	graph.load(pool, compilerOptions.inputModules, [&ctx](Module* m) {
+		if (!compilerOptions.dumpAst) return;
+		Profiler::Span span(ctx.profiler, Phase::DUMP_AST, m->moduleInfo.path);
+		dumpAst(*m, compilerOptions.astDest);
+	});
+
+	List<std::filesystem::path> unreadable;
+	graph.getUnreadableInputs(unreadable);
+	if (unreadable.empty()) graph.resolve(pool);
+
+	// Every diagnostic of the compilation is shown here, once all of the
+	// threads are done
+	diagnostics.render(ctx);
+	if (!unreadable.empty()) throw ArgumentException("Invalid input module");
+	if (ctx.profiler) writeProfile(profiler);
+	if (graph.hasFailed()) exit(1);
+
+	if (compilerOptions.target == &OutputTarget::DEF) {
+		List<Module*> inputs;
+		graph.getInputModules(inputs);
+		auto destDir = getOutputDir();
+		for (auto& m : inputs) writeDefinition(*m, destDir);
 	}
 
-	auto m = new acl::Module{moduleInfo, nullptr, lines};
-
-	ctx.modules.push_back(m);
+	// TODO: Handle the rest of compilation here
 
-	acl::Parser parser =
-		acl::Parser(ctx, acl::Lexer(ctx, m->moduleInfo, lexerBuf));
-	auto ast = parser.parse();
+	if (activeServer && compilerOptions.useCache)
+		activeServer->reportModules(ctx, compilerOptions.cacheDir);
 
-	m->ast = ast;
+	for (auto& m : ctx.modules)
+		if (!listContains(heldModules, m)) delete m;
+}
 
-	if (compilerOptions.dumpAst) {
-		dumpAst(*m, compilerOptions.astDest);
-	}
+void runServer() {
+	using namespace acl;
+	bt::initInvariantTypes();
 
-	acl::Resolver resolver = acl::Resolver(ctx, m);
-	try {
-		resolver.resolve();
-	} catch (acl::AcceleException& e) {
+	CompileServer server(compilerOptions.serverSocket, ACLC_VERSION);
+	activeServer = &server;
+	auto started = server.run([](const List<String>& args) {
+		compilerOptions = AclcOptions();
+		List<char*> argv = {const_cast<char*>("aclc")};
+		for (auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+		return run(static_cast<int>(argv.size()), argv.data());
+	});
+	activeServer = nullptr;
+
+	if (!started) {
+		StringBuffer msg;
+		msg << "Unable to start the compile server on \""
+			<< compilerOptions.serverSocket.string() << "\"";
+		log::error(std::cout, msg.str());
 		exit(1);
 	}
-
-	// TODO: Handle the rest of compilation here
 }
 
 void setDefaultGlobalImportDir() {
@@ -656,6 +913,18 @@ void enableDumpAst(const acl::String& dest) {
 	compilerOptions.astDest = p;
 }
 
+void setLoadAstDir(const acl::String& dir) {
+	std::filesystem::path p = dir;
+	if (!std::filesystem::is_directory(p)) {
+		acl::StringBuffer sb;
+		sb << "The specified AST directory \"" << dir
+		   << "\" is not a directory";
+		throw ArgumentException(sb.str());
+	}
+
+	compilerOptions.loadAstDir = p;
+}
+
 void setGlobalImportDir(const acl::String& dir) {
 	std::filesystem::path p = dir;
 	if (!std::filesystem::exists(p)) {
@@ -693,6 +962,93 @@ void addImportDir(const acl::String& dir) {
 	compilerOptions.additionalImportPaths.push_back(p);
 }
 
+void setJobs(const acl::String& jobs) {
+	unsigned long count = 0;
+	try {
+		std::size_t end = 0;
+		count = std::stoul(jobs, &end);
+		if (end != jobs.length()) throw std::invalid_argument(jobs);
+	} catch (std::logic_error& e) {
+		acl::StringBuffer sb;
+		sb << "Invalid job count \"" << jobs << "\"";
+		throw ArgumentException(sb.str());
+	}
+
+	compilerOptions.jobs =
+		count ? count : acl::ThreadPool::getDefaultJobs();
+}
+
+void setCacheDir(const acl::String& dir) {
+	std::filesystem::path p = dir;
+	if (std::filesystem::exists(p) && !std::filesystem::is_directory(p)) {
+		acl::StringBuffer sb;
+		sb << "The specified cache directory \"" << dir
+		   << "\" is not a directory";
+		throw ArgumentException(sb.str());
+	}
+
+	compilerOptions.cacheDir = p;
+	compilerOptions.useCache = true;
+}
+
+void setMaxDiagnostics(const acl::String& count) {
+	try {
+		std::size_t end = 0;
+		compilerOptions.maxDiagnostics = std::stoul(count, &end);
+		if (end != count.length()) throw std::invalid_argument(count);
+	} catch (std::logic_error& e) {
+		acl::StringBuffer sb;
+		sb << "Invalid diagnostic count \"" << count << "\"";
+		throw ArgumentException(sb.str());
+	}
+}
+
+void writeIndex(const acl::String& dir) {
+	if (!std::filesystem::is_directory(dir)) {
+		acl::StringBuffer sb;
+		sb << "The specified directory \"" << dir << "\" is not a directory";
+		throw ArgumentException(sb.str());
+	}
+
+	if (!acl::FileIndex::writeManifest(dir)) {
+		acl::StringBuffer sb;
+		sb << "Unable to write the index of \"" << dir << "\"";
+		acl::log::error(std::cout, sb.str());
+		exit(1);
+	}
+}
+
+void writeArchive(const acl::String& dir) {
+	using namespace acl;
+
+	std::filesystem::path p = std::filesystem::absolute(dir).lexically_normal();
+	if (!p.has_filename()) p = p.parent_path();
+	if (!std::filesystem::is_directory(p) || !p.has_relative_path()) {
+		StringBuffer sb;
+		sb << "The specified directory \"" << dir << "\" is not a directory";
+		throw ArgumentException(sb.str());
+	}
+
+	// The modules are parsed so that their interfaces can be stored as well
+	bt::initInvariantTypes();
+	CompilerContext ctx;
+	DiagnosticSink diagnostics(std::cout, DiagnosticFormat::TEXT, 0,
+							   ACLC_VERSION);
+	ctx.diagnostics = &diagnostics;
+	auto archivePath = p;
+	archivePath += ModuleArchive::EXTENSION;
+	auto written = ModuleArchive::write(ctx, p, archivePath, ACLC_VERSION);
+	diagnostics.render(ctx);
+	for (auto& m : ctx.modules) delete m;
+
+	if (!written) {
+		StringBuffer sb;
+		sb << "Unable to write the module archive of \"" << dir << "\"";
+		log::error(std::cout, sb.str());
+		exit(1);
+	}
+}
+
 void setArch(const acl::String& arch) { compilerOptions.arch = arch; }
 
 void setPlatform(const Platform& platform) {
@@ -721,20 +1077,116 @@ void addInputFile(const acl::String& file) {
 	compilerOptions.inputModules.push_back(p);
 }
 
+void dumpBinaryAst(const acl::Module& m,
+				   const std::filesystem::path& destDir) {
+	auto destFile = destDir / (m.moduleInfo.name + ".ast");
+
+	acl::String data;
+	auto source = m.getAstSource();
+	bool failed = !acl::serializeAst(data, m.ast, false, &source);
+	if (!failed) {
+		std::ofstream ofs(destFile, std::ios::binary);
+		ofs.write(data.data(), data.length());
+		failed = !ofs;
+	}
+
+	if (failed) {
+		acl::StringBuffer sb;
+		sb << "Failed to write AST for destination file \"" << destFile.string()
+		   << "\"";
+		acl::log::error(std::cout, sb.str());
+	}
+}
+
 void dumpAst(const acl::Module& m, const std::filesystem::path& destDir) {
+	if (compilerOptions.binaryAst) return dumpBinaryAst(m, destDir);
+
 	auto destFile = destDir / (m.moduleInfo.name + ".ast.json");
-	std::ofstream ofs(destFile);
 
-	if (!ofs) {
+	// The AST is streamed into the file, since the dumps of large modules
+	// can be much larger than the modules themselves
+	auto file = std::fopen(destFile.string().c_str(), "wb");
+	bool failed = !file;
+	if (file) {
+		auto format = compilerOptions.compactAst
+						  ? acl::json::Writer::Format::COMPACT
+						  : acl::json::Writer::Format::PRETTY;
+		acl::json::Writer writer(file, format, compilerOptions.loadableAst);
+		acl::writeAstJson(writer, m.ast, m.getAstSource());
+		writer.flush();
+		failed = std::ferror(file) != 0;
+		failed = std::fclose(file) != 0 || failed;
+	}
+
+	if (failed) {
 		acl::StringBuffer sb;
 		sb << "Failed to write AST for destination file \"" << destFile.string()
 		   << "\"";
 		acl::log::error(std::cout, sb.str());
 	}
+}
 
-	acl::StringBuffer sb;
-	m.ast->globalScope->toJson(sb);
-	auto str = sb.str();
-	ofs << str;
+void writeProfile(const acl::Profiler& profiler) {
+	if (compilerOptions.timeReport) profiler.writeReport(std::cout);
+	if (compilerOptions.memReport) profiler.writeMemoryReport(std::cout);
+	if (compilerOptions.tracePath.empty()) return;
+
+	auto file = std::fopen(compilerOptions.tracePath.string().c_str(), "wb");
+	bool failed = !file;
+	if (file) {
+		acl::json::Writer writer(file, acl::json::Writer::Format::COMPACT);
+		profiler.writeTrace(writer);
+		writer.flush();
+		failed = std::ferror(file) != 0;
+		failed = std::fclose(file) != 0 || failed;
+	}
+
+	if (failed) {
+		acl::StringBuffer sb;
+		sb << "Failed to write the trace \""
+		   << compilerOptions.tracePath.string() << "\"";
+		acl::log::error(std::cout, sb.str());
+	}
+}
+
+std::filesystem::path getOutputDir() {
+	if (compilerOptions.outputDest.empty())
+		return std::filesystem::current_path();
+
+	std::error_code ec;
+	std::filesystem::create_directories(compilerOptions.outputDest, ec);
+	if (!std::filesystem::is_directory(compilerOptions.outputDest)) {
+		acl::StringBuffer sb;
+		sb << "The specified output directory \""
+		   << compilerOptions.outputDest.string() << "\" is not a directory";
+		throw ArgumentException(sb.str());
+	}
+
+	return compilerOptions.outputDest;
+}
+
+void writeDefinition(const acl::Module& m,
+					 const std::filesystem::path& destDir) {
+	auto destFile = destDir / (m.moduleInfo.name + ".acldef");
+
+	acl::String data;
+	if (!acl::serializeAst(data, m.ast, true)) {
+		acl::StringBuffer sb;
+		sb << "Failed to generate the module definition for \""
+		   << m.moduleInfo.path << "\"";
+		acl::log::error(std::cout, sb.str());
+		exit(1);
+	}
+
+	std::ofstream ofs(destFile, std::ios::binary);
+	ofs.write(data.data(), data.length());
+
+	if (!ofs) {
+		acl::StringBuffer sb;
+		sb << "Failed to write module definition file \"" << destFile.string()
+		   << "\"";
+		acl::log::error(std::cout, sb.str());
+		exit(1);
+	}
 }
 }  // namespace
\ No newline at end of file
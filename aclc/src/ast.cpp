@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <filesystem>
+#include <mutex>
 
 #include "diagnoser.hpp"
 #include "invariant_types.hpp"
@@ -23,10 +24,80 @@ ResolutionStage operator++(ResolutionStage& rs, int) {
 	return result;
 }
 
-Scope::Scope(Scope* parentScope) : parentScope(parentScope) {}
+Scope::Scope(Scope* parentScope) : parentScope(parentScope), info() {}
 
 Scope::~Scope() {}
 
+static bool isOwningFunctionScope(const Scope* scope) {
+	if (auto block = dynamic_cast<const FunctionBlock*>(scope)) {
+		return block->blockType == TokenType::GET ||
+			   block->blockType == TokenType::INIT;
+	}
+
+	return dynamic_cast<const Function*>(scope) ||
+		   dynamic_cast<const LambdaExpression*>(scope) ||
+		   dynamic_cast<const Constructor*>(scope) ||
+		   dynamic_cast<const Destructor*>(scope) ||
+		   dynamic_cast<const SetBlock*>(scope);
+}
+
+// Whether a scope declared directly in a type has no instance to refer to
+static bool isStaticMember(const Scope* scope) {
+	if (auto f = dynamic_cast<const Function*>(scope)) {
+		for (auto& m : f->modifiers)
+			if (m->content->type == TokenType::STATIC) return true;
+		return false;
+	}
+
+	return dynamic_cast<const FunctionBlock*>(scope) ||
+		   dynamic_cast<const SetBlock*>(scope) ||
+		   dynamic_cast<const Constructor*>(scope);
+}
+
+const ScopeInfo& Scope::getInfo() const {
+	std::call_once(infoFlag, [this]() {
+		auto self = const_cast<Scope*>(this);
+		info.functionScope = isFunctionScope(this);
+		auto type = dynamic_cast<Type*>(self);
+
+		if (!parentScope) {
+			info.globalScope = dynamic_cast<const GlobalScope*>(this);
+			info.owningFunction = isOwningFunctionScope(this) ? self : nullptr;
+			info.enclosingType = type;
+			info.selfType = info.functionScope ? nullptr : type;
+			info.staticContext = true;
+			info.depth = 0;
+			return;
+		}
+
+		const auto& parent = parentScope->getInfo();
+		info.globalScope = parent.globalScope;
+		info.owningFunction =
+			isOwningFunctionScope(this) ? self : parent.owningFunction;
+		info.enclosingType = type ? type : parent.enclosingType;
+		info.selfType = info.functionScope ? parent.selfType : type;
+		info.depth = parent.depth + 1;
+
+		if (dynamic_cast<const Type*>(parentScope))
+			info.staticContext = isStaticMember(this);
+		else if (dynamic_cast<const GlobalScope*>(this))
+			info.staticContext = true;
+		else
+			info.staticContext = parent.staticContext;
+	});
+	return info;
+}
+
+bool Scope::isWithin(const Scope* scope) const {
+	auto depth = getInfo().depth;
+	auto targetDepth = scope->getInfo().depth;
+	if (targetDepth > depth) return false;
+
+	auto current = this;
+	for (; depth > targetDepth; depth--) current = current->parentScope;
+	return current == scope;
+}
+
 void Scope::addSymbol(Symbol* symbol) {
 	// We only check types and namespaces here; we can't check functions or the
 	// like because addSymbol() doesn't consider overloaded functions
@@ -55,62 +126,107 @@ Symbol* Scope::containsSymbol(Symbol* symbol) {
 }
 
 namespace type {
+static void buildTypeHierarchy(TypeHierarchy* dest, const Type* type) {
+	dest->ancestors.clear();
+	dest->indices.clear();
+	dest->complete = true;
+
+	dest->indices[type] = 0;
+	dest->ancestors.push_back({type, 0, nullptr});
+
+	// Breadth-first traversal guarantees that the first time an ancestor is
+	// reached is along one of its shortest paths
+	for (std::size_t i = 0; i < dest->ancestors.size(); i++) {
+		auto current = dest->ancestors[i];
+		for (const auto& p : current.type->parentTypes) {
+			if (!p->actualType) {
+				dest->complete = false;
+				continue;
+			}
+			if (dest->indices.count(p->actualType)) continue;
+			dest->indices[p->actualType] = dest->ancestors.size();
+			dest->ancestors.push_back(
+				{p->actualType, current.distance + 1, p});
+		}
+	}
+}
+
+// Guards building hierarchies since types (particularly the invariant types)
+// are shared between modules that may be resolved in parallel. Complete
+// hierarchies are never modified again, so they can be read without locking.
+static std::mutex typeHierarchyMutex;
+
+const TypeHierarchy* getTypeHierarchy(const Type* type) {
+	auto result = type->hierarchy.load(std::memory_order_acquire);
+	if (result && result->complete) return result;
+
+	std::lock_guard<std::mutex> lock(typeHierarchyMutex);
+	result = type->hierarchy.load(std::memory_order_relaxed);
+	if (result && result->complete) return result;
+
+	// Another thread may still be reading an incomplete hierarchy (the bodies
+	// of a module are resolved in parallel), so it is replaced rather than
+	// rebuilt and kept alive until the type is destroyed
+	auto rebuilt = new TypeHierarchy();
+	buildTypeHierarchy(rebuilt, type);
+	if (result) type->retiredHierarchies.push_back(result);
+	type->hierarchy.store(rebuilt, std::memory_order_release);
+	return rebuilt;
+}
+
 static int getTypeMatchScore0(const TypeRef** commonTypeDest, const TypeRef* a,
-							  const TypeRef* b, bool traceAll, bool traceB) {
+							  const TypeRef* b, bool traceAll) {
 	if (a->actualType == b->actualType) {
 		// This could be set to a or b; it doesn't matter
 		if (commonTypeDest) *commonTypeDest = a;
 		return 0;
 	}
 
-	const TypeRef* commonTypeA = nullptr;
-	const TypeRef* commonTypeB = nullptr;
-	int minA = -1;
-	int minB = -1;
-
-	for (auto& p : a->actualType->parentTypes) {
-		const TypeRef* commonType = nullptr;
-		int s = getTypeMatchScore0(&commonType, p, b, traceAll, false);
-		if (minA == -1 || s < minA) {
-			commonTypeA = commonType;
-			minA = s;
-		}
-	}
+	const auto* ha = getTypeHierarchy(a->actualType);
+	const auto* hb = getTypeHierarchy(b->actualType);
 
-	if (traceAll || traceB) {
-		for (auto& p : b->actualType->parentTypes) {
-			const TypeRef* commonType = nullptr;
-			int s = getTypeMatchScore0(&commonType, p, a, traceAll, false);
-			if (minB == -1 || s < minB) {
-				commonTypeB = commonType;
-				minB = s;
-			}
+	if (!traceAll) {
+		// One of the types must be an ancestor of the other
+		const auto* ea = ha->find(b->actualType);
+		const auto* eb = hb->find(a->actualType);
+
+		if (eb && (!ea || eb->distance < ea->distance)) {
+			if (commonTypeDest) *commonTypeDest = eb->ref;
+			return eb->distance;
 		}
-	}
 
-	if (minA > -1 && minB > -1) {
-		if (minB < minA) {
-			if (commonTypeDest) *commonTypeDest = commonTypeB;
-			return minB + 1;
-		} else {
-			if (commonTypeDest) *commonTypeDest = commonTypeA;
-			return minA + 1;
+		if (ea) {
+			if (commonTypeDest) *commonTypeDest = ea->ref;
+			return ea->distance;
 		}
-	}
 
-	if (minA > -1) {
-		if (commonTypeDest) *commonTypeDest = commonTypeA;
-		return minA + 1;
+		return -1;
 	}
 
-	if (minB > -1) {
-		if (commonTypeDest) *commonTypeDest = commonTypeB;
-		return minB + 1;
+	// Find the common ancestor with the shortest combined path length
+	const TypeHierarchy::Entry* bestA = nullptr;
+	const TypeHierarchy::Entry* bestB = nullptr;
+	for (const auto& ea : ha->ancestors) {
+		// Ancestors are sorted by distance; nothing further can beat the
+		// current best
+		if (bestA && ea.distance >= bestA->distance + bestB->distance) break;
+		const auto* eb = hb->find(ea.type);
+		if (eb && (!bestA || ea.distance + eb->distance <
+								 bestA->distance + bestB->distance)) {
+			bestA = &ea;
+			bestB = eb;
+		}
 	}
 
-	// TODO: Handle the case where at least one of the types is an InvariantType
+	if (!bestA) {
+		// TODO: Handle the case where at least one of the types is an
+		// InvariantType
+		return -1;
+	}
 
-	return -1;
+	if (commonTypeDest)
+		*commonTypeDest = bestA->distance == 0 ? bestB->ref : bestA->ref;
+	return bestA->distance + bestB->distance;
 }
 
 int getTypeMatchScore(const TypeRef** commonTypeDest, const TypeRef* a,
@@ -119,7 +235,7 @@ int getTypeMatchScore(const TypeRef** commonTypeDest, const TypeRef* a,
 		a = g->actualParentType;
 	if (GenericType* g = dynamic_cast<GenericType*>(b->actualType))
 		b = g->actualParentType;
-	return getTypeMatchScore0(commonTypeDest, a, b, traceAll, true);
+	return getTypeMatchScore0(commonTypeDest, a, b, traceAll);
 }
 
 bool typesMatch(TypeRef* a, TypeRef* b) {
@@ -151,10 +267,30 @@ bool genericsAreCompatible(const List<TypeRef*>& supplied,
 static bool canCast(const TypeRef* src, const TypeRef* target,
 					bool checkForBuiltins);
 
+// Whether the result of casting involving the type ref can no longer change
+static bool isSettled(const TypeRef* ref) {
+	if (GenericType* g = dynamic_cast<GenericType*>(ref->actualType))
+		ref = g->actualParentType;
+	return ref && ref->actualType &&
+		   getTypeHierarchy(ref->actualType)->complete;
+}
+
 bool genericAcceptsType(const GenericType* g, const TypeRef* t) {
+	{
+		std::shared_lock<std::shared_mutex> lock(g->acceptedTypesMutex);
+		auto it = g->acceptedTypes.find(t->actualType);
+		if (it != g->acceptedTypes.end()) return it->second;
+	}
+
 	// Do not handle builtins here; we are strictly looking through the type
 	// hierarchy only
-	return canCast(t, g->actualParentType, false);
+	bool result = canCast(t, g->actualParentType, false);
+
+	if (t->actualType && isSettled(t) && isSettled(g->actualParentType)) {
+		std::lock_guard<std::shared_mutex> lock(g->acceptedTypesMutex);
+		g->acceptedTypes[t->actualType] = result;
+	}
+	return result;
 }
 
 const TypeRef* getMinCommonType(const TypeRef* a, const TypeRef* b) {
@@ -189,10 +325,8 @@ static bool canCast(const TypeRef* src, const TypeRef* target,
 }
 
 static bool canCastBuiltin(const TypeRef* src, const TypeRef* target) {
-	auto voidRef = tb::base(const_cast<bt::InvariantType*>(bt::VOID), {},
-							bt::VOID->sourceMeta);
-	auto strRef = tb::base(const_cast<bt::InvariantType*>(bt::STRING), {},
-						   bt::STRING->sourceMeta);
+	auto voidRef = tb::base(const_cast<bt::InvariantType*>(bt::VOID), {});
+	auto strRef = tb::base(const_cast<bt::InvariantType*>(bt::STRING), {});
 
 	bool result = false;
 
@@ -230,9 +364,6 @@ static bool canCastBuiltin(const TypeRef* src, const TypeRef* target) {
 				  ((a == bt::OPTIONAL || a == bt::UNWRAPPED_OPTIONAL) &&
 				   b == bt::BOOL));
 
-	delete voidRef;
-	delete strRef;
-
 	return result;
 }
 
@@ -241,14 +372,95 @@ bool canCastTo(const TypeRef* src, const TypeRef* target) {
 }
 }  // namespace type
 
-Node::Node(const SourceMeta& sourceMeta) : sourceMeta(sourceMeta) {}
+static thread_local std::size_t createdNodes = 0;
+
+Node::Node(const SourceMeta& sourceMeta) : sourceMeta(sourceMeta) {
+	createdNodes++;
+}
 
 Node::~Node() {}
 
+std::size_t Node::getCreatedCount() { return createdNodes; }
+
+void* Node::operator new(std::size_t size) {
+	auto p = ::operator new(size);
+	Profiler::countNode(p, size);
+	return p;
+}
+
+void Node::operator delete(void* p) {
+	Profiler::forgetNode(p);
+	::operator delete(p);
+}
+
 Ast::Ast(GlobalScope* globalScope)
-	: globalScope(globalScope), stage(ResolutionStage::UNRESOLVED) {}
+	: globalScope(globalScope),
+	  stage(ResolutionStage::UNRESOLVED),
+	  exports(nullptr),
+	  onDemand(false) {}
+
+Ast::~Ast() {
+	delete exports;
+	delete globalScope;
+}
+
+const ExportTable::Entry* ExportTable::find(const String& id) const {
+	auto it = entries.find(id);
+	return it != entries.end() ? &it->second : nullptr;
+}
+
+static std::mutex exportTableMutex;
+
+const ExportTable* getExportTable(Ast* ast) {
+	std::lock_guard<std::mutex> lock(exportTableMutex);
+	if (ast->exports) return ast->exports;
+
+	auto table = new ExportTable();
+	for (auto& s : ast->globalScope->symbols) {
+		auto& entry = table->entries[s->id->data];
+		const Token* destToken = nullptr;
+		if (getSymbolVisibility(ast->globalScope, s, false, &destToken) ==
+			TokenType::INTERNAL)
+			entry.internal = true;
+		entry.symbols.push_back(s);
+	}
 
-Ast::~Ast() { delete globalScope; }
+	ast->exports = table;
+	return table;
+}
+
+String getQualifiedName(const Scope* owningScope, const Symbol* symbol) {
+	String result = symbol->id->data;
+	for (auto s = owningScope; s && !dynamic_cast<const GlobalScope*>(s);
+		 s = s->parentScope) {
+		auto owner = dynamic_cast<const Symbol*>(s);
+		if (!owner) return "";
+		result = owner->id->data + "." + result;
+	}
+	return result;
+}
+
+void findQualifiedSymbols(List<Symbol*>& dest, const Ast* ast,
+						  const String& name) {
+	const Scope* scope = ast->globalScope;
+	std::size_t start = 0;
+	for (auto end = name.find('.'); end != String::npos;
+		 end = name.find('.', start)) {
+		auto id = name.substr(start, end - start);
+		const Scope* next = nullptr;
+		for (auto& s : scope->symbols) {
+			if (s->id->data != id) continue;
+			if ((next = dynamic_cast<const Scope*>(s))) break;
+		}
+		if (!next) return;
+		scope = next;
+		start = end + 1;
+	}
+
+	auto id = name.substr(start);
+	for (auto& s : scope->symbols)
+		if (s->id->data == id) dest.push_back(s);
+}
 
 GlobalScope::GlobalScope(const SourceMeta& sourceMeta,
 						 const List<Node*>& content)
@@ -260,11 +472,10 @@ GlobalScope::~GlobalScope() {
 	for (auto& c : content) delete c;
 }
 
-void GlobalScope::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"GlobalScope\",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void GlobalScope::toJson(json::Writer& dest) const {
+	dest.beginNode("GlobalScope", sourceMeta);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 void GlobalScope::addImport(Import* imp) {
@@ -281,7 +492,10 @@ void GlobalScope::addImport(Import* imp) {
 }
 
 TypeRef::TypeRef(const SourceMeta& sourceMeta)
-	: Node(sourceMeta), actualType(nullptr), refType(ReferenceType::UNKNOWN) {}
+	: Node(sourceMeta),
+	  actualType(nullptr),
+	  refType(ReferenceType::UNKNOWN),
+	  canonical(false) {}
 
 TypeRef::~TypeRef() {}
 
@@ -296,18 +510,12 @@ SimpleTypeRef::~SimpleTypeRef() {
 	delete parent;
 }
 
-void SimpleTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"SimpleTypeRef\",\n";
-	dest << "\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<TypeRef*>(dest, generics,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"parent\": ";
-	if (parent)
-		parent->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void SimpleTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("SimpleTypeRef", sourceMeta);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.node("parent", parent);
+	dest.endNode();
 }
 
 SuffixTypeRef::SuffixTypeRef(const SourceMeta& sourceMeta, TypeRef* type,
@@ -319,11 +527,11 @@ SuffixTypeRef::~SuffixTypeRef() {
 	delete suffixSymbol;
 }
 
-void SuffixTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"SuffixTypeRef\",\n";
-	dest << "\"type\": ";
-	type->toJson(dest);
-	dest << ",\n\"suffixSymbol\": \"" << suffixSymbol->data << "\"\n}";
+void SuffixTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("SuffixTypeRef", sourceMeta);
+	dest.node("type", type);
+	dest.field("suffixSymbol", suffixSymbol->data);
+	dest.endNode();
 }
 
 TupleTypeRef::TupleTypeRef(const SourceMeta& sourceMeta,
@@ -337,12 +545,10 @@ TupleTypeRef::~TupleTypeRef() {
 		for (auto& c : elementTypes) delete c;
 }
 
-void TupleTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"TupleTypeRef\",\n";
-	dest << "\"elementTypes\": ";
-	json::appendList<TypeRef*>(dest, elementTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void TupleTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("TupleTypeRef", sourceMeta);
+	dest.nodes("elementTypes", elementTypes);
+	dest.endNode();
 }
 
 MapTypeRef::MapTypeRef(const SourceMeta& sourceMeta, TypeRef* keyType,
@@ -354,13 +560,11 @@ MapTypeRef::~MapTypeRef() {
 	delete valueType;
 }
 
-void MapTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"MapTypeRef\",\n";
-	dest << "\"keyType\": ";
-	keyType->toJson(dest);
-	dest << ",\n\"valueType\": ";
-	valueType->toJson(dest);
-	dest << "\n}";
+void MapTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("MapTypeRef", sourceMeta);
+	dest.node("keyType", keyType);
+	dest.node("valueType", valueType);
+	dest.endNode();
 }
 
 ArrayTypeRef::ArrayTypeRef(const SourceMeta& sourceMeta, TypeRef* elementType)
@@ -368,11 +572,10 @@ ArrayTypeRef::ArrayTypeRef(const SourceMeta& sourceMeta, TypeRef* elementType)
 
 ArrayTypeRef::~ArrayTypeRef() { delete elementType; }
 
-void ArrayTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"ArrayTypeRef\",\n";
-	dest << "\"elementType\": ";
-	elementType->toJson(dest);
-	dest << "\n}";
+void ArrayTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("ArrayTypeRef", sourceMeta);
+	dest.node("elementType", elementType);
+	dest.endNode();
 }
 
 FunctionTypeRef::FunctionTypeRef(const SourceMeta& sourceMeta,
@@ -385,14 +588,11 @@ FunctionTypeRef::~FunctionTypeRef() {
 	delete returnType;
 }
 
-void FunctionTypeRef::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\":\"FunctionTypeRef\",\n";
-	dest << "\"paramTypes\": ";
-	json::appendList<TypeRef*>(dest, paramTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"returnType\": ";
-	returnType->toJson(dest);
-	dest << "\n}";
+void FunctionTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("FunctionTypeRef", sourceMeta);
+	dest.nodes("paramTypes", paramTypes);
+	dest.node("returnType", returnType);
+	dest.endNode();
 }
 
 SuperTypeRef::SuperTypeRef(const SourceMeta& sourceMeta, Type* child)
@@ -400,7 +600,10 @@ SuperTypeRef::SuperTypeRef(const SourceMeta& sourceMeta, Type* child)
 
 SuperTypeRef::~SuperTypeRef() {}
 
-void SuperTypeRef::toJson(StringBuffer& dest) const {}
+void SuperTypeRef::toJson(json::Writer& dest) const {
+	dest.beginNode("SuperTypeRef", sourceMeta);
+	dest.endNode();
+}
 
 Expression::Expression(const SourceMeta& sourceMeta)
 	: Node(sourceMeta), valueType(nullptr), immediate(true) {}
@@ -418,15 +621,12 @@ TernaryExpression::~TernaryExpression() {
 	delete arg2;
 }
 
-void TernaryExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"TernaryExpression\",\n";
-	dest << "\"arg0\": ";
-	arg0->toJson(dest);
-	dest << ",\n\"arg1\": ";
-	arg1->toJson(dest);
-	dest << ",\n\"arg2\": ";
-	arg2->toJson(dest);
-	dest << "\n}";
+void TernaryExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("TernaryExpression", sourceMeta);
+	dest.node("arg0", arg0);
+	dest.node("arg1", arg1);
+	dest.node("arg2", arg2);
+	dest.endNode();
 }
 
 BinaryExpression::BinaryExpression(const SourceMeta& sourceMeta, Token* op,
@@ -439,14 +639,12 @@ BinaryExpression::~BinaryExpression() {
 	delete right;
 }
 
-void BinaryExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"BinaryExpression\",\n";
-	dest << "\"op\": \"" << op->data << "\",\n";
-	dest << "\"left\": ";
-	left->toJson(dest);
-	dest << ",\n\"right\": ";
-	right->toJson(dest);
-	dest << "\n}";
+void BinaryExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("BinaryExpression", sourceMeta);
+	dest.field("op", op->data);
+	dest.node("left", left);
+	dest.node("right", right);
+	dest.endNode();
 }
 
 UnaryPrefixExpression::UnaryPrefixExpression(const SourceMeta& sourceMeta,
@@ -458,12 +656,11 @@ UnaryPrefixExpression::~UnaryPrefixExpression() {
 	delete arg;
 }
 
-void UnaryPrefixExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"UnaryPrefixExpression\",\n";
-	dest << "\"op\": \"" << op->data << "\",\n";
-	dest << "\"arg\": ";
-	arg->toJson(dest);
-	dest << "\n}";
+void UnaryPrefixExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("UnaryPrefixExpression", sourceMeta);
+	dest.field("op", op->data);
+	dest.node("arg", arg);
+	dest.endNode();
 }
 
 UnaryPostfixExpression::UnaryPostfixExpression(const SourceMeta& sourceMeta,
@@ -475,12 +672,11 @@ UnaryPostfixExpression::~UnaryPostfixExpression() {
 	delete arg;
 }
 
-void UnaryPostfixExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"UnaryPostfixExpression\",\n";
-	dest << "\"op\": \"" << op->data << "\",\n";
-	dest << "\"arg\": ";
-	arg->toJson(dest);
-	dest << "\n}";
+void UnaryPostfixExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("UnaryPostfixExpression", sourceMeta);
+	dest.field("op", op->data);
+	dest.node("arg", arg);
+	dest.endNode();
 }
 
 FunctionCallExpression::FunctionCallExpression(const SourceMeta& sourceMeta,
@@ -493,14 +689,11 @@ FunctionCallExpression::~FunctionCallExpression() {
 	for (auto& c : args) delete c;
 }
 
-void FunctionCallExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"FunctionCallExpression\",\n";
-	dest << "\"caller\": ";
-	caller->toJson(dest);
-	dest << ",\n\"args\": ";
-	json::appendList<Expression*>(dest, args,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void FunctionCallExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("FunctionCallExpression", sourceMeta);
+	dest.node("caller", caller);
+	dest.nodes("args", args);
+	dest.endNode();
 }
 
 SubscriptExpression::SubscriptExpression(const SourceMeta& sourceMeta,
@@ -512,13 +705,11 @@ SubscriptExpression::~SubscriptExpression() {
 	delete index;
 }
 
-void SubscriptExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"SubscriptExpression\",\n";
-	dest << "\"target\": ";
-	target->toJson(dest);
-	dest << ",\n\"index\": ";
-	index->toJson(dest);
-	dest << "\n}";
+void SubscriptExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("SubscriptExpression", sourceMeta);
+	dest.node("target", target);
+	dest.node("index", index);
+	dest.endNode();
 }
 
 CastingExpression::CastingExpression(const SourceMeta& sourceMeta, Token* op,
@@ -531,14 +722,12 @@ CastingExpression::~CastingExpression() {
 	delete right;
 }
 
-void CastingExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"CastingExpression\",\n";
-	dest << "\"op\": \"" << op->data << "\",\n";
-	dest << "\"left\": ";
-	left->toJson(dest);
-	dest << ",\n\"right\": ";
-	right->toJson(dest);
-	dest << "\n}";
+void CastingExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("CastingExpression", sourceMeta);
+	dest.field("op", op->data);
+	dest.node("left", left);
+	dest.node("right", right);
+	dest.endNode();
 }
 
 MapLiteralExpression::MapLiteralExpression(const SourceMeta& sourceMeta,
@@ -551,15 +740,11 @@ MapLiteralExpression::~MapLiteralExpression() {
 	for (auto& c : values) delete c;
 }
 
-void MapLiteralExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"MapLiteralExpression\",\n";
-	dest << "\"keys\": ";
-	json::appendList<Expression*>(dest, keys,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"values\": ";
-	json::appendList<Expression*>(dest, values,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void MapLiteralExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("MapLiteralExpression", sourceMeta);
+	dest.nodes("keys", keys);
+	dest.nodes("values", values);
+	dest.endNode();
 }
 
 ArrayLiteralExpression::ArrayLiteralExpression(
@@ -570,12 +755,10 @@ ArrayLiteralExpression::~ArrayLiteralExpression() {
 	for (auto& c : elements) delete c;
 }
 
-void ArrayLiteralExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ArrayLiteralExpression\",\n";
-	dest << "\"elements\": ";
-	json::appendList<Expression*>(dest, elements,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void ArrayLiteralExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("ArrayLiteralExpression", sourceMeta);
+	dest.nodes("elements", elements);
+	dest.endNode();
 }
 
 TupleLiteralExpression::TupleLiteralExpression(
@@ -586,12 +769,10 @@ TupleLiteralExpression::~TupleLiteralExpression() {
 	for (auto& c : elements) delete c;
 }
 
-void TupleLiteralExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"TupleLiteralExpression\",\n";
-	dest << "\"elements\": ";
-	json::appendList<Expression*>(dest, elements,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void TupleLiteralExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("TupleLiteralExpression", sourceMeta);
+	dest.nodes("elements", elements);
+	dest.endNode();
 }
 
 LiteralExpression::LiteralExpression(Token* value)
@@ -599,12 +780,29 @@ LiteralExpression::LiteralExpression(Token* value)
 
 LiteralExpression::~LiteralExpression() { delete value; }
 
-void LiteralExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"LiteralExpression\",\n";
-	dest << "\"type\": " << (int)value->type << ",\n";
-	dest << "\"value\": ";
-	json::appendToken(dest, value);
-	dest << "\n}";
+void LiteralExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("LiteralExpression", sourceMeta);
+	dest.field("type", static_cast<int>(value->type));
+	dest.key("value");
+	dest.token(value);
+
+	// The expressions interpolated into a string by the index they are
+	// inserted at, in order
+	auto str = dynamic_cast<const StringToken*>(value);
+	if (dest.loadable && str) {
+		List<int> indices;
+		for (const auto& e : str->interpolations) indices.push_back(e.first);
+		std::sort(indices.begin(), indices.end());
+
+		dest.key("interpolations");
+		dest.startObject();
+		for (auto i : indices) {
+			dest.key(std::to_string(i).c_str());
+			dest.string(str->interpolations.at(i));
+		}
+		dest.endObject();
+	}
+	dest.endNode();
 }
 
 IdentifierExpression::IdentifierExpression(Token* value,
@@ -622,15 +820,12 @@ IdentifierExpression::~IdentifierExpression() {
 	for (auto& c : generics) delete c;
 }
 
-void IdentifierExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"IdentifierExpression\",\n";
-	dest << "\"value\": \"" << value->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<TypeRef*>(dest, generics,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"globalPrefix\": ";
-	json::appendBool(dest, globalPrefix);
-	dest << "\n}";
+void IdentifierExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("IdentifierExpression", sourceMeta);
+	dest.field("value", value->data);
+	dest.nodes("generics", generics);
+	dest.field("globalPrefix", globalPrefix);
+	dest.endNode();
 }
 
 LambdaExpression::LambdaExpression(const SourceMeta& sourceMeta,
@@ -650,21 +845,19 @@ LambdaExpression::~LambdaExpression() {
 	for (auto& c : content) delete c;
 }
 
-void LambdaExpression::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"LambdaExpression\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"parameters\": ";
-	json::appendList<Parameter*>(dest, parameters,
-								 [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void LambdaExpression::toJson(json::Writer& dest) const {
+	dest.beginNode("LambdaExpression", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.nodes("parameters", parameters);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
-Symbol::Symbol(Token* id) : Node(id->meta), id(id) {}
+Symbol::Symbol(Token* id)
+	: Node(id->meta),
+	  id(id),
+	  signatureQuery(QueryState::PENDING),
+	  contentQuery(QueryState::PENDING) {}
 
 Symbol::~Symbol() { delete id; }
 
@@ -678,21 +871,15 @@ Parameter::Parameter(const List<Modifier*>& modifiers, Token* id,
 Parameter::~Parameter() {
 	for (auto& c : modifiers) delete c;
 	delete declaredType;
-	if (actualType != declaredType) delete actualType;
-}
-
-void Parameter::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Parameter\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"declaredType\": ";
-	if (declaredType)
-		declaredType->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+	if (actualType != declaredType) tb::release(actualType);
+}
+
+void Parameter::toJson(json::Writer& dest) const {
+	dest.beginNode("Parameter", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.node("declaredType", declaredType);
+	dest.endNode();
 }
 
 FunctionBlock::FunctionBlock(const SourceMeta& sourceMeta,
@@ -710,15 +897,12 @@ FunctionBlock::~FunctionBlock() {
 	for (auto& c : content) delete c;
 }
 
-void FunctionBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"FunctionBlock\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void FunctionBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("FunctionBlock", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	if (dest.loadable) dest.field("blockType", static_cast<int>(blockType));
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 void FunctionBlock::addSymbol(Symbol* symbol) {
@@ -767,31 +951,20 @@ Function::~Function() {
 	for (auto& c : generics) delete c;
 	for (auto& c : parameters) delete c;
 	delete declaredReturnType;
-	if (declaredReturnType != actualReturnType) delete actualReturnType;
+	if (declaredReturnType != actualReturnType) tb::release(actualReturnType);
 	for (auto& c : content) delete c;
 }
 
-void Function::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Function\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"parameters\": ";
-	json::appendList<Parameter*>(dest, parameters,
-								 [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"declaredReturnType\": ";
-	if (declaredReturnType)
-		declaredReturnType->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Function::toJson(json::Writer& dest) const {
+	dest.beginNode("Function", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("parameters", parameters);
+	dest.node("declaredReturnType", declaredReturnType);
+	if (dest.loadable) dest.field("hasBody", hasBody);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Variable::Variable(const List<Modifier*>& modifiers, Token* id,
@@ -810,25 +983,14 @@ Variable::~Variable() {
 	delete value;
 }
 
-void Variable::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Variable\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"declaredType\": ";
-	if (declaredType)
-		declaredType->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"value\": ";
-	if (value)
-		value->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"constant\": ";
-	json::appendBool(dest, constant);
-	dest << "\n}";
+void Variable::toJson(json::Writer& dest) const {
+	dest.beginNode("Variable", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.node("declaredType", declaredType);
+	dest.node("value", value);
+	dest.field("constant", constant);
+	dest.endNode();
 }
 
 ConditionalBlock::ConditionalBlock(const SourceMeta& sourceMeta,
@@ -840,13 +1002,11 @@ ConditionalBlock::~ConditionalBlock() {
 	delete block;
 }
 
-void ConditionalBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ConditionalBlock\",\n";
-	dest << "\"condition\": ";
-	condition->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void ConditionalBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("ConditionalBlock", sourceMeta);
+	dest.node("condition", condition);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 IfBlock::IfBlock(const SourceMeta& sourceMeta, Expression* condition,
@@ -862,21 +1022,13 @@ IfBlock::~IfBlock() {
 	delete elseBlock;
 }
 
-void IfBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"IfBlock\",\n";
-	dest << "\"condition\": ";
-	condition->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << ",\n\"elifBlocks\": ";
-	json::appendList<ConditionalBlock*>(
-		dest, elifBlocks, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"elseBlock\": ";
-	if (elseBlock)
-		elseBlock->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void IfBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("IfBlock", sourceMeta);
+	dest.node("condition", condition);
+	dest.node("block", block);
+	dest.nodes("elifBlocks", elifBlocks);
+	dest.node("elseBlock", elseBlock);
+	dest.endNode();
 }
 
 WhileBlock::WhileBlock(const SourceMeta& sourceMeta, Expression* condition,
@@ -885,13 +1037,11 @@ WhileBlock::WhileBlock(const SourceMeta& sourceMeta, Expression* condition,
 
 WhileBlock::~WhileBlock() {}
 
-void WhileBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"WhileBlock\",\n";
-	dest << "\"condition\": ";
-	condition->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void WhileBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("WhileBlock", sourceMeta);
+	dest.node("condition", condition);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 RepeatBlock::RepeatBlock(const SourceMeta& sourceMeta, Expression* condition,
@@ -900,13 +1050,11 @@ RepeatBlock::RepeatBlock(const SourceMeta& sourceMeta, Expression* condition,
 
 RepeatBlock::~RepeatBlock() {}
 
-void RepeatBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"RepeatBlock\",\n";
-	dest << "\"condition\": ";
-	condition->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void RepeatBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("RepeatBlock", sourceMeta);
+	dest.node("condition", condition);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 ForBlock::ForBlock(const SourceMeta& sourceMeta, Parameter* iterator,
@@ -919,15 +1067,12 @@ ForBlock::~ForBlock() {
 	delete block;
 }
 
-void ForBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ForBlock\",\n";
-	dest << "\"iterator\": ";
-	iterator->toJson(dest);
-	dest << ",\n\"iteratee\": ";
-	iteratee->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void ForBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("ForBlock", sourceMeta);
+	dest.node("iterator", iterator);
+	dest.node("iteratee", iteratee);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 CatchBlock::CatchBlock(const SourceMeta& sourceMeta,
@@ -939,13 +1084,11 @@ CatchBlock::~CatchBlock() {
 	delete block;
 }
 
-void CatchBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"CatchBlock\",\n";
-	dest << "\"exceptionVariable\": ";
-	exceptionVariable->toJson(dest);
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void CatchBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("CatchBlock", sourceMeta);
+	dest.node("exceptionVariable", exceptionVariable);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 TryBlock::TryBlock(const SourceMeta& sourceMeta, FunctionBlock* block,
@@ -957,14 +1100,11 @@ TryBlock::~TryBlock() {
 	for (auto& c : catchBlocks) delete c;
 }
 
-void TryBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"TryBlock\",\n";
-	dest << "\"block\": ";
-	block->toJson(dest);
-	dest << ",\n\"catchBlocks\": ";
-	json::appendList<CatchBlock*>(dest, catchBlocks,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void TryBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("TryBlock", sourceMeta);
+	dest.node("block", block);
+	dest.nodes("catchBlocks", catchBlocks);
+	dest.endNode();
 }
 
 SwitchCaseBlock::SwitchCaseBlock(const SourceMeta& sourceMeta, Token* caseType,
@@ -980,17 +1120,12 @@ SwitchCaseBlock::~SwitchCaseBlock() {
 	delete block;
 }
 
-void SwitchCaseBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"SwitchCaseBlock\",\n";
-	dest << "\"caseType\": \"" << caseType->data << "\",\n";
-	dest << "\"condition\": ";
-	if (condition)
-		condition->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"block\": ";
-	block->toJson(dest);
-	dest << "\n}";
+void SwitchCaseBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("SwitchCaseBlock", sourceMeta);
+	dest.field("caseType", caseType->data);
+	dest.node("condition", condition);
+	dest.node("block", block);
+	dest.endNode();
 }
 
 SwitchBlock::SwitchBlock(const SourceMeta& sourceMeta, Expression* condition,
@@ -1002,14 +1137,11 @@ SwitchBlock::~SwitchBlock() {
 	for (auto& c : cases) delete c;
 }
 
-void SwitchBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"SwitchBlock\",\n";
-	dest << "\"condition\": ";
-	condition->toJson(dest);
-	dest << ",\n\"cases\": ";
-	json::appendList<SwitchCaseBlock*>(
-		dest, cases, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void SwitchBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("SwitchBlock", sourceMeta);
+	dest.node("condition", condition);
+	dest.nodes("cases", cases);
+	dest.endNode();
 }
 
 ReturnStatement::ReturnStatement(const SourceMeta& sourceMeta,
@@ -1018,14 +1150,10 @@ ReturnStatement::ReturnStatement(const SourceMeta& sourceMeta,
 
 ReturnStatement::~ReturnStatement() { delete value; }
 
-void ReturnStatement::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ReturnStatement\",\n";
-	dest << "\"value\": ";
-	if (value)
-		value->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void ReturnStatement::toJson(json::Writer& dest) const {
+	dest.beginNode("ReturnStatement", sourceMeta);
+	dest.node("value", value);
+	dest.endNode();
 }
 
 ThrowStatement::ThrowStatement(const SourceMeta& sourceMeta, Expression* value)
@@ -1033,11 +1161,10 @@ ThrowStatement::ThrowStatement(const SourceMeta& sourceMeta, Expression* value)
 
 ThrowStatement::~ThrowStatement() { delete value; }
 
-void ThrowStatement::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ThrowStatement\",\n";
-	dest << "\"value\": ";
-	value->toJson(dest);
-	dest << "\n}";
+void ThrowStatement::toJson(json::Writer& dest) const {
+	dest.beginNode("ThrowStatement", sourceMeta);
+	dest.node("value", value);
+	dest.endNode();
 }
 
 SingleTokenStatement::SingleTokenStatement(Token* content)
@@ -1045,17 +1172,27 @@ SingleTokenStatement::SingleTokenStatement(Token* content)
 
 SingleTokenStatement::~SingleTokenStatement() { delete content; }
 
-void SingleTokenStatement::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"SingleTokenStatement\",\n";
-	dest << "\"content\": \"" << content->data << "\"";
-	dest << "\n}";
+void SingleTokenStatement::toJson(json::Writer& dest) const {
+	dest.beginNode("SingleTokenStatement", sourceMeta);
+	dest.field("content", content->data);
+	dest.endNode();
+}
+
+TypeHierarchy::TypeHierarchy() : complete(false) {}
+
+const TypeHierarchy::Entry* TypeHierarchy::find(const Type* type) const {
+	auto it = indices.find(type);
+	if (it == indices.end()) return nullptr;
+	return &ancestors[it->second];
 }
 
 Type::Type(Token* id, const List<GenericType*>& generics)
-	: Symbol(id), generics(generics) {}
+	: Symbol(id), generics(generics), hierarchy(nullptr) {}
 
 Type::~Type() {
 	for (auto& c : generics) delete c;
+	delete hierarchy.load();
+	for (auto& h : retiredHierarchies) delete h;
 }
 
 GenericType::GenericType(Token* id, TypeRef* declaredParentType)
@@ -1065,15 +1202,11 @@ GenericType::GenericType(Token* id, TypeRef* declaredParentType)
 
 GenericType::~GenericType() { delete declaredParentType; }
 
-void GenericType::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"GenericType\",\n";
-	dest << "\"id\": \"" << id->data << "\",\n";
-	dest << "\"declaredParentType\": ";
-	if (declaredParentType)
-		declaredParentType->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void GenericType::toJson(json::Writer& dest) const {
+	dest.beginNode("GenericType", sourceMeta);
+	dest.field("id", id->data);
+	dest.node("declaredParentType", declaredParentType);
+	dest.endNode();
 }
 
 Alias::Alias(const List<Modifier*>& modifiers, Token* id,
@@ -1091,18 +1224,13 @@ Alias::~Alias() {
 	delete value;
 }
 
-void Alias::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Alias\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"value\": ";
-	value->toJson(dest);
-	dest << "\n}";
+void Alias::toJson(json::Writer& dest) const {
+	dest.beginNode("Alias", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.node("value", value);
+	dest.endNode();
 }
 
 SetBlock::SetBlock(const SourceMeta& sourceMeta,
@@ -1120,20 +1248,12 @@ SetBlock::~SetBlock() {
 	for (auto& c : content) delete c;
 }
 
-void SetBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"SetBlock\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"parameter\": ";
-	if (parameter)
-		parameter->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void SetBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("SetBlock", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.node("parameter", parameter);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 VariableBlock::VariableBlock(const SourceMeta& sourceMeta,
@@ -1150,24 +1270,12 @@ VariableBlock::~VariableBlock() {
 	delete initBlock;
 }
 
-void VariableBlock::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"VariableBlock\",\n";
-	dest << "\"getBlock\": ";
-	if (getBlock)
-		getBlock->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"setBlock\": ";
-	if (setBlock)
-		setBlock->toJson(dest);
-	else
-		dest << "null";
-	dest << ",\n\"initBlock\": ";
-	if (initBlock)
-		initBlock->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void VariableBlock::toJson(json::Writer& dest) const {
+	dest.beginNode("VariableBlock", sourceMeta);
+	dest.node("getBlock", getBlock);
+	dest.node("setBlock", setBlock);
+	dest.node("initBlock", initBlock);
+	dest.endNode();
 }
 
 Class::Class(const List<Modifier*>& modifiers, Token* id,
@@ -1183,7 +1291,7 @@ Class::Class(const List<Modifier*>& modifiers, Token* id,
 	for (auto& p : declaredParentTypes) parentTypes.push_back(p);
 	if (parentTypes.empty())
 		parentTypes.push_back(
-			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}, sourceMeta));
+			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}));
 }
 
 Class::~Class() {
@@ -1192,22 +1300,14 @@ Class::~Class() {
 	for (auto& c : content) delete c;
 }
 
-void Class::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Class\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"declaredParentTypes\": ";
-	json::appendList<TypeRef*>(dest, declaredParentTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Class::toJson(json::Writer& dest) const {
+	dest.beginNode("Class", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("declaredParentTypes", declaredParentTypes);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Struct::Struct(const List<Modifier*>& modifiers, Token* id,
@@ -1223,7 +1323,7 @@ Struct::Struct(const List<Modifier*>& modifiers, Token* id,
 	for (auto& p : declaredParentTypes) parentTypes.push_back(p);
 	if (parentTypes.empty())
 		parentTypes.push_back(
-			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}, sourceMeta));
+			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}));
 }
 
 Struct::~Struct() {
@@ -1232,22 +1332,14 @@ Struct::~Struct() {
 	for (auto& c : content) delete c;
 }
 
-void Struct::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Struct\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"declaredParentTypes\": ";
-	json::appendList<TypeRef*>(dest, declaredParentTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Struct::toJson(json::Writer& dest) const {
+	dest.beginNode("Struct", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("declaredParentTypes", declaredParentTypes);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Template::Template(const List<Modifier*>& modifiers, Token* id,
@@ -1263,7 +1355,7 @@ Template::Template(const List<Modifier*>& modifiers, Token* id,
 	for (auto& p : declaredParentTypes) parentTypes.push_back(p);
 	if (parentTypes.empty())
 		parentTypes.push_back(
-			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}, sourceMeta));
+			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}));
 }
 
 Template::~Template() {
@@ -1272,22 +1364,14 @@ Template::~Template() {
 	for (auto& c : content) delete c;
 }
 
-void Template::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Template\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"declaredParentTypes\": ";
-	json::appendList<TypeRef*>(dest, declaredParentTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Template::toJson(json::Writer& dest) const {
+	dest.beginNode("Template", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("declaredParentTypes", declaredParentTypes);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Enum::Enum(const List<Modifier*>& modifiers, Token* id,
@@ -1303,7 +1387,7 @@ Enum::Enum(const List<Modifier*>& modifiers, Token* id,
 	for (auto& p : declaredParentTypes) parentTypes.push_back(p);
 	if (parentTypes.empty())
 		parentTypes.push_back(
-			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}, sourceMeta));
+			tb::base(const_cast<bt::InvariantType*>(bt::ANY), {}));
 }
 
 Enum::~Enum() {
@@ -1312,22 +1396,14 @@ Enum::~Enum() {
 	for (auto& c : content) delete c;
 }
 
-void Enum::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Enum\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"declaredParentTypes\": ";
-	json::appendList<TypeRef*>(dest, declaredParentTypes,
-							   [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Enum::toJson(json::Writer& dest) const {
+	dest.beginNode("Enum", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("declaredParentTypes", declaredParentTypes);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Namespace::Namespace(const List<Modifier*>& modifiers, Token* id,
@@ -1347,19 +1423,13 @@ Namespace::~Namespace() {
 	for (auto& c : content) delete c;
 }
 
-void Namespace::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Namespace\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"generics\": ";
-	json::appendList<GenericType*>(
-		dest, generics, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Namespace::toJson(json::Writer& dest) const {
+	dest.beginNode("Namespace", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("generics", generics);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Constructor::Constructor(const List<Modifier*>& modifiers, Token* id,
@@ -1377,19 +1447,13 @@ Constructor::~Constructor() {
 	for (auto& c : content) delete c;
 }
 
-void Constructor::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Constructor\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"parameters\": ";
-	json::appendList<Parameter*>(dest, parameters,
-								 [](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Constructor::toJson(json::Writer& dest) const {
+	dest.beginNode("Constructor", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("parameters", parameters);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 Destructor::Destructor(const SourceMeta& sourceMeta, List<Modifier*>& modifiers,
@@ -1404,15 +1468,11 @@ Destructor::~Destructor() {
 	for (auto& c : content) delete c;
 }
 
-void Destructor::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Destructor\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"content\": ";
-	json::appendList<Node*>(dest, content,
-							[](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void Destructor::toJson(json::Writer& dest) const {
+	dest.beginNode("Destructor", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.nodes("content", content);
+	dest.endNode();
 }
 
 EnumCase::EnumCase(const List<Modifier*>& modifiers, Token* id,
@@ -1424,16 +1484,12 @@ EnumCase::~EnumCase() {
 	for (auto& c : args) delete c;
 }
 
-void EnumCase::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"EnumCase\",\n";
-	dest << "\"modifiers\": ";
-	json::appendList<Modifier*>(dest, modifiers,
-								[](auto& d, const auto& e) { e->toJson(d); });
-	dest << ",\n\"id\": \"" << id->data << "\",\n";
-	dest << "\"args\": ";
-	json::appendList<Expression*>(dest, args,
-								  [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+void EnumCase::toJson(json::Writer& dest) const {
+	dest.beginNode("EnumCase", sourceMeta);
+	dest.nodes("modifiers", modifiers);
+	dest.field("id", id->data);
+	dest.nodes("args", args);
+	dest.endNode();
 }
 
 ImportTarget::ImportTarget(Token* id, TypeRef* declaredType)
@@ -1444,15 +1500,11 @@ ImportTarget::~ImportTarget() {
 	delete declaredType;
 }
 
-void ImportTarget::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ImportTarget\",\n";
-	dest << "\"id\": \"" << id->data << "\",\n";
-	dest << "\"declaredType\": ";
-	if (declaredType)
-		declaredType->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void ImportTarget::toJson(json::Writer& dest) const {
+	dest.beginNode("ImportTarget", sourceMeta);
+	dest.field("id", id->data);
+	dest.node("declaredType", declaredType);
+	dest.endNode();
 }
 
 ImportSource::ImportSource(Token* content, ImportSource* parent,
@@ -1467,15 +1519,12 @@ ImportSource::~ImportSource() {
 	delete parent;
 }
 
-void ImportSource::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"ImportSource\",\n";
-	dest << "\"content\": \"" << content->data << "\",\n";
-	dest << "\"parent\": ";
-	if (parent)
-		parent->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void ImportSource::toJson(json::Writer& dest) const {
+	dest.beginNode("ImportSource", sourceMeta);
+	dest.field("content", content->data);
+	dest.node("parent", parent);
+	if (dest.loadable) dest.field("declaredRelative", declaredRelative);
+	dest.endNode();
 }
 
 static String formatImportAlias(const String& str) {
@@ -1511,44 +1560,46 @@ Import::Import(ImportSource* source, Token* alias,
 }
 
 Import::~Import() {
+	// The ID is the content of the source, which the source frees, and the
+	// alias may be taken from the source too
+	id = nullptr;
+	if (actualAlias != alias && actualAlias != source->content)
+		delete actualAlias;
 	delete source;
 	delete alias;
 	for (auto& c : targets) delete c;
 }
 
-void Import::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Import\",\n";
-	dest << "\"source\": ";
-	source->toJson(dest);
-	dest << ",\n\"alias\": ";
+void Import::toJson(json::Writer& dest) const {
+	dest.beginNode("Import", sourceMeta);
+	dest.node("source", source);
+	dest.key("alias");
 	if (alias)
-		dest << "\"" << alias->data << "\"";
+		dest.string(alias->data);
 	else
-		dest << "null";
-	dest << ",\n\"targets\": ";
-	json::appendList<ImportTarget*>(
-		dest, targets, [](auto& d, const auto& e) { e->toJson(d); });
-	dest << "\n}";
+		dest.null();
+	dest.nodes("targets", targets);
+	dest.endNode();
 }
 
 Modifier::Modifier(Token* content) : Node(content->meta), content(content) {}
 
 Modifier::~Modifier() { delete content; }
 
-void Modifier::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"Modifier\",\n";
-	dest << "\"content\": \"" << content->data << "\"";
-	dest << "\n}";
+void Modifier::toJson(json::Writer& dest) const {
+	dest.beginNode("Modifier", sourceMeta);
+	dest.field("content", content->data);
+	dest.endNode();
 }
 
 MetaDeclaration::MetaDeclaration(Token* content) : Modifier(content) {}
 
 MetaDeclaration::~MetaDeclaration() {}
 
-void MetaDeclaration::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"MetaDeclaration\",\n";
-	dest << "\"content\": \"" << content->data << "\"";
-	dest << "\n}";
+void MetaDeclaration::toJson(json::Writer& dest) const {
+	dest.beginNode("MetaDeclaration", sourceMeta);
+	dest.field("content", content->data);
+	dest.endNode();
 }
 
 WarningMetaDeclaration::WarningMetaDeclaration(Token* content,
@@ -1561,18 +1612,15 @@ WarningMetaDeclaration::~WarningMetaDeclaration() {
 	delete target;
 }
 
-void WarningMetaDeclaration::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"WarningMetaDeclaration\",\n";
-	dest << "\"content\": \"" << content->data << "\",\n";
-	dest << "\"args\": ";
-	json::appendList<Token*>(
-		dest, args, [](auto& d, const auto& e) { json::appendToken(d, e); });
-	dest << ",\n\"target\": ";
-	if (target)
-		target->toJson(dest);
-	else
-		dest << "null";
-	dest << "\n}";
+void WarningMetaDeclaration::toJson(json::Writer& dest) const {
+	dest.beginNode("WarningMetaDeclaration", sourceMeta);
+	dest.field("content", content->data);
+	dest.key("args");
+	dest.startArray();
+	for (const auto& t : args) dest.token(t);
+	dest.endArray();
+	dest.node("target", target);
+	dest.endNode();
 }
 
 bool isFunctionScope(const Scope* scope) {
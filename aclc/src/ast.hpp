@@ -1,13 +1,24 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+
 #include "common.hpp"
 #include "lexer.hpp"
+#include "profiler.hpp"
+#include "small_list.hpp"
 
 namespace acl {
+namespace json {
+class Writer;
+}
+
 struct Symbol;
 struct Type;
 struct TypeRef;
 struct GenericType;
+struct TypeHierarchy;
 
 namespace type {
 /*
@@ -28,8 +39,20 @@ bool typesAreCompatible(const TypeRef* a, const TypeRef* b);
 void getGenerics(List<GenericType*>& dest, Symbol* s);
 bool genericsAreCompatible(const List<TypeRef*>& supplied,
 						   const List<GenericType*>& target);
+
+/*
+Returns true if "t" satisfies the constraint of "g". The result is remembered
+for the actual type of "t" once the hierarchies it depends on are complete, so
+each pair of generic type and supplied type is only checked once.
+*/
 bool genericAcceptsType(const GenericType* g, const TypeRef* t);
 
+/*
+Returns the precomputed hierarchy of the specified type, building it on first
+use. Subsequent queries are answered from the cached table.
+*/
+const TypeHierarchy* getTypeHierarchy(const Type* type);
+
 /*
 Returns the minimal common type between the two types.
 All types are guaranteed to have at least one common type (Any).
@@ -42,14 +65,61 @@ Returns true if "src" can be cast to "target".
 bool canCastTo(const TypeRef* src, const TypeRef* target);
 }  // namespace type
 
+struct Scope;
+struct GlobalScope;
+
+/*
+Facts about where a scope sits in the scope hierarchy, which the resolver asks
+about on every reference. They only depend on the parent scopes, which never
+change once a scope is created, so they are computed from the facts of the
+parent the first time they are needed and kept from then on.
+*/
+struct ScopeInfo {
+	// nullptr if the outermost scope is not a global scope
+	const GlobalScope* globalScope;
+
+	// The innermost function, lambda, constructor, destructor, getter,
+	// initializer or setter containing the scope (or the scope itself), if any
+	Scope* owningFunction;
+
+	// The innermost type containing the scope (or the scope itself), if any
+	Type* enclosingType;
+
+	// The type that "self" refers to in the scope, which is the scope around
+	// its function scopes if that is a type
+	Type* selfType;
+
+	bool functionScope;
+
+	// True if there is no instance of a type to refer to in the scope
+	bool staticContext;
+
+	// The number of parent scopes
+	unsigned depth;
+};
+
+// The symbols of a scope, whose memory is counted (see Profiler)
+using SymbolTable =
+	std::vector<Symbol*,
+				CountingAllocator<Symbol*, MemoryCategory::SYMBOL_TABLES>>;
+
 struct Scope {
 	Scope* parentScope;
-	List<Symbol*> symbols;
+	SymbolTable symbols;
 
 	Scope(Scope* parentScope);
 	virtual ~Scope();
 	virtual void addSymbol(Symbol* symbol);
 	virtual Symbol* containsSymbol(Symbol* symbol);
+
+	const ScopeInfo& getInfo() const;
+
+	// True if "scope" is this scope or one of its parents
+	bool isWithin(const Scope* scope) const;
+
+   private:
+	mutable ScopeInfo info;
+	mutable std::once_flag infoFlag;
 };
 
 bool hasCompatibleGenerics(const Type* type, const List<TypeRef*>& generics);
@@ -58,11 +128,29 @@ struct Node {
 	SourceMeta sourceMeta;
 	Node(const SourceMeta& sourceMeta);
 	virtual ~Node();
-	virtual void toJson(StringBuffer& dest) const = 0;
+	virtual void toJson(json::Writer& dest) const = 0;
+
+	// The number of nodes created on the calling thread so far
+	static std::size_t getCreatedCount();
+
+	// Count the memory of nodes (see Profiler)
+	static void* operator new(std::size_t size);
+	static void operator delete(void* p);
 };
 
+/*
+The resolution of a symbol is split into two queries which are each run until
+they complete and skipped from then on: the signature (the types the symbol
+declares) and the content (initializers, bodies and members). A query only
+completes once nothing it depends on had to be left for a later stage. A query
+that is found to be active again depends on itself.
+*/
+enum class QueryState { PENDING, ACTIVE, DONE };
+
 struct Symbol : public Node {
 	Token* id;
+	QueryState signatureQuery;
+	QueryState contentQuery;
 	Symbol(Token* id);
 	virtual ~Symbol();
 };
@@ -71,13 +159,13 @@ struct Modifier : public Node {
 	Token* content;
 	Modifier(Token* content);
 	virtual ~Modifier();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct MetaDeclaration : public Modifier {
 	MetaDeclaration(Token* content);
 	virtual ~MetaDeclaration();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct WarningMetaDeclaration : public MetaDeclaration {
@@ -86,7 +174,7 @@ struct WarningMetaDeclaration : public MetaDeclaration {
 	WarningMetaDeclaration(Token* content, const List<Token*>& args,
 						   Node* target);
 	virtual ~WarningMetaDeclaration();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Import;
@@ -96,7 +184,7 @@ struct GlobalScope : public Symbol, public Scope {
 	List<Import*> imports;
 	GlobalScope(const SourceMeta& sourceMeta, const List<Node*>& content);
 	virtual ~GlobalScope();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 	void addImport(Import* imp);
 };
 
@@ -108,6 +196,9 @@ struct TypeRef : public Node {
 	Type* actualType;
 	ReferenceType refType;
 	List<TypeRef*> actualGenerics;
+
+	// True if this type ref is owned by the type builder (see type_builder.hpp)
+	bool canonical;
 	TypeRef(const SourceMeta& sourceMeta);
 	virtual ~TypeRef();
 };
@@ -124,7 +215,7 @@ struct SimpleTypeRef : public TypeRef {
 	SimpleTypeRef(const SourceMeta& sourceMeta, Token* id,
 				  const List<TypeRef*>& generics, SimpleTypeRef* parent);
 	virtual ~SimpleTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SuffixTypeRef : public TypeRef {
@@ -133,7 +224,7 @@ struct SuffixTypeRef : public TypeRef {
 	SuffixTypeRef(const SourceMeta& sourceMeta, TypeRef* type,
 				  Token* suffixSymbol);
 	virtual ~SuffixTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct TupleTypeRef : public TypeRef {
@@ -145,7 +236,7 @@ struct TupleTypeRef : public TypeRef {
 	TupleTypeRef(const SourceMeta& sourceMeta,
 				 const List<TypeRef*>& elementTypes);
 	virtual ~TupleTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct MapTypeRef : public TypeRef {
@@ -154,14 +245,14 @@ struct MapTypeRef : public TypeRef {
 	MapTypeRef(const SourceMeta& sourceMeta, TypeRef* keyType,
 			   TypeRef* valueType);
 	virtual ~MapTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ArrayTypeRef : public TypeRef {
 	TypeRef* elementType;
 	ArrayTypeRef(const SourceMeta& sourceMeta, TypeRef* elementType);
 	virtual ~ArrayTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct FunctionTypeRef : public TypeRef {
@@ -170,7 +261,7 @@ struct FunctionTypeRef : public TypeRef {
 	FunctionTypeRef(const SourceMeta& sourceMeta,
 					const List<TypeRef*>& paramTypes, TypeRef* returnType);
 	virtual ~FunctionTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 /*
@@ -180,7 +271,7 @@ struct SuperTypeRef : public TypeRef {
 	Type* child;
 	SuperTypeRef(const SourceMeta& sourceMeta, Type* child);
 	virtual ~SuperTypeRef();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Expression : public Node {
@@ -197,7 +288,7 @@ struct TernaryExpression : public Expression {
 	TernaryExpression(const SourceMeta& sourceMeta, Expression* arg0,
 					  Expression* arg1, Expression* arg2);
 	virtual ~TernaryExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct BinaryExpression : public Expression {
@@ -207,7 +298,7 @@ struct BinaryExpression : public Expression {
 	BinaryExpression(const SourceMeta& sourceMeta, Token* op, Expression* left,
 					 Expression* right);
 	virtual ~BinaryExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct UnaryPrefixExpression : public Expression {
@@ -216,7 +307,7 @@ struct UnaryPrefixExpression : public Expression {
 	UnaryPrefixExpression(const SourceMeta& sourceMeta, Token* op,
 						  Expression* arg);
 	virtual ~UnaryPrefixExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct UnaryPostfixExpression : public Expression {
@@ -225,7 +316,7 @@ struct UnaryPostfixExpression : public Expression {
 	UnaryPostfixExpression(const SourceMeta& sourceMeta, Token* op,
 						   Expression* arg);
 	virtual ~UnaryPostfixExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct FunctionCallExpression : public Expression {
@@ -234,7 +325,7 @@ struct FunctionCallExpression : public Expression {
 	FunctionCallExpression(const SourceMeta& sourceMeta, Expression* caller,
 						   List<Expression*> args);
 	virtual ~FunctionCallExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SubscriptExpression : public Expression {
@@ -243,7 +334,7 @@ struct SubscriptExpression : public Expression {
 	SubscriptExpression(const SourceMeta& sourceMeta, Expression* target,
 						Expression* index);
 	virtual ~SubscriptExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct CastingExpression : public Expression {
@@ -253,7 +344,7 @@ struct CastingExpression : public Expression {
 	CastingExpression(const SourceMeta& sourceMeta, Token* op, Expression* left,
 					  TypeRef* right);
 	virtual ~CastingExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct MapLiteralExpression : public Expression {
@@ -263,7 +354,7 @@ struct MapLiteralExpression : public Expression {
 						 const List<Expression*>& keys,
 						 const List<Expression*>& values);
 	virtual ~MapLiteralExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ArrayLiteralExpression : public Expression {
@@ -271,7 +362,7 @@ struct ArrayLiteralExpression : public Expression {
 	ArrayLiteralExpression(const SourceMeta& sourceMeta,
 						   const List<Expression*>& elements);
 	virtual ~ArrayLiteralExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct TupleLiteralExpression : public Expression {
@@ -279,14 +370,14 @@ struct TupleLiteralExpression : public Expression {
 	TupleLiteralExpression(const SourceMeta& sourceMeta,
 						   const List<Expression*>& elements);
 	virtual ~TupleLiteralExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct LiteralExpression : public Expression {
 	Token* value;
 	LiteralExpression(Token* value);
 	virtual ~LiteralExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 namespace resolve {
@@ -297,6 +388,9 @@ struct SearchResult {
 	Scope* owningScope;
 	ResultOrigin origin;
 };
+
+// Most lookups find one or two symbols
+using SearchResults = SmallList<SearchResult, 2>;
 }  // namespace resolve
 
 struct IdentifierExpression : public Expression {
@@ -304,11 +398,11 @@ struct IdentifierExpression : public Expression {
 	List<TypeRef*> generics;
 	bool globalPrefix;
 	Symbol* referent;
-	List<resolve::SearchResult> possibleReferents;
+	resolve::SearchResults possibleReferents;
 	IdentifierExpression(Token* value, const List<TypeRef*>& generics,
 						 bool globalPrefix);
 	virtual ~IdentifierExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Parameter;
@@ -323,7 +417,7 @@ struct LambdaExpression : public Expression, public Scope {
 					 const List<Parameter*>& parameters,
 					 const List<Node*>& content, Scope* parentScope);
 	virtual ~LambdaExpression();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Parameter : public Symbol {
@@ -333,7 +427,7 @@ struct Parameter : public Symbol {
 	Parameter(const List<Modifier*>& modifiers, Token* id,
 			  TypeRef* declaredType);
 	virtual ~Parameter();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct FunctionBlock : public Node, public Scope {
@@ -344,7 +438,7 @@ struct FunctionBlock : public Node, public Scope {
 				  const List<Modifier*>& modifiers, const List<Node*>& content,
 				  Scope* parentScope, TokenType blockType);
 	virtual ~FunctionBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 	virtual void addSymbol(Symbol* symbol) override;
 };
 
@@ -363,7 +457,7 @@ struct Function : public Symbol, public Scope {
 			 const List<Parameter*>& parameters, TypeRef* declaredReturnType,
 			 const List<Node*>& content, Scope* parentScope, bool hasBody);
 	virtual ~Function();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Variable : public Symbol {
@@ -376,7 +470,7 @@ struct Variable : public Symbol {
 	Variable(const List<Modifier*>& modifiers, Token* id, TypeRef* declaredType,
 			 Node* value, bool constant);
 	virtual ~Variable();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ConditionalBlock : public Node {
@@ -385,7 +479,7 @@ struct ConditionalBlock : public Node {
 	ConditionalBlock(const SourceMeta& sourceMeta, Expression* condition,
 					 FunctionBlock* block);
 	virtual ~ConditionalBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct IfBlock : public ConditionalBlock {
@@ -395,21 +489,21 @@ struct IfBlock : public ConditionalBlock {
 			FunctionBlock* block, const List<ConditionalBlock*>& elifBlocks,
 			FunctionBlock* elseBlock);
 	virtual ~IfBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct WhileBlock : public ConditionalBlock {
 	WhileBlock(const SourceMeta& sourceMeta, Expression* condition,
 			   FunctionBlock* block);
 	virtual ~WhileBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct RepeatBlock : public ConditionalBlock {
 	RepeatBlock(const SourceMeta& sourceMeta, Expression* condition,
 				FunctionBlock* block);
 	virtual ~RepeatBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ForBlock : public Node {
@@ -419,7 +513,7 @@ struct ForBlock : public Node {
 	ForBlock(const SourceMeta& sourceMeta, Parameter* iterator,
 			 Expression* iteratee, FunctionBlock* block);
 	virtual ~ForBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct CatchBlock : public Node {
@@ -428,7 +522,7 @@ struct CatchBlock : public Node {
 	CatchBlock(const SourceMeta& sourceMeta, Parameter* exceptionVariable,
 			   FunctionBlock* block);
 	virtual ~CatchBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct TryBlock : public Node {
@@ -437,7 +531,7 @@ struct TryBlock : public Node {
 	TryBlock(const SourceMeta& sourceMeta, FunctionBlock* block,
 			 const List<CatchBlock*>& catchBlocks);
 	virtual ~TryBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SwitchCaseBlock : public Node {
@@ -447,7 +541,7 @@ struct SwitchCaseBlock : public Node {
 	SwitchCaseBlock(const SourceMeta& sourceMeta, Token* caseType,
 					Expression* condition, FunctionBlock* block);
 	virtual ~SwitchCaseBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SwitchBlock : public Node {
@@ -456,35 +550,61 @@ struct SwitchBlock : public Node {
 	SwitchBlock(const SourceMeta& sourceMeta, Expression* condition,
 				const List<SwitchCaseBlock*>& cases);
 	virtual ~SwitchBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ReturnStatement : public Node {
 	Expression* value;
 	ReturnStatement(const SourceMeta& sourceMeta, Expression* value);
 	virtual ~ReturnStatement();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ThrowStatement : public Node {
 	Expression* value;
 	ThrowStatement(const SourceMeta& sourceMeta, Expression* value);
 	virtual ~ThrowStatement();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SingleTokenStatement : public Node {
 	Token* content;
 	SingleTokenStatement(Token* content);
 	virtual ~SingleTokenStatement();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct GenericType;
 
+/*
+The flattened ancestry of a type. Every ancestor of the type (including the
+type itself at distance 0) is listed exactly once in breadth-first order along
+with its minimum distance in the type hierarchy and the parent type ref through
+which it was first reached.
+*/
+struct TypeHierarchy {
+	struct Entry {
+		const Type* type;
+		int distance;
+		const TypeRef* ref;
+	};
+
+	List<Entry> ancestors;
+	Map<const Type*, std::size_t> indices;
+
+	// This is false if one of the parent type refs has not been resolved yet,
+	// in which case the hierarchy will be rebuilt on the next query
+	bool complete;
+
+	TypeHierarchy();
+	const Entry* find(const Type* type) const;
+};
+
 struct Type : public Symbol {
 	List<GenericType*> generics;
 	List<TypeRef*> parentTypes;
+	mutable std::atomic<TypeHierarchy*> hierarchy;
+	mutable List<TypeHierarchy*> retiredHierarchies;
 	Type(Token* id, const List<GenericType*>& generics);
 	virtual ~Type();
 };
@@ -493,11 +613,16 @@ struct GenericType : public Type {
 	TypeRef* declaredParentType;
 	TypeRef* actualParentType;
 
+	// Whether each supplied type satisfies the constraint of the generic type,
+	// by its actual type (see type::genericAcceptsType())
+	mutable Map<const Type*, bool> acceptedTypes;
+	mutable std::shared_mutex acceptedTypesMutex;
+
 	// A generic type cannot itself declare generics,
 	// therefore it does not accept the list of generic types
 	GenericType(Token* id, TypeRef* declaredParentType);
 	virtual ~GenericType();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 // An alias is a scope because it stores its own generics
@@ -508,7 +633,7 @@ struct Alias : public Type, public Scope {
 		  const List<GenericType*>& generics, TypeRef* value,
 		  Scope* parentScope);
 	virtual ~Alias();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct SetBlock : public Node, public Scope {
@@ -519,7 +644,7 @@ struct SetBlock : public Node, public Scope {
 			 Parameter* parameter, const List<Node*>& content,
 			 Scope* parentScope);
 	virtual ~SetBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct VariableBlock : public Node {
@@ -529,7 +654,7 @@ struct VariableBlock : public Node {
 	VariableBlock(const SourceMeta& sourceMeta, FunctionBlock* getBlock,
 				  SetBlock* setBlock, FunctionBlock* initBlock);
 	virtual ~VariableBlock();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Class : public Type, public Scope {
@@ -541,7 +666,7 @@ struct Class : public Type, public Scope {
 		  const List<TypeRef*>& declaredParentTypes, const List<Node*>& content,
 		  Scope* parentScope);
 	virtual ~Class();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Struct : public Type, public Scope {
@@ -553,7 +678,7 @@ struct Struct : public Type, public Scope {
 		   const List<TypeRef*>& declaredParentTypes,
 		   const List<Node*>& content, Scope* parentScope);
 	virtual ~Struct();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Template : public Type, public Scope {
@@ -565,7 +690,7 @@ struct Template : public Type, public Scope {
 			 const List<TypeRef*>& declaredParentTypes,
 			 const List<Node*>& content, Scope* parentScope);
 	virtual ~Template();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Enum : public Type, public Scope {
@@ -577,7 +702,7 @@ struct Enum : public Type, public Scope {
 		 const List<TypeRef*>& declaredParentTypes, const List<Node*>& content,
 		 Scope* parentScope);
 	virtual ~Enum();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Namespace : public Symbol, public Scope {
@@ -588,7 +713,7 @@ struct Namespace : public Symbol, public Scope {
 			  const List<GenericType*>& generics, const List<Node*>& content,
 			  Scope* parentScope);
 	virtual ~Namespace();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Constructor : public Symbol, public Scope {
@@ -599,7 +724,7 @@ struct Constructor : public Symbol, public Scope {
 				const List<Parameter*>& parameters, const List<Node*>& content,
 				Scope* parentScope);
 	virtual ~Constructor();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Destructor : public Node, public Scope {
@@ -608,7 +733,7 @@ struct Destructor : public Node, public Scope {
 	Destructor(const SourceMeta& sourceMeta, List<Modifier*>& modifiers,
 			   const List<Node*>& content, Scope* parentScope);
 	virtual ~Destructor();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct EnumCase : public Symbol {
@@ -618,7 +743,7 @@ struct EnumCase : public Symbol {
 	EnumCase(const List<Modifier*>& modifiers, Token* id,
 			 const List<Expression*>& args, Enum* enumType);
 	virtual ~EnumCase();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ImportTarget : public Node {
@@ -627,7 +752,7 @@ struct ImportTarget : public Node {
 	List<Symbol*> referents;
 	ImportTarget(Token* id, TypeRef* declaredType);
 	virtual ~ImportTarget();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct ImportSource : public Node {
@@ -636,7 +761,7 @@ struct ImportSource : public Node {
 	bool declaredRelative;
 	ImportSource(Token* content, ImportSource* parent, bool declaredRelative);
 	virtual ~ImportSource();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 struct Ast;
@@ -650,7 +775,7 @@ struct Import : public Symbol {
 	Import(ImportSource* source, Token* alias,
 		   const List<ImportTarget*>& targets);
 	virtual ~Import();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 enum class ResolutionStage {
@@ -667,13 +792,47 @@ enum class ResolutionStage {
 ResolutionStage& operator++(ResolutionStage& rs);
 ResolutionStage operator++(ResolutionStage& rs, int);
 
+/*
+The symbols a module makes available to importers, keyed by their IDs. A name
+that refers to any internal symbol is flagged as such since internal symbols
+cannot be imported.
+*/
+struct ExportTable {
+	struct Entry {
+		List<Symbol*> symbols;
+		bool internal;
+	};
+
+	Map<String, Entry> entries;
+
+	const Entry* find(const String& id) const;
+};
+
 struct Ast {
 	GlobalScope* globalScope;
 	ResolutionStage stage;
+	ExportTable* exports;
+
+	// True if the module is resolved on demand (see resolveOnDemand())
+	bool onDemand;
 	Ast(GlobalScope* globalScope);
 	~Ast();
 };
 
+// The export table is built on first use, so this should only be called once
+// the global scope of the AST has been populated
+const ExportTable* getExportTable(Ast* ast);
+
+// The names of the scopes enclosing a symbol followed by the name of the
+// symbol, separated by dots. Returns an empty string if one of the enclosing
+// scopes has no name (e.g. a block).
+String getQualifiedName(const Scope* owningScope, const Symbol* symbol);
+
+// Appends every symbol with the qualified name to "dest", of which there may be
+// several since functions can be overloaded
+void findQualifiedSymbols(List<Symbol*>& dest, const Ast* ast,
+						  const String& name);
+
 bool isFunctionScope(const Scope* scope);
 bool isStaticSymbol(const Scope* owningScope, const Symbol* symbol);
 TokenType getSymbolVisibility(const Scope* owningScope, const Symbol* symbol,
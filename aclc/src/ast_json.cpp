@@ -0,0 +1,771 @@
+#include "ast_json.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "json_util.hpp"
+#include "lexer.hpp"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/reader.h"
+#include "source_map.hpp"
+
+namespace {
+using namespace acl;
+
+const std::size_t BUFFER_SIZE = 64 * 1024;
+
+class MalformedJsonException {};
+
+enum class NodeKind {
+	GLOBAL_SCOPE,
+	IMPORT,
+	IMPORT_SOURCE,
+	IMPORT_TARGET,
+	MODIFIER,
+	META_DECLARATION,
+	WARNING_META_DECLARATION,
+	CLASS,
+	STRUCT,
+	TEMPLATE,
+	ENUM,
+	NAMESPACE,
+	ALIAS,
+	FUNCTION,
+	CONSTRUCTOR,
+	DESTRUCTOR,
+	VARIABLE,
+	PARAMETER,
+	GENERIC_TYPE,
+	ENUM_CASE,
+	VARIABLE_BLOCK,
+	SET_BLOCK,
+	FUNCTION_BLOCK,
+	CONDITIONAL_BLOCK,
+	IF_BLOCK,
+	WHILE_BLOCK,
+	REPEAT_BLOCK,
+	FOR_BLOCK,
+	CATCH_BLOCK,
+	TRY_BLOCK,
+	SWITCH_CASE_BLOCK,
+	SWITCH_BLOCK,
+	RETURN_STATEMENT,
+	THROW_STATEMENT,
+	SINGLE_TOKEN_STATEMENT,
+	SIMPLE_TYPE_REF,
+	SUFFIX_TYPE_REF,
+	TUPLE_TYPE_REF,
+	MAP_TYPE_REF,
+	ARRAY_TYPE_REF,
+	FUNCTION_TYPE_REF,
+	TERNARY_EXPRESSION,
+	BINARY_EXPRESSION,
+	UNARY_PREFIX_EXPRESSION,
+	UNARY_POSTFIX_EXPRESSION,
+	FUNCTION_CALL_EXPRESSION,
+	SUBSCRIPT_EXPRESSION,
+	CASTING_EXPRESSION,
+	MAP_LITERAL_EXPRESSION,
+	ARRAY_LITERAL_EXPRESSION,
+	TUPLE_LITERAL_EXPRESSION,
+	LITERAL_EXPRESSION,
+	IDENTIFIER_EXPRESSION,
+	LAMBDA_EXPRESSION
+};
+
+// The node kinds by the names that toJson() writes
+const Map<String, NodeKind> NODE_KINDS = {
+	{"GlobalScope", NodeKind::GLOBAL_SCOPE},
+	{"Import", NodeKind::IMPORT},
+	{"ImportSource", NodeKind::IMPORT_SOURCE},
+	{"ImportTarget", NodeKind::IMPORT_TARGET},
+	{"Modifier", NodeKind::MODIFIER},
+	{"MetaDeclaration", NodeKind::META_DECLARATION},
+	{"WarningMetaDeclaration", NodeKind::WARNING_META_DECLARATION},
+	{"Class", NodeKind::CLASS},
+	{"Struct", NodeKind::STRUCT},
+	{"Template", NodeKind::TEMPLATE},
+	{"Enum", NodeKind::ENUM},
+	{"Namespace", NodeKind::NAMESPACE},
+	{"Alias", NodeKind::ALIAS},
+	{"Function", NodeKind::FUNCTION},
+	{"Constructor", NodeKind::CONSTRUCTOR},
+	{"Destructor", NodeKind::DESTRUCTOR},
+	{"Variable", NodeKind::VARIABLE},
+	{"Parameter", NodeKind::PARAMETER},
+	{"GenericType", NodeKind::GENERIC_TYPE},
+	{"EnumCase", NodeKind::ENUM_CASE},
+	{"VariableBlock", NodeKind::VARIABLE_BLOCK},
+	{"SetBlock", NodeKind::SET_BLOCK},
+	{"FunctionBlock", NodeKind::FUNCTION_BLOCK},
+	{"ConditionalBlock", NodeKind::CONDITIONAL_BLOCK},
+	{"IfBlock", NodeKind::IF_BLOCK},
+	{"WhileBlock", NodeKind::WHILE_BLOCK},
+	{"RepeatBlock", NodeKind::REPEAT_BLOCK},
+	{"ForBlock", NodeKind::FOR_BLOCK},
+	{"CatchBlock", NodeKind::CATCH_BLOCK},
+	{"TryBlock", NodeKind::TRY_BLOCK},
+	{"SwitchCaseBlock", NodeKind::SWITCH_CASE_BLOCK},
+	{"SwitchBlock", NodeKind::SWITCH_BLOCK},
+	{"ReturnStatement", NodeKind::RETURN_STATEMENT},
+	{"ThrowStatement", NodeKind::THROW_STATEMENT},
+	{"SingleTokenStatement", NodeKind::SINGLE_TOKEN_STATEMENT},
+	{"SimpleTypeRef", NodeKind::SIMPLE_TYPE_REF},
+	{"SuffixTypeRef", NodeKind::SUFFIX_TYPE_REF},
+	{"TupleTypeRef", NodeKind::TUPLE_TYPE_REF},
+	{"MapTypeRef", NodeKind::MAP_TYPE_REF},
+	{"ArrayTypeRef", NodeKind::ARRAY_TYPE_REF},
+	{"FunctionTypeRef", NodeKind::FUNCTION_TYPE_REF},
+	{"TernaryExpression", NodeKind::TERNARY_EXPRESSION},
+	{"BinaryExpression", NodeKind::BINARY_EXPRESSION},
+	{"UnaryPrefixExpression", NodeKind::UNARY_PREFIX_EXPRESSION},
+	{"UnaryPostfixExpression", NodeKind::UNARY_POSTFIX_EXPRESSION},
+	{"FunctionCallExpression", NodeKind::FUNCTION_CALL_EXPRESSION},
+	{"SubscriptExpression", NodeKind::SUBSCRIPT_EXPRESSION},
+	{"CastingExpression", NodeKind::CASTING_EXPRESSION},
+	{"MapLiteralExpression", NodeKind::MAP_LITERAL_EXPRESSION},
+	{"ArrayLiteralExpression", NodeKind::ARRAY_LITERAL_EXPRESSION},
+	{"TupleLiteralExpression", NodeKind::TUPLE_LITERAL_EXPRESSION},
+	{"LiteralExpression", NodeKind::LITERAL_EXPRESSION},
+	{"IdentifierExpression", NodeKind::IDENTIFIER_EXPRESSION},
+	{"LambdaExpression", NodeKind::LAMBDA_EXPRESSION}};
+
+// The dump only keeps the text of most tokens, which the lexer would have
+// given the same type
+TokenType getTokenType(const String& data) {
+	if (!data.empty() && data[0] == '@') return getMetaType(data);
+	if (data == "try?") return TokenType::TRY_OPTIONAL;
+	if (data == "try!") return TokenType::TRY_UNWRAPPED;
+	if (data == "as?") return TokenType::AS_OPTIONAL;
+	if (data == "as!") return TokenType::AS_UNWRAPPED;
+
+	auto type = getSymbolType(data);
+	return type != TokenType::EOF_TOKEN ? type : getIdentifierType(data);
+}
+
+// A member of an object that has been read. Depending on the value, either
+// the string (which numbers are read as as well), the flag, the node or the
+// elements are set.
+struct Field {
+	String key;
+	String value;
+	bool flag;
+	bool null;
+	Node* node;
+	List<Node*> nodes;
+	List<String> values;
+
+	// The interpolations of a string literal, by the index they are inserted at
+	Map<int, String> interpolations;
+	bool hasInterpolations;
+
+	Field(const char* key, rapidjson::SizeType length)
+		: key(key, length),
+		  flag(false),
+		  null(false),
+		  node(nullptr),
+		  hasInterpolations(false) {}
+};
+
+// An object that is being read, which is either a node or the interpolations
+// of a string literal
+struct Frame {
+	bool interpolations;
+	bool inArray;
+	List<Field> fields;
+
+	// The scope that a node with content is, which is created as soon as its
+	// content starts since the nodes within need it as their parent scope
+	Scope* scope;
+	Node* scopeNode;
+	List<Node*>* content;
+
+	Frame(bool interpolations)
+		: interpolations(interpolations),
+		  inArray(false),
+		  scope(nullptr),
+		  scopeNode(nullptr),
+		  content(nullptr) {}
+
+	Field& current() {
+		if (fields.empty()) throw MalformedJsonException();
+		return fields.back();
+	}
+
+	const Field& get(const char* key) const {
+		for (const auto& f : fields)
+			if (f.key == key) return f;
+		throw MalformedJsonException();
+	}
+
+	bool has(const char* key) const {
+		for (const auto& f : fields)
+			if (f.key == key) return true;
+		return false;
+	}
+};
+
+class AstBuilder
+	: public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, AstBuilder> {
+	const ModuleInfo* moduleInfo;
+	std::size_t sourceSize;
+	const AstSource& source;
+
+	// Only registered once the source of the dump is known to match
+	SourceFile* file;
+	List<Frame> frames;
+	Scope* currentScope;
+	GlobalScope* result;
+
+	static std::int64_t toNumber(const acl::String& str) {
+		if (str.empty()) throw MalformedJsonException();
+		char* end = nullptr;
+		auto result = std::strtoll(str.c_str(), &end, 10);
+		if (*end) throw MalformedJsonException();
+		return result;
+	}
+
+	static NodeKind getKind(const Frame& frame) {
+		auto it = NODE_KINDS.find(frame.get("name").value);
+		if (it == NODE_KINDS.end()) throw MalformedJsonException();
+		return it->second;
+	}
+
+	SourceMeta getMeta(const Frame& frame) {
+		auto pos = toNumber(frame.get("pos").value);
+		auto line = toNumber(frame.get("line").value);
+		auto col = toNumber(frame.get("col").value);
+		if (pos < 0 || static_cast<std::uint64_t>(pos) > sourceSize ||
+			line < 1 || col < 1 || pos - col + 1 < 0)
+			throw MalformedJsonException();
+
+		// Only the lines that locations point into are known, which are all
+		// the lines that are ever looked up
+		file->addLine(pos - col + 1, static_cast<int>(line));
+		return SourceMeta(file, pos);
+	}
+
+	// Returns nullptr if the value is null
+	Token* getToken(const Frame& frame, const char* key,
+					const SourceMeta& meta) {
+		const auto& f = frame.get(key);
+		if (f.null) return nullptr;
+		return new Token(getTokenType(f.value), f.value, meta);
+	}
+
+	bool getFlag(const Frame& frame, const char* key) {
+		return frame.get(key).flag;
+	}
+
+	template <typename T>
+	T* getNode(const Frame& frame, const char* key) {
+		auto n = frame.get(key).node;
+		auto result = dynamic_cast<T*>(n);
+		if (n && !result) throw MalformedJsonException();
+		return result;
+	}
+
+	template <typename T>
+	List<T*> getNodes(const Frame& frame, const char* key) {
+		List<T*> result;
+		for (auto& n : frame.get(key).nodes) {
+			auto t = dynamic_cast<T*>(n);
+			if (!t) throw MalformedJsonException();
+			result.push_back(t);
+		}
+		return result;
+	}
+
+	template <typename T>
+	T* beginScope(Frame& frame, T* scope) {
+		frame.scope = scope;
+		frame.scopeNode = scope;
+		frame.content = &scope->content;
+		currentScope = scope;
+		return scope;
+	}
+
+	template <typename T>
+	void beginType(Frame& frame) {
+		auto meta = getMeta(frame);
+		beginScope(frame, new T(getNodes<Modifier>(frame, "modifiers"),
+								getToken(frame, "id", meta),
+								getNodes<GenericType>(frame, "generics"),
+								getNodes<TypeRef>(frame, "declaredParentTypes"),
+								{}, currentScope));
+	}
+
+	void beginContent(Frame& frame);
+	Node* endScope(Frame& frame);
+	Node* buildNode(Frame& frame);
+	void addNode(Node* node);
+
+   public:
+	AstBuilder(const ModuleInfo* moduleInfo, std::size_t sourceSize,
+			   const AstSource& source)
+		: moduleInfo(moduleInfo),
+		  sourceSize(sourceSize),
+		  source(source),
+		  file(nullptr),
+		  currentScope(nullptr),
+		  result(nullptr) {}
+
+	GlobalScope* getResult() const { return result; }
+
+	// Any other kind of value (such as a number that isn't read as a string)
+	// can't be part of a dump
+	bool Default() { return false; }
+
+	bool Null() {
+		if (frames.empty()) return false;
+		frames.back().current().null = true;
+		return true;
+	}
+
+	bool Bool(bool b) {
+		if (frames.empty()) return false;
+		frames.back().current().flag = b;
+		return true;
+	}
+
+	bool String(const char* str, rapidjson::SizeType length, bool) {
+		if (frames.empty()) return false;
+		auto& frame = frames.back();
+		if (frame.inArray)
+			frame.current().values.emplace_back(str, length);
+		else
+			frame.current().value.assign(str, length);
+		return true;
+	}
+
+	bool RawNumber(const char* str, rapidjson::SizeType length, bool copy) {
+		return String(str, length, copy);
+	}
+
+	bool Key(const char* str, rapidjson::SizeType length, bool) {
+		auto& frame = frames.back();
+		frame.fields.emplace_back(str, length);
+
+		// The source of the dump comes before its nodes
+		if (frames.size() == 1) {
+			if (frame.fields.back().key != "ast") return true;
+			if (frame.get("sourcePath").value != source.path ||
+				frame.get("sourceHash").value != std::to_string(source.hash))
+				return false;
+			file = SourceFile::add(moduleInfo, sourceSize);
+			return true;
+		}
+
+		if (!frame.interpolations && frame.fields.back().key == "content")
+			beginContent(frame);
+		return true;
+	}
+
+	bool StartObject() {
+		if (frames.empty()) {
+			if (result) return false;
+			frames.emplace_back(false);
+			return true;
+		}
+
+		// The only node of the dump itself is its global scope
+		auto& parent = frames.back();
+		if (parent.interpolations || !file) return false;
+		auto interpolations =
+			!parent.inArray && parent.current().key == "interpolations";
+		frames.emplace_back(interpolations);
+		return true;
+	}
+
+	bool EndObject(rapidjson::SizeType) {
+		auto frame = std::move(frames.back());
+		frames.pop_back();
+
+		if (frames.empty()) {
+			result = getNode<GlobalScope>(frame, "ast");
+			return result;
+		}
+
+		if (frame.interpolations) {
+			auto& f = frames.back().current();
+			for (auto& i : frame.fields)
+				f.interpolations[static_cast<int>(toNumber(i.key))] = i.value;
+			f.hasInterpolations = true;
+			return true;
+		}
+
+		addNode(buildNode(frame));
+		return true;
+	}
+
+	bool StartArray() {
+		if (frames.empty()) return false;
+		auto& frame = frames.back();
+		if (frame.inArray || frame.interpolations) return false;
+		frame.current();
+		frame.inArray = true;
+		return true;
+	}
+
+	bool EndArray(rapidjson::SizeType) {
+		frames.back().inArray = false;
+		return true;
+	}
+};
+
+void AstBuilder::addNode(Node* node) {
+	auto& f = frames.back().current();
+	if (frames.back().inArray)
+		f.nodes.push_back(node);
+	else
+		f.node = node;
+}
+
+// Every node that is a scope is created here, since the nodes of its content
+// have to know it as their parent scope. Any other node may have content as
+// well (e.g. the content of a modifier), which is just a regular field.
+void AstBuilder::beginContent(Frame& frame) {
+	auto kind = getKind(frame);
+	switch (kind) {
+		case NodeKind::GLOBAL_SCOPE:
+			if (currentScope) throw MalformedJsonException();
+			beginScope(frame, new GlobalScope(getMeta(frame), {}));
+			break;
+		case NodeKind::CLASS:
+			beginType<Class>(frame);
+			break;
+		case NodeKind::STRUCT:
+			beginType<Struct>(frame);
+			break;
+		case NodeKind::TEMPLATE:
+			beginType<Template>(frame);
+			break;
+		case NodeKind::ENUM:
+			beginType<Enum>(frame);
+			break;
+		case NodeKind::NAMESPACE: {
+			auto meta = getMeta(frame);
+			beginScope(frame, new Namespace(
+								  getNodes<Modifier>(frame, "modifiers"),
+								  getToken(frame, "id", meta),
+								  getNodes<GenericType>(frame, "generics"), {},
+								  currentScope));
+			break;
+		}
+		case NodeKind::FUNCTION: {
+			auto meta = getMeta(frame);
+			beginScope(
+				frame,
+				new Function(getNodes<Modifier>(frame, "modifiers"),
+							 getToken(frame, "id", meta),
+							 getNodes<GenericType>(frame, "generics"),
+							 getNodes<Parameter>(frame, "parameters"),
+							 getNode<TypeRef>(frame, "declaredReturnType"), {},
+							 currentScope, getFlag(frame, "hasBody")));
+			break;
+		}
+		case NodeKind::CONSTRUCTOR: {
+			auto meta = getMeta(frame);
+			beginScope(frame,
+					   new Constructor(getNodes<Modifier>(frame, "modifiers"),
+									   getToken(frame, "id", meta),
+									   getNodes<Parameter>(frame, "parameters"),
+									   {}, currentScope));
+			break;
+		}
+		case NodeKind::DESTRUCTOR: {
+			auto modifiers = getNodes<Modifier>(frame, "modifiers");
+			beginScope(frame, new Destructor(getMeta(frame), modifiers, {},
+											 currentScope));
+			break;
+		}
+		case NodeKind::SET_BLOCK:
+			beginScope(frame,
+					   new SetBlock(getMeta(frame),
+									getNodes<Modifier>(frame, "modifiers"),
+									getNode<Parameter>(frame, "parameter"), {},
+									currentScope));
+			break;
+		case NodeKind::FUNCTION_BLOCK: {
+			auto blockType = toNumber(frame.get("blockType").value);
+			if (blockType < 0 ||
+				blockType > static_cast<int>(TokenType::META_NOBUILTINS))
+				throw MalformedJsonException();
+			beginScope(frame,
+					   new FunctionBlock(getMeta(frame),
+										 getNodes<Modifier>(frame, "modifiers"),
+										 {}, currentScope,
+										 static_cast<TokenType>(blockType)));
+			break;
+		}
+		case NodeKind::LAMBDA_EXPRESSION:
+			beginScope(frame, new LambdaExpression(
+								  getMeta(frame),
+								  getNodes<Modifier>(frame, "modifiers"),
+								  getNodes<Parameter>(frame, "parameters"), {},
+								  currentScope));
+			break;
+		default:
+			break;
+	}
+}
+
+// The symbols of a scope are registered in the same order as the parser does:
+// function scopes only keep their generic types and parameters (which their
+// constructors register), and every other scope has the symbols of its
+// content as well
+Node* AstBuilder::endScope(Frame& frame) {
+	*frame.content = getNodes<Node>(frame, "content");
+	currentScope = frame.scope->parentScope;
+
+	if (!isFunctionScope(frame.scope)) {
+		for (auto n : *frame.content) {
+			while (auto w = dynamic_cast<WarningMetaDeclaration*>(n))
+				n = w->target;
+
+			// Imports are kept apart from the other symbols
+			auto symbol = dynamic_cast<Symbol*>(n);
+			if (symbol && !dynamic_cast<Import*>(symbol))
+				frame.scope->symbols.push_back(symbol);
+		}
+	}
+
+	// The parser reports duplicate imports, which can't be part of a module
+	// that parsed
+	if (auto g = dynamic_cast<GlobalScope*>(frame.scope))
+		for (auto n : g->content)
+			if (auto i = dynamic_cast<Import*>(n)) g->addImport(i);
+
+	return frame.scopeNode;
+}
+
+Node* AstBuilder::buildNode(Frame& frame) {
+	if (frame.scope) return endScope(frame);
+
+	auto kind = getKind(frame);
+	auto meta = getMeta(frame);
+	switch (kind) {
+		case NodeKind::IMPORT: {
+			auto source = getNode<ImportSource>(frame, "source");
+			if (!source) throw MalformedJsonException();
+			return new Import(source, getToken(frame, "alias", meta),
+							  getNodes<ImportTarget>(frame, "targets"));
+		}
+		case NodeKind::IMPORT_SOURCE:
+			return new ImportSource(getToken(frame, "content", meta),
+									getNode<ImportSource>(frame, "parent"),
+									getFlag(frame, "declaredRelative"));
+		case NodeKind::IMPORT_TARGET:
+			return new ImportTarget(getToken(frame, "id", meta),
+									getNode<TypeRef>(frame, "declaredType"));
+		case NodeKind::MODIFIER:
+			return new Modifier(getToken(frame, "content", meta));
+		case NodeKind::META_DECLARATION:
+			return new MetaDeclaration(getToken(frame, "content", meta));
+		case NodeKind::WARNING_META_DECLARATION: {
+			List<Token*> args;
+			for (auto& a : frame.get("args").values)
+				args.push_back(
+					new StringToken(TokenType::STRING_LITERAL, a, meta, {}));
+			return new WarningMetaDeclaration(getToken(frame, "content", meta),
+											  args,
+											  getNode<Node>(frame, "target"));
+		}
+		case NodeKind::ALIAS:
+			return new Alias(getNodes<Modifier>(frame, "modifiers"),
+							 getToken(frame, "id", meta),
+							 getNodes<GenericType>(frame, "generics"),
+							 getNode<TypeRef>(frame, "value"), currentScope);
+		case NodeKind::VARIABLE:
+			return new Variable(getNodes<Modifier>(frame, "modifiers"),
+								getToken(frame, "id", meta),
+								getNode<TypeRef>(frame, "declaredType"),
+								getNode<Node>(frame, "value"),
+								getFlag(frame, "constant"));
+		case NodeKind::PARAMETER:
+			return new Parameter(getNodes<Modifier>(frame, "modifiers"),
+								 getToken(frame, "id", meta),
+								 getNode<TypeRef>(frame, "declaredType"));
+		case NodeKind::GENERIC_TYPE:
+			return new GenericType(
+				getToken(frame, "id", meta),
+				getNode<TypeRef>(frame, "declaredParentType"));
+		case NodeKind::ENUM_CASE:
+			return new EnumCase(getNodes<Modifier>(frame, "modifiers"),
+								getToken(frame, "id", meta),
+								getNodes<Expression>(frame, "args"),
+								dynamic_cast<Enum*>(currentScope));
+		case NodeKind::VARIABLE_BLOCK:
+			return new VariableBlock(
+				meta, getNode<FunctionBlock>(frame, "getBlock"),
+				getNode<SetBlock>(frame, "setBlock"),
+				getNode<FunctionBlock>(frame, "initBlock"));
+		case NodeKind::CONDITIONAL_BLOCK:
+			return new ConditionalBlock(
+				meta, getNode<Expression>(frame, "condition"),
+				getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::IF_BLOCK:
+			return new IfBlock(meta, getNode<Expression>(frame, "condition"),
+							   getNode<FunctionBlock>(frame, "block"),
+							   getNodes<ConditionalBlock>(frame, "elifBlocks"),
+							   getNode<FunctionBlock>(frame, "elseBlock"));
+		case NodeKind::WHILE_BLOCK:
+			return new WhileBlock(meta, getNode<Expression>(frame, "condition"),
+								  getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::REPEAT_BLOCK:
+			return new RepeatBlock(meta,
+								   getNode<Expression>(frame, "condition"),
+								   getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::FOR_BLOCK:
+			return new ForBlock(meta, getNode<Parameter>(frame, "iterator"),
+								getNode<Expression>(frame, "iteratee"),
+								getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::CATCH_BLOCK:
+			return new CatchBlock(
+				meta, getNode<Parameter>(frame, "exceptionVariable"),
+				getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::TRY_BLOCK:
+			return new TryBlock(meta, getNode<FunctionBlock>(frame, "block"),
+								getNodes<CatchBlock>(frame, "catchBlocks"));
+		case NodeKind::SWITCH_CASE_BLOCK:
+			return new SwitchCaseBlock(meta,
+									   getToken(frame, "caseType", meta),
+									   getNode<Expression>(frame, "condition"),
+									   getNode<FunctionBlock>(frame, "block"));
+		case NodeKind::SWITCH_BLOCK:
+			return new SwitchBlock(meta,
+								   getNode<Expression>(frame, "condition"),
+								   getNodes<SwitchCaseBlock>(frame, "cases"));
+		case NodeKind::RETURN_STATEMENT:
+			return new ReturnStatement(meta,
+									   getNode<Expression>(frame, "value"));
+		case NodeKind::THROW_STATEMENT:
+			return new ThrowStatement(meta,
+									  getNode<Expression>(frame, "value"));
+		case NodeKind::SINGLE_TOKEN_STATEMENT:
+			return new SingleTokenStatement(getToken(frame, "content", meta));
+		case NodeKind::SIMPLE_TYPE_REF:
+			return new SimpleTypeRef(meta, getToken(frame, "id", meta),
+									 getNodes<TypeRef>(frame, "generics"),
+									 getNode<SimpleTypeRef>(frame, "parent"));
+		case NodeKind::SUFFIX_TYPE_REF:
+			return new SuffixTypeRef(meta, getNode<TypeRef>(frame, "type"),
+									 getToken(frame, "suffixSymbol", meta));
+		case NodeKind::TUPLE_TYPE_REF:
+			return new TupleTypeRef(meta,
+									getNodes<TypeRef>(frame, "elementTypes"));
+		case NodeKind::MAP_TYPE_REF:
+			return new MapTypeRef(meta, getNode<TypeRef>(frame, "keyType"),
+								  getNode<TypeRef>(frame, "valueType"));
+		case NodeKind::ARRAY_TYPE_REF:
+			return new ArrayTypeRef(meta,
+									getNode<TypeRef>(frame, "elementType"));
+		case NodeKind::FUNCTION_TYPE_REF:
+			return new FunctionTypeRef(meta,
+									   getNodes<TypeRef>(frame, "paramTypes"),
+									   getNode<TypeRef>(frame, "returnType"));
+		case NodeKind::TERNARY_EXPRESSION:
+			return new TernaryExpression(meta,
+										 getNode<Expression>(frame, "arg0"),
+										 getNode<Expression>(frame, "arg1"),
+										 getNode<Expression>(frame, "arg2"));
+		case NodeKind::BINARY_EXPRESSION:
+			return new BinaryExpression(meta, getToken(frame, "op", meta),
+										getNode<Expression>(frame, "left"),
+										getNode<Expression>(frame, "right"));
+		case NodeKind::UNARY_PREFIX_EXPRESSION:
+			return new UnaryPrefixExpression(meta, getToken(frame, "op", meta),
+											 getNode<Expression>(frame, "arg"));
+		case NodeKind::UNARY_POSTFIX_EXPRESSION:
+			return new UnaryPostfixExpression(
+				meta, getToken(frame, "op", meta),
+				getNode<Expression>(frame, "arg"));
+		case NodeKind::FUNCTION_CALL_EXPRESSION:
+			return new FunctionCallExpression(
+				meta, getNode<Expression>(frame, "caller"),
+				getNodes<Expression>(frame, "args"));
+		case NodeKind::SUBSCRIPT_EXPRESSION:
+			return new SubscriptExpression(
+				meta, getNode<Expression>(frame, "target"),
+				getNode<Expression>(frame, "index"));
+		case NodeKind::CASTING_EXPRESSION:
+			return new CastingExpression(meta, getToken(frame, "op", meta),
+										 getNode<Expression>(frame, "left"),
+										 getNode<TypeRef>(frame, "right"));
+		case NodeKind::MAP_LITERAL_EXPRESSION:
+			return new MapLiteralExpression(
+				meta, getNodes<Expression>(frame, "keys"),
+				getNodes<Expression>(frame, "values"));
+		case NodeKind::ARRAY_LITERAL_EXPRESSION:
+			return new ArrayLiteralExpression(
+				meta, getNodes<Expression>(frame, "elements"));
+		case NodeKind::TUPLE_LITERAL_EXPRESSION:
+			return new TupleLiteralExpression(
+				meta, getNodes<Expression>(frame, "elements"));
+		case NodeKind::LITERAL_EXPRESSION: {
+			auto type = toNumber(frame.get("type").value);
+			if (type < 0 || type > static_cast<int>(TokenType::META_NOBUILTINS))
+				throw MalformedJsonException();
+
+			const auto& value = frame.get("value");
+			if (frame.has("interpolations"))
+				return new LiteralExpression(new StringToken(
+					static_cast<TokenType>(type), value.value, meta,
+					frame.get("interpolations").interpolations));
+			return new LiteralExpression(
+				new Token(static_cast<TokenType>(type), value.value, meta));
+		}
+		case NodeKind::IDENTIFIER_EXPRESSION:
+			return new IdentifierExpression(
+				getToken(frame, "value", meta),
+				getNodes<TypeRef>(frame, "generics"),
+				getFlag(frame, "globalPrefix"));
+		default:
+			// Scopes are only ever created once their content starts
+			throw MalformedJsonException();
+	}
+}
+}  // namespace
+
+namespace acl {
+void writeAstJson(json::Writer& dest, const Ast* ast, const AstSource& source) {
+	if (!dest.loadable) return ast->globalScope->toJson(dest);
+
+	dest.startObject();
+	dest.key("sourcePath");
+	dest.string(source.path);
+
+	// As a string, since JSON numbers can't hold every 64-bit value
+	dest.key("sourceHash");
+	dest.string(std::to_string(source.hash));
+	dest.node("ast", ast->globalScope);
+	dest.endObject();
+}
+
+Ast* readAstJson(const std::filesystem::path& path,
+				 const ModuleInfo* moduleInfo, std::size_t sourceSize,
+				 const AstSource& source) {
+	auto f = std::fopen(path.string().c_str(), "rb");
+	if (!f) return nullptr;
+
+	List<char> buffer(BUFFER_SIZE);
+	rapidjson::FileReadStream stream(f, buffer.data(), buffer.size());
+	AstBuilder builder(moduleInfo, sourceSize, source);
+	rapidjson::Reader reader;
+
+	// Like with deserializeAst(), the nodes read before running into
+	// malformed data are not freed, as there is no complete tree to free them
+	// through
+	GlobalScope* result = nullptr;
+	try {
+		if (reader.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream,
+																builder))
+			result = builder.getResult();
+	} catch (MalformedJsonException& e) {
+	} catch (AcceleException& e) {
+	}
+
+	std::fclose(f);
+	return result ? new Ast(result) : nullptr;
+}
+}  // namespace acl
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <filesystem>
+
+#include "ast.hpp"
+#include "common.hpp"
+
+namespace acl {
+namespace json {
+class Writer;
+}
+
+/*
+Reads an AST back in from the JSON that "--dump-ast" writes with
+"--loadable-ast" (see writeAstJson()), so that a module which was already
+dumped doesn't have to be parsed again. The file is streamed through a SAX
+reader and the nodes are built as soon as their objects end, so the document
+itself is never held in memory.
+
+A loadable dump is an object holding the path and hash of the source it was
+written for ("sourcePath" and "sourceHash", see AstSource) followed by the
+global scope ("ast", see toJson()), whose nodes carry their locations. A dump
+of another source is rejected before any of its nodes are built, and so is a
+plain dump, which is only the global scope.
+
+The AST comes out the way the parser left it. The symbols of the scopes aren't
+part of the dump, so they are collected from the content of every scope just
+like the parser registers them. Tokens that have no location of their own in
+the dump (such as the operators of expressions) take the location of their
+node.
+*/
+
+// Writes only the global scope unless the writer is loadable
+void writeAstJson(json::Writer& dest, const Ast* ast, const AstSource& source);
+
+// Returns nullptr if the file can't be read or doesn't hold the dump of a
+// module with the specified source. The locations of the nodes point into a
+// source of the specified size, which is registered for the module info.
+Ast* readAstJson(const std::filesystem::path& path,
+				 const ModuleInfo* moduleInfo, std::size_t sourceSize,
+				 const AstSource& source);
+}  // namespace acl
@@ -0,0 +1,1248 @@
+#include "ast_serializer.hpp"
+
+#include <cstring>
+
+#include "source_map.hpp"
+
+namespace {
+using namespace acl;
+
+const char MAGIC[] = {'A', 'C', 'L', 'B'};
+const std::uint64_t FORMAT_VERSION = 3;
+
+enum class NodeKind : std::uint8_t {
+	NONE,
+	GLOBAL_SCOPE,
+	IMPORT,
+	IMPORT_SOURCE,
+	IMPORT_TARGET,
+	MODIFIER,
+	META_DECLARATION,
+	WARNING_META_DECLARATION,
+	CLASS,
+	STRUCT,
+	TEMPLATE,
+	ENUM,
+	NAMESPACE,
+	ALIAS,
+	FUNCTION,
+	CONSTRUCTOR,
+	DESTRUCTOR,
+	VARIABLE,
+	PARAMETER,
+	GENERIC_TYPE,
+	ENUM_CASE,
+	VARIABLE_BLOCK,
+	SET_BLOCK,
+	FUNCTION_BLOCK,
+	CONDITIONAL_BLOCK,
+	IF_BLOCK,
+	WHILE_BLOCK,
+	REPEAT_BLOCK,
+	FOR_BLOCK,
+	CATCH_BLOCK,
+	TRY_BLOCK,
+	SWITCH_CASE_BLOCK,
+	SWITCH_BLOCK,
+	RETURN_STATEMENT,
+	THROW_STATEMENT,
+	SINGLE_TOKEN_STATEMENT,
+	SIMPLE_TYPE_REF,
+	SUFFIX_TYPE_REF,
+	TUPLE_TYPE_REF,
+	MAP_TYPE_REF,
+	ARRAY_TYPE_REF,
+	FUNCTION_TYPE_REF,
+	TERNARY_EXPRESSION,
+	BINARY_EXPRESSION,
+	UNARY_PREFIX_EXPRESSION,
+	UNARY_POSTFIX_EXPRESSION,
+	FUNCTION_CALL_EXPRESSION,
+	SUBSCRIPT_EXPRESSION,
+	CASTING_EXPRESSION,
+	MAP_LITERAL_EXPRESSION,
+	ARRAY_LITERAL_EXPRESSION,
+	TUPLE_LITERAL_EXPRESSION,
+	LITERAL_EXPRESSION,
+	IDENTIFIER_EXPRESSION,
+	LAMBDA_EXPRESSION,
+	__END_OF_ENUM
+};
+
+enum class TokenKind : std::uint8_t { NONE, PLAIN, STRING };
+
+struct UnserializableNodeException {};
+
+struct MalformedDataException {};
+
+class AstWriter {
+	String body;
+	Map<String, std::size_t> stringIndices;
+	List<const String*> strings;
+	Map<const Symbol*, std::size_t> symbolIds;
+	bool signaturesOnly;
+	bool omitMeta;
+
+	// The size of the source the locations point into, so that the reader can
+	// set aside the same range of locations
+	std::size_t sourceSize;
+
+	void writeByte(std::uint8_t b) { body.push_back(static_cast<char>(b)); }
+
+	void writeVarint(std::uint64_t v) {
+		while (v >= 0x80) {
+			writeByte(static_cast<std::uint8_t>(v | 0x80));
+			v >>= 7;
+		}
+		writeByte(static_cast<std::uint8_t>(v));
+	}
+
+	// Signed values are zigzag-encoded so that small negative values stay small
+	void writeInt(std::int64_t v) {
+		writeVarint((static_cast<std::uint64_t>(v) << 1) ^
+					static_cast<std::uint64_t>(v >> 63));
+	}
+
+	void writeBool(bool b) { writeByte(b ? 1 : 0); }
+
+	void writeKind(NodeKind kind) {
+		writeByte(static_cast<std::uint8_t>(kind));
+	}
+
+	void writeString(const String& str) {
+		auto it = stringIndices.find(str);
+		if (it == stringIndices.end()) {
+			it = stringIndices.emplace(str, strings.size()).first;
+			strings.push_back(&it->first);
+		}
+		writeVarint(it->second);
+	}
+
+	void writeMeta(const SourceMeta& meta) {
+		if (omitMeta) return;
+		writeInt(meta.getPos());
+		writeInt(meta.getLine());
+		writeInt(meta.getCol());
+	}
+
+	void writeToken(const Token* token) {
+		if (!token) {
+			writeByte(static_cast<std::uint8_t>(TokenKind::NONE));
+			return;
+		}
+
+		auto st = dynamic_cast<const StringToken*>(token);
+		writeByte(static_cast<std::uint8_t>(st ? TokenKind::STRING
+											  : TokenKind::PLAIN));
+		writeVarint(static_cast<std::uint64_t>(token->type));
+		writeString(token->data);
+		writeMeta(token->meta);
+		if (!st) return;
+
+		writeVarint(st->interpolations.size());
+		for (const auto& i : st->interpolations) {
+			writeInt(i.first);
+			writeString(i.second);
+		}
+	}
+
+	void writeTokens(const List<Token*>& tokens) {
+		writeVarint(tokens.size());
+		for (auto& t : tokens) writeToken(t);
+	}
+
+	template <typename T>
+	void writeNodes(const List<T*>& nodes) {
+		writeVarint(nodes.size());
+		for (auto& n : nodes) writeNode(n);
+	}
+
+	void writeBody(const List<Node*>& content) {
+		if (signaturesOnly)
+			writeVarint(0);
+		else
+			writeNodes(content);
+	}
+
+	void writeSymbolId(const Symbol* symbol) {
+		auto id = symbolIds.size();
+		symbolIds[symbol] = id;
+		writeVarint(id);
+	}
+
+	template <typename L>
+	void writeSymbolRefs(const L& symbols) {
+		writeVarint(symbols.size());
+		for (auto& s : symbols) {
+			auto it = symbolIds.find(s);
+			if (it == symbolIds.end()) throw UnserializableNodeException();
+			writeVarint(it->second);
+		}
+	}
+
+	void writeType(NodeKind kind, const Type* type,
+				   const List<Modifier*>& modifiers,
+				   const List<TypeRef*>& declaredParentTypes,
+				   const List<Node*>& content, const Scope* scope) {
+		writeKind(kind);
+		writeSymbolId(type);
+		writeNodes(modifiers);
+		writeToken(type->id);
+		writeNodes(type->generics);
+		writeNodes(declaredParentTypes);
+		writeNodes(content);
+		writeSymbolRefs(scope->symbols);
+	}
+
+	void writeFunctionBlock(const FunctionBlock* n, bool omitContent) {
+		writeKind(NodeKind::FUNCTION_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->modifiers);
+		writeVarint(static_cast<std::uint64_t>(n->blockType));
+		if (omitContent)
+			writeVarint(0);
+		else
+			writeNodes(n->content);
+		writeSymbolRefs(n->symbols);
+	}
+
+	void writeConditionalBlock(NodeKind kind, const ConditionalBlock* n) {
+		writeKind(kind);
+		writeMeta(n->sourceMeta);
+		writeNode(n->condition);
+		writeNode(n->block);
+	}
+
+	void writePropertyBlock(const FunctionBlock* n) {
+		if (n)
+			writeFunctionBlock(n, signaturesOnly);
+		else
+			writeKind(NodeKind::NONE);
+	}
+
+	void writeDeclaration(const Node* n);
+	void writeStatement(const Node* n);
+	void writeTypeRef(const Node* n);
+	void writeExpression(const Node* n);
+
+   public:
+	AstWriter(bool signaturesOnly, bool omitMeta)
+		: signaturesOnly(signaturesOnly), omitMeta(omitMeta), sourceSize(0) {}
+
+	void writeNode(const Node* n);
+	void writeGlobalScope(const GlobalScope* n);
+	// The source is only written for dumps (see AstSource)
+	void finish(String& dest, const AstSource* source) const;
+};
+
+void AstWriter::writeNode(const Node* n) {
+	if (!n)
+		writeKind(NodeKind::NONE);
+	else if (dynamic_cast<const TypeRef*>(n))
+		writeTypeRef(n);
+	else if (dynamic_cast<const Expression*>(n))
+		writeExpression(n);
+	else if (dynamic_cast<const Symbol*>(n) ||
+			 dynamic_cast<const Modifier*>(n) ||
+			 dynamic_cast<const ImportSource*>(n) ||
+			 dynamic_cast<const ImportTarget*>(n) ||
+			 dynamic_cast<const Destructor*>(n))
+		writeDeclaration(n);
+	else
+		writeStatement(n);
+}
+
+void AstWriter::writeGlobalScope(const GlobalScope* n) {
+	writeKind(NodeKind::GLOBAL_SCOPE);
+	writeMeta(n->sourceMeta);
+	auto file = n->sourceMeta.getFile();
+	if (file && !omitMeta) sourceSize = file->getSize();
+	writeNodes(n->content);
+	writeSymbolRefs(n->symbols);
+
+	List<Symbol*> imports(n->imports.begin(), n->imports.end());
+	writeSymbolRefs(imports);
+}
+
+void AstWriter::writeDeclaration(const Node* node) {
+	if (auto n = dynamic_cast<const Import*>(node)) {
+		writeKind(NodeKind::IMPORT);
+		writeSymbolId(n);
+		writeNode(n->source);
+		writeToken(n->alias);
+		writeNodes(n->targets);
+	} else if (auto n = dynamic_cast<const ImportSource*>(node)) {
+		writeKind(NodeKind::IMPORT_SOURCE);
+		writeToken(n->content);
+		writeNode(n->parent);
+		writeBool(n->declaredRelative);
+	} else if (auto n = dynamic_cast<const ImportTarget*>(node)) {
+		writeKind(NodeKind::IMPORT_TARGET);
+		writeToken(n->id);
+		writeNode(n->declaredType);
+	} else if (auto n = dynamic_cast<const WarningMetaDeclaration*>(node)) {
+		writeKind(NodeKind::WARNING_META_DECLARATION);
+		writeToken(n->content);
+		writeTokens(n->args);
+		writeNode(n->target);
+	} else if (auto n = dynamic_cast<const MetaDeclaration*>(node)) {
+		writeKind(NodeKind::META_DECLARATION);
+		writeToken(n->content);
+	} else if (auto n = dynamic_cast<const Modifier*>(node)) {
+		writeKind(NodeKind::MODIFIER);
+		writeToken(n->content);
+	} else if (auto n = dynamic_cast<const Class*>(node)) {
+		writeType(NodeKind::CLASS, n, n->modifiers, n->declaredParentTypes,
+				  n->content, n);
+	} else if (auto n = dynamic_cast<const Struct*>(node)) {
+		writeType(NodeKind::STRUCT, n, n->modifiers, n->declaredParentTypes,
+				  n->content, n);
+	} else if (auto n = dynamic_cast<const Template*>(node)) {
+		writeType(NodeKind::TEMPLATE, n, n->modifiers, n->declaredParentTypes,
+				  n->content, n);
+	} else if (auto n = dynamic_cast<const Enum*>(node)) {
+		writeType(NodeKind::ENUM, n, n->modifiers, n->declaredParentTypes,
+				  n->content, n);
+	} else if (auto n = dynamic_cast<const Namespace*>(node)) {
+		writeKind(NodeKind::NAMESPACE);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNodes(n->generics);
+		writeNodes(n->content);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const Alias*>(node)) {
+		writeKind(NodeKind::ALIAS);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNodes(n->generics);
+		writeNode(n->value);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const Function*>(node)) {
+		writeKind(NodeKind::FUNCTION);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNodes(n->generics);
+		writeNodes(n->parameters);
+		writeNode(n->declaredReturnType);
+		writeBool(n->hasBody);
+		writeBody(n->content);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const Constructor*>(node)) {
+		writeKind(NodeKind::CONSTRUCTOR);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNodes(n->parameters);
+		writeBody(n->content);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const Destructor*>(node)) {
+		writeKind(NodeKind::DESTRUCTOR);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->modifiers);
+		writeBody(n->content);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const Variable*>(node)) {
+		writeKind(NodeKind::VARIABLE);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNode(n->declaredType);
+
+		// The value is only needed to infer the type of the variable, unless
+		// it is a constant
+		if (signaturesOnly && n->declaredType && !n->constant &&
+			dynamic_cast<const Expression*>(n->value))
+			writeKind(NodeKind::NONE);
+		else
+			writeNode(n->value);
+		writeBool(n->constant);
+	} else if (auto n = dynamic_cast<const Parameter*>(node)) {
+		writeKind(NodeKind::PARAMETER);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNode(n->declaredType);
+	} else if (auto n = dynamic_cast<const GenericType*>(node)) {
+		writeKind(NodeKind::GENERIC_TYPE);
+		writeSymbolId(n);
+		writeToken(n->id);
+		writeNode(n->declaredParentType);
+	} else if (auto n = dynamic_cast<const EnumCase*>(node)) {
+		writeKind(NodeKind::ENUM_CASE);
+		writeSymbolId(n);
+		writeNodes(n->modifiers);
+		writeToken(n->id);
+		writeNodes(n->args);
+	} else {
+		throw UnserializableNodeException();
+	}
+}
+
+void AstWriter::writeStatement(const Node* node) {
+	if (auto n = dynamic_cast<const VariableBlock*>(node)) {
+		writeKind(NodeKind::VARIABLE_BLOCK);
+		writeMeta(n->sourceMeta);
+		writePropertyBlock(n->getBlock);
+		writeNode(n->setBlock);
+		writePropertyBlock(n->initBlock);
+	} else if (auto n = dynamic_cast<const SetBlock*>(node)) {
+		writeKind(NodeKind::SET_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->modifiers);
+		writeNode(n->parameter);
+		writeBody(n->content);
+		writeSymbolRefs(n->symbols);
+	} else if (auto n = dynamic_cast<const FunctionBlock*>(node)) {
+		writeFunctionBlock(n, false);
+	} else if (auto n = dynamic_cast<const IfBlock*>(node)) {
+		writeConditionalBlock(NodeKind::IF_BLOCK, n);
+		writeNodes(n->elifBlocks);
+		writeNode(n->elseBlock);
+	} else if (auto n = dynamic_cast<const WhileBlock*>(node)) {
+		writeConditionalBlock(NodeKind::WHILE_BLOCK, n);
+	} else if (auto n = dynamic_cast<const RepeatBlock*>(node)) {
+		writeConditionalBlock(NodeKind::REPEAT_BLOCK, n);
+	} else if (auto n = dynamic_cast<const ConditionalBlock*>(node)) {
+		writeConditionalBlock(NodeKind::CONDITIONAL_BLOCK, n);
+	} else if (auto n = dynamic_cast<const ForBlock*>(node)) {
+		writeKind(NodeKind::FOR_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNode(n->iterator);
+		writeNode(n->iteratee);
+		writeNode(n->block);
+	} else if (auto n = dynamic_cast<const CatchBlock*>(node)) {
+		writeKind(NodeKind::CATCH_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNode(n->exceptionVariable);
+		writeNode(n->block);
+	} else if (auto n = dynamic_cast<const TryBlock*>(node)) {
+		writeKind(NodeKind::TRY_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNode(n->block);
+		writeNodes(n->catchBlocks);
+	} else if (auto n = dynamic_cast<const SwitchCaseBlock*>(node)) {
+		writeKind(NodeKind::SWITCH_CASE_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeToken(n->caseType);
+		writeNode(n->condition);
+		writeNode(n->block);
+	} else if (auto n = dynamic_cast<const SwitchBlock*>(node)) {
+		writeKind(NodeKind::SWITCH_BLOCK);
+		writeMeta(n->sourceMeta);
+		writeNode(n->condition);
+		writeNodes(n->cases);
+	} else if (auto n = dynamic_cast<const ReturnStatement*>(node)) {
+		writeKind(NodeKind::RETURN_STATEMENT);
+		writeMeta(n->sourceMeta);
+		writeNode(n->value);
+	} else if (auto n = dynamic_cast<const ThrowStatement*>(node)) {
+		writeKind(NodeKind::THROW_STATEMENT);
+		writeMeta(n->sourceMeta);
+		writeNode(n->value);
+	} else if (auto n = dynamic_cast<const SingleTokenStatement*>(node)) {
+		writeKind(NodeKind::SINGLE_TOKEN_STATEMENT);
+		writeToken(n->content);
+	} else {
+		throw UnserializableNodeException();
+	}
+}
+
+void AstWriter::writeTypeRef(const Node* node) {
+	if (auto n = dynamic_cast<const SimpleTypeRef*>(node)) {
+		writeKind(NodeKind::SIMPLE_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeToken(n->id);
+		writeNodes(n->generics);
+		writeNode(n->parent);
+	} else if (auto n = dynamic_cast<const SuffixTypeRef*>(node)) {
+		writeKind(NodeKind::SUFFIX_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeNode(n->type);
+		writeToken(n->suffixSymbol);
+	} else if (auto n = dynamic_cast<const TupleTypeRef*>(node)) {
+		writeKind(NodeKind::TUPLE_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->elementTypes);
+	} else if (auto n = dynamic_cast<const MapTypeRef*>(node)) {
+		writeKind(NodeKind::MAP_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeNode(n->keyType);
+		writeNode(n->valueType);
+	} else if (auto n = dynamic_cast<const ArrayTypeRef*>(node)) {
+		writeKind(NodeKind::ARRAY_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeNode(n->elementType);
+	} else if (auto n = dynamic_cast<const FunctionTypeRef*>(node)) {
+		writeKind(NodeKind::FUNCTION_TYPE_REF);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->paramTypes);
+		writeNode(n->returnType);
+	} else {
+		throw UnserializableNodeException();
+	}
+}
+
+void AstWriter::writeExpression(const Node* node) {
+	if (auto n = dynamic_cast<const TernaryExpression*>(node)) {
+		writeKind(NodeKind::TERNARY_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNode(n->arg0);
+		writeNode(n->arg1);
+		writeNode(n->arg2);
+	} else if (auto n = dynamic_cast<const BinaryExpression*>(node)) {
+		writeKind(NodeKind::BINARY_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeToken(n->op);
+		writeNode(n->left);
+		writeNode(n->right);
+	} else if (auto n = dynamic_cast<const UnaryPrefixExpression*>(node)) {
+		writeKind(NodeKind::UNARY_PREFIX_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeToken(n->op);
+		writeNode(n->arg);
+	} else if (auto n = dynamic_cast<const UnaryPostfixExpression*>(node)) {
+		writeKind(NodeKind::UNARY_POSTFIX_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeToken(n->op);
+		writeNode(n->arg);
+	} else if (auto n = dynamic_cast<const FunctionCallExpression*>(node)) {
+		writeKind(NodeKind::FUNCTION_CALL_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNode(n->caller);
+		writeNodes(n->args);
+	} else if (auto n = dynamic_cast<const SubscriptExpression*>(node)) {
+		writeKind(NodeKind::SUBSCRIPT_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNode(n->target);
+		writeNode(n->index);
+	} else if (auto n = dynamic_cast<const CastingExpression*>(node)) {
+		writeKind(NodeKind::CASTING_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeToken(n->op);
+		writeNode(n->left);
+		writeNode(n->right);
+	} else if (auto n = dynamic_cast<const MapLiteralExpression*>(node)) {
+		writeKind(NodeKind::MAP_LITERAL_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->keys);
+		writeNodes(n->values);
+	} else if (auto n = dynamic_cast<const ArrayLiteralExpression*>(node)) {
+		writeKind(NodeKind::ARRAY_LITERAL_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->elements);
+	} else if (auto n = dynamic_cast<const TupleLiteralExpression*>(node)) {
+		writeKind(NodeKind::TUPLE_LITERAL_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->elements);
+	} else if (auto n = dynamic_cast<const LiteralExpression*>(node)) {
+		writeKind(NodeKind::LITERAL_EXPRESSION);
+		writeToken(n->value);
+	} else if (auto n = dynamic_cast<const IdentifierExpression*>(node)) {
+		writeKind(NodeKind::IDENTIFIER_EXPRESSION);
+		writeToken(n->value);
+		writeNodes(n->generics);
+		writeBool(n->globalPrefix);
+	} else if (auto n = dynamic_cast<const LambdaExpression*>(node)) {
+		// Lambdas are kept whole even when only the signatures are written
+		// since the type of a variable may be inferred from one
+		writeKind(NodeKind::LAMBDA_EXPRESSION);
+		writeMeta(n->sourceMeta);
+		writeNodes(n->modifiers);
+		writeNodes(n->parameters);
+		writeNodes(n->content);
+		writeSymbolRefs(n->symbols);
+	} else {
+		throw UnserializableNodeException();
+	}
+}
+
+void AstWriter::finish(String& dest, const AstSource* source) const {
+	AstWriter header(signaturesOnly, omitMeta);
+	header.body.append(MAGIC, sizeof(MAGIC));
+	header.writeVarint(FORMAT_VERSION);
+	header.writeBool(signaturesOnly);
+	header.writeVarint(sourceSize);
+	header.writeBool(source);
+	if (source) {
+		header.writeVarint(source->path.length());
+		header.body.append(source->path);
+		header.writeVarint(source->hash);
+	}
+	header.writeVarint(strings.size());
+	for (auto& s : strings) {
+		header.writeVarint(s->length());
+		header.body.append(*s);
+	}
+
+	dest.append(header.body);
+	dest.append(body);
+}
+
+class AstReader {
+	const char* begin;
+	const char* pos;
+	const char* end;
+	const ModuleInfo* moduleInfo;
+	SourceFile* file;
+	List<String> strings;
+	List<Symbol*> symbols;
+	Scope* currentScope;
+
+	std::uint8_t readByte() {
+		if (pos == end) throw MalformedDataException();
+		return static_cast<std::uint8_t>(*pos++);
+	}
+
+	std::uint64_t readVarint() {
+		std::uint64_t result = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			auto b = readByte();
+			result |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+			if (!(b & 0x80)) return result;
+		}
+		throw MalformedDataException();
+	}
+
+	std::int64_t readInt() {
+		auto v = readVarint();
+		return static_cast<std::int64_t>(v >> 1) ^
+			   -static_cast<std::int64_t>(v & 1);
+	}
+
+	bool readBool() { return readByte() != 0; }
+
+	std::size_t readCount() {
+		// Every element takes at least one byte, which also protects against
+		// huge allocations
+		auto count = readVarint();
+		if (count > static_cast<std::uint64_t>(end - pos))
+			throw MalformedDataException();
+		return count;
+	}
+
+	const String& readString() {
+		auto index = readVarint();
+		if (index >= strings.size()) throw MalformedDataException();
+		return strings[index];
+	}
+
+	SourceMeta readMeta() {
+		auto p = readInt();
+		auto line = static_cast<int>(readInt());
+		auto col = static_cast<int>(readInt());
+
+		// Only the lines that locations point into are known, which are all
+		// the lines that are ever looked up
+		if (file && line > 0 && col > 0 && p - col + 1 >= 0)
+			file->addLine(p - col + 1, line);
+		return SourceMeta(file, p);
+	}
+
+	Token* readToken() {
+		auto kind = static_cast<TokenKind>(readByte());
+		if (kind == TokenKind::NONE) return nullptr;
+		if (kind != TokenKind::PLAIN && kind != TokenKind::STRING)
+			throw MalformedDataException();
+
+		auto type = static_cast<TokenType>(readVarint());
+		const auto& data = readString();
+		auto meta = readMeta();
+		if (kind == TokenKind::PLAIN) return new Token(type, data, meta);
+
+		Map<int, String> interpolations;
+		auto count = readCount();
+		for (std::size_t i = 0; i < count; i++) {
+			auto index = static_cast<int>(readInt());
+			interpolations[index] = readString();
+		}
+		return new StringToken(type, data, meta, interpolations);
+	}
+
+	void readTokens(List<Token*>& dest) {
+		auto count = readCount();
+		for (std::size_t i = 0; i < count; i++) dest.push_back(readToken());
+	}
+
+	template <typename T>
+	T* readNodeAs() {
+		auto n = readNode();
+		auto result = dynamic_cast<T*>(n);
+		if (n && !result) throw MalformedDataException();
+		return result;
+	}
+
+	template <typename T>
+	void readNodes(List<T*>& dest) {
+		auto count = readCount();
+		for (std::size_t i = 0; i < count; i++)
+			dest.push_back(readNodeAs<T>());
+	}
+
+	// Every symbol takes more than one byte, so there can't be more symbols
+	// than bytes
+	std::size_t readSymbolId() {
+		auto id = readVarint();
+		if (id >= static_cast<std::uint64_t>(end - begin))
+			throw MalformedDataException();
+		return id;
+	}
+
+	template <typename T>
+	T* registerSymbol(std::size_t id, T* symbol) {
+		if (id >= symbols.size()) symbols.resize(id + 1, nullptr);
+		symbols[id] = symbol;
+		return symbol;
+	}
+
+	template <typename L>
+	void readSymbolRefs(L& dest) {
+		auto count = readCount();
+		dest.clear();
+		for (std::size_t i = 0; i < count; i++) {
+			auto id = readVarint();
+			if (id >= symbols.size() || !symbols[id])
+				throw MalformedDataException();
+			dest.push_back(symbols[id]);
+		}
+	}
+
+	// The scope has to be current while its content is read so that nested
+	// scopes get the right parent scope
+	void readScopeContent(Scope* scope, List<Node*>& content) {
+		auto parent = currentScope;
+		currentScope = scope;
+		readNodes(content);
+		currentScope = parent;
+		readSymbolRefs(scope->symbols);
+	}
+
+	template <typename T>
+	T* readType() {
+		auto id = readSymbolId();
+		List<Modifier*> modifiers;
+		readNodes(modifiers);
+		auto name = readToken();
+		List<GenericType*> generics;
+		readNodes(generics);
+		List<TypeRef*> declaredParentTypes;
+		readNodes(declaredParentTypes);
+
+		auto result = registerSymbol(
+			id, new T(modifiers, name, generics, declaredParentTypes, {},
+					  currentScope));
+		readScopeContent(result, result->content);
+		return result;
+	}
+
+	FunctionBlock* readFunctionBlock() {
+		auto meta = readMeta();
+		List<Modifier*> modifiers;
+		readNodes(modifiers);
+		auto blockType = static_cast<TokenType>(readVarint());
+		auto result =
+			new FunctionBlock(meta, modifiers, {}, currentScope, blockType);
+		readScopeContent(result, result->content);
+		return result;
+	}
+
+	template <typename T>
+	T* readConditionalBlock() {
+		auto meta = readMeta();
+		auto condition = readNodeAs<Expression>();
+		auto block = readNodeAs<FunctionBlock>();
+		return new T(meta, condition, block);
+	}
+
+	Node* readNode();
+	Node* readDeclaration(NodeKind kind);
+	Node* readStatement(NodeKind kind);
+	Node* readTypeRef(NodeKind kind);
+	Node* readExpression(NodeKind kind);
+
+   public:
+	AstReader(const char* data, std::size_t size, const ModuleInfo* moduleInfo)
+		: begin(data),
+		  pos(data),
+		  end(data + size),
+		  moduleInfo(moduleInfo),
+		  file(nullptr),
+		  currentScope(nullptr) {}
+
+	// Returns false if the data isn't of the current format or wasn't written
+	// for the expected source (unless that is nullptr)
+	bool readHeader(const AstSource* expected);
+	GlobalScope* readGlobalScope();
+};
+
+bool AstReader::readHeader(const AstSource* expected) {
+	if (static_cast<std::size_t>(end - pos) < sizeof(MAGIC) ||
+		std::memcmp(pos, MAGIC, sizeof(MAGIC)) != 0)
+		return false;
+	pos += sizeof(MAGIC);
+
+	if (readVarint() != FORMAT_VERSION) return false;
+	readBool();
+	auto sourceSize = readVarint();
+
+	AstSource source = {"", 0};
+	bool hasSource = readBool();
+	if (hasSource) {
+		auto length = readVarint();
+		if (length > static_cast<std::uint64_t>(end - pos))
+			throw MalformedDataException();
+		source.path.assign(pos, length);
+		pos += length;
+		source.hash = readVarint();
+	}
+	if (expected && (!hasSource || source != *expected)) return false;
+
+	auto count = readCount();
+	strings.reserve(count);
+	for (std::size_t i = 0; i < count; i++) {
+		auto length = readVarint();
+		if (length > static_cast<std::uint64_t>(end - pos))
+			throw MalformedDataException();
+		strings.emplace_back(pos, length);
+		pos += length;
+	}
+
+	file = SourceFile::add(moduleInfo, sourceSize);
+	return true;
+}
+
+GlobalScope* AstReader::readGlobalScope() {
+	if (static_cast<NodeKind>(readByte()) != NodeKind::GLOBAL_SCOPE)
+		throw MalformedDataException();
+
+	auto result = new GlobalScope(readMeta(), {});
+	readScopeContent(result, result->content);
+
+	List<Symbol*> imports;
+	readSymbolRefs(imports);
+	for (auto& s : imports) {
+		auto i = dynamic_cast<Import*>(s);
+		if (!i) throw MalformedDataException();
+		result->imports.push_back(i);
+	}
+	return result;
+}
+
+Node* AstReader::readNode() {
+	auto kind = static_cast<NodeKind>(readByte());
+	if (kind == NodeKind::NONE) return nullptr;
+	if (kind >= NodeKind::__END_OF_ENUM) throw MalformedDataException();
+
+	if (kind < NodeKind::VARIABLE_BLOCK) return readDeclaration(kind);
+	if (kind < NodeKind::SIMPLE_TYPE_REF) return readStatement(kind);
+	if (kind < NodeKind::TERNARY_EXPRESSION) return readTypeRef(kind);
+	return readExpression(kind);
+}
+
+Node* AstReader::readDeclaration(NodeKind kind) {
+	switch (kind) {
+		case NodeKind::IMPORT: {
+			auto id = readSymbolId();
+			auto source = readNodeAs<ImportSource>();
+			if (!source) throw MalformedDataException();
+			auto alias = readToken();
+			List<ImportTarget*> targets;
+			readNodes(targets);
+			return registerSymbol(id, new Import(source, alias, targets));
+		}
+		case NodeKind::IMPORT_SOURCE: {
+			auto content = readToken();
+			auto parent = readNodeAs<ImportSource>();
+			auto declaredRelative = readBool();
+			return new ImportSource(content, parent, declaredRelative);
+		}
+		case NodeKind::IMPORT_TARGET: {
+			auto id = readToken();
+			auto declaredType = readNodeAs<TypeRef>();
+			return new ImportTarget(id, declaredType);
+		}
+		case NodeKind::MODIFIER:
+			return new Modifier(readToken());
+		case NodeKind::META_DECLARATION:
+			return new MetaDeclaration(readToken());
+		case NodeKind::WARNING_META_DECLARATION: {
+			auto content = readToken();
+			List<Token*> args;
+			readTokens(args);
+			auto target = readNode();
+			return new WarningMetaDeclaration(content, args, target);
+		}
+		case NodeKind::CLASS:
+			return readType<Class>();
+		case NodeKind::STRUCT:
+			return readType<Struct>();
+		case NodeKind::TEMPLATE:
+			return readType<Template>();
+		case NodeKind::ENUM:
+			return readType<Enum>();
+		case NodeKind::NAMESPACE: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			List<GenericType*> generics;
+			readNodes(generics);
+			auto result = registerSymbol(
+				id, new Namespace(modifiers, name, generics, {}, currentScope));
+			readScopeContent(result, result->content);
+			return result;
+		}
+		case NodeKind::ALIAS: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			List<GenericType*> generics;
+			readNodes(generics);
+			auto value = readNodeAs<TypeRef>();
+			auto result = registerSymbol(
+				id, new Alias(modifiers, name, generics, value, currentScope));
+			readSymbolRefs(result->symbols);
+			return result;
+		}
+		case NodeKind::FUNCTION: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			List<GenericType*> generics;
+			readNodes(generics);
+			List<Parameter*> parameters;
+			readNodes(parameters);
+			auto declaredReturnType = readNodeAs<TypeRef>();
+			auto hasBody = readBool();
+			auto result = registerSymbol(
+				id, new Function(modifiers, name, generics, parameters,
+								 declaredReturnType, {}, currentScope,
+								 hasBody));
+			readScopeContent(result, result->content);
+			return result;
+		}
+		case NodeKind::CONSTRUCTOR: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			List<Parameter*> parameters;
+			readNodes(parameters);
+			auto result = registerSymbol(
+				id,
+				new Constructor(modifiers, name, parameters, {}, currentScope));
+			readScopeContent(result, result->content);
+			return result;
+		}
+		case NodeKind::DESTRUCTOR: {
+			auto meta = readMeta();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto result = new Destructor(meta, modifiers, {}, currentScope);
+			readScopeContent(result, result->content);
+			return result;
+		}
+		case NodeKind::VARIABLE: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			auto declaredType = readNodeAs<TypeRef>();
+			auto value = readNode();
+			auto constant = readBool();
+			auto result =
+				new Variable(modifiers, name, declaredType, value, constant);
+			return registerSymbol(id, result);
+		}
+		case NodeKind::PARAMETER: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			auto declaredType = readNodeAs<TypeRef>();
+			return registerSymbol(id,
+								  new Parameter(modifiers, name, declaredType));
+		}
+		case NodeKind::GENERIC_TYPE: {
+			auto id = readSymbolId();
+			auto name = readToken();
+			auto declaredParentType = readNodeAs<TypeRef>();
+			return registerSymbol(id,
+								  new GenericType(name, declaredParentType));
+		}
+		case NodeKind::ENUM_CASE: {
+			auto id = readSymbolId();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto name = readToken();
+			List<Expression*> args;
+			readNodes(args);
+			return registerSymbol(
+				id, new EnumCase(modifiers, name, args,
+								 dynamic_cast<Enum*>(currentScope)));
+		}
+		default:
+			throw MalformedDataException();
+	}
+}
+
+Node* AstReader::readStatement(NodeKind kind) {
+	switch (kind) {
+		case NodeKind::VARIABLE_BLOCK: {
+			auto meta = readMeta();
+			auto getBlock = readNodeAs<FunctionBlock>();
+			auto setBlock = readNodeAs<SetBlock>();
+			auto initBlock = readNodeAs<FunctionBlock>();
+			return new VariableBlock(meta, getBlock, setBlock, initBlock);
+		}
+		case NodeKind::SET_BLOCK: {
+			auto meta = readMeta();
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			auto parameter = readNodeAs<Parameter>();
+			auto result =
+				new SetBlock(meta, modifiers, parameter, {}, currentScope);
+			readScopeContent(result, result->content);
+			return result;
+		}
+		case NodeKind::FUNCTION_BLOCK:
+			return readFunctionBlock();
+		case NodeKind::CONDITIONAL_BLOCK:
+			return readConditionalBlock<ConditionalBlock>();
+		case NodeKind::IF_BLOCK: {
+			auto meta = readMeta();
+			auto condition = readNodeAs<Expression>();
+			auto block = readNodeAs<FunctionBlock>();
+			List<ConditionalBlock*> elifBlocks;
+			readNodes(elifBlocks);
+			auto elseBlock = readNodeAs<FunctionBlock>();
+			return new IfBlock(meta, condition, block, elifBlocks, elseBlock);
+		}
+		case NodeKind::WHILE_BLOCK:
+			return readConditionalBlock<WhileBlock>();
+		case NodeKind::REPEAT_BLOCK:
+			return readConditionalBlock<RepeatBlock>();
+		case NodeKind::FOR_BLOCK: {
+			auto meta = readMeta();
+			auto iterator = readNodeAs<Parameter>();
+			auto iteratee = readNodeAs<Expression>();
+			auto block = readNodeAs<FunctionBlock>();
+			return new ForBlock(meta, iterator, iteratee, block);
+		}
+		case NodeKind::CATCH_BLOCK: {
+			auto meta = readMeta();
+			auto exceptionVariable = readNodeAs<Parameter>();
+			auto block = readNodeAs<FunctionBlock>();
+			return new CatchBlock(meta, exceptionVariable, block);
+		}
+		case NodeKind::TRY_BLOCK: {
+			auto meta = readMeta();
+			auto block = readNodeAs<FunctionBlock>();
+			List<CatchBlock*> catchBlocks;
+			readNodes(catchBlocks);
+			return new TryBlock(meta, block, catchBlocks);
+		}
+		case NodeKind::SWITCH_CASE_BLOCK: {
+			auto meta = readMeta();
+			auto caseType = readToken();
+			auto condition = readNodeAs<Expression>();
+			auto block = readNodeAs<FunctionBlock>();
+			return new SwitchCaseBlock(meta, caseType, condition, block);
+		}
+		case NodeKind::SWITCH_BLOCK: {
+			auto meta = readMeta();
+			auto condition = readNodeAs<Expression>();
+			List<SwitchCaseBlock*> cases;
+			readNodes(cases);
+			return new SwitchBlock(meta, condition, cases);
+		}
+		case NodeKind::RETURN_STATEMENT: {
+			auto meta = readMeta();
+			return new ReturnStatement(meta, readNodeAs<Expression>());
+		}
+		case NodeKind::THROW_STATEMENT: {
+			auto meta = readMeta();
+			return new ThrowStatement(meta, readNodeAs<Expression>());
+		}
+		case NodeKind::SINGLE_TOKEN_STATEMENT:
+			return new SingleTokenStatement(readToken());
+		default:
+			throw MalformedDataException();
+	}
+}
+
+Node* AstReader::readTypeRef(NodeKind kind) {
+	auto meta = readMeta();
+	switch (kind) {
+		case NodeKind::SIMPLE_TYPE_REF: {
+			auto id = readToken();
+			List<TypeRef*> generics;
+			readNodes(generics);
+			auto parent = readNodeAs<SimpleTypeRef>();
+			return new SimpleTypeRef(meta, id, generics, parent);
+		}
+		case NodeKind::SUFFIX_TYPE_REF: {
+			auto type = readNodeAs<TypeRef>();
+			return new SuffixTypeRef(meta, type, readToken());
+		}
+		case NodeKind::TUPLE_TYPE_REF: {
+			List<TypeRef*> elementTypes;
+			readNodes(elementTypes);
+			return new TupleTypeRef(meta, elementTypes);
+		}
+		case NodeKind::MAP_TYPE_REF: {
+			auto keyType = readNodeAs<TypeRef>();
+			auto valueType = readNodeAs<TypeRef>();
+			return new MapTypeRef(meta, keyType, valueType);
+		}
+		case NodeKind::ARRAY_TYPE_REF:
+			return new ArrayTypeRef(meta, readNodeAs<TypeRef>());
+		case NodeKind::FUNCTION_TYPE_REF: {
+			List<TypeRef*> paramTypes;
+			readNodes(paramTypes);
+			auto returnType = readNodeAs<TypeRef>();
+			return new FunctionTypeRef(meta, paramTypes, returnType);
+		}
+		default:
+			throw MalformedDataException();
+	}
+}
+
+Node* AstReader::readExpression(NodeKind kind) {
+	switch (kind) {
+		case NodeKind::LITERAL_EXPRESSION:
+			return new LiteralExpression(readToken());
+		case NodeKind::IDENTIFIER_EXPRESSION: {
+			auto value = readToken();
+			List<TypeRef*> generics;
+			readNodes(generics);
+			auto globalPrefix = readBool();
+			return new IdentifierExpression(value, generics, globalPrefix);
+		}
+		default:
+			break;
+	}
+
+	auto meta = readMeta();
+	switch (kind) {
+		case NodeKind::TERNARY_EXPRESSION: {
+			auto arg0 = readNodeAs<Expression>();
+			auto arg1 = readNodeAs<Expression>();
+			auto arg2 = readNodeAs<Expression>();
+			return new TernaryExpression(meta, arg0, arg1, arg2);
+		}
+		case NodeKind::BINARY_EXPRESSION: {
+			auto op = readToken();
+			auto left = readNodeAs<Expression>();
+			auto right = readNodeAs<Expression>();
+			return new BinaryExpression(meta, op, left, right);
+		}
+		case NodeKind::UNARY_PREFIX_EXPRESSION: {
+			auto op = readToken();
+			return new UnaryPrefixExpression(meta, op,
+											 readNodeAs<Expression>());
+		}
+		case NodeKind::UNARY_POSTFIX_EXPRESSION: {
+			auto op = readToken();
+			return new UnaryPostfixExpression(meta, op,
+											  readNodeAs<Expression>());
+		}
+		case NodeKind::FUNCTION_CALL_EXPRESSION: {
+			auto caller = readNodeAs<Expression>();
+			List<Expression*> args;
+			readNodes(args);
+			return new FunctionCallExpression(meta, caller, args);
+		}
+		case NodeKind::SUBSCRIPT_EXPRESSION: {
+			auto target = readNodeAs<Expression>();
+			auto index = readNodeAs<Expression>();
+			return new SubscriptExpression(meta, target, index);
+		}
+		case NodeKind::CASTING_EXPRESSION: {
+			auto op = readToken();
+			auto left = readNodeAs<Expression>();
+			auto right = readNodeAs<TypeRef>();
+			return new CastingExpression(meta, op, left, right);
+		}
+		case NodeKind::MAP_LITERAL_EXPRESSION: {
+			List<Expression*> keys;
+			readNodes(keys);
+			List<Expression*> values;
+			readNodes(values);
+			return new MapLiteralExpression(meta, keys, values);
+		}
+		case NodeKind::ARRAY_LITERAL_EXPRESSION: {
+			List<Expression*> elements;
+			readNodes(elements);
+			return new ArrayLiteralExpression(meta, elements);
+		}
+		case NodeKind::TUPLE_LITERAL_EXPRESSION: {
+			List<Expression*> elements;
+			readNodes(elements);
+			return new TupleLiteralExpression(meta, elements);
+		}
+		case NodeKind::LAMBDA_EXPRESSION: {
+			List<Modifier*> modifiers;
+			readNodes(modifiers);
+			List<Parameter*> parameters;
+			readNodes(parameters);
+			auto result = new LambdaExpression(meta, modifiers, parameters, {},
+											   currentScope);
+			readScopeContent(result, result->content);
+			return result;
+		}
+		default:
+			throw MalformedDataException();
+	}
+}
+}  // namespace
+
+namespace acl {
+bool serializeAst(String& dest, const Ast* ast, bool signaturesOnly,
+				  const AstSource* source) {
+	AstWriter writer(signaturesOnly, false);
+	try {
+		writer.writeGlobalScope(ast->globalScope);
+	} catch (UnserializableNodeException& e) {
+		return false;
+	}
+
+	writer.finish(dest, source);
+	return true;
+}
+
+std::uint64_t getInterfaceFingerprint(const Symbol* symbol) {
+	// Source positions are left out so that moving a symbol doesn't count as
+	// changing it
+	AstWriter writer(true, true);
+	try {
+		writer.writeNode(symbol);
+	} catch (UnserializableNodeException& e) {
+		return 0;
+	}
+
+	String data;
+	writer.finish(data, nullptr);
+	auto result = fnv1a(data.data(), data.length());
+	return result ? result : 1;
+}
+
+Ast* deserializeAst(const char* data, std::size_t size,
+					const ModuleInfo* moduleInfo, const AstSource* source) {
+	AstReader reader(data, size, moduleInfo);
+
+	// The nodes read before running into malformed data are not freed, as
+	// there is no complete tree to free them through. Callers that can't rule
+	// out corrupt data (e.g. the module cache) should verify it beforehand.
+	try {
+		if (!reader.readHeader(source)) return nullptr;
+		return new Ast(reader.readGlobalScope());
+	} catch (MalformedDataException& e) {
+		return nullptr;
+	}
+}
+}  // namespace acl
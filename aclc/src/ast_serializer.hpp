@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ast.hpp"
+#include "common.hpp"
+
+namespace acl {
+/*
+A compact binary form of an unresolved AST. Strings are stored once in a string
+table and nodes are written in pre-order, tagged with their kind. References to
+symbols (the symbols of a scope and the imports of the global scope) are stored
+as indices into the symbols written before them, so the AST comes back out
+exactly as the parser left it.
+
+If "signaturesOnly" is true, everything that importers of a module never look at
+is left out: the bodies of functions, constructors, destructors and property
+blocks, as well as the values of non-constant variables with a declared type.
+
+Dumps of an AST (see "--binary-ast") also record the source they were written
+for, which is checked when they are read back.
+*/
+
+// Appends the serialized AST to "dest". Returns false (in which case "dest" is
+// left unchanged) if the AST contains a node of an unknown kind or a reference
+// to a symbol that isn't part of it.
+bool serializeAst(String& dest, const Ast* ast, bool signaturesOnly,
+				  const AstSource* source = nullptr);
+
+// A hash of the part of a symbol that other modules can depend on: its
+// signature, its modifiers (including its visibility) and, for scopes such as
+// types, the signatures of its members. It is computed from the signature-only
+// serialization of the symbol without source positions, so editing the body of
+// a function or moving a symbol around leaves it unchanged. Returns 0 if the
+// symbol can't be serialized, which is never the fingerprint of any symbol.
+std::uint64_t getInterfaceFingerprint(const Symbol* symbol);
+
+// Returns nullptr if the data is not a serialized AST of the current format, or
+// if a source is specified and the AST wasn't written for it. The source
+// metadata of the nodes will point to the specified module info.
+Ast* deserializeAst(const char* data, std::size_t size,
+					const ModuleInfo* moduleInfo,
+					const AstSource* source = nullptr);
+}  // namespace acl
@@ -3,15 +3,110 @@
 #include "ast.hpp"
 #include "diagnoser.hpp"
 
+namespace {
+using namespace acl;
+
+String getModuleKey(const std::filesystem::path& path) {
+	return path.lexically_normal().string();
+}
+}  // namespace
+
 namespace acl {
-CompilerContext::CompilerContext() {
+CompilerContext::CompilerContext()
+	: jobs(1),
+	  pool(nullptr),
+	  moduleCache(nullptr),
+	  fileIndex(nullptr),
+	  diagnostics(nullptr),
+	  profiler(nullptr) {
 	warnings[ec::NONFRONTED_SOURCE_LOCK] = true;
 }
 
+bool CompilerContext::isWarningEnabled(int warning) const {
+	auto it = warnings.find(warning);
+	return it != warnings.end() && it->second;
+}
+
+Module* CompilerContext::findModule(const std::filesystem::path& path) const {
+	std::lock_guard<std::mutex> lock(modulesMutex);
+	auto it = modulesByPath.find(getModuleKey(path));
+	return it == modulesByPath.end() ? nullptr : it->second;
+}
+
+const Module* CompilerContext::findModule(const ModuleInfo* moduleInfo) const {
+	std::lock_guard<std::mutex> lock(modulesMutex);
+	auto it = modulesByInfo.find(moduleInfo);
+	return it == modulesByInfo.end() ? nullptr : it->second;
+}
+
+Module* CompilerContext::addModule(Module* m) {
+	std::lock_guard<std::mutex> lock(modulesMutex);
+	auto& existing = modulesByPath[getModuleKey(m->moduleInfo.path)];
+	if (existing) return existing;
+
+	existing = m;
+	modulesByInfo[&m->moduleInfo] = m;
+	modules.push_back(m);
+	return m;
+}
+
+void CompilerContext::waitUntilLoaded(const Module* m) const {
+	std::unique_lock<std::mutex> lock(modulesMutex);
+	moduleLoaded.wait(lock, [m]() { return !m->loading; });
+}
+
+void CompilerContext::finishLoading(Module* m) {
+	{
+		std::lock_guard<std::mutex> lock(modulesMutex);
+		m->loading = false;
+	}
+	moduleLoaded.notify_all();
+}
+
 Module::Module(const ModuleInfo& moduleInfo, Ast* ast,
 			   const List<String>& source)
-	: moduleInfo(moduleInfo), ast(ast), source(source) {}
+	: moduleInfo(moduleInfo),
+	  ast(ast),
+	  source(source),
+	  untrackedDependencies(false),
+	  loading(false),
+	  failed(false) {}
 
 Module::~Module() { /*delete ast;*/
 }
+
+void Module::addDependency(const String& modulePath, const String& name) {
+	std::lock_guard<std::mutex> lock(dependenciesMutex);
+	dependencies.emplace(modulePath, name);
+}
+
+void Module::addUntrackedDependency() {
+	std::lock_guard<std::mutex> lock(dependenciesMutex);
+	untrackedDependencies = true;
+}
+
+AstSource Module::getAstSource() const {
+	auto hash = fnv1a(nullptr, 0);
+	for (const auto& line : source) {
+		hash = fnv1a(line.data(), line.length(), hash);
+		hash = fnv1a("\n", 1, hash);
+	}
+	return {moduleInfo.path, hash};
+}
+
+bool AstSource::operator==(const AstSource& other) const {
+	return path == other.path && hash == other.hash;
+}
+
+bool AstSource::operator!=(const AstSource& other) const {
+	return !(*this == other);
+}
+
+std::uint64_t fnv1a(const char* data, std::size_t size, std::uint64_t hash) {
+	for (std::size_t i = 0; i < size; i++) {
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
 }  // namespace acl
\ No newline at end of file
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <condition_variable>
 #include <cstdint>
 #include <filesystem>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <string>
 #include <unordered_map>
@@ -25,34 +28,168 @@ struct ModuleInfo {
 
 using FilePos = std::intmax_t;
 
-struct SourceMeta {
-	const ModuleInfo* moduleInfo;
-	FilePos pos;
-	int line;
-	int col;
+class SourceFile;
+
+/*
+A location in the source of a module, packed into 32 bits. Every source that is
+read gets a range of location IDs of its own (see SourceFile), one for every
+position in it, so a location is nothing but the ID of its position. The
+module, line and column are looked up from the ID, which only happens when
+locations are shown or serialized.
+
+A default-constructed location points nowhere, as do the locations of sources
+read after the IDs have run out.
+*/
+class SourceMeta {
+	std::uint32_t id;
+
+   public:
+	SourceMeta();
+	SourceMeta(const SourceFile* file, FilePos pos);
+
+	bool isValid() const;
+
+	// nullptr if the location points nowhere
+	const SourceFile* getFile() const;
+	const ModuleInfo* getModuleInfo() const;
+
+	// -1 if the location points nowhere
+	FilePos getPos() const;
+	int getLine() const;
+	int getCol() const;
+
+	bool operator==(const SourceMeta& other) const;
+	bool operator!=(const SourceMeta& other) const;
 };
 
 struct Ast;
+class DiagnosticSink;
+class FileIndex;
+class ModuleCache;
+class Profiler;
+class ThreadPool;
+
+// A symbol of another module that a module depends on: the absolute path of
+// the other module and the qualified name of the symbol (see
+// getQualifiedName()), along with the combined interface fingerprint of every
+// symbol with that name (see getInterfaceFingerprint()). An empty name stands
+// for the import of the other module itself.
+struct SymbolDependency {
+	String modulePath;
+	String name;
+	std::uint64_t fingerprint;
+};
+
+// The source that a dump of the AST of a module was written for (see
+// "--dump-ast"): the absolute path of the module and a hash of its content. A
+// dump is only read back for the same source, so neither another module with
+// the same name nor an edited module is ever compiled from it.
+struct AstSource {
+	String path;
+	std::uint64_t hash;
+
+	bool operator==(const AstSource& other) const;
+	bool operator!=(const AstSource& other) const;
+};
 
 struct Module {
 	ModuleInfo moduleInfo;
 	Ast* ast;
 	List<String> source;
 
+	// The paths and qualified names of the symbols of other modules that were
+	// looked up while resolving this module. Bodies may be resolved on several
+	// threads, so these should only be changed through addDependency().
+	std::set<std::pair<String, String>> dependencies;
+
+	// True if a symbol of another module was looked up that has no qualified
+	// name, in which case the dependencies are incomplete
+	bool untrackedDependencies;
+	std::mutex dependenciesMutex;
+
+	// True while the module is registered but its AST isn't set up yet (see
+	// CompilerContext::waitUntilLoaded())
+	bool loading;
+
+	// True if the imports of the module couldn't be resolved, in which case
+	// none of its symbols can be used
+	bool failed;
+
 	Module(const ModuleInfo& moduleInfo, Ast* ast, const List<String>& source);
 	~Module();
+
+	// An empty name marks the other module as imported
+	void addDependency(const String& modulePath, const String& name);
+	void addUntrackedDependency();
+
+	AstSource getAstSource() const;
 };
 
 // Contains common flags and features to be used across all parts of the
-// compilation process.
+// compilation process. Modules may be compiled on several threads at once, so
+// the module list and the maps indexing it should only be accessed through the
+// member functions while compilation is in progress. The remaining members are
+// set up before compilation starts and are read-only afterwards.
 struct CompilerContext {
 	Map<int, bool> warnings;
 	List<Module*> modules;
+
+	// The modules by their normalized path and by their module info
+	Map<String, Module*> modulesByPath;
+	Map<const ModuleInfo*, Module*> modulesByInfo;
 	List<std::filesystem::path> additionalImportDirs;
 	std::filesystem::path globalImportDir;
+
+	// The number of threads that may be used to compile modules
+	unsigned jobs;
+
+	// The pool that modules are compiled by, which also resolves the bodies of
+	// a module in parallel, or nullptr if everything runs on one thread
+	ThreadPool* pool;
+
+	// The cache of imported module interfaces, or nullptr if it is disabled
+	ModuleCache* moduleCache;
+
+	// The index used to locate imports, or nullptr if the file system should
+	// be asked directly
+	FileIndex* fileIndex;
+
+	// The directory that the ASTs of modules are read from instead of parsing
+	// the modules if they were dumped there (see readAstJson()), or an empty
+	// path
+	std::filesystem::path astDir;
+
+	// Where diagnostics are collected until the compilation is done. It must
+	// be set before anything is compiled, since only the driver shows them.
+	DiagnosticSink* diagnostics;
+
+	// Where the time spent on each phase is recorded, or nullptr if it isn't
+	Profiler* profiler;
+	mutable std::mutex modulesMutex;
+	mutable std::condition_variable moduleLoaded;
 	CompilerContext();
+
+	bool isWarningEnabled(int warning) const;
+
+	// Returns nullptr if there is no module with the specified absolute path
+	Module* findModule(const std::filesystem::path& path) const;
+	const Module* findModule(const ModuleInfo* moduleInfo) const;
+
+	// Returns the module that was already registered under the same path if
+	// there is one, in which case the specified module is not added
+	Module* addModule(Module* m);
+
+	// Modules are registered before they are loaded so that diagnostics can
+	// show their source, so another thread may still be loading a module that
+	// was found. This blocks until the module is done loading.
+	void waitUntilLoaded(const Module* m) const;
+	void finishLoading(Module* m);
 };
 
+// The 64-bit FNV-1a hash of the data, continuing from "hash"
+std::uint64_t fnv1a(const char* data, std::size_t size,
+					std::uint64_t hash = 0xcbf29ce484222325ULL);
+
 template <typename T>
 bool listContains(const List<T>& list, const T& t) {
 	for (const auto& e : list)
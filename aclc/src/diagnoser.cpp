@@ -1,9 +1,13 @@
 #include "diagnoser.hpp"
 
+#include <algorithm>
+#include <iomanip>
 #include <iostream>
 
 #include "ast.hpp"
+#include "json_util.hpp"
 #include "lexer.hpp"
+#include "profiler.hpp"
 
 namespace {
 using namespace acl::ec;
@@ -115,11 +119,29 @@ void error(std::ostream& dest, const String& message,
 namespace {
 using namespace acl;
 
-void printCodeSnippet(std::ostream& dest, const CompilerContext& ctx,
+const SourceMeta NO_LOCATION;
+
+// "m" is nullptr if the module is not part of the compilation
+void printCodeSnippet(std::ostream& dest, const Module* m,
 					  const SourceMeta& highlightBegin, int highlightLength,
 					  ec::ErrorType highlightType);
 
 String getLocationInfo(const SourceMeta& location);
+
+// Orders diagnostics by module path and position, and then by everything else
+// so that the order doesn't depend on the order they were found in. Returns 0
+// if the diagnostics are identical.
+int compareDiagnostics(const Diagnostic& a, const Diagnostic& b);
+
+bool sameLocation(const SourceMeta& a, const SourceMeta& b);
+
+// The length of the highlight at the location of the diagnostic itself
+int getHighlightLength(const Diagnostic& d);
+
+String getRuleId(ec::ErrorCode ec);
+const char* getSarifLevel(ec::ErrorType severity);
+void appendSarifLocation(StringBuffer& dest, const SourceMeta& location,
+						 int highlightLength, const String& caption);
 }  // namespace
 
 namespace acl {
@@ -129,83 +151,266 @@ ErrorType getErrorCodeType(ErrorCode ec) { return ERROR_CODE_DATA.at(ec).type; }
 const String& getErrorCodeTitle(ErrorCode ec) {
 	return ERROR_CODE_DATA.at(ec).title;
 }
+const String& getErrorCodeId(ErrorCode ec) { return ERROR_CODE_DATA.at(ec).id; }
 }  // namespace ec
 
-Diagnoser::Diagnoser(const CompilerContext& ctx, std::ostream& dest)
-	: ctx(ctx), dest(dest) {}
+DiagnosticSink::DiagnosticSink(std::ostream& dest, DiagnosticFormat format,
+							   std::size_t limit, const String& toolVersion)
+	: dest(dest), format(format), limit(limit), toolVersion(toolVersion) {}
 
-void Diagnoser::diagnose(ec::ErrorCode ec, const String& message) {
-	const auto& title = ec::getErrorCodeTitle(ec);
+void DiagnosticSink::add(List<Diagnostic>&& batch) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if (diagnostics.empty()) {
+		diagnostics = std::move(batch);
+		return;
+	}
+	diagnostics.insert(diagnostics.end(),
+					   std::make_move_iterator(batch.begin()),
+					   std::make_move_iterator(batch.end()));
+}
+
+bool DiagnosticSink::hasDiagnostics(const String& modulePath) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& d : diagnostics) {
+		auto moduleInfo = d.location.getModuleInfo();
+		if (!moduleInfo || moduleInfo->path == modulePath) return true;
+	}
+	return false;
+}
+
+void DiagnosticSink::render(const CompilerContext& ctx) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The diagnostics themselves stay where they are; only pointers to them
+	// are sorted
+	List<const Diagnostic*> sorted;
+	sorted.reserve(diagnostics.size());
+	for (const auto& d : diagnostics) sorted.push_back(&d);
+	std::sort(sorted.begin(), sorted.end(), [](auto a, auto b) {
+		return compareDiagnostics(*a, *b) < 0;
+	});
+
+	// Identical diagnostics end up next to each other
+	List<const Diagnostic*> shown;
+	std::size_t omitted = 0;
+	const Diagnostic* previous = nullptr;
+	for (auto d : sorted) {
+		if (previous && compareDiagnostics(*previous, *d) == 0) continue;
+		previous = d;
+		if (limit && shown.size() >= limit)
+			omitted++;
+		else
+			shown.push_back(d);
+	}
+
+	if (format == DiagnosticFormat::SARIF)
+		renderSarif(shown);
+	else
+		renderText(ctx, shown, omitted);
+	dest.flush();
+
+	diagnostics.clear();
+}
 
+void DiagnosticSink::renderText(const CompilerContext& ctx,
+								const List<const Diagnostic*>& shown,
+								std::size_t omitted) const {
+	// Looking up a module takes a lock, and most diagnostics are in a handful
+	// of modules
+	Map<const ModuleInfo*, const Module*> modules;
+	auto getModule = [&](const ModuleInfo* moduleInfo) {
+		auto it = modules.find(moduleInfo);
+		if (it != modules.end()) return it->second;
+		return modules[moduleInfo] = ctx.findModule(moduleInfo);
+	};
+
+	for (auto d : shown) {
+		if (d->location.isValid()) {
+			if (d->severity == ec::ErrorType::WARNING)
+				log::warn(dest, getLocationInfo(d->location));
+			else
+				log::error(dest, getLocationInfo(d->location));
+		}
+
+		dest << ec::getErrorCodeTitle(d->ec) << " (ACL" << std::setfill('0')
+			 << std::setw(4) << d->ec << ")";
+		if (!d->message.empty()) dest << " - " << d->message;
+		dest << "\n";
+
+		for (const auto& s : d->snippets) {
+			dest << s.caption;
+			auto m = getModule(s.location.getModuleInfo());
+			printCodeSnippet(dest, m, s.location, s.highlightLength,
+							 s.highlightType);
+		}
+	}
+
+	if (omitted > 0) {
+		StringBuffer msg;
+		msg << omitted << " more diagnostic"
+			<< (omitted == 1 ? " was" : "s were") << " not shown";
+		log::warn(dest, msg.str());
+	}
+}
+
+void DiagnosticSink::renderSarif(const List<const Diagnostic*>& shown) const {
 	StringBuffer sb;
-	sb << title;
+	sb << "{\n\"$schema\": "
+		  "\"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+		  "\"version\": \"2.1.0\",\n\"runs\": [{\n\"tool\": {\"driver\": {"
+		  "\n\"name\": \"aclc\",\n\"version\": ";
+	json::appendString(sb, toolVersion);
+	sb << ",\n\"rules\": ";
+
+	// Results refer to their rule by its index in the list of rules
+	List<ec::ErrorCode> rules;
+	Map<ec::ErrorCode, std::size_t> ruleIndices;
+	for (auto d : shown) {
+		if (ruleIndices.count(d->ec)) continue;
+		ruleIndices[d->ec] = rules.size();
+		rules.push_back(d->ec);
+	}
+	std::sort(rules.begin(), rules.end());
+	for (std::size_t i = 0; i < rules.size(); i++) ruleIndices[rules[i]] = i;
+
+	json::appendList<ec::ErrorCode>(sb, rules, [](auto& d, const auto& e) {
+		d << "{\"id\": ";
+		json::appendString(d, getRuleId(e));
+		d << ", \"name\": ";
+		json::appendString(d, ec::getErrorCodeId(e));
+		d << ", \"shortDescription\": {\"text\": ";
+		json::appendString(d, ec::getErrorCodeTitle(e));
+		d << "}}";
+	});
+	sb << "\n}},\n\"results\": ";
+
+	json::appendList<const Diagnostic*>(sb, shown, [&](auto& d, auto e) {
+		d << "{\"ruleId\": ";
+		json::appendString(d, getRuleId(e->ec));
+		d << ", \"ruleIndex\": " << ruleIndices.at(e->ec)
+		  << ", \"level\": " << getSarifLevel(e->severity)
+		  << ", \"message\": {\"text\": ";
+		json::appendString(d, e->message.empty()
+								  ? ec::getErrorCodeTitle(e->ec)
+								  : e->message);
+		d << "}";
+
+		if (e->location.isValid()) {
+			d << ", \"locations\": [";
+			appendSarifLocation(d, e->location, getHighlightLength(*e), "");
+			d << "]";
+		}
+
+		// Snippets other than the one at the location of the diagnostic (such
+		// as the original of a duplicate) are related locations
+		List<const DiagnosticSnippet*> related;
+		for (const auto& s : e->snippets)
+			if (!sameLocation(s.location, e->location)) related.push_back(&s);
+		if (!related.empty()) {
+			d << ", \"relatedLocations\": [";
+			for (std::size_t i = 0; i < related.size(); i++) {
+				if (i > 0) d << ", ";
+				appendSarifLocation(d, related[i]->location,
+									related[i]->highlightLength,
+									related[i]->caption);
+			}
+			d << "]";
+		}
+		d << "}";
+	});
+	sb << "\n}]\n}\n";
+
+	dest << sb.str();
+}
+
+Diagnoser::Diagnoser(const CompilerContext& ctx) : ctx(ctx), dest(&buffer) {}
+
+Diagnoser::Diagnoser(const CompilerContext& ctx, List<Diagnostic>& dest)
+	: ctx(ctx), dest(&dest) {}
+
+Diagnoser::Diagnoser(const Diagnoser& other)
+	: ctx(other.ctx),
+	  dest(other.dest == &other.buffer ? &buffer : other.dest) {}
+
+Diagnoser::~Diagnoser() { flush(); }
+
+List<Diagnostic>& Diagnoser::getDest() { return *dest; }
+
+void Diagnoser::setDest(List<Diagnostic>* dest) {
+	this->dest = dest ? dest : &buffer;
+}
+
+void Diagnoser::flush() {
+	if (buffer.empty() || !ctx.diagnostics) return;
 
-	sb << " (ACL" << std::setfill('0') << std::setw(4) << ec << ")";
+	ctx.diagnostics->add(std::move(buffer));
+	buffer.clear();
+}
+
+void Diagnoser::add(ec::ErrorCode ec, ec::ErrorType severity,
+					const SourceMeta& location, const String& message,
+					const List<DiagnosticSnippet>& snippets) {
+	auto size = sizeof(Diagnostic) + message.length() +
+				snippets.size() * sizeof(DiagnosticSnippet);
+	for (const auto& s : snippets) size += s.caption.length();
+	Profiler::countAllocation(MemoryCategory::DIAGNOSTICS, size);
 
-	if (!message.empty()) sb << " - " << message;
+	dest->push_back({ec, severity, location, message, snippets});
+}
 
-	std::cout << sb.str() << "\n";
+void Diagnoser::diagnose(ec::ErrorCode ec, const String& message) {
+	add(ec, ec::ErrorType::ERROR, NO_LOCATION, message, {});
 }
 
 void Diagnoser::diagnose(ec::ErrorCode ec) { diagnose(ec, ""); }
 
 void Diagnoser::diagnose(ec::ErrorCode ec, const SourceMeta& location,
 						 int highlightLength) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec);
-	printCodeSnippet(dest, ctx, location, highlightLength,
-					 getErrorCodeType(ec));
+	diagnose(ec, location, highlightLength, "");
 }
 
 void Diagnoser::diagnose(ec::ErrorCode ec, const SourceMeta& location,
 						 int highlightLength, const String& message) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec, message);
-	printCodeSnippet(dest, ctx, location, highlightLength,
-					 getErrorCodeType(ec));
+	add(ec, ec::ErrorType::ERROR, location, message,
+		{{"", location, highlightLength, getErrorCodeType(ec)}});
 }
 
 void Diagnoser::diagnoseMultiLineCommentEnd(const SourceMeta& location) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec::INVALID_COMMENT_BLOCK_END,
-			 "The following comment block does not terminate:");
-	printCodeSnippet(dest, ctx, location, 2, ec::ErrorType::ERROR);
+	add(ec::INVALID_COMMENT_BLOCK_END, ec::ErrorType::ERROR, location,
+		"The following comment block does not terminate:",
+		{{"", location, 2, ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseFloatLiteral(const SourceMeta& location) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec::INVALID_FLOAT_LITERAL,
-			 "Expected digits following the exponent marker");
-	printCodeSnippet(dest, ctx, location, 1, ec::ErrorType::ERROR);
+	add(ec::INVALID_FLOAT_LITERAL, ec::ErrorType::ERROR, location,
+		"Expected digits following the exponent marker",
+		{{"", location, 1, ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseHexLiteral(const SourceMeta& location) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec::INVALID_HEX_LITERAL,
-			 "Expected hexadecimal digits following the hex literal indicator");
-	printCodeSnippet(dest, ctx, location, 1, ec::ErrorType::ERROR);
+	add(ec::INVALID_HEX_LITERAL, ec::ErrorType::ERROR, location,
+		"Expected hexadecimal digits following the hex literal indicator",
+		{{"", location, 1, ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseOctalLiteral(const SourceMeta& location) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec::INVALID_OCTAL_LITERAL,
-			 "Expected octal digits following the octal literal indicator");
-	printCodeSnippet(dest, ctx, location, 1, ec::ErrorType::ERROR);
+	add(ec::INVALID_OCTAL_LITERAL, ec::ErrorType::ERROR, location,
+		"Expected octal digits following the octal literal indicator",
+		{{"", location, 1, ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseBinaryLiteral(const SourceMeta& location) {
-	log::error(dest, getLocationInfo(location));
-	diagnose(ec::INVALID_BINARY_LITERAL,
-			 "Expected binary digits following the binary literal indicator");
-	printCodeSnippet(dest, ctx, location, 1, ec::ErrorType::ERROR);
+	add(ec::INVALID_BINARY_LITERAL, ec::ErrorType::ERROR, location,
+		"Expected binary digits following the binary literal indicator",
+		{{"", location, 1, ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseSourceLock(const Token* token) {
-	log::warn(dest, getLocationInfo(token->meta));
-	diagnose(ec::NONFRONTED_SOURCE_LOCK,
-			 "Source lock tags should be placed at the top of the module");
-	printCodeSnippet(dest, ctx, token->meta, token->data.length() + 1,
-					 ec::ErrorType::WARNING);  // +1 for the initial '@'
+	// +1 for the initial '@'
+	add(ec::NONFRONTED_SOURCE_LOCK, ec::ErrorType::WARNING, token->meta,
+		"Source lock tags should be placed at the top of the module",
+		{{"", token->meta, static_cast<int>(token->data.length()) + 1,
+		  ec::ErrorType::WARNING}});
 }
 
 void Diagnoser::diagnoseInvalidToken(TokenType expected,
@@ -222,67 +427,58 @@ void Diagnoser::diagnoseInvalidToken(const String& expectedMessage,
 
 void Diagnoser::diagnoseInvalidTokenWithMessage(const String& message,
 												const Token* received) {
-	log::error(dest, getLocationInfo(received->meta));
-	diagnose(ec::INVALID_TOKEN, message);
-	printCodeSnippet(dest, ctx, received->meta, received->data.length(),
-					 ec::ErrorType::ERROR);
+	add(ec::INVALID_TOKEN, ec::ErrorType::ERROR, received->meta, message,
+		{{"", received->meta, static_cast<int>(received->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseInvalidModifier(const Token* token) {
-	log::error(dest, getLocationInfo(token->meta));
 	StringBuffer sb;
 	sb << token->data << " is not a modifier";
-	diagnose(ec::INVALID_MODIFIER, sb.str());
-	printCodeSnippet(dest, ctx, token->meta, token->data.length(),
-					 ec::ErrorType::ERROR);
+	add(ec::INVALID_MODIFIER, ec::ErrorType::ERROR, token->meta, sb.str(),
+		{{"", token->meta, static_cast<int>(token->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseDuplicateSymbol(Symbol* original, Symbol* duplicate) {
-	log::error(dest, getLocationInfo(duplicate->sourceMeta));
-	diagnose(ec::DUPLICATE_SYMBOL);
-	std::cout << "Original declaration:\n";
-	printCodeSnippet(dest, ctx, original->id->meta, original->id->data.length(),
-					 ec::ErrorType::INFO);
-	std::cout << "\nDuplicate declaration:\n";
-	printCodeSnippet(dest, ctx, duplicate->id->meta,
-					 duplicate->id->data.length(), ec::ErrorType::ERROR);
+	add(ec::DUPLICATE_SYMBOL, ec::ErrorType::ERROR, duplicate->sourceMeta, "",
+		{{"Original declaration:\n", original->id->meta,
+		  static_cast<int>(original->id->data.length()), ec::ErrorType::INFO},
+		 {"\nDuplicate declaration:\n", duplicate->id->meta,
+		  static_cast<int>(duplicate->id->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseDuplicateImport(Import* original, Import* duplicate) {
-	log::error(dest, getLocationInfo(duplicate->sourceMeta));
-	diagnose(ec::DUPLICATE_IMPORT);
-	std::cout << "Original declaration:\n";
-	printCodeSnippet(dest, ctx, original->id->meta, original->id->data.length(),
-					 ec::ErrorType::INFO);
-	std::cout << "\nDuplicate declaration:\n";
-	printCodeSnippet(dest, ctx, duplicate->id->meta,
-					 duplicate->id->data.length(), ec::ErrorType::ERROR);
+	add(ec::DUPLICATE_IMPORT, ec::ErrorType::ERROR, duplicate->sourceMeta, "",
+		{{"Original declaration:\n", original->id->meta,
+		  static_cast<int>(original->id->data.length()), ec::ErrorType::INFO},
+		 {"\nDuplicate declaration:\n", duplicate->id->meta,
+		  static_cast<int>(duplicate->id->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseSymbolNotVisible(const SourceMeta& refMeta,
 										 const Symbol* referent) {
-	log::error(dest, getLocationInfo(refMeta));
-	diagnose(ec::SYMBOL_NOT_VISIBLE);
-	printCodeSnippet(dest, ctx, refMeta, referent->id->data.length(),
-					 ec::ErrorType::ERROR);
+	add(ec::SYMBOL_NOT_VISIBLE, ec::ErrorType::ERROR, refMeta, "",
+		{{"", refMeta, static_cast<int>(referent->id->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 void Diagnoser::diagnoseStaticViaInstance(const SourceMeta& refMeta,
 										  const Symbol* referent) {
-	log::error(dest, getLocationInfo(refMeta));
-	diagnose(ec::STATIC_ACCESS_VIA_INSTANCE,
-			 "Static members should be accessed in a static way");
-	printCodeSnippet(dest, ctx, refMeta, referent->id->data.length(),
-					 ec::ErrorType::WARNING);
+	add(ec::STATIC_ACCESS_VIA_INSTANCE, ec::ErrorType::ERROR, refMeta,
+		"Static members should be accessed in a static way",
+		{{"", refMeta, static_cast<int>(referent->id->data.length()),
+		  ec::ErrorType::WARNING}});
 }
 
 void Diagnoser::diagnoseInstanceViaStatic(const SourceMeta& refMeta,
 										  const Symbol* referent) {
-	log::error(dest, getLocationInfo(refMeta));
-	diagnose(ec::INSTANCE_ACCESS_VIA_STATIC,
-			 "Instance members cannot be accessed in a static way");
-	printCodeSnippet(dest, ctx, refMeta, referent->id->data.length(),
-					 ec::ErrorType::ERROR);
+	add(ec::INSTANCE_ACCESS_VIA_STATIC, ec::ErrorType::ERROR, refMeta,
+		"Instance members cannot be accessed in a static way",
+		{{"", refMeta, static_cast<int>(referent->id->data.length()),
+		  ec::ErrorType::ERROR}});
 }
 
 AcceleException::AcceleException(ec::ErrorCode ec, const SourceMeta& sourceMeta,
@@ -326,22 +522,13 @@ using namespace acl;
 
 String getLocationInfo(const SourceMeta& location) {
 	StringBuffer sb;
-	sb << "In module \"" << location.moduleInfo->name << "\" at "
-	   << location.line << ":" << location.col << " ("
-	   << location.moduleInfo->path << ")";
+	sb << "In module \"" << location.getModuleInfo()->name << "\" at "
+	   << location.getLine() << ":" << location.getCol() << " ("
+	   << location.getModuleInfo()->path << ")";
 	String str = sb.str();
 	return str;
 }
 
-const Module* getModule(const CompilerContext& ctx,
-						const ModuleInfo* moduleInfo) {
-	for (const auto& m : ctx.modules) {
-		if (&m->moduleInfo == moduleInfo) return m;
-	}
-
-	return nullptr;
-}
-
 String getTextColorForErrorType(ec::ErrorType type) {
 	if (type == ec::ErrorType::INFO) return "\u001b[36m";
 	if (type == ec::ErrorType::WARNING) return "\u001b[33m";
@@ -349,44 +536,44 @@ String getTextColorForErrorType(ec::ErrorType type) {
 	return "\u001b[0m";
 }
 
-void printCodeSnippet(std::ostream& dest, const CompilerContext& ctx,
-					  const SourceMeta& begin, int highlightLength,
+void printCodeSnippet(std::ostream& dest, const Module* m,
+					  const SourceMeta& highlightBegin, int highlightLength,
 					  ec::ErrorType highlightType) {
 	auto highlightColor = getTextColorForErrorType(highlightType);
+	int line = highlightBegin.getLine();
+	int col = highlightBegin.getCol();
 
-	auto m = getModule(ctx, begin.moduleInfo);
-
-	if (!m) return;
+	// Modules loaded from definition files have no source
+	if (!m || line < 1 || (std::size_t)line > m->source.size()) return;
 
 	int maxNumberLength = 0;
 	{
 		StringBuffer sb;
-		sb << begin.line + 1;
+		sb << line + 1;
 		String str = sb.str();
 		maxNumberLength = str.length();
 	}
 
 	// print line above (if available)
-	if (begin.line > 1) {
-		dest << std::setfill('0') << std::setw(maxNumberLength)
-			 << begin.line - 1 << " | ";
-		dest << m->source[begin.line - 2]
+	if (line > 1) {
+		dest << std::setfill('0') << std::setw(maxNumberLength) << line - 1
+			 << " | ";
+		dest << m->source[line - 2]
 			 << "\n";  // 1 for line before and then 1 more for the index
 					   // of the line
 	}
 
 	// print problem line
-	dest << std::setfill('0') << std::setw(maxNumberLength) << begin.line
-		 << " | ";
-	dest << m->source[begin.line - 1] << "\n";
+	dest << std::setfill('0') << std::setw(maxNumberLength) << line << " | ";
+	dest << m->source[line - 1] << "\n";
 
 	// print highlight
 	for (int i = 0; i < maxNumberLength; i++)
 		dest << " ";  // Account for line number
 	dest << " | ";
-	for (std::size_t i = 1; i <= m->source[begin.line - 1].length(); i++) {
-		if (i >= (std::size_t)begin.col &&
-			i <= (std::size_t)(begin.col + highlightLength - 1)) {
+	for (std::size_t i = 1; i <= m->source[line - 1].length(); i++) {
+		if (i >= (std::size_t)col &&
+			i <= (std::size_t)(col + highlightLength - 1)) {
 			dest << highlightColor << "^\u001b[0m";
 		} else
 			dest << " ";
@@ -394,10 +581,93 @@ void printCodeSnippet(std::ostream& dest, const CompilerContext& ctx,
 	dest << "\n";
 
 	// print line below
-	if ((std::size_t)begin.line < m->source.size()) {
-		dest << std::setfill('0') << std::setw(maxNumberLength)
-			 << begin.line + 1 << " | ";
-		dest << m->source[begin.line] << "\n";
+	if ((std::size_t)line < m->source.size()) {
+		dest << std::setfill('0') << std::setw(maxNumberLength) << line + 1
+			 << " | ";
+		dest << m->source[line] << "\n";
+	}
+}
+
+int compareLocations(const SourceMeta& a, const SourceMeta& b) {
+	if (a == b) return 0;
+
+	auto aInfo = a.getModuleInfo();
+	auto bInfo = b.getModuleInfo();
+	if (aInfo != bInfo) {
+		if (!aInfo || !bInfo) return aInfo ? 1 : -1;
+		if (int c = aInfo->path.compare(bInfo->path)) return c;
 	}
+
+	// Positions are in the same order as lines and columns, but are found
+	// without looking up the lines of the module
+	auto aPos = a.getPos();
+	auto bPos = b.getPos();
+	if (aPos != bPos) return aPos < bPos ? -1 : 1;
+	return 0;
 }
-}  // namespace
\ No newline at end of file
+
+int compareDiagnostics(const Diagnostic& a, const Diagnostic& b) {
+	if (int c = compareLocations(a.location, b.location)) return c;
+	if (a.ec != b.ec) return a.ec < b.ec ? -1 : 1;
+	if (a.severity != b.severity) return a.severity < b.severity ? -1 : 1;
+	if (int c = a.message.compare(b.message)) return c;
+	if (a.snippets.size() != b.snippets.size())
+		return a.snippets.size() < b.snippets.size() ? -1 : 1;
+
+	for (std::size_t i = 0; i < a.snippets.size(); i++) {
+		const auto& sa = a.snippets[i];
+		const auto& sb = b.snippets[i];
+		if (int c = compareLocations(sa.location, sb.location)) return c;
+		if (sa.highlightLength != sb.highlightLength)
+			return sa.highlightLength < sb.highlightLength ? -1 : 1;
+		if (sa.highlightType != sb.highlightType)
+			return sa.highlightType < sb.highlightType ? -1 : 1;
+		if (int c = sa.caption.compare(sb.caption)) return c;
+	}
+	return 0;
+}
+
+bool sameLocation(const SourceMeta& a, const SourceMeta& b) {
+	return compareLocations(a, b) == 0;
+}
+
+int getHighlightLength(const Diagnostic& d) {
+	for (const auto& s : d.snippets)
+		if (sameLocation(s.location, d.location)) return s.highlightLength;
+	return 1;
+}
+
+String getRuleId(ec::ErrorCode ec) {
+	StringBuffer sb;
+	sb << "ACL" << std::setfill('0') << std::setw(4) << ec;
+	return sb.str();
+}
+
+const char* getSarifLevel(ec::ErrorType severity) {
+	if (severity == ec::ErrorType::INFO) return "\"note\"";
+	if (severity == ec::ErrorType::WARNING) return "\"warning\"";
+	return "\"error\"";
+}
+
+void appendSarifLocation(StringBuffer& dest, const SourceMeta& location,
+						 int highlightLength, const String& caption) {
+	dest << "{\"physicalLocation\": {\"artifactLocation\": {\"uri\": ";
+	auto path = std::filesystem::path(location.getModuleInfo()->path);
+	json::appendString(dest, path.generic_string());
+	auto col = location.getCol();
+	dest << "}, \"region\": {\"startLine\": " << location.getLine()
+		 << ", \"startColumn\": " << col
+		 << ", \"endColumn\": " << col + std::max(highlightLength, 1)
+		 << "}}";
+
+	// Captions end with a colon and may be surrounded by blank lines
+	auto begin = caption.find_first_not_of('\n');
+	auto end = caption.find_last_not_of(":\n");
+	if (begin != String::npos && end != String::npos && end >= begin) {
+		dest << ", \"message\": {\"text\": ";
+		json::appendString(dest, caption.substr(begin, end - begin + 1));
+		dest << "}";
+	}
+	dest << "}";
+}
+}  // namespace
@@ -2,6 +2,7 @@
 
 #include <exception>
 #include <iostream>
+#include <mutex>
 
 #include "common.hpp"
 
@@ -71,15 +72,101 @@ enum class TokenType;
 struct Symbol;
 struct Import;
 
+// A piece of source code shown by a diagnostic, introduced by the caption (if
+// there is one)
+struct DiagnosticSnippet {
+	String caption;
+	SourceMeta location;
+	int highlightLength;
+	ec::ErrorType highlightType;
+};
+
+struct Diagnostic {
+	ec::ErrorCode ec;
+
+	// How the diagnostic is introduced, which isn't always the type of its
+	// error code
+	ec::ErrorType severity;
+
+	// The location has no module info if the diagnostic isn't about a
+	// particular location, in which case only the message is shown
+	SourceMeta location;
+	String message;
+	List<DiagnosticSnippet> snippets;
+};
+
+enum class DiagnosticFormat { TEXT, SARIF };
+
+/*
+Collects the diagnostics of a compilation so that they can be shown once it is
+done, sorted by module and position no matter which thread found them first.
+Diagnosers hand their diagnostics over in batches (see Diagnoser), so adding
+them only takes the lock once per batch.
+
+Identical diagnostics (which come up when several resolvers look at the same
+symbol) are only shown once, and at most "limit" diagnostics are shown if the
+limit isn't 0.
+*/
+class DiagnosticSink {
+	List<Diagnostic> diagnostics;
+	std::ostream& dest;
+	DiagnosticFormat format;
+	std::size_t limit;
+	String toolVersion;
+	std::mutex mutex;
+
+	void renderText(const CompilerContext& ctx,
+					const List<const Diagnostic*>& shown,
+					std::size_t omitted) const;
+	void renderSarif(const List<const Diagnostic*>& shown) const;
+
+   public:
+	DiagnosticSink(std::ostream& dest, DiagnosticFormat format,
+				   std::size_t limit, const String& toolVersion);
+
+	void add(List<Diagnostic>&& batch);
+
+	// True if any of the diagnostics added so far is located in the module
+	// with the specified path or isn't located anywhere
+	bool hasDiagnostics(const String& modulePath);
+
+	// Writes the diagnostics that were added so far and forgets them. The
+	// modules they refer to must still be part of the compiler context.
+	void render(const CompilerContext& ctx);
+};
+
+/*
+Records diagnostics into a list, which is the diagnoser's own unless it is
+pointed somewhere else. Its own diagnostics are handed to the diagnostic sink
+of the compiler context when it is flushed or destroyed. A diagnoser never
+shows anything itself, since it may run on any thread. A copy of a diagnoser
+starts out with none of the diagnostics of the original.
+*/
 class Diagnoser {
    public:
 	const CompilerContext& ctx;
 
    private:
-	std::ostream& dest;
+	List<Diagnostic> buffer;
+	List<Diagnostic>* dest;
+
+	void add(ec::ErrorCode ec, ec::ErrorType severity,
+			 const SourceMeta& location, const String& message,
+			 const List<DiagnosticSnippet>& snippets);
 
    public:
-	Diagnoser(const CompilerContext& ctx, std::ostream& dest);
+	Diagnoser(const CompilerContext& ctx);
+	Diagnoser(const CompilerContext& ctx, List<Diagnostic>& dest);
+	Diagnoser(const Diagnoser& other);
+	Diagnoser& operator=(const Diagnoser&) = delete;
+	~Diagnoser();
+
+	List<Diagnostic>& getDest();
+
+	// Points the diagnoser back at its own list if "dest" is nullptr
+	void setDest(List<Diagnostic>* dest);
+
+	void flush();
 	void diagnose(ec::ErrorCode ec, const String& message);
 	void diagnose(ec::ErrorCode ec);
 	void diagnose(ec::ErrorCode ec, const SourceMeta& location,
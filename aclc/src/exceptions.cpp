@@ -19,17 +19,17 @@ void AclException::updateMessage(const String& protocol, const SourceMeta& meta,
 								 const String& message) {
 	StringBuffer sb;
 	sb << "The following violates ASP " << protocol << ":\n";
-	if (meta.moduleInfo) {
+	if (meta.isValid()) {
 		sb << "In module ";
-		sb << meta.moduleInfo->name << " at " << meta.line << ":" << meta.col
-		   << ": ";
+		sb << meta.getModuleInfo()->name << " at " << meta.getLine() << ":"
+		   << meta.getCol() << ": ";
 	}
 	sb << message;
 	this->message = sb.str();
 }
 
 LexerException::LexerException()
-	: AclException(ASP_CORE_UNKNOWN, SourceMeta{nullptr, -1, -1, -1},
+	: AclException(ASP_CORE_UNKNOWN, SourceMeta(),
 				   "Lexer exception") {}
 
 LexerException::LexerException(const SourceMeta& meta, const String& message)
@@ -63,7 +63,7 @@ TokenMismatchException::~TokenMismatchException() {}
 UnresolvedImportException::UnresolvedImportException(const String& protocol,
 													 const SourceMeta& meta,
 													 const String& message)
-	: AclException(protocol, meta, message) {}
+	: AclException(protocol, meta, message), meta(meta), reason(message) {}
 
 UnresolvedImportException::~UnresolvedImportException() {}
 
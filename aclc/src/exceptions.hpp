@@ -73,6 +73,10 @@ class TokenMismatchException : public ParserException {
 
 class UnresolvedImportException : public AclException {
    public:
+	// The import that couldn't be resolved and why
+	SourceMeta meta;
+	String reason;
+
 	UnresolvedImportException(const String& protocol, const SourceMeta& meta,
 							  const String& message);
 	virtual ~UnresolvedImportException();
@@ -0,0 +1,236 @@
+#include "file_index.hpp"
+
+#include <fstream>
+
+namespace {
+using namespace acl;
+
+const char MANIFEST_HEADER[] = "ACLINDEX 1";
+const char MANIFEST_FILE = 'f';
+const char MANIFEST_DIRECTORY = 'd';
+
+// Symbolic links to directories are followed when writing a manifest, so the
+// depth is limited in case they form a cycle
+const int MAX_MANIFEST_DEPTH = 64;
+
+// The absolute path without any "." or ".." components or trailing separators
+String getKey(const std::filesystem::path& path) {
+	std::error_code ec;
+	auto p = std::filesystem::absolute(path, ec);
+	if (ec) p = path;
+	p = p.lexically_normal();
+	if (!p.has_filename() && p.has_relative_path()) p = p.parent_path();
+	return p.string();
+}
+
+bool isWithin(const String& path, const String& dir) {
+	return path.compare(0, dir.length(), dir) == 0 &&
+		   (path.length() == dir.length() ||
+			path[dir.length()] == std::filesystem::path::preferred_separator);
+}
+}  // namespace
+
+namespace acl {
+const char* const FileIndex::MANIFEST_NAME = ".aclindex";
+
+FileIndex::FileIndex(const String& compilerVersion)
+	: compilerVersion(compilerVersion) {}
+
+FileIndex::EntryType FileIndex::getType(const std::filesystem::path& path) {
+	std::filesystem::path p = getKey(path);
+
+	// The root of the file system isn't part of any listing
+	if (!p.has_relative_path()) {
+		std::error_code ec;
+		auto status = std::filesystem::status(p, ec);
+		if (std::filesystem::is_directory(status)) return EntryType::DIRECTORY;
+		return std::filesystem::exists(status) ? EntryType::FILE
+											   : EntryType::NONE;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const auto& listing = getListing(p.parent_path().string());
+	auto it = listing.find(p.filename().string());
+	return it == listing.end() ? EntryType::NONE : it->second;
+}
+
+const FileIndex::Listing& FileIndex::getListing(const String& dir) {
+	auto it = listings.find(dir);
+	if (it != listings.end()) return it->second;
+
+	// Every directory of an indexed tree was added along with the tree, so
+	// this one doesn't exist
+	if (isIndexed(dir)) return listings[dir];
+
+	std::error_code ec;
+	std::filesystem::directory_iterator i(dir, ec);
+	if (ec) {
+		// The directory may be part of an archive further up, which is opened
+		// once the parent is listed. Otherwise, a directory that can't be
+		// listed is treated like one that doesn't exist.
+		auto parent = std::filesystem::path(dir).parent_path().string();
+		if (parent != dir) getListing(parent);
+		return listings[dir];
+	}
+
+	Listing listing;
+	std::filesystem::directory_iterator end;
+	for (; !ec && i != end; i.increment(ec)) {
+		std::error_code typeEc;
+		if (i->is_directory(typeEc))
+			listing[i->path().filename().string()] = EntryType::DIRECTORY;
+		else if (i->exists(typeEc))
+			listing[i->path().filename().string()] = EntryType::FILE;
+	}
+
+	auto& result = listings[dir] = std::move(listing);
+	openArchives(dir, result);
+	return result;
+}
+
+void FileIndex::openArchives(const String& dir, Listing& listing) {
+	List<String> names;
+	for (const auto& e : listing) {
+		std::filesystem::path name = e.first;
+		if (e.second == EntryType::FILE &&
+			name.extension() == ModuleArchive::EXTENSION &&
+			listing.find(name.stem().string()) == listing.end())
+			names.push_back(e.first);
+	}
+
+	for (const auto& name : names) {
+		auto path = std::filesystem::path(dir) / name;
+		auto archive = ModuleArchive::open(path, compilerVersion);
+		if (!archive) continue;
+
+		auto root = getKey(path.parent_path() / path.stem());
+		listing[path.stem().string()] = EntryType::DIRECTORY;
+		archives.emplace_back(archive);
+		archivesByRoot[root] = archive;
+		indexedRoots.push_back(root);
+
+		// The directories in the archive are implied by the paths of its
+		// files
+		listings[root];
+		for (const auto& e : archive->getEntries()) {
+			std::filesystem::path p =
+				getKey(std::filesystem::path(root) / e.first);
+			auto type = EntryType::FILE;
+			while (isWithin(p.parent_path().string(), root)) {
+				auto& parent = listings[p.parent_path().string()];
+				if (parent.find(p.filename().string()) != parent.end()) break;
+				parent[p.filename().string()] = type;
+				type = EntryType::DIRECTORY;
+				p = p.parent_path();
+			}
+		}
+	}
+}
+
+bool FileIndex::isIndexed(const String& dir) const {
+	for (const auto& root : indexedRoots)
+		if (isWithin(dir, root)) return true;
+	return false;
+}
+
+bool FileIndex::loadManifest(const std::filesystem::path& root) {
+	auto rootKey = getKey(root);
+	std::ifstream ifs(std::filesystem::path(rootKey) / MANIFEST_NAME);
+	if (!ifs) return false;
+
+	String line;
+	if (!std::getline(ifs, line) || line != MANIFEST_HEADER) return false;
+
+	Map<String, Listing> loaded;
+	loaded[rootKey];
+	while (std::getline(ifs, line)) {
+		if (line.length() < 3 || line[1] != ' ' ||
+			(line[0] != MANIFEST_FILE && line[0] != MANIFEST_DIRECTORY))
+			return false;
+
+		std::filesystem::path p =
+			getKey(std::filesystem::path(rootKey) / line.substr(2));
+		auto parent = p.parent_path().string();
+		if (!isWithin(parent, rootKey)) return false;
+
+		if (line[0] == MANIFEST_DIRECTORY) {
+			loaded[parent][p.filename().string()] = EntryType::DIRECTORY;
+			loaded[p.string()];
+		} else {
+			loaded[parent][p.filename().string()] = EntryType::FILE;
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (auto& l : loaded) listings[l.first] = std::move(l.second);
+	indexedRoots.push_back(rootKey);
+	for (auto& l : loaded) openArchives(l.first, listings[l.first]);
+	return true;
+}
+
+bool FileIndex::isFile(const std::filesystem::path& path) {
+	return getType(path) == EntryType::FILE;
+}
+
+bool FileIndex::isDirectory(const std::filesystem::path& path) {
+	return getType(path) == EntryType::DIRECTORY;
+}
+
+const ArchiveEntry* FileIndex::findArchived(
+	const std::filesystem::path& path) {
+	auto key = getKey(path);
+
+	std::lock_guard<std::mutex> lock(mutex);
+	for (const auto& a : archivesByRoot) {
+		if (key.length() <= a.first.length() || !isWithin(key, a.first))
+			continue;
+		std::filesystem::path name = key.substr(a.first.length() + 1);
+		return a.second->find(name.generic_string());
+	}
+	return nullptr;
+}
+
+bool FileIndex::writeManifest(const std::filesystem::path& root) {
+	String content = MANIFEST_HEADER;
+	content.push_back('\n');
+
+	std::error_code ec;
+	std::filesystem::recursive_directory_iterator end;
+	std::filesystem::recursive_directory_iterator i(
+		root, std::filesystem::directory_options::follow_directory_symlink, ec);
+	for (; !ec && i != end; i.increment(ec)) {
+		auto relative = i->path().lexically_relative(root).generic_string();
+		if (relative == MANIFEST_NAME ||
+			relative.find('\n') != String::npos)
+			continue;
+
+		std::error_code typeEc;
+		if (i->is_directory(typeEc)) {
+			content.push_back(MANIFEST_DIRECTORY);
+			if (i.depth() >= MAX_MANIFEST_DEPTH) i.disable_recursion_pending();
+		} else if (i->exists(typeEc)) {
+			content.push_back(MANIFEST_FILE);
+		} else {
+			continue;
+		}
+
+		content.push_back(' ');
+		content.append(relative);
+		content.push_back('\n');
+	}
+	if (ec) return false;
+
+	// The manifest is replaced in one step so that a compiler reading it never
+	// sees half of it
+	auto path = root / MANIFEST_NAME;
+	auto tempPath = root / (String(MANIFEST_NAME) + ".tmp");
+	{
+		std::ofstream ofs(tempPath);
+		if (!(ofs << content)) return false;
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) std::filesystem::remove(tempPath, ec);
+	return !ec;
+}
+}  // namespace acl
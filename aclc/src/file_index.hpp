@@ -0,0 +1,80 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+
+#include "common.hpp"
+#include "module_archive.hpp"
+
+namespace acl {
+/*
+A record of which files exist in the directories that imports are looked up in,
+so that locating an import doesn't have to ask the file system about every
+candidate path. A directory is listed the first time a path in it is looked up,
+and every later lookup in it (including one for a file that doesn't exist) is
+answered from that listing. The index is meant to last for one compilation:
+files that are created or removed after their directory was listed go
+unnoticed.
+
+A directory tree can also come with a prebuilt manifest at its root (see
+writeManifest()) which lists everything in the tree, in which case none of its
+directories are listed at all. This is meant for the global import directory,
+whose packages only change when they are installed. The manifest has to be
+written again whenever they do, since anything it doesn't list is treated as
+missing.
+
+A module archive (see ModuleArchive) found in a listing is opened right away and
+stands in for the directory of the same name, unless there is such a directory.
+Modules in an archive are read through findArchived() rather than from the file
+system.
+*/
+class FileIndex {
+	enum class EntryType { NONE, FILE, DIRECTORY };
+
+	// The entries of a directory by name
+	using Listing = Map<String, EntryType>;
+
+	// The listings by absolute path, including those of directories that don't
+	// exist, which are empty
+	Map<String, Listing> listings;
+
+	// The roots of the trees whose listings are all known, which are those
+	// with a manifest and those in archives
+	List<String> indexedRoots;
+
+	List<std::unique_ptr<ModuleArchive>> archives;
+	Map<String, ModuleArchive*> archivesByRoot;
+	String compilerVersion;
+	std::mutex mutex;
+
+	EntryType getType(const std::filesystem::path& path);
+	const Listing& getListing(const String& dir);
+	void openArchives(const String& dir, Listing& listing);
+	bool isIndexed(const String& dir) const;
+
+   public:
+	static const char* const MANIFEST_NAME;
+
+	// The compiler version decides whether the interfaces in archives can be
+	// used
+	FileIndex(const String& compilerVersion);
+
+	// Takes the listings of the tree from the manifest at its root. Returns
+	// false (in which case the tree is listed like any other directory) if
+	// there is no manifest or it is invalid.
+	bool loadManifest(const std::filesystem::path& root);
+
+	bool isFile(const std::filesystem::path& path);
+	bool isDirectory(const std::filesystem::path& path);
+
+	// Returns nullptr if the file isn't in an archive. The entry is valid for
+	// as long as the index is.
+	const ArchiveEntry* findArchived(const std::filesystem::path& path);
+
+	// Writes a manifest of the files and directories below "root" to its root.
+	// Returns false if the tree can't be listed or the manifest can't be
+	// written.
+	static bool writeManifest(const std::filesystem::path& root);
+};
+}  // namespace acl
@@ -1,9 +1,9 @@
 #include "import_handler.hpp"
 
-#include <fstream>
-
 #include "exceptions.hpp"
-#include "parser.hpp"
+#include "file_index.hpp"
+#include "module_loader.hpp"
+#include "profiler.hpp"
 #include "resolver.hpp"
 
 namespace acl {
@@ -11,6 +11,7 @@ ImportHandler::ImportHandler(CompilerContext& ctx, Module* mod)
 	: ctx(ctx), mod(mod) {}
 
 void ImportHandler::resolveImports() {
+	Profiler::Span span(ctx.profiler, Phase::IMPORTS, mod->moduleInfo.path);
 	for (auto& i : mod->ast->globalScope->imports) {
 		resolveImport(i);
 	}
@@ -28,31 +29,29 @@ void ImportHandler::resolveImport(Import* i) {
 
 	i->referent = ast;
 
+	auto target = ctx.findModule(ast->globalScope->sourceMeta.getModuleInfo());
+	if (target) mod->addDependency(target->moduleInfo.path, "");
+
+	auto exports = getExportTable(ast);
+	std::unordered_set<Symbol*> imported;
 	for (auto& t : i->targets) {
-		resolveImportTarget(ast, t, i->targets);
+		resolveImportTarget(exports, t, imported);
+		if (target) mod->addDependency(target->moduleInfo.path, t->id->data);
 	}
 }
 
-void ImportHandler::resolveImportTarget(Ast* searchTarget, ImportTarget* target,
-										const List<ImportTarget*>& allTargets) {
-	for (auto& s : searchTarget->globalScope->symbols) {
-		if (target->id->data == s->id->data) {
-			const Token* destToken = nullptr;
-			if (getSymbolVisibility(mod->ast->globalScope, s, false,
-									&destToken) == TokenType::INTERNAL)
-				throw UnresolvedSymbolException(target->id);
-			for (auto& t : allTargets) {
-				for (auto& r : t->referents)
-					if (r == s)
-						throw AclException(ASP_CORE_UNKNOWN, target->sourceMeta,
-										   "Duplicate symbol import");
-			}
-
-			target->referents.push_back(s);
-		}
+void ImportHandler::resolveImportTarget(const ExportTable* exports,
+										ImportTarget* target,
+										std::unordered_set<Symbol*>& imported) {
+	auto entry = exports->find(target->id->data);
+	if (!entry || entry->internal) throw UnresolvedSymbolException(target->id);
+
+	for (auto& s : entry->symbols) {
+		if (!imported.insert(s).second)
+			throw AclException(ASP_CORE_UNKNOWN, target->sourceMeta,
+							   "Duplicate symbol import");
+		target->referents.push_back(s);
 	}
-
-	if (target->referents.empty()) throw UnresolvedSymbolException(target->id);
 }
 
 void ImportHandler::getPossibleBaseDirs(bool declaredRelative,
@@ -77,9 +76,12 @@ std::filesystem::path resolveImportSourceParent(
 	return p / parent->content->data;
 }
 
-Ast* ImportHandler::resolveImportSource(ImportSource* src) {
-	if (src->content->type == TokenType::STRING_LITERAL)
-		return resolveImportSourcePath(src->content->data, src->sourceMeta);
+std::filesystem::path ImportHandler::locateImportSource(ImportSource* src) {
+	if (src->content->type == TokenType::STRING_LITERAL) {
+		std::filesystem::path path = src->content->data;
+		if (isImportableFile(path)) return path;
+		return {};
+	}
 
 	List<std::filesystem::path> possibleBaseDirs;
 	getPossibleBaseDirs(src->declaredRelative, possibleBaseDirs);
@@ -89,97 +91,71 @@ Ast* ImportHandler::resolveImportSource(ImportSource* src) {
 			dir = resolveImportSourceParent(src->parent, dir);
 		}
 
-		try {
-			return resolveImportSourcePath(
-				dir / (src->content->data + ".accele"), src->sourceMeta);
-		} catch (UnresolvedImportException& e) {
-			try {
-				return resolveImportSourcePath(
-					dir / (src->content->data + ".acldef"), src->sourceMeta);
-			} catch (UnresolvedImportException& e2) {
-			}
-		}
+		auto path = dir / (src->content->data + ".accele");
+		if (isImportableFile(path)) return path;
+		path = dir / (src->content->data + ".acldef");
+		if (isImportableFile(path)) return path;
 	}
 
-	throw UnresolvedImportException(ASP_CORE_UNKNOWN, src->sourceMeta,
-									"Unresolved import");
+	return {};
+}
+
+Ast* ImportHandler::resolveImportSource(ImportSource* src) {
+	if (src->content->type == TokenType::STRING_LITERAL)
+		return resolveImportSourcePath(src->content->data, src->sourceMeta);
+
+	auto path = locateImportSource(src);
+	if (path.empty())
+		throw UnresolvedImportException(ASP_CORE_UNKNOWN, src->sourceMeta,
+										"The module can't be found");
+
+	return findImportSourcePath(path, src->sourceMeta);
 }
 
 Ast* ImportHandler::resolveImportSourcePath(const std::filesystem::path& path,
 											const SourceMeta& meta) {
-	if (!std::filesystem::exists(path))
+	if (!isImportableFile(path)) {
+		auto isDirectory = ctx.fileIndex ? ctx.fileIndex->isDirectory(path)
+										 : std::filesystem::is_directory(path);
+		if (isDirectory)
+			throw UnresolvedImportException(
+				ASP_CORE_UNKNOWN, meta, "The specified module is not a file");
 		throw UnresolvedImportException(ASP_CORE_UNKNOWN, meta,
 										"The specified module does not exist");
-	if (std::filesystem::is_directory(path))
-		throw UnresolvedImportException(ASP_CORE_UNKNOWN, meta,
-										"The specified module is not a file");
-
-	for (const auto& m : ctx.modules) {
-		if (m->moduleInfo.path == path) return m->ast;
 	}
 
-	return compileImport(path, meta);
+	return findImportSourcePath(path, meta);
 }
 
-static acl::String getModuleDir(const std::filesystem::path& path) {
-	return path.parent_path();
-}
+bool ImportHandler::isImportableFile(const std::filesystem::path& path) {
+	if (ctx.fileIndex) return ctx.fileIndex->isFile(path);
 
-static acl::String getModuleName(const std::filesystem::path& path) {
-	return path.stem();
+	std::error_code ec;
+	auto status = std::filesystem::status(path, ec);
+	return std::filesystem::exists(status) &&
+		   !std::filesystem::is_directory(status);
 }
 
-static acl::ModuleInfo getModuleInfo(const std::filesystem::path& path) {
-	auto p = std::filesystem::absolute(path);
-	return {getModuleDir(p), p, getModuleName(p)};
+Ast* ImportHandler::findImportSourcePath(const std::filesystem::path& path,
+										 const SourceMeta& meta) {
+	if (!isImportableFile(path)) return nullptr;
+
+	auto m = ctx.findModule(std::filesystem::absolute(path));
+	if (m) ctx.waitUntilLoaded(m);
+	auto ast = m ? m->ast : compileImport(path, meta);
+
+	// The reasons why the module couldn't be loaded have already been reported
+	if (!ast) throw AcceleException();
+	return ast;
 }
 
 Ast* ImportHandler::compileImport(const std::filesystem::path& path,
 								  const SourceMeta& meta) {
-	std::ifstream ifs(path);
-
-	if (ifs) {
-		acl::StringBuffer sb;
-		sb << ifs.rdbuf();
-		ifs.close();
-
-		acl::String str = sb.str();
-
-		acl::StringBuffer lexerBuf;
-		lexerBuf << str;
-
-		// TODO: A .accele file and a .acldef file should be parsed and resolved
-		// differently. Also, .acldef files cannot be translated to C++ source
-		// or OBJ files. They can only be used to reference a library.
-
-		auto moduleInfo = getModuleInfo(path);
-
-		acl::StringBuffer linesBuf;
-		linesBuf << str;
-
-		acl::List<acl::String> lines;
-		while (linesBuf) {
-			acl::String line;
-			std::getline(linesBuf, line);
-			lines.push_back(line);
-		}
-
-		auto m = new acl::Module{moduleInfo, nullptr, lines};
-
-		ctx.modules.push_back(m);
-
-		acl::Parser parser =
-			acl::Parser(ctx, acl::Lexer(ctx, m->moduleInfo, lexerBuf));
-		auto ast = parser.parse();
-
-		m->ast = ast;
-
-		Resolver resolver = Resolver(ctx, m, ResolutionStage::INTERNAL_ALL);
-		resolver.resolve();
-
-		return ast;
-	} else
+	auto m = loadImportedModule(ctx, path);
+	if (!m)
 		throw UnresolvedImportException(ASP_CORE_UNKNOWN, meta,
-										"Unresolved import");
+										"The module can't be loaded");
+
+	return m->ast;
 }
-}  // namespace acl
\ No newline at end of file
+}  // namespace acl
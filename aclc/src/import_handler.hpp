@@ -1,6 +1,7 @@
 #pragma once
 
 #include <filesystem>
+#include <unordered_set>
 
 #include "ast.hpp"
 #include "common.hpp"
@@ -14,15 +15,23 @@ class ImportHandler {
 	Ast* resolveImportSource(ImportSource* src);
 	Ast* resolveImportSourcePath(const std::filesystem::path& path,
 								 const SourceMeta& meta);
+	bool isImportableFile(const std::filesystem::path& path);
+	// Returns nullptr if the path does not refer to a file
+	Ast* findImportSourcePath(const std::filesystem::path& path,
+							  const SourceMeta& meta);
 	Ast* compileImport(const std::filesystem::path& path,
 					   const SourceMeta& meta);
 	void getPossibleBaseDirs(bool declaredRelative,
 							 List<std::filesystem::path>& dest);
-	void resolveImportTarget(Ast* searchTarget, ImportTarget* target,
-							 const List<ImportTarget*>& allTargets);
+	void resolveImportTarget(const ExportTable* exports, ImportTarget* target,
+							 std::unordered_set<Symbol*>& imported);
 
    public:
 	ImportHandler(CompilerContext& ctx, Module* mod);
 	void resolveImports();
+
+	// Returns the path of the module the import source refers to without
+	// loading it, or an empty path if no such module can be found
+	std::filesystem::path locateImportSource(ImportSource* src);
 };
 }  // namespace acl
\ No newline at end of file
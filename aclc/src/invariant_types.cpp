@@ -1,13 +1,14 @@
 #include "invariant_types.hpp"
 
 #include "diagnoser.hpp"
+#include "json_util.hpp"
 #include "type_builder.hpp"
 
 namespace acl {
 namespace bt {
 InvariantType::InvariantType(const String& id,
 							 std::initializer_list<TypeRef*> parentTypes)
-	: Type(new Token(TokenType::ID, id, {nullptr, -1, -1}), {}),
+	: Type(new Token(TokenType::ID, id, SourceMeta()), {}),
 	  Scope(nullptr) {
 	this->parentTypes.insert(this->parentTypes.end(), parentTypes.begin(),
 							 parentTypes.end());
@@ -15,106 +16,105 @@ InvariantType::InvariantType(const String& id,
 
 InvariantType::InvariantType(const String& id,
 							 std::initializer_list<GenericType*> generics)
-	: Type(new Token(TokenType::ID, id, {nullptr, -1, -1}), generics),
+	: Type(new Token(TokenType::ID, id, SourceMeta()), generics),
 	  Scope(nullptr) {}
 
 InvariantType::~InvariantType() {
 	for (auto& t : parentTypes) {
-		delete t;
+		tb::release(t);
 	}
 }
 
-void InvariantType::toJson(StringBuffer& dest) const {
-	dest << "{\n\"name\": \"InvariantType\",\n\"id\": \"" << this->id->data
-		 << "\"\n}";
+void InvariantType::toJson(json::Writer& dest) const {
+	dest.beginNode("InvariantType", sourceMeta);
+	dest.field("id", this->id->data);
+	dest.endNode();
 }
 
 static InvariantType T_ANY =
 	InvariantType("Any", std::initializer_list<TypeRef*>{});
 static InvariantType T_NUMBER = InvariantType(
 	"Number",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_INT = InvariantType(
 	"Int",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_INT8 = InvariantType(
 	"Int8",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_INT16 = InvariantType(
 	"Int16",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_INT32 = InvariantType(
 	"Int32",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_INT64 = InvariantType(
 	"Int64",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_UINT = InvariantType(
 	"UInt",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_UINT8 = InvariantType(
 	"UInt8",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_UINT16 = InvariantType(
 	"UInt16",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_UINT32 = InvariantType(
 	"UInt32",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_UINT64 = InvariantType(
 	"UInt64",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_FLOAT = InvariantType(
 	"Float",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_DOUBLE = InvariantType(
 	"Double",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_FLOAT80 = InvariantType(
 	"Float80",
-	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {}, T_NUMBER.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_NUMBER), {})});
 static InvariantType T_BOOL = InvariantType(
 	"Bool",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_STRING = InvariantType(
 	"String",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_VOID = InvariantType(
 	"Void",
 	std::initializer_list<TypeRef*>{});	 // TODO: Not sure whether this needs to
 										 // have a parent type of "Any"...
 static InvariantType T_ARRAY = InvariantType(
 	"Array",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_MAP = InvariantType(
 	"Map",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_TUPLE = InvariantType(
 	"Tuple",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_FUNCTION = InvariantType(
 	"Function",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_OPTIONAL = InvariantType(
 	"Optional",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_UNWRAPPED_OPTIONAL = InvariantType(
 	"UnwrappedOptional",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_POINTER = InvariantType(
 	"Pointer",
-	{tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta)});
+	{tb::base(const_cast<InvariantType*>(&T_ANY), {})});
 static InvariantType T_ITERATOR = InvariantType(
 	"Iterator",
-	{new GenericType(new Token(TokenType::ID, "T", {nullptr, -1, -1}),
-					 nullptr)});
+	{new GenericType(new Token(TokenType::ID, "T", SourceMeta()), nullptr)});
 static InvariantType T_RANGE = InvariantType(
-	"Range", {new GenericType(new Token(TokenType::ID, "T", {nullptr, -1, -1}),
+	"Range", {new GenericType(new Token(TokenType::ID, "T", SourceMeta()),
 							  nullptr)});
 static InvariantType T_ITERABLE = InvariantType(
 	"Iterable",
-	{new GenericType(new Token(TokenType::ID, "T", {nullptr, -1, -1}),
-					 nullptr)});
+	{new GenericType(new Token(TokenType::ID, "T", SourceMeta()), nullptr)});
 
 const InvariantType* ANY = &T_ANY;
 const InvariantType* NUMBER = &T_NUMBER;
@@ -154,16 +154,30 @@ static const InvariantType* T_INVARIANTS[T_INVARIANTS_LEN] = {
 	ARRAY,	 MAP,	   TUPLE,	FUNCTION, OPTIONAL, UNWRAPPED_OPTIONAL,
 	POINTER, ITERATOR, RANGE,	ITERABLE};
 
+static const Map<String, const InvariantType*>& getInvariantTypeTable() {
+	static const Map<String, const InvariantType*> table = [] {
+		Map<String, const InvariantType*> result;
+		for (int i = 0; i < T_INVARIANTS_LEN; i++)
+			result[T_INVARIANTS[i]->id->data] = T_INVARIANTS[i];
+		return result;
+	}();
+	return table;
+}
+
 bool isInvariantType(const String& id) {
-	for (int i = 0; i < T_INVARIANTS_LEN; i++)
-		if (T_INVARIANTS[i]->id->data == id) return true;
-	return false;
+	return findInvariantType(id) != nullptr;
+}
+
+const InvariantType* findInvariantType(const String& id) {
+	const auto& table = getInvariantTypeTable();
+	auto it = table.find(id);
+	return it != table.end() ? it->second : nullptr;
 }
 
 const InvariantType* resolveInvariantType(const Token* id) {
-	for (int i = 0; i < T_INVARIANTS_LEN; i++)
-		if (T_INVARIANTS[i]->id->data == id->data) return T_INVARIANTS[i];
-	throw UnresolvedSymbolException(id);
+	auto result = findInvariantType(id->data);
+	if (!result) throw UnresolvedSymbolException(id);
+	return result;
 }
 
 static Symbol* func(const String& id, TokenType type,
@@ -174,9 +188,9 @@ static Symbol* func(const String& id, TokenType type,
 		sb << "p" << paramSymbols.size();
 		String id = sb.str();
 		paramSymbols.push_back(new Parameter(
-			{}, new Token(TokenType::ID, id, {nullptr, -1, -1}), p));
+			{}, new Token(TokenType::ID, id, SourceMeta()), p));
 	}
-	return new Function({}, new Token(type, id, {nullptr, -1, -1}), {},
+	return new Function({}, new Token(type, id, SourceMeta()), {},
 						paramSymbols, ret, {}, nullptr, false);
 }
 
@@ -191,8 +205,8 @@ static Symbol* preop(const String& id, TypeRef* ret) {
 	auto idType = getSymbolType(id);
 	if (idType == TokenType::EOF_TOKEN) idType = getIdentifierType(id);
 	return new Function({new Modifier(new Token(TokenType::PREFIX, "prefix",
-												{nullptr, -1, -1}))},
-						new Token(idType, id, {nullptr, -1, -1}), {}, {}, ret,
+												SourceMeta()))},
+						new Token(idType, id, SourceMeta()), {}, {}, ret,
 						{}, nullptr, false);
 }
 
@@ -200,74 +214,45 @@ static Symbol* postop(const String& id, TypeRef* ret) {
 	auto idType = getSymbolType(id);
 	if (idType == TokenType::EOF_TOKEN) idType = getIdentifierType(id);
 	return new Function({new Modifier(new Token(TokenType::POSTFIX, "postfix",
-												{nullptr, -1, -1}))},
-						new Token(idType, id, {nullptr, -1, -1}), {}, {}, ret,
+												SourceMeta()))},
+						new Token(idType, id, SourceMeta()), {}, {}, ret,
 						{}, nullptr, false);
 }
 
-#define INT_OP_FUNCS(T)                                                       \
-	ifunc("&",                                                                \
-		  {tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})},   \
-		  tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),    \
-		ifunc(                                                                \
-			"|",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"^",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"<<",                                                             \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			">>",                                                             \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		preop("~",                                                            \
-			  tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1}))
+#define INT_OP_FUNCS(T)                                                        \
+	ifunc("&", {tb::base(const_cast<InvariantType*>(T), {})},                  \
+	      tb::base(const_cast<InvariantType*>(T), {})),                        \
+		ifunc("|", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("^", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("<<", {tb::base(const_cast<InvariantType*>(T), {})},             \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc(">>", {tb::base(const_cast<InvariantType*>(T), {})},             \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		preop("~", tb::base(const_cast<InvariantType*>(T), {}))
 
-#define ARITHMETIC_OP_FUNCS(T)                                                \
-	ifunc("+",                                                                \
-		  {tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})},   \
-		  tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),    \
-		ifunc(                                                                \
-			"-",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"*",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"/",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"%",                                                              \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"**",                                                             \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})),  \
-		ifunc(                                                                \
-			"<=>",                                                            \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(&T_INT), {},                  \
-					 {nullptr, -1, -1})),                                     \
-		ifunc(                                                                \
-			"..",                                                             \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(&T_RANGE),                    \
-					 {tb::base(T, {}, {nullptr, -1, -1})},                    \
-					 {nullptr, -1, -1})),                                     \
-		ifunc(                                                                \
-			"...",                                                            \
-			{tb::base(const_cast<InvariantType*>(T), {}, {nullptr, -1, -1})}, \
-			tb::base(const_cast<InvariantType*>(&T_RANGE),                    \
-					 {tb::base(T, {}, {nullptr, -1, -1})}, {nullptr, -1, -1}))
+#define ARITHMETIC_OP_FUNCS(T)                                                 \
+	ifunc("+", {tb::base(const_cast<InvariantType*>(T), {})},                  \
+	      tb::base(const_cast<InvariantType*>(T), {})),                        \
+		ifunc("-", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("*", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("/", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("%", {tb::base(const_cast<InvariantType*>(T), {})},              \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("**", {tb::base(const_cast<InvariantType*>(T), {})},             \
+		      tb::base(const_cast<InvariantType*>(T), {})),                    \
+		ifunc("<=>", {tb::base(const_cast<InvariantType*>(T), {})},            \
+		      tb::base(const_cast<InvariantType*>(&T_INT), {})),               \
+		ifunc("..", {tb::base(const_cast<InvariantType*>(T), {})},             \
+		      tb::base(const_cast<InvariantType*>(&T_RANGE),                   \
+		               {tb::base(T, {})})),                                    \
+		ifunc("...", {tb::base(const_cast<InvariantType*>(T), {})},            \
+		      tb::base(const_cast<InvariantType*>(&T_RANGE),                   \
+		               {tb::base(T, {})}))
 
 static void addMembers(InvariantType* t,
 					   std::initializer_list<Symbol*> members) {
@@ -275,32 +260,34 @@ static void addMembers(InvariantType* t,
 }
 
 void initInvariantTypes() {
+	static bool initialized = false;
+	if (initialized) return;
+	initialized = true;
+
 	T_ITERATOR.parentTypes.push_back(
-		tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta));
+		tb::base(const_cast<InvariantType*>(&T_ANY), {}));
 	T_ITERABLE.parentTypes.push_back(
-		tb::base(const_cast<InvariantType*>(&T_ANY), {}, T_ANY.sourceMeta));
+		tb::base(const_cast<InvariantType*>(&T_ANY), {}));
 	T_RANGE.parentTypes.push_back(
 		tb::base(const_cast<InvariantType*>(&T_ITERABLE),
-				 {tb::base(T_RANGE.generics[0], {}, T_RANGE.sourceMeta)},
-				 T_ITERABLE.sourceMeta));
+				 {tb::base(T_RANGE.generics[0], {})}));
 
 	T_ITERATOR.addSymbol(
 		func("next", TokenType::ID, {},
-			 tb::base(T_ITERATOR.generics[0], {}, {nullptr, -1, -1})));
+			 tb::base(T_ITERATOR.generics[0], {})));
 	T_ITERATOR.addSymbol(func("hasNext", TokenType::ID, {},
-							  tb::base(&T_BOOL, {}, {nullptr, -1, -1})));
+							  tb::base(&T_BOOL, {})));
 	T_RANGE.addSymbol(
 		func("getStart", TokenType::ID, {},
-			 tb::base(T_RANGE.generics[0], {}, {nullptr, -1, -1})));
+			 tb::base(T_RANGE.generics[0], {})));
 	T_RANGE.addSymbol(
 		func("getEnd", TokenType::ID, {},
-			 tb::base(T_RANGE.generics[0], {}, {nullptr, -1, -1})));
+			 tb::base(T_RANGE.generics[0], {})));
 
 	T_ITERABLE.addSymbol(
 		func("iterator", TokenType::ID, {},
 			 tb::base(&T_ITERATOR,
-					  {tb::base(T_ITERABLE.generics[0], {}, {nullptr, -1, -1})},
-					  {nullptr, -1, -1})));
+					  {tb::base(T_ITERABLE.generics[0], {})})));
 
 	addMembers(&T_INT, {ARITHMETIC_OP_FUNCS(&T_INT), INT_OP_FUNCS(&T_INT)});
 	addMembers(&T_INT8, {ARITHMETIC_OP_FUNCS(&T_INT8), INT_OP_FUNCS(&T_INT8)});
@@ -20,7 +20,7 @@ class InvariantType : public Type, public Scope {
 	InvariantType(const String& id,
 				  std::initializer_list<GenericType*> generics);
 	virtual ~InvariantType();
-	virtual void toJson(StringBuffer& dest) const override;
+	virtual void toJson(json::Writer& dest) const override;
 };
 
 extern const InvariantType* ANY;
@@ -53,10 +53,16 @@ extern const InvariantType* RANGE;
 extern const InvariantType* ITERABLE;
 
 bool isInvariantType(const String& id);
+
+// Returns nullptr if there is no invariant type with the specified ID
+const InvariantType* findInvariantType(const String& id);
+
+// Throws an UnresolvedSymbolException if there is no invariant type with the
+// specified ID
 const InvariantType* resolveInvariantType(const Token* id);
 
-// Call this once at startup to initialize the invariant type members and
-// properties
+// Call this at startup to initialize the invariant type members and properties.
+// Calling it again has no effect.
 void initInvariantTypes();
 }  // namespace bt
 }  // namespace acl
\ No newline at end of file
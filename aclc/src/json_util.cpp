@@ -1,32 +1,167 @@
 #include "json_util.hpp"
 
+#include <cctype>
+#include <iomanip>
+
+#include "source_map.hpp"
+
 namespace acl {
 namespace json {
-void appendToken(StringBuffer& dest, const Token* token) {
-	if (const auto* t = dynamic_cast<const StringToken*>(token)) {
-		appendStringToken(dest, t);
-	} else if (token->type == TokenType::INTEGER_LITERAL ||
-			   token->type == TokenType::FLOAT_LITERAL) {
-		dest << token->data;
-	} else {
-		dest << "\"" << token->data << "\"";
+Writer::Writer(std::FILE* file, Format format, bool loadable)
+	: buffer(BUFFER_SIZE),
+	  stream(file, buffer.data(), buffer.size()),
+	  compactWriter(stream),
+	  prettyWriter(stream),
+	  pretty(format == Format::PRETTY),
+	  loadable(loadable) {
+	prettyWriter.SetIndent('\t', 1);
+}
+
+void Writer::startObject() {
+	if (pretty)
+		prettyWriter.StartObject();
+	else
+		compactWriter.StartObject();
+}
+
+void Writer::endObject() {
+	if (pretty)
+		prettyWriter.EndObject();
+	else
+		compactWriter.EndObject();
+}
+
+void Writer::startArray() {
+	if (pretty)
+		prettyWriter.StartArray();
+	else
+		compactWriter.StartArray();
+}
+
+void Writer::endArray() {
+	if (pretty)
+		prettyWriter.EndArray();
+	else
+		compactWriter.EndArray();
+}
+
+void Writer::key(const char* key) {
+	if (pretty)
+		prettyWriter.Key(key);
+	else
+		compactWriter.Key(key);
+}
+
+void Writer::string(const String& value) {
+	auto length = static_cast<rapidjson::SizeType>(value.length());
+	if (pretty)
+		prettyWriter.String(value.data(), length);
+	else
+		compactWriter.String(value.data(), length);
+}
+
+void Writer::boolean(bool value) {
+	if (pretty)
+		prettyWriter.Bool(value);
+	else
+		compactWriter.Bool(value);
+}
+
+void Writer::integer(std::int64_t value) {
+	if (pretty)
+		prettyWriter.Int64(value);
+	else
+		compactWriter.Int64(value);
+}
+
+void Writer::null() {
+	if (pretty)
+		prettyWriter.Null();
+	else
+		compactWriter.Null();
+}
+
+void Writer::token(const Token* token) {
+	if (dynamic_cast<const StringToken*>(token) ||
+		(token->type != TokenType::INTEGER_LITERAL &&
+		 token->type != TokenType::FLOAT_LITERAL)) {
+		string(token->data);
+		return;
 	}
+
+	// Numeric literals are written just as they appear in the source, unless
+	// they have leading zeros, which JSON doesn't allow
+	const auto& data = token->data;
+	if (data.length() > 1 && data[0] == '0' && isdigit(data[1])) {
+		string(data);
+		return;
+	}
+
+	if (pretty)
+		prettyWriter.RawValue(data.data(), data.length(),
+							  rapidjson::kNumberType);
+	else
+		compactWriter.RawValue(data.data(), data.length(),
+							   rapidjson::kNumberType);
 }
 
-void appendStringToken(StringBuffer& dest, const StringToken* token) {
+void Writer::beginNode(const char* name, const SourceMeta& meta) {
+	startObject();
+	key("name");
+	string(name);
+
+	auto file = meta.getFile();
+	if (!loadable || !file) return;
+
+	auto pos = meta.getPos();
+	int line = 0;
+	int col = 0;
+	file->getLineAndCol(pos, line, col);
+	key("line");
+	integer(line);
+	key("col");
+	integer(col);
+	key("pos");
+	integer(pos);
+}
+
+void Writer::endNode() { endObject(); }
+
+void Writer::field(const char* key, const String& value) {
+	this->key(key);
+	string(value);
+}
+
+void Writer::field(const char* key, bool value) {
+	this->key(key);
+	boolean(value);
+}
+
+void Writer::field(const char* key, int value) {
+	this->key(key);
+	integer(value);
+}
+
+void Writer::flush() { stream.Flush(); }
+
+void appendString(StringBuffer& dest, const String& str) {
 	dest << "\"";
-	for (char c : token->data) {
-		if (c == '\\') dest << "\\";
-		dest << c;
+	for (char c : str) {
+		if (c == '"' || c == '\\')
+			dest << "\\" << c;
+		else if (c == '\n')
+			dest << "\\n";
+		else if (c == '\r')
+			dest << "\\r";
+		else if (c == '\t')
+			dest << "\\t";
+		else if (static_cast<unsigned char>(c) < 0x20)
+			dest << "\\u" << std::hex << std::setfill('0') << std::setw(4)
+				 << static_cast<int>(c) << std::dec;
+		else
+			dest << c;
 	}
 	dest << "\"";
 }
-
-void appendBool(StringBuffer& dest, bool value) {
-	if (value)
-		dest << "true";
-	else
-		dest << "false";
-}
 }  // namespace json
 }  // namespace acl
\ No newline at end of file
@@ -1,12 +1,91 @@
 #pragma once
 
+#include <cstdio>
 #include <functional>
 
 #include "common.hpp"
 #include "lexer.hpp"
+#include "rapidjson/filewritestream.h"
+#include "rapidjson/prettywriter.h"
+#include "rapidjson/writer.h"
 
 namespace acl {
 namespace json {
+/*
+Writes JSON into a file as it is produced, through a buffer of a fixed size, so
+that documents of any size can be written without ever holding them in memory.
+The output is either compact or indented (see Format).
+
+Nodes are written as objects whose first member is their name, followed by
+their fields in order (see beginNode()).
+*/
+class Writer {
+	List<char> buffer;
+	rapidjson::FileWriteStream stream;
+	rapidjson::Writer<rapidjson::FileWriteStream> compactWriter;
+	rapidjson::PrettyWriter<rapidjson::FileWriteStream> prettyWriter;
+	bool pretty;
+
+   public:
+	enum class Format { COMPACT, PRETTY };
+
+	static constexpr std::size_t BUFFER_SIZE = 64 * 1024;
+
+	// True if nodes are written with everything that is needed to read them
+	// back in (see readAstJson()), such as their locations and the fields
+	// that only the parser sets
+	const bool loadable;
+
+	Writer(std::FILE* file, Format format, bool loadable = false);
+	Writer(const Writer&) = delete;
+	Writer& operator=(const Writer&) = delete;
+
+	void startObject();
+	void endObject();
+	void startArray();
+	void endArray();
+	void key(const char* key);
+	void string(const String& value);
+	void boolean(bool value);
+	void integer(std::int64_t value);
+	void null();
+
+	// Writes the token as a number if it is a numeric literal and as a string
+	// otherwise
+	void token(const Token* token);
+
+	// Starts a node with its name and, if the writer is loadable and the
+	// location points somewhere, its location as "line", "col" and "pos" (the
+	// offset into the source)
+	void beginNode(const char* name, const SourceMeta& meta);
+	void endNode();
+
+	void field(const char* key, const String& value);
+	void field(const char* key, bool value);
+	void field(const char* key, int value);
+
+	// Writes null if there is no node
+	template <typename T>
+	void node(const char* key, const T* node) {
+		this->key(key);
+		if (node)
+			node->toJson(*this);
+		else
+			null();
+	}
+
+	template <typename T>
+	void nodes(const char* key, const List<T*>& nodes) {
+		this->key(key);
+		startArray();
+		for (const auto& n : nodes) n->toJson(*this);
+		endArray();
+	}
+
+	// Writes out whatever is still buffered. The file itself is not flushed.
+	void flush();
+};
+
 template <typename T>
 using ListAppendFunc = std::function<void(StringBuffer&, const T&)>;
 
@@ -25,8 +104,7 @@ void appendList(StringBuffer& dest, const List<T>& list,
 	dest << "]";
 }
 
-void appendToken(StringBuffer& dest, const Token* token);
-void appendStringToken(StringBuffer& dest, const StringToken* token);
-void appendBool(StringBuffer& dest, bool value);
+// Appends the string as a JSON string literal, escaping whatever has to be
+void appendString(StringBuffer& dest, const String& str);
 }  // namespace json
 }  // namespace acl
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "diagnoser.hpp"
 #include "exceptions.hpp"
+#include "profiler.hpp"
 
 namespace {
 using namespace acl;
@@ -151,39 +152,62 @@ Map<TokenType, String> TOKEN_TYPE_STRINGS = {
 }  // namespace
 
 namespace acl {
+// Tokens are only ever allocated on their own, so their memory is counted
+// when they are constructed (see Profiler). Derived tokens add what they take
+// beyond a token.
 Token::Token(TokenType type, const String& data, const SourceMeta& meta)
-	: type(type), data(data), meta(meta) {}
+	: type(type), data(data), meta(meta) {
+	Profiler::countAllocation(MemoryCategory::TOKENS, sizeof(Token));
+}
 Token::~Token() {}
 
 StringToken::StringToken(TokenType type, const String& data,
 						 const SourceMeta& meta,
 						 const Map<int, String>& interpolations)
-	: Token(type, data, meta), interpolations(interpolations) {}
+	: Token(type, data, meta), interpolations(interpolations) {
+	Profiler::countAllocation(MemoryCategory::TOKENS,
+							  sizeof(StringToken) - sizeof(Token), 0);
+}
 StringToken::~StringToken() {}
 
 Lexer::Lexer(const CompilerContext& ctx, const ModuleInfo& moduleInfo,
 			 StringBuffer& buf)
-	: moduleInfo(moduleInfo),
+	: moduleInfo(&moduleInfo),
 	  buf(buf),
 	  line(1),
-	  col(1),
-	  diagnoser(ctx, std::cout),
-	  currentPos(0) {}
+	  diagnoser(ctx),
+	  currentPos(0),
+	  file(SourceFile::add(&moduleInfo, getStringBufferLength(buf))),
+	  origin(0),
+	  ownsFile(true) {}
+
+Lexer::Lexer(const CompilerContext& ctx, const SourceMeta& origin,
+			 StringBuffer& buf)
+	: moduleInfo(origin.getModuleInfo()),
+	  buf(buf),
+	  line(1),
+	  diagnoser(ctx),
+	  currentPos(0),
+	  file(const_cast<SourceFile*>(origin.getFile())),
+	  origin(origin.getPos()),
+	  ownsFile(false) {}
+
+void Lexer::addLine(FilePos start) {
+	if (ownsFile) file->addLine(start, line);
+}
 
 SourceMeta Lexer::getSourceMeta() {
-	return {&moduleInfo, currentPos, line, col};
+	return SourceMeta(file, origin + currentPos);
 }
 
 int Lexer::get() { return buf.peek(); }
 
 int Lexer::advance() {
-	col++;
 	currentPos++;
 	return buf.get();
 }
 
 void Lexer::retract(char c) {
-	col--;
 	currentPos--;
 	buf.putback(c);
 }
@@ -205,18 +229,18 @@ Token* Lexer::lexSingleLineComment() {
 }
 
 Token* Lexer::lexMultiLineComment() {
-	auto sourceMeta = getSourceMeta();
-	sourceMeta.col--;  // Subtract the column by 1 because we want the column to
-					   // start at the '/', not the '*'
+	// Subtract the position by 1 because we want the location to start at the
+	// '/', not the '*'
+	auto sourceMeta = SourceMeta(file, origin + currentPos - 1);
 	advance();	// The initial '/' has already been read, but we still need to
 				// read the initial '*' that proceeds it
 	int c;
 	while ((c = get()) != EOF) {
+		advance();
 		if (isNewlineChar(c)) {
 			line++;
-			col = 0;
+			addLine(currentPos);
 		}
-		advance();
 		if (c == '*' && get() == '/') {
 			advance();
 			return nextToken();
@@ -233,8 +257,8 @@ Token* Lexer::lexNewline() {
 	auto c = get();
 	if (c == '\r') sb << (char)advance();
 	if (c == '\n') sb << (char)advance();
-	col = 1;
 	line++;
+	addLine(currentPos);
 	String content = sb.str();
 	return new Token{TokenType::NL, content, sourceMeta};
 }
@@ -502,13 +526,13 @@ void Lexer::lexInterpolationEscapeSequence(int pos,
 			return;
 		}
 
-		if (c == '\r' || (c == '\n' && !prevWasCR)) {
-			line++;
-			prevWasCR = c == '\r';
-		} else
-			prevWasCR = false;
+		if (c == '\r' || (c == '\n' && !prevWasCR)) line++;
+		prevWasCR = c == '\r';
 
 		sb << (char)advance();
+
+		// The line after a "\r\n" starts after the '\n'
+		if (isNewlineChar(c)) addLine(currentPos);
 	}
 
 	diagnoser.diagnose(ec::INVALID_INTERPOLATION, getSourceMeta(), 1);
@@ -584,13 +608,15 @@ Token* Lexer::nextToken() {
 
 bool Lexer::hasNext() const { return buf.rdbuf()->in_avail() > 0; }
 
-const ModuleInfo& Lexer::getModuleInfo() const { return moduleInfo; }
+const ModuleInfo& Lexer::getModuleInfo() const { return *moduleInfo; }
 
 void Lexer::setRecoverySentinels(const List<int>& sentinels) {
 	recoverySentinels.clear();
 	recoverySentinels.insert(recoverySentinels.end(), sentinels.begin(),
 							 sentinels.end());
 }
+
+void Lexer::flushDiagnostics() { diagnoser.flush(); }
 }  // namespace acl
 
 namespace acl {
@@ -777,7 +803,7 @@ Relexer::Relexer(const CompilerContext& ctx, Token* originalToken)
 void Relexer::tryLex(const String& str, List<Token*>& dest) {
 	StringBuffer buf;
 	buf << str;
-	Lexer lexer = Lexer(ctx, *originalToken->meta.moduleInfo, buf);
+	Lexer lexer = Lexer(ctx, originalToken->meta, buf);
 	while (lexer.hasNext()) {
 		try {
 			dest.push_back(lexer.nextToken());
@@ -789,9 +815,8 @@ void Relexer::tryLex(const String& str, List<Token*>& dest) {
 }
 
 Token* Relexer::formatToken(Token* t, int start) {
-	t->meta.moduleInfo = originalToken->meta.moduleInfo;
-	t->meta.line = originalToken->meta.line;
-	t->meta.col = originalToken->meta.col + start;
+	t->meta = SourceMeta(originalToken->meta.getFile(),
+						 originalToken->meta.getPos() + start);
 	return t;
 }
 
@@ -2,6 +2,7 @@
 
 #include "common.hpp"
 #include "diagnoser.hpp"
+#include "source_map.hpp"
 
 namespace acl {
 enum class TokenType {
@@ -177,14 +178,22 @@ struct StringToken : public Token {
 };
 
 class Lexer {
-	const ModuleInfo& moduleInfo;
+	const ModuleInfo* moduleInfo;
 	StringBuffer& buf;
 	int line;
-	int col;
 	List<int> recoverySentinels;
 	Diagnoser diagnoser;
 	FilePos currentPos;
 
+	// The source the locations of the tokens point into and the position in
+	// it that the buffer starts at. The lines of the buffer are only recorded
+	// in the source if the lexer registered it itself.
+	SourceFile* file;
+	FilePos origin;
+	bool ownsFile;
+
+	void addLine(FilePos start);
+
    private:
 	SourceMeta getSourceMeta();
 	int get();
@@ -214,10 +223,16 @@ class Lexer {
    public:
 	Lexer(const CompilerContext& ctx, const ModuleInfo& moduleInfo,
 		  StringBuffer& buf);
+
+	// Lexes a part of a source that has already been lexed, such as the
+	// contents of a string literal, whose first character is at "origin"
+	Lexer(const CompilerContext& ctx, const SourceMeta& origin,
+		  StringBuffer& buf);
 	Token* nextToken();
 	bool hasNext() const;
 	const ModuleInfo& getModuleInfo() const;
 	void setRecoverySentinels(const List<int>& sentinels);
+	void flushDiagnostics();
 };
 
 class Relexer {
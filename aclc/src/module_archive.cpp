@@ -0,0 +1,247 @@
+#include "module_archive.hpp"
+
+#include <cstring>
+#include <fstream>
+
+#include "ast_serializer.hpp"
+#include "module_loader.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACLC_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+using namespace acl;
+
+const char ARCHIVE_MAGIC[] = {'A', 'C', 'L', 'A'};
+const std::uint64_t ARCHIVE_FORMAT_VERSION = 1;
+
+// Every entry of the index is its path followed by the offsets and sizes of
+// its data and its interface
+const std::size_t INDEX_ENTRY_SIZE = 4 * 8;
+
+void appendFixed(String& dest, std::uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		dest.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+void writeFixed(char* dest, std::uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		dest[i] = static_cast<char>((value >> (i * 8)) & 0xff);
+}
+
+bool readFixed(const char*& pos, const char* end, std::uint64_t& dest) {
+	if (end - pos < 8) return false;
+	dest = 0;
+	for (int i = 0; i < 8; i++)
+		dest |= static_cast<std::uint64_t>(static_cast<unsigned char>(pos[i]))
+				<< (i * 8);
+	pos += 8;
+	return true;
+}
+
+void appendString(String& dest, const String& str) {
+	appendFixed(dest, str.length());
+	dest.append(str);
+}
+
+bool readString(const char*& pos, const char* end, String& dest) {
+	std::uint64_t length = 0;
+	if (!readFixed(pos, end, length) ||
+		static_cast<std::uint64_t>(end - pos) < length)
+		return false;
+	dest.assign(pos, length);
+	pos += length;
+	return true;
+}
+
+bool isModuleFile(const std::filesystem::path& path) {
+	return path.extension() == ".accele" || path.extension() == ".acldef";
+}
+
+bool readFile(const std::filesystem::path& path, String& dest) {
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) return false;
+
+	StringBuffer sb;
+	sb << ifs.rdbuf();
+	dest = sb.str();
+	return true;
+}
+}  // namespace
+
+namespace acl {
+const char* const ModuleArchive::EXTENSION = ".aclpkg";
+
+ModuleArchive::ModuleArchive() : data(nullptr), size(0) {}
+
+ModuleArchive::~ModuleArchive() {
+#ifdef ACLC_USE_MMAP
+	if (data) munmap(const_cast<char*>(data), size);
+#endif
+}
+
+ModuleArchive* ModuleArchive::open(const std::filesystem::path& path,
+								   const String& compilerVersion) {
+	auto archive = new ModuleArchive();
+
+#ifdef ACLC_USE_MMAP
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		delete archive;
+		return nullptr;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		delete archive;
+		return nullptr;
+	}
+
+	auto size = static_cast<std::size_t>(st.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		delete archive;
+		return nullptr;
+	}
+
+	archive->data = static_cast<const char*>(data);
+	archive->size = size;
+#else
+	if (!readFile(path, archive->buffer)) {
+		delete archive;
+		return nullptr;
+	}
+	archive->data = archive->buffer.data();
+	archive->size = archive->buffer.length();
+#endif
+
+	if (!archive->readIndex(compilerVersion)) {
+		delete archive;
+		return nullptr;
+	}
+	return archive;
+}
+
+bool ModuleArchive::readIndex(const String& compilerVersion) {
+	const char* pos = data;
+	const char* end = data + size;
+	if (size < sizeof(ARCHIVE_MAGIC) ||
+		std::memcmp(pos, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0)
+		return false;
+	pos += sizeof(ARCHIVE_MAGIC);
+
+	std::uint64_t formatVersion = 0;
+	String version;
+	std::uint64_t count = 0;
+	if (!readFixed(pos, end, formatVersion) ||
+		formatVersion != ARCHIVE_FORMAT_VERSION ||
+		!readString(pos, end, version) || !readFixed(pos, end, count))
+		return false;
+
+	// The interfaces of a different compiler are of no use, but the modules
+	// can still be parsed
+	bool useInterfaces = version == compilerVersion;
+
+	for (std::uint64_t i = 0; i < count; i++) {
+		String name;
+		std::uint64_t fields[INDEX_ENTRY_SIZE / 8];
+		if (!readString(pos, end, name)) return false;
+		for (auto& f : fields)
+			if (!readFixed(pos, end, f)) return false;
+
+		// Both the data and the interface have to lie within the archive
+		for (int j = 0; j < 4; j += 2)
+			if (fields[j] > size || fields[j + 1] > size - fields[j])
+				return false;
+
+		ArchiveEntry entry = {data + fields[0], fields[1], nullptr, 0};
+		if (useInterfaces && fields[3] > 0) {
+			entry.interface = data + fields[2];
+			entry.interfaceSize = fields[3];
+		}
+		entries[name] = entry;
+	}
+
+	return true;
+}
+
+const Map<String, ArchiveEntry>& ModuleArchive::getEntries() const {
+	return entries;
+}
+
+const ArchiveEntry* ModuleArchive::find(const String& name) const {
+	auto it = entries.find(name);
+	return it == entries.end() ? nullptr : &it->second;
+}
+
+bool ModuleArchive::write(CompilerContext& ctx,
+						  const std::filesystem::path& dir,
+						  const std::filesystem::path& path,
+						  const String& compilerVersion) {
+	List<std::filesystem::path> files;
+	std::error_code ec;
+	std::filesystem::recursive_directory_iterator end;
+	std::filesystem::recursive_directory_iterator i(dir, ec);
+	for (; !ec && i != end; i.increment(ec)) {
+		std::error_code typeEc;
+		if (i->is_regular_file(typeEc) && isModuleFile(i->path()))
+			files.push_back(i->path());
+	}
+	if (ec) return false;
+
+	// The offsets in the index aren't known until the data is laid out, so
+	// they are filled in afterwards
+	String archive(ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+	appendFixed(archive, ARCHIVE_FORMAT_VERSION);
+	appendString(archive, compilerVersion);
+	appendFixed(archive, files.size());
+
+	List<std::size_t> fieldOffsets;
+	for (const auto& f : files) {
+		appendString(archive, f.lexically_relative(dir).generic_string());
+		fieldOffsets.push_back(archive.length());
+		archive.append(INDEX_ENTRY_SIZE, '\0');
+	}
+
+	for (std::size_t j = 0; j < files.size(); j++) {
+		String content;
+		if (!readFile(files[j], content)) return false;
+
+		auto fields = &archive[0] + fieldOffsets[j];
+		writeFixed(fields, archive.length());
+		writeFixed(fields + 8, content.length());
+		archive.append(content);
+
+		if (files[j].extension() != ".accele") continue;
+
+		String interface;
+		auto m = loadModule(ctx, files[j]);
+		if (m && !m->ast) return false;
+		if (!m || !serializeAst(interface, m->ast, true)) continue;
+
+		// The archive may have grown since "fields" was taken
+		fields = &archive[0] + fieldOffsets[j];
+		writeFixed(fields + 16, archive.length());
+		writeFixed(fields + 24, interface.length());
+		archive.append(interface);
+	}
+
+	auto tempPath = path;
+	tempPath += ".tmp";
+	{
+		std::ofstream ofs(tempPath, std::ios::binary);
+		if (!ofs.write(archive.data(), archive.length())) return false;
+	}
+
+	std::filesystem::rename(tempPath, path, ec);
+	if (ec) std::filesystem::remove(tempPath, ec);
+	return !ec;
+}
+}  // namespace acl
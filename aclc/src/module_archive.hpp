@@ -0,0 +1,70 @@
+#pragma once
+
+#include <filesystem>
+
+#include "common.hpp"
+
+namespace acl {
+// A file in a module archive. The data points into the archive, so it is only
+// valid as long as the archive is.
+struct ArchiveEntry {
+	const char* data;
+	std::size_t size;
+
+	// The serialized interface of a source module (see serializeAst()), or
+	// nullptr if the archive doesn't hold one that this compiler can use
+	const char* interface;
+	std::size_t interfaceSize;
+};
+
+/*
+The modules of a directory tree packed into a single file, so that they can be
+located and read without opening and examining every one of them. An archive
+named "<name>.aclpkg" stands in for a directory "<name>" next to it (see
+FileIndex). It starts with an index of the modules in the tree, followed by
+their contents and the interfaces of the source modules (where they can be
+serialized), which spare the importers from parsing them. The whole archive is
+mapped into memory at once and is only ever read from there.
+
+Interfaces are only used if the archive was written by the same compiler
+version, just like the entries of the module cache.
+*/
+class ModuleArchive {
+	const char* data;
+	std::size_t size;
+
+	// Holds the archive if it can't be mapped into memory
+	String buffer;
+
+	// The entries by their path relative to the root of the archive, with "/"
+	// as the separator
+	Map<String, ArchiveEntry> entries;
+
+	ModuleArchive();
+	bool readIndex(const String& compilerVersion);
+
+   public:
+	static const char* const EXTENSION;
+
+	~ModuleArchive();
+	ModuleArchive(const ModuleArchive&) = delete;
+	ModuleArchive& operator=(const ModuleArchive&) = delete;
+
+	// Returns nullptr if the file can't be read or is not a valid archive
+	static ModuleArchive* open(const std::filesystem::path& path,
+							   const String& compilerVersion);
+
+	const Map<String, ArchiveEntry>& getEntries() const;
+
+	// Returns nullptr if there is no entry with the relative path
+	const ArchiveEntry* find(const String& name) const;
+
+	// Writes an archive of the modules below "dir" to "path". Every source
+	// module is parsed so that its interface can be stored as well. Returns
+	// false if the tree can't be listed, one of the modules fails to parse or
+	// the archive can't be written.
+	static bool write(CompilerContext& ctx, const std::filesystem::path& dir,
+					  const std::filesystem::path& path,
+					  const String& compilerVersion);
+};
+}  // namespace acl
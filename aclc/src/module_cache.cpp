@@ -0,0 +1,249 @@
+#include "module_cache.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+#include "ast_serializer.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACLC_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+using namespace acl;
+
+const char ENTRY_MAGIC[] = {'A', 'C', 'L', 'I'};
+const char DEPENDENCIES_MAGIC[] = {'A', 'C', 'L', 'D'};
+
+// The magic, the size of the serialized AST and its checksum
+const std::size_t ENTRY_HEADER_SIZE = sizeof(ENTRY_MAGIC) + 8 + 8;
+
+// An unrelated second hash so that keys are 128 bits wide
+std::uint64_t mixHash(const char* data, std::size_t size, std::uint64_t hash) {
+	for (std::size_t i = 0; i < size; i++) {
+		hash = (hash ^ static_cast<unsigned char>(data[i])) *
+			   0x9e3779b97f4a7c15ULL;
+		hash ^= hash >> 29;
+	}
+	return hash;
+}
+
+std::uint64_t getChecksum(const char* data, std::size_t size) {
+	return fnv1a(data, size);
+}
+
+void appendHex(String& dest, std::uint64_t value) {
+	const char digits[] = "0123456789abcdef";
+	for (int shift = 60; shift >= 0; shift -= 4)
+		dest.push_back(digits[(value >> shift) & 0xf]);
+}
+
+void appendFixed(String& dest, std::uint64_t value) {
+	for (int i = 0; i < 8; i++)
+		dest.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+std::uint64_t readFixed(const char* data) {
+	std::uint64_t result = 0;
+	for (int i = 0; i < 8; i++)
+		result |= static_cast<std::uint64_t>(
+					  static_cast<unsigned char>(data[i]))
+				  << (i * 8);
+	return result;
+}
+
+// Returns false if the data is not an intact entry starting with the magic
+bool readEntry(const char* data, std::size_t size, const char* magic,
+			   const char*& payload, std::size_t& payloadSize) {
+	if (size < ENTRY_HEADER_SIZE ||
+		std::memcmp(data, magic, sizeof(ENTRY_MAGIC)) != 0)
+		return false;
+
+	payloadSize = readFixed(data + sizeof(ENTRY_MAGIC));
+	auto checksum = readFixed(data + sizeof(ENTRY_MAGIC) + 8);
+	payload = data + ENTRY_HEADER_SIZE;
+	return payloadSize == size - ENTRY_HEADER_SIZE &&
+		   checksum == getChecksum(payload, payloadSize);
+}
+
+Ast* readAstEntry(const char* data, std::size_t size,
+				  const ModuleInfo* moduleInfo) {
+	const char* payload = nullptr;
+	std::size_t payloadSize = 0;
+	if (!readEntry(data, size, ENTRY_MAGIC, payload, payloadSize))
+		return nullptr;
+	return deserializeAst(payload, payloadSize, moduleInfo);
+}
+
+void appendString(String& dest, const String& str) {
+	appendFixed(dest, str.length());
+	dest.append(str);
+}
+
+bool readString(const char*& pos, const char* end, String& dest) {
+	if (end - pos < 8) return false;
+	auto length = readFixed(pos);
+	pos += 8;
+	if (static_cast<std::uint64_t>(end - pos) < length) return false;
+	dest.assign(pos, length);
+	pos += length;
+	return true;
+}
+}  // namespace
+
+namespace acl {
+ModuleCache::ModuleCache(const std::filesystem::path& dir,
+						 const String& compilerVersion)
+	: dir(dir), compilerVersion(compilerVersion), tempCounter(0) {}
+
+std::filesystem::path ModuleCache::getEntryPath(const String& key) const {
+	return dir / (key + ".acli");
+}
+
+std::filesystem::path ModuleCache::getDependenciesPath(
+	const String& modulePath) const {
+	return dir / (getKey(modulePath) + ".acld");
+}
+
+String ModuleCache::getKey(const String& source) const {
+	// The version is terminated so that it can't run into the source
+	auto h0 = fnv1a(compilerVersion.c_str(), compilerVersion.length() + 1);
+	h0 = fnv1a(source.data(), source.length(), h0);
+	auto h1 = mixHash(compilerVersion.c_str(), compilerVersion.length() + 1,
+					  source.length());
+	h1 = mixHash(source.data(), source.length(), h1);
+
+	String result;
+	appendHex(result, h0);
+	appendHex(result, h1);
+	return result;
+}
+
+Ast* ModuleCache::load(const String& key, const ModuleInfo* moduleInfo) const {
+	auto path = getEntryPath(key);
+
+#ifdef ACLC_USE_MMAP
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	auto size = static_cast<std::size_t>(st.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+
+	auto result =
+		readAstEntry(static_cast<const char*>(data), size, moduleInfo);
+	munmap(data, size);
+	return result;
+#else
+	std::ifstream ifs(path, std::ios::binary);
+	if (!ifs) return nullptr;
+
+	StringBuffer sb;
+	sb << ifs.rdbuf();
+	auto str = sb.str();
+	return readAstEntry(str.data(), str.length(), moduleInfo);
+#endif
+}
+
+void ModuleCache::store(const String& key, const Ast* ast) const {
+	String payload;
+	if (!serializeAst(payload, ast, true)) return;
+	writeEntry(getEntryPath(key), ENTRY_MAGIC, payload);
+}
+
+bool ModuleCache::loadDependencies(const String& modulePath, String& sourceKey,
+								   List<SymbolDependency>& dest) const {
+	std::ifstream ifs(getDependenciesPath(modulePath), std::ios::binary);
+	if (!ifs) return false;
+
+	StringBuffer sb;
+	sb << ifs.rdbuf();
+	auto str = sb.str();
+	const char* pos = nullptr;
+	std::size_t size = 0;
+	if (!readEntry(str.data(), str.length(), DEPENDENCIES_MAGIC, pos, size))
+		return false;
+
+	auto end = pos + size;
+	if (!readString(pos, end, sourceKey) || end - pos < 8) return false;
+	auto count = readFixed(pos);
+	pos += 8;
+
+	List<SymbolDependency> result;
+	for (std::uint64_t i = 0; i < count; i++) {
+		SymbolDependency d;
+		if (!readString(pos, end, d.modulePath) ||
+			!readString(pos, end, d.name) || end - pos < 8)
+			return false;
+		d.fingerprint = readFixed(pos);
+		pos += 8;
+		result.push_back(d);
+	}
+
+	dest.insert(dest.end(), result.begin(), result.end());
+	return true;
+}
+
+void ModuleCache::storeDependencies(
+	const String& modulePath, const String& sourceKey,
+	const List<SymbolDependency>& dependencies) const {
+	String payload;
+	appendString(payload, sourceKey);
+	appendFixed(payload, dependencies.size());
+	for (const auto& d : dependencies) {
+		appendString(payload, d.modulePath);
+		appendString(payload, d.name);
+		appendFixed(payload, d.fingerprint);
+	}
+	writeEntry(getDependenciesPath(modulePath), DEPENDENCIES_MAGIC, payload);
+}
+
+void ModuleCache::writeEntry(const std::filesystem::path& path,
+							 const char* magic, const String& payload) const {
+	String entry;
+	entry.append(magic, sizeof(ENTRY_MAGIC));
+	appendFixed(entry, payload.length());
+	appendFixed(entry, getChecksum(payload.data(), payload.length()));
+	entry.append(payload);
+
+	std::error_code ec;
+	std::filesystem::create_directories(dir, ec);
+	if (ec) return;
+
+	// The temporary file has to be unique across threads and processes
+	StringBuffer suffix;
+	suffix << ".tmp" << std::hash<std::thread::id>()(std::this_thread::get_id())
+		   << "-" << std::chrono::steady_clock::now().time_since_epoch().count()
+		   << "-" << tempCounter++;
+	auto temp = path;
+	temp += suffix.str();
+
+	{
+		std::ofstream ofs(temp, std::ios::binary);
+		if (!ofs) return;
+		ofs.write(entry.data(), entry.length());
+		if (!ofs) {
+			ofs.close();
+			std::filesystem::remove(temp, ec);
+			return;
+		}
+	}
+
+	std::filesystem::rename(temp, path, ec);
+	if (ec) std::filesystem::remove(temp, ec);
+}
+}  // namespace acl
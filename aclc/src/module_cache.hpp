@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+
+#include "common.hpp"
+
+namespace acl {
+/*
+A persistent cache of the interfaces of imported modules, stored as one file per
+module in a directory on disk. An interface is the signature-only AST of a
+module (see serializeAst()), which is all that importers of the module need.
+
+Entries are addressed by a hash of the compiler version and the module source,
+so an entry is never stale: a changed module (or a different compiler) simply
+maps to a different entry. Each entry carries a checksum of its content and is
+written to a temporary file before being renamed into place, so several threads
+or compiler processes can share a cache directory, and a corrupt entry is
+treated like a missing one.
+
+The cache also records the dependencies of every input module that was resolved
+without errors (see SymbolDependency), so that a later compilation can skip
+resolving the module again if neither the module nor the interfaces of the
+symbols it looked up have changed. These records are stored by module path and
+are replaced whenever the module is resolved again.
+*/
+class ModuleCache {
+	std::filesystem::path dir;
+	String compilerVersion;
+	mutable std::atomic<unsigned> tempCounter;
+
+	std::filesystem::path getEntryPath(const String& key) const;
+	std::filesystem::path getDependenciesPath(const String& modulePath) const;
+	void writeEntry(const std::filesystem::path& path, const char* magic,
+					const String& payload) const;
+
+   public:
+	ModuleCache(const std::filesystem::path& dir,
+				const String& compilerVersion);
+
+	String getKey(const String& source) const;
+
+	// Returns nullptr if there is no valid entry for the key
+	Ast* load(const String& key, const ModuleInfo* moduleInfo) const;
+
+	// Failing to write an entry is not an error since the cache is only used to
+	// avoid parsing modules again
+	void store(const String& key, const Ast* ast) const;
+
+	// Returns false if there are no valid dependencies recorded for the
+	// module. "sourceKey" is set to the key of the source the module was
+	// resolved from.
+	bool loadDependencies(const String& modulePath, String& sourceKey,
+						  List<SymbolDependency>& dest) const;
+	void storeDependencies(const String& modulePath, const String& sourceKey,
+						   const List<SymbolDependency>& dependencies) const;
+};
+}  // namespace acl
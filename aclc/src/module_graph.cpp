@@ -0,0 +1,359 @@
+#include "module_graph.hpp"
+
+#include <algorithm>
+
+#include "ast.hpp"
+#include "ast_serializer.hpp"
+#include "diagnoser.hpp"
+#include "import_handler.hpp"
+#include "module_cache.hpp"
+#include "module_loader.hpp"
+#include "profiler.hpp"
+#include "resolver.hpp"
+
+namespace {
+using namespace acl;
+
+// The combined fingerprint of every symbol with the qualified name, or 0 if
+// there are none
+std::uint64_t getFingerprint(const Module* m, const String& name) {
+	List<Symbol*> symbols;
+	findQualifiedSymbols(symbols, m->ast, name);
+	if (symbols.empty()) return 0;
+
+	auto result = fnv1a(nullptr, 0);
+	for (auto& s : symbols) {
+		auto fingerprint = getInterfaceFingerprint(s);
+		if (!fingerprint) return 0;
+
+		char bytes[8];
+		for (int i = 0; i < 8; i++)
+			bytes[i] = static_cast<char>((fingerprint >> (i * 8)) & 0xff);
+		result = fnv1a(bytes, sizeof(bytes), result);
+	}
+	return result ? result : 1;
+}
+}  // namespace
+
+namespace acl {
+ModuleGraph::ModuleGraph(CompilerContext& ctx) : ctx(ctx), failed(false) {}
+
+std::size_t ModuleGraph::addNode(const std::filesystem::path& path,
+								 bool input, bool& added) {
+	auto p = std::filesystem::absolute(path);
+	auto it = indices.find(p.string());
+	if (it != indices.end()) {
+		added = false;
+		return it->second;
+	}
+
+	added = true;
+	auto index = nodes.size();
+	nodes.push_back({p, nullptr, input, {}, false, false, false});
+	indices[p.string()] = index;
+	return index;
+}
+
+void ModuleGraph::load(ThreadPool& pool,
+					   const List<std::filesystem::path>& inputs,
+					   const std::function<void(Module*)>& onLoaded) {
+	// All of the inputs are added before anything is loaded so that an input
+	// module which is imported by another one is still treated as an input
+	List<std::size_t> added;
+	for (const auto& p : inputs) {
+		bool isNew = false;
+		auto index = addNode(p, true, isNew);
+		if (isNew) added.push_back(index);
+	}
+
+	for (auto& i : added)
+		pool.submit([this, &pool, i, &onLoaded]() {
+			loadNode(pool, i, onLoaded);
+		});
+	pool.wait();
+
+	// Whether an input module has to be resolved again depends on the modules
+	// it imports, so the internal stages only start once everything is loaded.
+	// The modules are all checked first since resolving changes their ASTs.
+	for (auto& n : nodes) {
+		if (!n.input || n.failed || !n.module || !ctx.moduleCache ||
+			!isUpToDate(n))
+			continue;
+		n.upToDate = true;
+		resolveOnDemand(n.module);
+	}
+
+	for (std::size_t i = 0; i < nodes.size(); i++) {
+		if (!nodes[i].input || nodes[i].failed || !nodes[i].module ||
+			nodes[i].upToDate)
+			continue;
+		pool.submit([this, i]() {
+			try {
+				Resolver resolver = Resolver(ctx, nodes[i].module,
+											 ResolutionStage::INTERNAL_ALL);
+				resolver.resolve();
+			} catch (AcceleException& e) {
+				nodes[i].failed = true;
+				failed = true;
+			}
+		});
+	}
+	pool.wait();
+}
+
+void ModuleGraph::loadNode(ThreadPool& pool, std::size_t index,
+						   const std::function<void(Module*)>& onLoaded) {
+	std::filesystem::path path;
+	bool input = false;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		path = nodes[index].path;
+		input = nodes[index].input;
+	}
+
+	auto m = input ? loadModule(ctx, path) : loadImportedModule(ctx, path);
+	if (!m) return;
+
+	// The reasons have been reported, and are shown once everything is loaded
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		nodes[index].module = m;
+		nodes[index].failed = !m->ast;
+	}
+	if (!m->ast) {
+		failed = true;
+		return;
+	}
+
+	if (!input) return;
+
+	onLoaded(m);
+
+	// Modules which can't be found are reported once the imports are resolved
+	ImportHandler ih = ImportHandler(ctx, m);
+	List<std::filesystem::path> importPaths;
+	{
+		Profiler::Span span(ctx.profiler, Phase::IMPORTS, m->moduleInfo.path);
+		for (auto& i : m->ast->globalScope->imports) {
+			auto p = ih.locateImportSource(i->source);
+			if (!p.empty()) importPaths.push_back(p);
+		}
+	}
+
+	List<std::size_t> added;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto& p : importPaths) {
+			bool isNew = false;
+			auto i = addNode(p, false, isNew);
+			if (isNew) added.push_back(i);
+			nodes[index].imports.push_back(i);
+		}
+	}
+
+	for (auto& i : added)
+		pool.submit([this, &pool, i, &onLoaded]() {
+			loadNode(pool, i, onLoaded);
+		});
+}
+
+void ModuleGraph::getComponents(List<List<std::size_t>>& dest) const {
+	// Tarjan's algorithm, which produces the components in reverse topological
+	// order
+	const std::size_t UNVISITED = static_cast<std::size_t>(-1);
+	List<std::size_t> visitIndices(nodes.size(), UNVISITED);
+	List<std::size_t> lowLinks(nodes.size(), 0);
+	List<bool> onStack(nodes.size(), false);
+	List<std::size_t> stack;
+	std::size_t counter = 0;
+
+	std::function<void(std::size_t)> visit = [&](std::size_t v) {
+		visitIndices[v] = lowLinks[v] = counter++;
+		stack.push_back(v);
+		onStack[v] = true;
+
+		for (auto& w : nodes[v].imports) {
+			if (visitIndices[w] == UNVISITED) {
+				visit(w);
+				lowLinks[v] = std::min(lowLinks[v], lowLinks[w]);
+			} else if (onStack[w]) {
+				lowLinks[v] = std::min(lowLinks[v], visitIndices[w]);
+			}
+		}
+
+		if (lowLinks[v] != visitIndices[v]) return;
+
+		List<std::size_t> component;
+		std::size_t w;
+		do {
+			w = stack.back();
+			stack.pop_back();
+			onStack[w] = false;
+			component.push_back(w);
+		} while (w != v);
+
+		// Resolve the modules of a component in the order they were added
+		std::sort(component.begin(), component.end());
+		dest.push_back(component);
+	};
+
+	for (std::size_t v = 0; v < nodes.size(); v++)
+		if (visitIndices[v] == UNVISITED) visit(v);
+}
+
+String ModuleGraph::getSourceKey(const Module* m) const {
+	String source;
+	for (const auto& line : m->source) {
+		source.append(line);
+		source.push_back('\n');
+	}
+	return ctx.moduleCache->getKey(source);
+}
+
+bool ModuleGraph::isUpToDate(const Node& node) const {
+	String sourceKey;
+	List<SymbolDependency> dependencies;
+	if (!ctx.moduleCache->loadDependencies(node.module->moduleInfo.path,
+										   sourceKey, dependencies) ||
+		sourceKey != getSourceKey(node.module))
+		return false;
+
+	for (const auto& d : dependencies) {
+		if (!d.name.empty()) {
+			auto m = ctx.findModule(d.modulePath);
+			if (!m || !m->ast || getFingerprint(m, d.name) != d.fingerprint)
+				return false;
+			continue;
+		}
+
+		// The imports must still lead to the same modules
+		bool found = false;
+		for (auto& i : node.imports)
+			if (nodes[i].path.string() == d.modulePath) found = true;
+		if (!found) return false;
+	}
+
+	return true;
+}
+
+void ModuleGraph::storeDependencies(const Node& node) const {
+	auto m = node.module;
+	if (m->untrackedDependencies) return;
+
+	// Diagnostics are only shown while a module is resolved, so a module that
+	// reported any (even warnings, and errors that didn't end the compilation)
+	// has to be resolved again the next time
+	if (!ctx.diagnostics || ctx.diagnostics->hasDiagnostics(m->moduleInfo.path))
+		return;
+
+	List<SymbolDependency> dependencies;
+	for (const auto& d : m->dependencies) {
+		std::uint64_t fingerprint = 0;
+		if (!d.second.empty()) {
+			auto owner = ctx.findModule(d.first);
+			if (!owner) return;
+			fingerprint = getFingerprint(owner, d.second);
+			if (!fingerprint) return;
+		}
+		dependencies.push_back({d.first, d.second, fingerprint});
+	}
+
+	ctx.moduleCache->storeDependencies(m->moduleInfo.path, getSourceKey(m),
+									   dependencies);
+}
+
+void ModuleGraph::resolve(ThreadPool& pool) {
+	List<List<std::size_t>> components;
+	getComponents(components);
+
+	List<std::size_t> componentIndices(nodes.size());
+	for (std::size_t c = 0; c < components.size(); c++)
+		for (auto& v : components[c]) componentIndices[v] = c;
+
+	List<List<std::size_t>> dependents(components.size());
+	List<std::size_t> pending(components.size(), 0);
+	for (std::size_t c = 0; c < components.size(); c++) {
+		List<std::size_t> dependencies;
+		for (auto& v : components[c]) {
+			for (auto& w : nodes[v].imports) {
+				auto d = componentIndices[w];
+				if (d != c && !listContains(dependencies, d))
+					dependencies.push_back(d);
+			}
+		}
+
+		pending[c] = dependencies.size();
+		for (auto& d : dependencies) dependents[d].push_back(c);
+	}
+
+	// Components that import from a component that failed, which only change
+	// while the lock is held
+	List<bool> blocked(components.size(), false);
+
+	std::function<void(std::size_t)> resolveComponent = [&](std::size_t c) {
+		bool componentFailed = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			componentFailed = blocked[c];
+		}
+
+		for (auto& v : components[c]) {
+			if (componentFailed) break;
+			if (nodes[v].failed) {
+				componentFailed = true;
+				break;
+			}
+			if (!nodes[v].input || !nodes[v].module || nodes[v].upToDate)
+				continue;
+
+			try {
+				Resolver resolver = Resolver(ctx, nodes[v].module);
+				resolver.resolve();
+				nodes[v].resolved = true;
+			} catch (AcceleException& e) {
+				nodes[v].failed = true;
+				componentFailed = true;
+				failed = true;
+			}
+		}
+
+		List<std::size_t> ready;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto& d : dependents[c]) {
+				if (componentFailed) blocked[d] = true;
+				if (--pending[d] == 0) ready.push_back(d);
+			}
+		}
+
+		for (auto& d : ready)
+			pool.submit([&resolveComponent, d]() { resolveComponent(d); });
+	};
+
+	// The counts are decremented as soon as the first task runs
+	List<std::size_t> ready;
+	for (std::size_t c = 0; c < components.size(); c++)
+		if (pending[c] == 0) ready.push_back(c);
+
+	for (auto& c : ready)
+		pool.submit([&resolveComponent, c]() { resolveComponent(c); });
+	pool.wait();
+
+	if (!ctx.moduleCache) return;
+	for (const auto& n : nodes)
+		if (n.resolved) storeDependencies(n);
+}
+
+void ModuleGraph::getUnreadableInputs(
+	List<std::filesystem::path>& dest) const {
+	for (const auto& n : nodes)
+		if (n.input && !n.module) dest.push_back(n.path);
+}
+
+void ModuleGraph::getInputModules(List<Module*>& dest) const {
+	for (const auto& n : nodes)
+		if (n.input && n.module) dest.push_back(n.module);
+}
+
+bool ModuleGraph::hasFailed() const { return failed; }
+}  // namespace acl
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+
+#include "common.hpp"
+#include "thread_pool.hpp"
+
+namespace acl {
+/*
+The import graph of the modules being compiled, used to compile independent
+modules in parallel.
+
+Loading parses every module, discovering the imports of the input modules along
+the way, and then resolves the internal stages of the input modules, which only
+depend on the module itself, so all modules are loaded concurrently. Only the
+imports of input modules are followed since imported modules are only resolved
+on demand.
+
+Resolving runs the external stages of the input modules. Each strongly
+connected component of the graph is resolved on its own once every component it
+imports from has been resolved, so an input module is always fully resolved
+before the modules that import it. A component is skipped if any of the
+components it imports from failed, and the modules of a component are resolved
+in order until one of them fails, so the diagnostics don't depend on the number
+of jobs.
+
+With a module cache, the symbols of other modules that each input module looks
+up are recorded once it resolves without any diagnostics. If neither the source
+of the module nor the interface fingerprints of those symbols have changed the
+next time, the module is not resolved again but treated like an imported
+module. So editing the body of a function only causes the module containing it
+to be resolved again. A module that reported diagnostics isn't recorded, so
+they are shown again every time.
+*/
+class ModuleGraph {
+	struct Node {
+		std::filesystem::path path;
+		Module* module;
+		bool input;
+		List<std::size_t> imports;
+
+		// True if the module doesn't need to be resolved again (see above)
+		bool upToDate;
+		bool resolved;
+
+		// True if the module couldn't be loaded or resolved
+		bool failed;
+	};
+
+	CompilerContext& ctx;
+	List<Node> nodes;
+	Map<String, std::size_t> indices;
+	std::mutex mutex;
+	std::atomic<bool> failed;
+
+	std::size_t addNode(const std::filesystem::path& path, bool input,
+						bool& added);
+	void loadNode(ThreadPool& pool, std::size_t index,
+				  const std::function<void(Module*)>& onLoaded);
+	void getComponents(List<List<std::size_t>>& dest) const;
+	String getSourceKey(const Module* m) const;
+	bool isUpToDate(const Node& node) const;
+	void storeDependencies(const Node& node) const;
+
+   public:
+	ModuleGraph(CompilerContext& ctx);
+
+	// "onLoaded" is called for every input module right after it is parsed
+	void load(ThreadPool& pool, const List<std::filesystem::path>& inputs,
+			  const std::function<void(Module*)>& onLoaded);
+	void resolve(ThreadPool& pool);
+
+	// Input modules which could not be read
+	void getUnreadableInputs(List<std::filesystem::path>& dest) const;
+
+	// Input modules which were loaded, in the order they were added
+	void getInputModules(List<Module*>& dest) const;
+
+	// True if resolving any of the modules produced an error
+	bool hasFailed() const;
+};
+}  // namespace acl
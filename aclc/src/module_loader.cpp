@@ -0,0 +1,296 @@
+#include "module_loader.hpp"
+
+#include <fstream>
+#include <iostream>
+
+#include "ast_json.hpp"
+#include "ast_serializer.hpp"
+#include "diagnoser.hpp"
+#include "file_index.hpp"
+#include "module_cache.hpp"
+#include "parser.hpp"
+#include "profiler.hpp"
+#include "resolver.hpp"
+#include "source_map.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACLC_USE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace acl {
+static String getModuleDir(const std::filesystem::path& path) {
+	return path.parent_path();
+}
+
+static String getModuleName(const std::filesystem::path& path) {
+	return path.stem();
+}
+
+ModuleInfo getModuleInfo(const std::filesystem::path& path) {
+	auto p = std::filesystem::absolute(path);
+	return {getModuleDir(p), p, getModuleName(p)};
+}
+
+static void splitLines(const String& str, List<String>& dest) {
+	StringBuffer linesBuf;
+	linesBuf << str;
+
+	while (linesBuf) {
+		String line;
+		std::getline(linesBuf, line);
+		dest.push_back(line);
+	}
+}
+
+static bool readFile(const std::filesystem::path& path, String& dest,
+					 std::ios::openmode mode) {
+	std::ifstream ifs(path, mode);
+
+	if (!ifs) return false;
+
+	StringBuffer sb;
+	sb << ifs.rdbuf();
+	dest = sb.str();
+	return true;
+}
+
+// The source is held as it was read as well as split into lines
+static void countSource(const String& str, const List<String>& lines) {
+	auto size = str.length();
+	for (const auto& line : lines) size += sizeof(String) + line.length();
+	Profiler::countAllocation(MemoryCategory::SOURCE, size, lines.size() + 1);
+}
+
+// Returns nullptr if the file isn't in a module archive
+static const ArchiveEntry* findArchived(CompilerContext& ctx,
+										const std::filesystem::path& path) {
+	return ctx.fileIndex ? ctx.fileIndex->findArchived(path) : nullptr;
+}
+
+static bool readSource(CompilerContext& ctx, const std::filesystem::path& path,
+					   String& dest, std::ios::openmode mode) {
+	if (auto archived = findArchived(ctx, path)) {
+		dest.assign(archived->data, archived->size);
+		return true;
+	}
+	return readFile(path, dest, mode);
+}
+
+// Returns nullptr if the file cannot be read. Otherwise, the module is
+// registered with the compiler context and "added" tells whether it is a new
+// module or one that was already registered under the same path, which is
+// returned instead once it is loaded. A new module is still loading, and the
+// caller has to finish loading it (see CompilerContext::finishLoading()).
+static Module* readModule(CompilerContext& ctx,
+						  const std::filesystem::path& path, String& dest,
+						  bool& added) {
+	auto info = getModuleInfo(path);
+	List<String> lines;
+	{
+		Profiler::Span span(ctx.profiler, Phase::READ, info.path);
+		if (!readSource(ctx, path, dest, std::ios::in)) return nullptr;
+		splitLines(dest, lines);
+		countSource(dest, lines);
+	}
+
+	// TODO: .acldef files cannot be translated to C++ source or OBJ files.
+	// They can only be used to reference a library.
+
+	auto m = new Module{info, nullptr, lines};
+	m->loading = true;
+
+	// The module has to be registered before parsing so that diagnostics can
+	// show its source
+	auto existing = ctx.addModule(m);
+	added = existing == m;
+	if (!added) {
+		delete m;
+		ctx.waitUntilLoaded(existing);
+	}
+	return existing;
+}
+
+// Binary dumps are mapped into memory instead of being read, since the nodes
+// are built straight from the data
+static Ast* readBinaryAst(const std::filesystem::path& path, const Module* m,
+						  const AstSource& source) {
+#ifdef ACLC_USE_MMAP
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) return nullptr;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	auto size = static_cast<std::size_t>(st.st_size);
+	void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return nullptr;
+
+	auto result = deserializeAst(static_cast<const char*>(data), size,
+								 &m->moduleInfo, &source);
+	munmap(data, size);
+	return result;
+#else
+	String str;
+	if (!readFile(path, str, std::ios::binary)) return nullptr;
+	return deserializeAst(str.data(), str.length(), &m->moduleInfo, &source);
+#endif
+}
+
+// Returns nullptr if the AST directory of the compiler context holds no dump
+// that was written for the module as it is now (see AstSource), or if the dump
+// can't be read. A binary dump is preferred over a JSON one.
+static Ast* readDumpedAst(CompilerContext& ctx, const Module* m,
+						  const String& str) {
+	if (ctx.astDir.empty()) return nullptr;
+
+	// Dumps are named after their module, which other modules may share
+	auto source = m->getAstSource();
+	auto binaryPath = ctx.astDir / (m->moduleInfo.name + ".ast");
+	std::error_code ec;
+	if (std::filesystem::exists(binaryPath, ec)) {
+		Profiler::Span span(ctx.profiler, Phase::LOAD_AST, m->moduleInfo.path);
+		if (auto ast = readBinaryAst(binaryPath, m, source)) return ast;
+	}
+
+	auto path = ctx.astDir / (m->moduleInfo.name + ".ast.json");
+	if (!std::filesystem::exists(path, ec)) return nullptr;
+	Profiler::Span span(ctx.profiler, Phase::LOAD_AST, m->moduleInfo.path);
+	return readAstJson(path, &m->moduleInfo, str.length(), source);
+}
+
+static Ast* parseModule(CompilerContext& ctx, Module* m, const String& str) {
+	if (auto ast = readDumpedAst(ctx, m, str)) return ast;
+
+	Profiler::Span span(ctx.profiler, Phase::PARSE, m->moduleInfo.path);
+	StringBuffer lexerBuf;
+	lexerBuf << str;
+	Profiler::countAllocation(MemoryCategory::SOURCE, str.length());
+
+	Parser parser = Parser(ctx, Lexer(ctx, m->moduleInfo, lexerBuf));
+	return parser.parse();
+}
+
+Module* loadModule(CompilerContext& ctx, const std::filesystem::path& path) {
+	String str;
+	bool added = false;
+	auto m = readModule(ctx, path, str, added);
+	if (!m || !added) return m;
+
+	m->ast = parseModule(ctx, m, str);
+	ctx.finishLoading(m);
+	return m;
+}
+
+// Module definition files already hold the signature-only AST of a module (see
+// serializeAst()), so they are never parsed
+static Module* loadDefinition(CompilerContext& ctx,
+							  const std::filesystem::path& path) {
+	auto info = getModuleInfo(path);
+	String str;
+	{
+		Profiler::Span span(ctx.profiler, Phase::READ, info.path);
+		if (!readSource(ctx, path, str, std::ios::binary)) return nullptr;
+	}
+
+	// There is no source to show in diagnostics
+	auto m = new Module{info, nullptr, {}};
+	m->loading = true;
+	auto existing = ctx.addModule(m);
+	if (existing != m) {
+		delete m;
+		ctx.waitUntilLoaded(existing);
+		return existing;
+	}
+
+	{
+		Profiler::Span span(ctx.profiler, Phase::LOAD_AST, m->moduleInfo.path);
+		m->ast = deserializeAst(str.data(), str.length(), &m->moduleInfo);
+	}
+
+	// Like a module that fails to parse, this fails the compilation
+	if (!m->ast) {
+		StringBuffer msg;
+		msg << "The module definition file \"" << m->moduleInfo.path
+			<< "\" is invalid or was generated by a different compiler version";
+		Diagnoser diagnoser(ctx);
+		diagnoser.diagnose(ec::UNRESOLVED_IMPORT, msg.str());
+	} else {
+		resolveOnDemand(m);
+	}
+
+	ctx.finishLoading(m);
+	return m;
+}
+
+Module* loadImportedModule(CompilerContext& ctx,
+						   const std::filesystem::path& path) {
+	if (path.extension() == ".acldef") return loadDefinition(ctx, path);
+
+	String str;
+	bool added = false;
+	auto m = readModule(ctx, path, str, added);
+	if (!m || !added) return m;
+
+	// An archive may come with the interface of the module
+	auto archived = findArchived(ctx, path);
+	if (archived && archived->interface) {
+		Profiler::Span span(ctx.profiler, Phase::LOAD_AST, m->moduleInfo.path);
+		m->ast = deserializeAst(archived->interface, archived->interfaceSize,
+								&m->moduleInfo);
+	}
+
+	if (!m->ast && ctx.moduleCache) {
+		auto key = ctx.moduleCache->getKey(str);
+		{
+			Profiler::Span span(ctx.profiler, Phase::LOAD_AST,
+								m->moduleInfo.path);
+			m->ast = ctx.moduleCache->load(key, &m->moduleInfo);
+		}
+		if (!m->ast) {
+			m->ast = parseModule(ctx, m, str);
+			if (m->ast) ctx.moduleCache->store(key, m->ast);
+		}
+	}
+
+	if (!m->ast) m->ast = parseModule(ctx, m, str);
+
+	if (m->ast) resolveOnDemand(m);
+	ctx.finishLoading(m);
+	return m;
+}
+
+Module* loadCachedModule(const std::filesystem::path& path,
+						 const ModuleCache& cache) {
+	auto definition = path.extension() == ".acldef";
+	String str;
+	if (!readFile(path, str, definition ? std::ios::binary : std::ios::in))
+		return nullptr;
+
+	auto m = new Module{getModuleInfo(path), nullptr, {}};
+	if (definition) {
+		m->ast = deserializeAst(str.data(), str.length(), &m->moduleInfo);
+	} else {
+		splitLines(str, m->source);
+		m->ast = cache.load(cache.getKey(str), &m->moduleInfo);
+	}
+
+	// The sources registered before running into invalid data would point
+	// into the deleted module
+	if (!m->ast) {
+		SourceFile::remove(&m->moduleInfo);
+		delete m;
+		return nullptr;
+	}
+
+	resolveOnDemand(m);
+	return m;
+}
+}  // namespace acl
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <filesystem>
+
+#include "common.hpp"
+
+namespace acl {
+ModuleInfo getModuleInfo(const std::filesystem::path& path);
+
+// Reads and parses the module at the specified path (unless its AST can be read
+// from the AST directory of the compiler context) and registers it with the
+// compiler context. Returns nullptr if the file cannot be read. The AST of the
+// module is nullptr if it can't be parsed, in which case the reasons have been
+// reported.
+Module* loadModule(CompilerContext& ctx, const std::filesystem::path& path);
+
+// Loads a module that is only imported, which is resolved on demand (see
+// resolveOnDemand()). Its AST is taken from the module archive it is in or the
+// module cache of the compiler context if either holds its interface, and the
+// cache is updated otherwise. Module definition files (.acldef) are read
+// directly. A module that was already registered is returned as is. Just like
+// with loadModule(), the AST is nullptr if the module can't be loaded.
+Module* loadImportedModule(CompilerContext& ctx,
+						   const std::filesystem::path& path);
+
+// Loads an imported module like loadImportedModule() without parsing it or
+// registering it with a compiler context. Returns nullptr if its AST is neither
+// in the module cache nor in a module definition file.
+Module* loadCachedModule(const std::filesystem::path& path,
+						 const ModuleCache& cache);
+}  // namespace acl
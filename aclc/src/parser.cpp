@@ -2,6 +2,8 @@
 
 #include <filesystem>
 
+#include "profiler.hpp"
+
 namespace {
 constexpr int GLOBAL_FUNCTION_MODIFIERS_LEN = 10;
 const acl::TokenType GLOBAL_FUNCTION_MODIFIERS[GLOBAL_FUNCTION_MODIFIERS_LEN] =
@@ -486,14 +488,22 @@ void Parser::sync(int pos) {
 }
 
 void Parser::fill(int n) {
-	for (int i = 0; i < n; i++) {
-		try {
-			auto t = lexer.nextToken();
-			buffer.push_back(t);
-		} catch (LexerPanicException& e) {
-			panic();
+	// Recovering from a panic parses, so it isn't timed as lexing
+	bool failed = false;
+	{
+		Profiler::LexTimer timer(ctx.profiler);
+		for (int i = 0; i < n && !failed; i++) {
+			try {
+				auto t = lexer.nextToken();
+				buffer.push_back(t);
+				timer.addToken();
+			} catch (LexerPanicException& e) {
+				failed = true;
+			}
 		}
 	}
+
+	if (failed) panic();
 }
 
 [[noreturn]] void Parser::panic() {
@@ -541,7 +551,7 @@ Parser::Parser(CompilerContext& ctx, Lexer&& lexer)
 	  currentScope(nullptr),
 	  panicking(false),
 	  didPanic(false),
-	  diagnoser(ctx, std::cout) {}
+	  diagnoser(ctx) {}
 
 Parser::~Parser() {}
 
@@ -568,8 +578,13 @@ Ast* Parser::parse() {
 		skipNewlines(true);
 	}
 
+	// Modules are parsed on several threads, so the compilation can't just
+	// end here. The diagnostics are shown once it ends instead.
 	if (didPanic) {
-		exit(1);
+		lexer.flushDiagnostics();
+		diagnoser.flush();
+		delete globalScope;
+		return nullptr;
 	}
 
 	return new Ast(globalScope);
@@ -2391,7 +2406,8 @@ ImportTarget* Parser::parseImportTarget() {
 
 MetaDeclaration* Parser::parseSourceLock(const List<Node*>& globalContent) {
 	auto t = match(TokenType::META_SRCLOCK);
-	if (!globalContent.empty() && ctx.warnings[ec::NONFRONTED_SOURCE_LOCK]) {
+	if (!globalContent.empty() &&
+		ctx.isWarningEnabled(ec::NONFRONTED_SOURCE_LOCK)) {
 		if (!isSpeculating()) diagnoser.diagnoseSourceLock(t);
 	}
 	return new MetaDeclaration(t);
@@ -50,6 +50,8 @@ class Parser {
    public:
 	Parser(CompilerContext& ctx, Lexer&& lexer);
 	~Parser();
+
+	// Returns nullptr if the parser had to recover from an error
 	Ast* parse();
 
    private:
@@ -0,0 +1,618 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+
+#include "ast.hpp"
+#include "json_util.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACLC_USE_POSIX_TIMES
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+
+namespace {
+using namespace acl;
+
+const std::size_t PHASE_COUNT = static_cast<std::size_t>(Phase::__END_OF_ENUM);
+
+const char* PHASE_NAMES[PHASE_COUNT] = {"read",
+										"lex",
+										"parse",
+										"load AST",
+										"imports",
+										"resolve (internal types)",
+										"resolve (internal non-recursive)",
+										"resolve (internal all)",
+										"resolve (external types)",
+										"resolve (external non-recursive)",
+										"resolve (final)",
+										"dump AST"};
+
+const std::size_t MEMORY_CATEGORY_COUNT =
+	static_cast<std::size_t>(MemoryCategory::__END_OF_ENUM);
+
+const char* MEMORY_CATEGORY_NAMES[MEMORY_CATEGORY_COUNT] = {
+	"source text", "tokens",        "AST nodes",
+	"type refs",   "symbol tables", "diagnostics"};
+
+// The span that is open on each thread, which the next span nests in
+thread_local Profiler::Span* currentSpan = nullptr;
+
+// The profiler that counts memory, if any
+std::atomic<Profiler*> countingProfiler(nullptr);
+
+// In nanoseconds, or 0 if the platform can't tell the CPU time of a thread
+std::int64_t getThreadCpuTime() {
+#ifdef ACLC_USE_POSIX_TIMES
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) return 0;
+	return static_cast<std::int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#else
+	return 0;
+#endif
+}
+
+// The CPU time of all threads of the process, in nanoseconds
+std::int64_t getProcessCpuTime() {
+	return static_cast<std::int64_t>(static_cast<double>(std::clock()) * 1e9 /
+									 CLOCKS_PER_SEC);
+}
+
+// In bytes, or 0 if the platform can't tell
+std::size_t getPeakResidentSetSize() {
+#ifdef ACLC_USE_POSIX_TIMES
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+	return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+	return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+	return 0;
+#endif
+}
+
+// The name of the node type without its namespace
+String getKindName(const std::type_index& type) {
+	String name = type.name();
+#if defined(__GNUG__)
+	int status = 0;
+	char* demangled =
+		abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+	if (status == 0 && demangled) name = demangled;
+	std::free(demangled);
+#endif
+	auto separator = name.rfind("::");
+	return separator == String::npos ? name : name.substr(separator + 2);
+}
+
+template <typename D>
+std::int64_t toNanoseconds(D duration) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(duration)
+		.count();
+}
+
+struct PhaseTotals {
+	std::int64_t wall = 0;
+	std::int64_t cpu = 0;
+	std::size_t count = 0;
+	std::size_t tokens = 0;
+	std::size_t nodes = 0;
+};
+
+void writeMilliseconds(std::ostream& dest, std::int64_t ns) {
+	dest << std::setw(12) << static_cast<double>(ns) / 1e6;
+}
+
+// The items per second, or nothing if no time was measured
+void writeCount(std::ostream& dest, std::size_t count, const char* unit,
+				std::int64_t ns) {
+	dest << "  " << count << " " << unit;
+	if (ns > 0)
+		dest << " (" << std::llround(static_cast<double>(count) * 1e9 / ns)
+			 << " " << unit << "/s)";
+}
+
+void writeTotals(std::ostream& dest, const List<PhaseTotals>& totals) {
+	PhaseTotals sum;
+	for (std::size_t i = 0; i < PHASE_COUNT; i++) {
+		auto& t = totals[i];
+		if (!t.count) continue;
+		sum.wall += t.wall;
+		sum.cpu += t.cpu;
+
+		dest << "  " << std::left << std::setw(34) << PHASE_NAMES[i]
+			 << std::right;
+		writeMilliseconds(dest, t.wall);
+		dest << " /";
+		writeMilliseconds(dest, t.cpu);
+
+		auto phase = static_cast<Phase>(i);
+		if (phase == Phase::LEX)
+			writeCount(dest, t.tokens, "tokens", t.wall);
+		else if (phase == Phase::PARSE || phase == Phase::LOAD_AST)
+			writeCount(dest, t.nodes, "nodes", t.wall);
+		dest << "\n";
+	}
+
+	dest << "  " << std::left << std::setw(34) << "total" << std::right;
+	writeMilliseconds(dest, sum.wall);
+	dest << " /";
+	writeMilliseconds(dest, sum.cpu);
+	dest << "\n";
+}
+
+// The modules of the records in the order they were first worked on
+template <typename R>
+List<String> getModules(const List<R>& records) {
+	List<String> modules;
+	Map<String, std::int64_t> firstStarts;
+	for (const auto& r : records) {
+		auto it = firstStarts.find(r.module);
+		if (it == firstStarts.end()) {
+			modules.push_back(r.module);
+			firstStarts[r.module] = r.start;
+		} else {
+			it->second = std::min(it->second, r.start);
+		}
+	}
+
+	std::stable_sort(modules.begin(), modules.end(),
+					 [&](const String& a, const String& b) {
+						 return firstStarts[a] < firstStarts[b];
+					 });
+	return modules;
+}
+
+template <typename C>
+void addMemory(C& dest, const C& counts) {
+	for (std::size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+		dest[i].objects += counts[i].objects;
+		dest[i].bytes += counts[i].bytes;
+	}
+}
+
+void writeMemoryLine(std::ostream& dest, const char* label,
+					 const char* category, std::size_t objects,
+					 std::size_t bytes) {
+	dest << "  " << std::left << std::setw(34) << label << std::setw(16)
+		 << category << std::right << std::setw(10) << objects
+		 << std::setw(14) << static_cast<double>(bytes) / 1024 << " KiB\n";
+}
+
+// The label is only written on the first line
+template <typename C>
+void writeMemory(std::ostream& dest, const char* label, const C& counts) {
+	for (std::size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+		if (!counts[i].objects && !counts[i].bytes) continue;
+		writeMemoryLine(dest, label, MEMORY_CATEGORY_NAMES[i],
+						counts[i].objects, counts[i].bytes);
+		label = "";
+	}
+}
+
+template <typename C>
+void writeMemoryTotal(std::ostream& dest, const List<C>& phaseCounts) {
+	std::size_t objects = 0;
+	std::size_t bytes = 0;
+	for (const auto& counts : phaseCounts) {
+		for (std::size_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+			objects += counts[i].objects;
+			bytes += counts[i].bytes;
+		}
+	}
+	writeMemoryLine(dest, "total", "", objects, bytes);
+}
+}  // namespace
+
+namespace acl {
+const char* getPhaseName(Phase phase) {
+	return PHASE_NAMES[static_cast<std::size_t>(phase)];
+}
+
+const char* getMemoryCategoryName(MemoryCategory category) {
+	return MEMORY_CATEGORY_NAMES[static_cast<std::size_t>(category)];
+}
+
+Phase getStagePhase(ResolutionStage stage) {
+	switch (stage) {
+		case ResolutionStage::INTERNAL_TYPES:
+			return Phase::INTERNAL_TYPES;
+		case ResolutionStage::INTERNAL_NON_RECURSIVE:
+			return Phase::INTERNAL_NON_RECURSIVE;
+		case ResolutionStage::INTERNAL_ALL:
+			return Phase::INTERNAL_ALL;
+		case ResolutionStage::EXTERNAL_TYPES:
+			return Phase::EXTERNAL_TYPES;
+		case ResolutionStage::EXTERNAL_NON_RECURSIVE:
+			return Phase::EXTERNAL_NON_RECURSIVE;
+		default:
+			return Phase::RESOLVED;
+	}
+}
+
+Profiler::Span::Span(Profiler* profiler, Phase phase, const String& modulePath)
+	: profiler(profiler),
+	  parent(nullptr),
+	  phase(phase),
+	  startCpu(0),
+	  startNodes(0),
+	  childWall(0),
+	  childCpu(0),
+	  childNodes(0),
+	  lexWall(0),
+	  tokens(0),
+	  lexing(false) {
+	if (!profiler) return;
+	module = modulePath;
+	parent = currentSpan;
+	currentSpan = this;
+	startNodes = Node::getCreatedCount();
+	startCpu = getThreadCpuTime();
+	start = Clock::now();
+}
+
+Profiler::Span::~Span() {
+	if (!profiler) return;
+	auto wall = toNanoseconds(Clock::now() - start);
+	auto cpu = getThreadCpuTime() - startCpu;
+	auto nodes = Node::getCreatedCount() - startNodes;
+
+	currentSpan = parent;
+	if (parent) {
+		parent->childWall += wall;
+		parent->childCpu += cpu;
+		parent->childNodes += nodes;
+	}
+
+	auto selfWall = std::max<std::int64_t>(wall - childWall, 0);
+	auto selfCpu = std::max<std::int64_t>(cpu - childCpu, 0);
+	auto selfLexWall = std::min(lexWall, selfWall);
+
+	Record record;
+	record.phase = phase;
+	record.module = std::move(module);
+	record.start = toNanoseconds(start - profiler->origin);
+	record.duration = wall;
+	record.wall = selfWall - selfLexWall;
+	record.lexWall = selfLexWall;
+	record.lexCpu =
+		selfWall > 0 ? static_cast<std::int64_t>(static_cast<double>(selfCpu) *
+												 selfLexWall / selfWall)
+					 : 0;
+	record.cpu = selfCpu - record.lexCpu;
+	record.tokens = tokens;
+	record.nodes = nodes - childNodes;
+
+	countNodeKinds(memory, record.nodeKinds, pendingNodes);
+	record.memory = memory;
+	record.lexMemory = lexMemory;
+	profiler->add(std::move(record), std::this_thread::get_id());
+}
+
+Profiler::LexTimer::LexTimer(Profiler* profiler) : span(nullptr) {
+	if (!profiler || !currentSpan || currentSpan->lexing) return;
+	span = currentSpan;
+	span->lexing = true;
+	start = Clock::now();
+}
+
+Profiler::LexTimer::~LexTimer() {
+	if (!span) return;
+	span->lexWall += toNanoseconds(Clock::now() - start);
+	span->lexing = false;
+}
+
+void Profiler::LexTimer::addToken() {
+	if (span) span->tokens++;
+}
+
+Profiler::Profiler(bool countMemory)
+	: origin(Clock::now()), originCpu(getProcessCpuTime()) {
+	threads[std::this_thread::get_id()] = 0;
+	if (countMemory) countingProfiler = this;
+}
+
+Profiler::~Profiler() {
+	Profiler* self = this;
+	countingProfiler.compare_exchange_strong(self, nullptr);
+}
+
+void Profiler::countAllocation(MemoryCategory category, std::size_t bytes,
+							   std::size_t objects) {
+	auto profiler = countingProfiler.load(std::memory_order_relaxed);
+	if (!profiler) return;
+
+	auto i = static_cast<std::size_t>(category);
+	if (currentSpan) {
+		auto& count = currentSpan->lexing ? currentSpan->lexMemory[i]
+										  : currentSpan->memory[i];
+		count.objects += objects;
+		count.bytes += bytes;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(profiler->memoryMutex);
+	profiler->outsideMemory[i].objects += objects;
+	profiler->outsideMemory[i].bytes += bytes;
+}
+
+void Profiler::countNode(const void* node, std::size_t bytes) {
+	auto profiler = countingProfiler.load(std::memory_order_relaxed);
+	if (!profiler) return;
+
+	if (currentSpan) {
+		currentSpan->pendingNodes[node] = bytes;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(profiler->memoryMutex);
+	profiler->outsideNodes[node] = bytes;
+}
+
+void Profiler::forgetNode(const void* node) {
+	auto profiler = countingProfiler.load(std::memory_order_relaxed);
+	if (!profiler) return;
+
+	// The node still counts, only its kind is lost
+	auto forget = [&](PendingNodes& nodes, MemoryCounts& memory) {
+		auto it = nodes.find(node);
+		if (it == nodes.end()) return false;
+		auto& count = memory[static_cast<std::size_t>(MemoryCategory::NODES)];
+		count.objects++;
+		count.bytes += it->second;
+		nodes.erase(it);
+		return true;
+	};
+
+	for (auto s = currentSpan; s; s = s->parent)
+		if (forget(s->pendingNodes, s->memory)) return;
+
+	std::lock_guard<std::mutex> lock(profiler->memoryMutex);
+	forget(profiler->outsideNodes, profiler->outsideMemory);
+}
+
+void Profiler::countNodeKinds(MemoryCounts& memory, NodeKindCounts& dest,
+							  const PendingNodes& nodes) {
+	for (const auto& n : nodes) {
+		auto node = static_cast<const Node*>(n.first);
+		auto category = dynamic_cast<const TypeRef*>(node)
+							? MemoryCategory::TYPE_REFS
+							: MemoryCategory::NODES;
+		auto& kind = dest.emplace(std::type_index(typeid(*node)),
+								  NodeKindCount{category, {}})
+						 .first->second;
+		kind.count.objects++;
+		kind.count.bytes += n.second;
+
+		auto& count = memory[static_cast<std::size_t>(category)];
+		count.objects++;
+		count.bytes += n.second;
+	}
+}
+
+void Profiler::add(Record&& record, std::thread::id thread) {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = threads.find(thread);
+	if (it == threads.end())
+		it = threads.emplace(thread, static_cast<unsigned>(threads.size()))
+				 .first;
+	record.thread = it->second;
+	records.push_back(std::move(record));
+}
+
+void Profiler::writeReport(std::ostream& dest) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto wall = toNanoseconds(Clock::now() - origin);
+	auto cpu = getProcessCpuTime() - originCpu;
+
+	Map<String, List<PhaseTotals>> moduleTotals;
+	List<PhaseTotals> totals(PHASE_COUNT);
+	for (const auto& r : records) {
+		auto& t = moduleTotals[r.module];
+		if (t.empty()) t.resize(PHASE_COUNT);
+
+		for (auto target : {&t, &totals}) {
+			auto& p = (*target)[static_cast<std::size_t>(r.phase)];
+			p.wall += r.wall;
+			p.cpu += r.cpu;
+			p.nodes += r.nodes;
+			p.count++;
+
+			if (!r.tokens && !r.lexWall) continue;
+			auto& lex = (*target)[static_cast<std::size_t>(Phase::LEX)];
+			lex.wall += r.lexWall;
+			lex.cpu += r.lexCpu;
+			lex.tokens += r.tokens;
+			lex.count++;
+		}
+	}
+
+	auto flags = dest.flags();
+	auto precision = dest.precision();
+	auto fill = dest.fill(' ');
+	dest << std::fixed << std::setprecision(2);
+
+	dest << "Time report (wall / CPU time in milliseconds)\n";
+	for (const auto& m : getModules(records)) {
+		dest << "\n" << m << "\n";
+		writeTotals(dest, moduleTotals[m]);
+	}
+
+	dest << "\nAll modules\n";
+	writeTotals(dest, totals);
+	dest << "\nElapsed: " << static_cast<double>(wall) / 1e6 << " ms wall, "
+		 << static_cast<double>(cpu) / 1e6 << " ms CPU on " << threads.size()
+		 << (threads.size() == 1 ? " thread\n" : " threads\n");
+
+	dest.flags(flags);
+	dest.precision(precision);
+	dest.fill(fill);
+}
+
+void Profiler::writeMemoryReport(std::ostream& dest) const {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	Map<String, List<MemoryCounts>> moduleMemory;
+	List<MemoryCounts> memory(PHASE_COUNT);
+	NodeKindCounts nodeKinds;
+	for (const auto& r : records) {
+		auto& m = moduleMemory[r.module];
+		if (m.empty()) m.resize(PHASE_COUNT);
+
+		for (auto target : {&m, &memory}) {
+			addMemory((*target)[static_cast<std::size_t>(r.phase)], r.memory);
+			addMemory((*target)[static_cast<std::size_t>(Phase::LEX)],
+					  r.lexMemory);
+		}
+
+		for (const auto& k : r.nodeKinds) {
+			auto& kind = nodeKinds
+							 .emplace(k.first,
+									  NodeKindCount{k.second.category, {}})
+							 .first->second;
+			kind.count.objects += k.second.count.objects;
+			kind.count.bytes += k.second.count.bytes;
+		}
+	}
+
+	// The nodes allocated outside of any span are all still there
+	MemoryCounts outside;
+	{
+		std::lock_guard<std::mutex> memoryLock(memoryMutex);
+		outside = outsideMemory;
+		countNodeKinds(outside, nodeKinds, outsideNodes);
+	}
+
+	auto flags = dest.flags();
+	auto precision = dest.precision();
+	auto fill = dest.fill(' ');
+	dest << std::fixed << std::setprecision(2);
+
+	dest << "Memory report (objects and memory allocated for the compiler's "
+			"data structures)\n";
+	for (const auto& m : getModules(records)) {
+		dest << "\n" << m << "\n";
+		auto& phases = moduleMemory[m];
+		for (std::size_t i = 0; i < PHASE_COUNT; i++)
+			writeMemory(dest, PHASE_NAMES[i], phases[i]);
+		writeMemoryTotal(dest, phases);
+	}
+
+	dest << "\nAll modules\n";
+	for (std::size_t i = 0; i < PHASE_COUNT; i++)
+		writeMemory(dest, PHASE_NAMES[i], memory[i]);
+	writeMemory(dest, "outside of any phase", outside);
+	memory.push_back(outside);
+
+	MemoryCounts categories;
+	for (const auto& m : memory) addMemory(categories, m);
+	writeMemory(dest, "all phases", categories);
+	writeMemoryTotal(dest, memory);
+
+	List<std::pair<String, NodeKindCount>> kinds;
+	for (const auto& k : nodeKinds)
+		kinds.push_back({getKindName(k.first), k.second});
+	std::sort(kinds.begin(), kinds.end(), [](const auto& a, const auto& b) {
+		return a.second.count.bytes != b.second.count.bytes
+				   ? a.second.count.bytes > b.second.count.bytes
+				   : a.first < b.first;
+	});
+
+	dest << "\nNodes by kind\n";
+	for (const auto& k : kinds)
+		writeMemoryLine(dest, k.first.c_str(),
+						getMemoryCategoryName(k.second.category),
+						k.second.count.objects, k.second.count.bytes);
+
+	dest << "\nPeak resident set size: "
+		 << static_cast<double>(getPeakResidentSetSize()) / (1024 * 1024)
+		 << " MiB\n";
+
+	dest.flags(flags);
+	dest.precision(precision);
+	dest.fill(fill);
+}
+
+void Profiler::writeTrace(json::Writer& dest) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	dest.startObject();
+	dest.key("traceEvents");
+	dest.startArray();
+
+	List<unsigned> threadIds;
+	for (const auto& t : threads) threadIds.push_back(t.second);
+	std::sort(threadIds.begin(), threadIds.end());
+	for (auto tid : threadIds) {
+		dest.startObject();
+		dest.key("name");
+		dest.string("thread_name");
+		dest.key("ph");
+		dest.string("M");
+		dest.key("pid");
+		dest.integer(1);
+		dest.key("tid");
+		dest.integer(tid);
+		dest.key("args");
+		dest.startObject();
+		dest.key("name");
+		dest.string(tid == 0 ? String("main")
+							 : "worker " + std::to_string(tid));
+		dest.endObject();
+		dest.endObject();
+	}
+
+	// Times are in microseconds
+	for (const auto& r : records) {
+		dest.startObject();
+		dest.key("name");
+		dest.string(getPhaseName(r.phase));
+		dest.key("cat");
+		dest.string("aclc");
+		dest.key("ph");
+		dest.string("X");
+		dest.key("ts");
+		dest.integer(r.start / 1000);
+		dest.key("dur");
+		dest.integer(r.duration / 1000);
+		dest.key("pid");
+		dest.integer(1);
+		dest.key("tid");
+		dest.integer(r.thread);
+
+		dest.key("args");
+		dest.startObject();
+		dest.key("module");
+		dest.string(r.module);
+		dest.key("cpu_us");
+		dest.integer((r.cpu + r.lexCpu) / 1000);
+		if (r.tokens || r.lexWall) {
+			dest.key("lex_us");
+			dest.integer(r.lexWall / 1000);
+			dest.key("tokens");
+			dest.integer(static_cast<std::int64_t>(r.tokens));
+		}
+		if (r.nodes) {
+			dest.key("nodes");
+			dest.integer(static_cast<std::int64_t>(r.nodes));
+		}
+		dest.endObject();
+		dest.endObject();
+	}
+
+	dest.endArray();
+	dest.key("displayTimeUnit");
+	dest.string("ms");
+	dest.endObject();
+}
+}  // namespace acl
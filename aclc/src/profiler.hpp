@@ -0,0 +1,255 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <typeindex>
+
+#include "common.hpp"
+
+namespace acl {
+namespace json {
+class Writer;
+}
+
+enum class ResolutionStage;
+
+// The phases of compiling a module, including every stage of resolving it
+enum class Phase {
+	READ,
+	LEX,
+	PARSE,
+	LOAD_AST,
+	IMPORTS,
+	INTERNAL_TYPES,
+	INTERNAL_NON_RECURSIVE,
+	INTERNAL_ALL,
+	EXTERNAL_TYPES,
+	EXTERNAL_NON_RECURSIVE,
+	RESOLVED,
+	DUMP_AST,
+	__END_OF_ENUM
+};
+
+const char* getPhaseName(Phase phase);
+
+Phase getStagePhase(ResolutionStage stage);
+
+// What the memory of the compiler's own data structures is used for
+enum class MemoryCategory {
+	SOURCE,
+	TOKENS,
+	NODES,
+	TYPE_REFS,
+	SYMBOL_TABLES,
+	DIAGNOSTICS,
+	__END_OF_ENUM
+};
+
+const char* getMemoryCategoryName(MemoryCategory category);
+
+/*
+Records where the time of a compilation goes, for "--time-report" and
+"--trace". The phases of a module are timed by spans (see Span), which do
+nothing without a profiler, so they stay in place in every compilation.
+
+Spans nest on the thread they were started on. The time of a nested span is
+taken out of the span containing it, so the times of the phases add up to the
+time spent on all threads. The spans on a thread that waits for others (such
+as the thread resolving a module whose bodies are resolved in parallel) include
+the waiting.
+
+Lexing is interleaved with parsing, token by token, so it doesn't have spans of
+its own. The parser times its calls to the lexer instead (see LexTimer), which
+are taken out of the parse span. Measuring the CPU time of every token would
+cost more than lexing it, so the CPU time of the parse span is split between
+lexing and parsing in proportion to their wall time.
+
+If the profiler counts memory ("--mem-report"), the memory allocated for the
+compiler's own data structures is counted towards the span that is open on the
+allocating thread (see countAllocation()), so it is attributed to a module and
+a phase. Tokens allocated while lexing count towards lexing. Only allocations
+are counted, not what is freed again. Nodes are counted by their kind, which
+isn't known until they are constructed, so they are put aside until their span
+ends. A node must not be deleted by another thread while the span it was
+allocated in is still open.
+*/
+class Profiler {
+	using Clock = std::chrono::steady_clock;
+
+	struct MemoryCount {
+		std::size_t objects = 0;
+		std::size_t bytes = 0;
+	};
+
+	using MemoryCounts = std::array<
+		MemoryCount, static_cast<std::size_t>(MemoryCategory::__END_OF_ENUM)>;
+
+	struct NodeKindCount {
+		MemoryCategory category;
+		MemoryCount count;
+	};
+
+	using NodeKindCounts = Map<std::type_index, NodeKindCount>;
+
+	// The nodes whose kind is yet to be counted, with their size
+	using PendingNodes = Map<const void*, std::size_t>;
+
+	struct Record {
+		Phase phase;
+		String module;
+		unsigned thread;
+
+		// In nanoseconds. The start is relative to the creation of the
+		// profiler and the duration includes nested spans, unlike the wall
+		// and CPU time of the phase.
+		std::int64_t start;
+		std::int64_t duration;
+		std::int64_t wall;
+		std::int64_t cpu;
+		std::int64_t lexWall;
+		std::int64_t lexCpu;
+
+		std::size_t tokens;
+		std::size_t nodes;
+
+		MemoryCounts memory;
+		MemoryCounts lexMemory;
+		NodeKindCounts nodeKinds;
+	};
+
+	Clock::time_point origin;
+	std::int64_t originCpu;
+	List<Record> records;
+	Map<std::thread::id, unsigned> threads;
+	mutable std::mutex mutex;
+
+	// What was allocated outside of any span
+	MemoryCounts outsideMemory;
+	PendingNodes outsideNodes;
+	mutable std::mutex memoryMutex;
+
+	void add(Record&& record, std::thread::id thread);
+	static void countNodeKinds(MemoryCounts& memory, NodeKindCounts& dest,
+							   const PendingNodes& nodes);
+
+   public:
+	class LexTimer;
+
+	class Span {
+		Profiler* profiler;
+		Span* parent;
+		Phase phase;
+		String module;
+		Clock::time_point start;
+		std::int64_t startCpu;
+		std::size_t startNodes;
+
+		// What the spans nested in this one took
+		std::int64_t childWall;
+		std::int64_t childCpu;
+		std::size_t childNodes;
+
+		std::int64_t lexWall;
+		std::size_t tokens;
+		bool lexing;
+
+		MemoryCounts memory;
+		MemoryCounts lexMemory;
+		PendingNodes pendingNodes;
+
+		friend class LexTimer;
+		friend class Profiler;
+
+	   public:
+		Span(Profiler* profiler, Phase phase, const String& modulePath);
+		~Span();
+		Span(const Span&) = delete;
+		Span& operator=(const Span&) = delete;
+	};
+
+	// Times the calls to the lexer made while it exists and counts the tokens
+	// they produce (see addToken()) for the span that is open on the calling
+	// thread. Timers nested in another one do nothing.
+	class LexTimer {
+		Span* span;
+		Clock::time_point start;
+
+	   public:
+		LexTimer(Profiler* profiler);
+		~LexTimer();
+		LexTimer(const LexTimer&) = delete;
+		LexTimer& operator=(const LexTimer&) = delete;
+
+		void addToken();
+	};
+
+	// Only one profiler may count memory at a time
+	Profiler(bool countMemory);
+	~Profiler();
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+
+	// Does nothing unless a profiler counts memory
+	static void countAllocation(MemoryCategory category, std::size_t bytes,
+								std::size_t objects = 1);
+	static void countNode(const void* node, std::size_t bytes);
+
+	// Must be called before a node is freed
+	static void forgetNode(const void* node);
+
+	// The wall and CPU time of every phase of every module and of all modules
+	// together, along with the number of tokens and nodes and how many of them
+	// were produced per second
+	void writeReport(std::ostream& dest) const;
+
+	// The objects and bytes allocated for each category of data structures in
+	// every phase of every module, the kinds of nodes allocated in total and
+	// the peak resident set size of the process
+	void writeMemoryReport(std::ostream& dest) const;
+
+	// Writes every span as a complete event of the Chrome trace event format,
+	// on the thread it ran on
+	void writeTrace(json::Writer& dest) const;
+};
+
+// Counts the memory it allocates towards the category (see Profiler)
+template <typename T, MemoryCategory C>
+struct CountingAllocator {
+	using value_type = T;
+
+	template <typename U>
+	struct rebind {
+		using other = CountingAllocator<U, C>;
+	};
+
+	CountingAllocator() = default;
+
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U, C>&) {}
+
+	T* allocate(std::size_t n) {
+		Profiler::countAllocation(C, n * sizeof(T));
+		return std::allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, std::size_t n) {
+		std::allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U, C>&) const {
+		return true;
+	}
+
+	template <typename U>
+	bool operator!=(const CountingAllocator<U, C>&) const {
+		return false;
+	}
+};
+}  // namespace acl
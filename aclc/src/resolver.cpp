@@ -1,11 +1,15 @@
 #include "resolver.hpp"
 
 #include <algorithm>
+#include <mutex>
 #include <utility>
 
 #include "diagnoser.hpp"
+#include "exceptions.hpp"
 #include "import_handler.hpp"
 #include "invariant_types.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
 #include "type_builder.hpp"
 
 namespace {
@@ -22,21 +26,19 @@ SearchTarget getSearchTarget(const Symbol* s) {
 
 resolve::ResultOrigin getResultOrigin(const Scope* owningScope,
 									  const Symbol* s) {
-	if (isFunctionScope(owningScope)) return resolve::ResultOrigin::LOCAL;
+	if (owningScope->getInfo().functionScope)
+		return resolve::ResultOrigin::LOCAL;
 	if (isStaticSymbol(owningScope, s)) return resolve::ResultOrigin::STATIC;
 	return resolve::ResultOrigin::TYPE_HIERARCHY;
 }
 
 const GlobalScope* getGlobalScope(const Scope* scope) {
-	auto currentScope = scope;
-	while (currentScope->parentScope) currentScope = currentScope->parentScope;
-
-	return dynamic_cast<const GlobalScope*>(currentScope);
+	return scope->getInfo().globalScope;
 }
 
-static void resolveSymbol0(List<resolve::SearchResult>& dest, Scope* scope,
+static void resolveSymbol0(resolve::SearchResults& dest, Scope* scope,
 						   const Token* id, bool recursive, bool allowExternal,
-						   const List<SearchTarget>& targets) {
+						   const SearchTargets& targets) {
 	for (auto& s : scope->symbols) {
 		if (s->id->data == id->data &&
 			listContains(targets, getSearchTarget(s)))
@@ -74,9 +76,9 @@ static void resolveSymbol0(List<resolve::SearchResult>& dest, Scope* scope,
 	}
 }
 
-void resolveSymbol(List<resolve::SearchResult>& dest, Scope* scope,
+void resolveSymbol(resolve::SearchResults& dest, Scope* scope,
 				   const Token* id, bool recursive, bool allowExternal,
-				   const List<SearchTarget>& targets) {
+				   const SearchTargets& targets) {
 	if (id->type == TokenType::GLOBAL) {
 		auto gs = const_cast<GlobalScope*>(getGlobalScope(scope));
 		dest.push_back({dynamic_cast<Symbol*>(gs), dynamic_cast<Scope*>(gs),
@@ -87,13 +89,10 @@ void resolveSymbol(List<resolve::SearchResult>& dest, Scope* scope,
 	resolveSymbol0(dest, scope, id, recursive, allowExternal, targets);
 
 	if (recursive && listContains(targets, SearchTarget::TYPE)) {
-		try {
-			auto s =
-				const_cast<bt::InvariantType*>(bt::resolveInvariantType(id));
+		if (auto s = const_cast<bt::InvariantType*>(
+				bt::findInvariantType(id->data)))
 			dest.push_back({dynamic_cast<Symbol*>(s), dynamic_cast<Scope*>(s),
 							resolve::ResultOrigin::STATIC});
-		} catch (UnresolvedSymbolException& e) {
-		}
 	}
 }
 
@@ -143,35 +142,19 @@ bool diagnoseVisibility(Diagnoser& diagnoser,
 		}
 
 		// Assert both have same type in lexical scope hierarchy
-		const Scope* currentScope = lexicalScope;
-		while (currentScope) {
-			if (currentScope == candidate.owningScope) return false;
-			currentScope = currentScope->parentScope;
-		}
+		if (lexicalScope->isWithin(candidate.owningScope)) return false;
 
 		// Otherwise, assert the type is a parent of the nearest containing type
-		currentScope = lexicalScope;
-		const Type* type = nullptr;
-		while (currentScope) {
-			if (const Type* t = dynamic_cast<const Type*>(currentScope)) {
-				type = t;
-				break;
-			}
-			currentScope = currentScope->parentScope;
-		}
+		const Type* type = lexicalScope->getInfo().enclosingType;
 
-		auto typeRef = tb::base(const_cast<Type*>(type), {}, type->sourceMeta);
-		auto candidateTypeRef = tb::base(const_cast<Type*>(candidateType), {},
-										 candidateType->sourceMeta);
+		auto typeRef = tb::base(const_cast<Type*>(type), {});
+		auto candidateTypeRef = tb::base(const_cast<Type*>(candidateType), {});
 
 		if (!type || !type::canCastTo(typeRef, candidateTypeRef)) {
 			diagnoser.diagnoseSymbolNotVisible(refererToken->meta,
 											   candidate.symbol);
 			return true;
 		}
-
-		delete typeRef;
-		delete candidateTypeRef;
 	} else if (visibility == TokenType::PRIVATE) {
 		// "private" can only be used on symbols which are declared in a type or
 		// namespace
@@ -182,11 +165,7 @@ bool diagnoseVisibility(Diagnoser& diagnoser,
 		}
 
 		// Assert both have same scope in lexical scope hierarchy
-		const Scope* currentScope = lexicalScope;
-		while (currentScope) {
-			if (currentScope == candidate.owningScope) return false;
-			currentScope = currentScope->parentScope;
-		}
+		if (lexicalScope->isWithin(candidate.owningScope)) return false;
 
 		diagnoser.diagnoseSymbolNotVisible(refererToken->meta,
 										   candidate.symbol);
@@ -324,7 +303,7 @@ bool findSymbolCandidateProblems(const resolve::SearchResult& candidate,
 	return d1 || d2 || d3;
 }
 
-Symbol* getSymbolReferent(const List<resolve::SearchResult>& results,
+Symbol* getSymbolReferent(const resolve::SearchResults& results,
 						  const List<TypeRef*>& generics,
 						  const SearchCriteria& searchCriteria,
 						  const Token* refererToken, const Scope* lexicalScope,
@@ -333,46 +312,27 @@ Symbol* getSymbolReferent(const List<resolve::SearchResult>& results,
 		throw UnresolvedSymbolException(refererToken);
 	}
 
-	StringBuffer tmp;
-	Diagnoser* tmpDiag = new Diagnoser(diagnoser.ctx, tmp);
-	StringBuffer other;
+	// Only the problems of the first candidate are reported
+	List<Diagnostic> tmp;
+	Diagnoser firstDiag(diagnoser.ctx, tmp);
+	List<Diagnostic> other;
+	Diagnoser otherDiag(diagnoser.ctx, other);
 	for (auto& r : results) {
 		bool problems = findSymbolCandidateProblems(
-			r, generics, searchCriteria, refererToken, lexicalScope, *tmpDiag);
+			r, generics, searchCriteria, refererToken, lexicalScope,
+			&r == &results[0] ? firstDiag : otherDiag);
 
 		if (!problems) return r.symbol;
-
-		delete tmpDiag;
-		tmpDiag = new Diagnoser(diagnoser.ctx, other);
 	}
 
 	auto initialCandidate = results[0];
 
-	String s = tmp.str();
-
-	std::cout << s;
+	auto& dest = diagnoser.getDest();
+	dest.insert(dest.end(), tmp.begin(), tmp.end());
 
 	return initialCandidate.symbol;
 }
 
-bool isStaticContext(Scope* scope) {
-	Scope* currentScope = scope;
-	while (!dynamic_cast<Type*>(currentScope->parentScope)) {
-		if (dynamic_cast<GlobalScope*>(currentScope)) return true;
-		currentScope = currentScope->parentScope;
-	}
-
-	if (Function* f = dynamic_cast<Function*>(currentScope)) {
-		for (auto& m : f->modifiers)
-			if (m->content->type == TokenType::STATIC) return true;
-		return false;
-	}
-
-	return dynamic_cast<FunctionBlock*>(currentScope) ||
-		   dynamic_cast<SetBlock*>(currentScope) ||
-		   dynamic_cast<Constructor*>(currentScope);
-}
-
 unsigned getRequiredArity(const List<TypeRef*>& expected, bool& variadicDest) {
 	unsigned result = 0;
 	SourceMeta* initialVarargsMeta = nullptr;
@@ -397,47 +357,44 @@ unsigned getRequiredArity(const List<TypeRef*>& expected, bool& variadicDest) {
 }
 
 void validateFunctionCallArgs(const List<TypeRef*>& expected,
-							  const List<TypeRef*>& actual,
+							  const List<Expression*>& args,
 							  const SourceMeta& sourceMeta,
 							  Diagnoser& diagnoser) {
 	bool variadic = false;
 	unsigned required = getRequiredArity(expected, variadic);
-	if (actual.size() < required) {
+	if (args.size() < required) {
 		diagnoser.diagnose(ec::INSUFFICIENT_ARGUMENTS, sourceMeta, 1);
 		throw AcceleException();
 	}
 
-	for (std::size_t i = 0; i < actual.size(); i++) {
-		auto argType = actual[i];
+	// Argument types may be canonical type refs which don't have a source
+	// location, so we report problems at the argument expressions instead
+	for (std::size_t i = 0; i < args.size(); i++) {
+		auto argType = args[i]->valueType;
+		const auto& argMeta = args[i]->sourceMeta;
 		if (i >= expected.size() && !variadic) {
-			diagnoser.diagnose(ec::TOO_MANY_ARGUMENTS, argType->sourceMeta, 1);
+			diagnoser.diagnose(ec::TOO_MANY_ARGUMENTS, argMeta, 1);
 		} else if (i >= expected.size()) {
 			SuffixTypeRef* s =
 				dynamic_cast<SuffixTypeRef*>(expected[expected.size() - 1]);
 			if (!type::canCastTo(argType, s->type)) {
-				diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH,
-								   argType->sourceMeta, 1);
+				diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, argMeta, 1);
 			}
 		} else if (!type::canCastTo(argType, expected[i])) {
-			diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, argType->sourceMeta,
-							   1);
+			diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, argMeta, 1);
 		}
 	}
 }
 
+// Assumes that the arity of the arguments has already been checked against the
+// candidate (see OverloadSet)
 int getFunctionArgsScore(const List<TypeRef*>& expected,
-						 const List<TypeRef*>& actual,
-						 const SourceMeta& callerMeta, bool& variadicDest) {
+						 const List<TypeRef*>& actual) {
 	int result = 0;
 
-	unsigned required = getRequiredArity(expected, variadicDest);
-	if (actual.size() < required) return -1;
-
 	for (std::size_t i = 0; i < actual.size(); i++) {
 		auto argType = actual[i];
-		if (i >= expected.size() && !variadicDest)
-			return -1;
-		else if (i >= expected.size()) {
+		if (i >= expected.size()) {
 			SuffixTypeRef* s =
 				dynamic_cast<SuffixTypeRef*>(expected[expected.size() - 1]);
 			int score =
@@ -455,65 +412,6 @@ int getFunctionArgsScore(const List<TypeRef*>& expected,
 	return result;
 }
 
-struct FCCandidate {
-	int score;
-	bool variadic;
-};
-
-void getFunctionCallCandidateScores(
-	const List<List<std::pair<Symbol*, FunctionTypeRef*>>>& candidates,
-	const List<TypeRef*>& argTypes, List<List<FCCandidate>>& candidateScores,
-	const SourceMeta& callerMeta) {
-	for (std::size_t i = 0; i < candidates.size(); i++) {
-		List<FCCandidate> tmp;
-		for (std::size_t j = 0; j < candidates[i].size(); j++) {
-			bool variadic = false;
-			int score =
-				getFunctionArgsScore(std::get<1>(candidates[i][j])->paramTypes,
-									 argTypes, callerMeta, variadic);
-			tmp.push_back({score, variadic});
-		}
-		candidateScores.push_back(tmp);
-	}
-}
-
-void sortFccScores(const List<List<FCCandidate>>& scores,
-				   List<std::pair<int, int>>& indices) {
-	using IntermediateType = std::pair<std::pair<int, int>, const FCCandidate*>;
-	List<IntermediateType> variadic;
-	List<IntermediateType> nonVariadic;
-
-	for (std::size_t i = 0; i < scores.size(); i++) {
-		for (std::size_t j = 0; j < scores[i].size(); j++) {
-			if (scores[i][j].variadic) {
-				variadic.push_back(
-					std::make_pair(std::make_pair(i, j), &scores[i][j]));
-			} else {
-				nonVariadic.push_back(
-					std::make_pair(std::make_pair(i, j), &scores[i][j]));
-			}
-		}
-	}
-
-	std::sort(nonVariadic.begin(), nonVariadic.end(),
-			  [](IntermediateType& a, IntermediateType& b) {
-				  return std::get<1>(a)->score < std::get<1>(b)->score;
-			  });
-
-	std::sort(variadic.begin(), variadic.end(),
-			  [](IntermediateType& a, IntermediateType& b) {
-				  return std::get<1>(a)->score < std::get<1>(b)->score;
-			  });
-
-	for (auto& e : nonVariadic) {
-		indices.push_back(std::get<0>(e));
-	}
-
-	for (auto& e : variadic) {
-		indices.push_back(std::get<0>(e));
-	}
-}
-
 resolve::SearchResult getFccSearchResult(const resolve::SearchResult& original,
 										 Symbol* symbol) {
 	if (Constructor* c = dynamic_cast<Constructor*>(symbol)) {
@@ -559,36 +457,19 @@ TypeRef* getIteratorElementType(TypeRef* iteratorType) {
 	return nullptr;
 }
 
-bool isOwningFunctionScope(Scope* scope) {
-	if (FunctionBlock* block = dynamic_cast<FunctionBlock*>(scope)) {
-		return block->blockType == TokenType::GET ||
-			   block->blockType == TokenType::INIT;
-	}
-
-	return dynamic_cast<Function*>(scope) ||
-		   dynamic_cast<LambdaExpression*>(scope) ||
-		   dynamic_cast<Constructor*>(scope) ||
-		   dynamic_cast<Destructor*>(scope) || dynamic_cast<SetBlock*>(scope);
+bool isQueryActive(const Symbol* symbol) {
+	return symbol->signatureQuery == QueryState::ACTIVE ||
+		   symbol->contentQuery == QueryState::ACTIVE;
 }
 
-Scope* getOwningFunction(Scope* currentScope) {
-	while (currentScope && !isOwningFunctionScope(currentScope))
-		currentScope = currentScope->parentScope;
-	return currentScope;
+bool isTypeStage(ResolutionStage stage) {
+	return stage == ResolutionStage::INTERNAL_TYPES ||
+		   stage == ResolutionStage::EXTERNAL_TYPES;
 }
+
 }  // namespace
 
 namespace acl {
-void Resolver::pushSymbol(Symbol* symbol) { symbolStack.push_back(symbol); }
-
-void Resolver::popSymbol() { symbolStack.pop_back(); }
-
-bool Resolver::stackContainsSymbol(Symbol* symbol) {
-	for (const auto& s : symbolStack)
-		if (s == symbol) return true;
-	return false;
-}
-
 void Resolver::pushScope(Scope* scope, bool isLexicalScope) {
 	if (!isLexicalScope) {
 		lexicalScopes.push_back(scopes.back());
@@ -624,38 +505,172 @@ Scope* Resolver::getLexicalScope() {
 	return !lexicalScopes.empty() ? lexicalScopes.back() : peekScope();
 }
 
+DeferredBody::DeferredBody(Scope* body) : body(body) {}
+
 Resolver::Resolver(CompilerContext& ctx, Module* mod)
 	: ctx(ctx),
 	  mod(mod),
 	  maxStage(ResolutionStage::RESOLVED),
-	  diagnoser(ctx, std::cout) {}
+	  diagnoser(ctx),
+	  deferredBodies(nullptr),
+	  sharedModule(false),
+	  dependent(mod),
+	  postponed(0) {}
 
 Resolver::Resolver(CompilerContext& ctx, Module* mod, ResolutionStage maxStage)
-	: ctx(ctx), mod(mod), maxStage(maxStage), diagnoser(ctx, std::cout) {}
+	: ctx(ctx),
+	  mod(mod),
+	  maxStage(maxStage),
+	  diagnoser(ctx),
+	  deferredBodies(nullptr),
+	  sharedModule(false),
+	  dependent(mod),
+	  postponed(0) {}
 
 void Resolver::resolve() {
+	auto& path = mod->moduleInfo.path;
 	mod->ast->stage++;
 	while (mod->ast->stage < maxStage) {
+		Profiler::Span span(ctx.profiler, getStagePhase(mod->ast->stage), path);
 		resolveGlobalScope();
 		mod->ast->stage++;
 	}
 
-	resolveGlobalScope();
+	Profiler::Span span(ctx.profiler, getStagePhase(mod->ast->stage), path);
+	if (mod->ast->stage == ResolutionStage::RESOLVED && ctx.pool &&
+		ctx.jobs > 1)
+		resolveGlobalScopeInParallel();
+	else
+		resolveGlobalScope();
 }
 
-void Resolver::resolveGlobalScope() {
-	if (mod->ast->stage == ResolutionStage::EXTERNAL_TYPES) {
-		ImportHandler ih = ImportHandler(ctx, mod);
-		ih.resolveImports();
+void Resolver::resolveGlobalScopeInParallel() {
+	List<std::unique_ptr<DeferredBody>> bodies;
+	bodies.push_back(std::make_unique<DeferredBody>(nullptr));
+	diagnoser.setDest(&bodies.back()->diagnostics);
+	deferredBodies = &bodies;
+
+	try {
+		resolveGlobalScope();
+	} catch (...) {
+		bodies.back()->error = std::current_exception();
+	}
+
+	deferredBodies = nullptr;
+	diagnoser.setDest(nullptr);
+
+	// This already runs on the pool that compiles the modules, which keeps
+	// resolving other modules while waiting for the bodies
+	List<std::function<void()>> tasks;
+	for (auto& b : bodies) {
+		if (!b->body) continue;
+		DeferredBody* body = b.get();
+		tasks.push_back([this, body]() { resolveDeferredBody(*body); });
+	}
+	ctx.pool->run(tasks);
+
+	// Stop at the first error just like resolving the bodies in order would
+	auto& dest = diagnoser.getDest();
+	for (auto& b : bodies) {
+		dest.insert(dest.end(), b->diagnostics.begin(), b->diagnostics.end());
+		if (b->error) std::rethrow_exception(b->error);
+	}
+}
+
+bool Resolver::deferBody(Scope* body) {
+	if (!deferredBodies) return false;
+
+	auto deferred = std::make_unique<DeferredBody>(body);
+	deferred->scopes = scopes;
+	deferred->lexicalScopes = lexicalScopes;
+	deferredBodies->push_back(std::move(deferred));
+
+	// The queries containing the body aren't complete until it is resolved
+	postponed++;
+
+	// Diagnostics that come after the body in source order
+	deferredBodies->push_back(std::make_unique<DeferredBody>(nullptr));
+	diagnoser.setDest(&deferredBodies->back()->diagnostics);
+	return true;
+}
+
+void Resolver::resolveDeferredBody(DeferredBody& body) {
+	Profiler::Span span(ctx.profiler, getStagePhase(mod->ast->stage),
+						mod->moduleInfo.path);
+	Resolver resolver = Resolver(ctx, mod, maxStage);
+	resolver.scopes = body.scopes;
+	resolver.lexicalScopes = body.lexicalScopes;
+	resolver.sharedModule = true;
+	resolver.dependent = dependent;
+	resolver.diagnoser.setDest(&body.diagnostics);
+
+	try {
+		if (Function* f = dynamic_cast<Function*>(body.body))
+			resolver.runQuery(f->contentQuery,
+							  [&]() { resolver.resolveFunctionBody(f); });
+		else if (Constructor* c = dynamic_cast<Constructor*>(body.body))
+			resolver.runQuery(c->contentQuery,
+							  [&]() { resolver.resolveConstructorBody(c); });
+	} catch (UnresolvedSymbolException& e) {
+		// This is what resolveNonLocalContent() does in the final stage
+		resolver.diagnoser.diagnose(ec::UNRESOLVED_SYMBOL, e.id->meta,
+									e.id->data.length());
+		body.error = std::current_exception();
+	} catch (...) {
+		body.error = std::current_exception();
 	}
+}
+
+void Resolver::runQuery(QueryState& query,
+						const std::function<void()>& resolve) {
+	if (query == QueryState::DONE) return;
 
-	pushScope(mod->ast->globalScope, true);
-	for (auto& c : mod->ast->globalScope->content) {
-		resolveNonLocalContent(c);
+	auto previouslyPostponed = postponed;
+	query = QueryState::ACTIVE;
+	try {
+		resolve();
+	} catch (...) {
+		query = QueryState::PENDING;
+		throw;
 	}
+
+	query = postponed == previouslyPostponed ? QueryState::DONE
+											 : QueryState::PENDING;
+}
+
+void Resolver::runMembersQuery(Symbol* n,
+							   const std::function<void()>& resolve) {
+	// The type stages only resolve the signatures of the members, so they
+	// can't complete the query but still have to visit every member
+	if (!isTypeStage(mod->ast->stage))
+		runQuery(n->contentQuery, resolve);
+	else if (n->contentQuery != QueryState::DONE)
+		resolve();
+}
+
+void Resolver::resolveGlobalScope() {
+	if (mod->ast->stage == ResolutionStage::EXTERNAL_TYPES)
+		resolveImports(mod);
+
+	auto gs = mod->ast->globalScope;
+	pushScope(gs, true);
+	runMembersQuery(gs, [&]() {
+		for (auto& c : gs->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
+void Resolver::resolveImports(Module* m) {
+	try {
+		ImportHandler ih = ImportHandler(ctx, m);
+		ih.resolveImports();
+	} catch (UnresolvedImportException& e) {
+		diagnoser.diagnose(ec::UNRESOLVED_IMPORT, e.meta, 1, e.reason);
+		m->failed = true;
+		throw AcceleException();
+	}
+}
+
 void Resolver::resolveNonLocalContent(Node* n) {
 	try {
 		if (Class* c = dynamic_cast<Class*>(n))
@@ -688,65 +703,88 @@ void Resolver::resolveNonLocalContent(Node* n) {
 							   e.id->data.length());
 			throw e;
 		}
+		postponed++;
 	}
 }
 
+void Resolver::resolveTypeSignature(Type* n) {
+	runQuery(n->signatureQuery, [&]() {
+		for (auto& g : n->generics) resolveGenericType(g);
+		for (auto& p : n->parentTypes) resolveTypeRef(p);
+	});
+}
+
 void Resolver::resolveClass(Class* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& p : n->parentTypes) resolveTypeRef(p);
-	for (auto& c : n->content) resolveNonLocalContent(c);
+	resolveTypeSignature(n);
+	runMembersQuery(n, [&]() {
+		for (auto& c : n->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
 void Resolver::resolveStruct(Struct* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& p : n->parentTypes) resolveTypeRef(p);
-	for (auto& c : n->content) resolveNonLocalContent(c);
+	resolveTypeSignature(n);
+	runMembersQuery(n, [&]() {
+		for (auto& c : n->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
 void Resolver::resolveTemplate(Template* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& p : n->parentTypes) resolveTypeRef(p);
-	for (auto& c : n->content) resolveNonLocalContent(c);
+	resolveTypeSignature(n);
+	runMembersQuery(n, [&]() {
+		for (auto& c : n->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
 void Resolver::resolveEnum(Enum* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& p : n->parentTypes) resolveTypeRef(p);
-	for (auto& c : n->content) resolveNonLocalContent(c);
+	resolveTypeSignature(n);
+	runMembersQuery(n, [&]() {
+		for (auto& c : n->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
 void Resolver::resolveNamespace(Namespace* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& c : n->content) resolveNonLocalContent(c);
+	runQuery(n->signatureQuery, [&]() {
+		for (auto& g : n->generics) resolveGenericType(g);
+	});
+	runMembersQuery(n, [&]() {
+		for (auto& c : n->content) resolveNonLocalContent(c);
+	});
 	popScope();
 }
 
 void Resolver::resolveAlias(Alias* n) {
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	resolveTypeRef(n->value);
+	runQuery(n->signatureQuery, [&]() {
+		for (auto& g : n->generics) resolveGenericType(g);
+		resolveTypeRef(n->value);
+	});
 	popScope();
 }
 
+void Resolver::resolveVariableSignature(Variable* n) {
+	runQuery(n->signatureQuery, [&]() {
+		if (!n->actualType && n->declaredType) {
+			resolveTypeRef(n->declaredType);
+			n->actualType = n->declaredType;
+		}
+	});
+}
+
 void Resolver::resolveVariable(Variable* n) {
-	pushSymbol(n);
+	resolveVariableSignature(n);
 
-	if (!n->actualType && n->declaredType) {
-		resolveTypeRef(n->declaredType);
-		n->actualType = n->declaredType;
-	}
+	if (!n->value || isTypeStage(mod->ast->stage)) return;
 
-	if (n->value && mod->ast->stage != ResolutionStage::INTERNAL_TYPES &&
-		mod->ast->stage != ResolutionStage::EXTERNAL_TYPES) {
+	runQuery(n->contentQuery, [&]() {
 		if (VariableBlock* vb = dynamic_cast<VariableBlock*>(n->value)) {
 			// TODO: Resolve variable block
 
@@ -760,57 +798,74 @@ void Resolver::resolveVariable(Variable* n) {
 				n->actualType = e->valueType;
 			}
 		}
-	}
-
-	popSymbol();
+	});
 }
 
 void Resolver::resolveEnumCase(EnumCase* n) {
-	if (mod->ast->stage != ResolutionStage::INTERNAL_TYPES &&
-		mod->ast->stage != ResolutionStage::EXTERNAL_TYPES) {
+	if (isTypeStage(mod->ast->stage)) return;
+
+	runQuery(n->contentQuery, [&]() {
 		for (auto& e : n->args) resolveExpression(e);
 		// TODO: Check to make sure the arguments are valid for the enum
-	}
+	});
+}
+
+void Resolver::resolveConstructorSignature(Constructor* n) {
+	runQuery(n->signatureQuery, [&]() {
+		for (auto& p : n->parameters) resolveParameter(p, nullptr);
+	});
 }
 
 void Resolver::resolveConstructor(Constructor* n) {
 	pushScope(n, true);
-	for (auto& p : n->parameters) resolveParameter(p, nullptr);
+	resolveConstructorSignature(n);
 
-	if (mod->ast->stage != ResolutionStage::INTERNAL_TYPES &&
-		mod->ast->stage != ResolutionStage::EXTERNAL_TYPES) {
-		for (auto& c : n->content) resolveLocalContent(c, nullptr);
-	}
+	if (!isTypeStage(mod->ast->stage) && n->contentQuery != QueryState::DONE &&
+		!deferBody(n))
+		runQuery(n->contentQuery, [&]() { resolveConstructorBody(n); });
 	popScope();
 }
 
+void Resolver::resolveConstructorBody(Constructor* n) {
+	for (auto& c : n->content) resolveLocalContent(c, nullptr);
+}
+
+void Resolver::resolveFunctionSignature(Function* n) {
+	runQuery(n->signatureQuery, [&]() {
+		for (auto& g : n->generics) resolveGenericType(g);
+		for (auto& p : n->parameters) resolveParameter(p, nullptr);
+
+		if (!n->actualReturnType) {
+			if (n->declaredReturnType) {
+				resolveTypeRef(n->declaredReturnType);
+				n->actualReturnType = n->declaredReturnType;
+			} else if (!n->hasBody)
+				n->actualReturnType = tb::base(
+					const_cast<bt::InvariantType*>(bt::VOID), {});
+		}
+	});
+}
+
 void Resolver::resolveFunction(Function* n) {
-	pushSymbol(n);
 	pushScope(n, true);
-	for (auto& g : n->generics) resolveGenericType(g);
-	for (auto& p : n->parameters) resolveParameter(p, nullptr);
-
-	if (!n->actualReturnType) {
-		if (n->declaredReturnType) {
-			resolveTypeRef(n->declaredReturnType);
-			n->actualReturnType = n->declaredReturnType;
-		} else if (!n->hasBody)
-			n->actualReturnType = tb::base(
-				const_cast<bt::InvariantType*>(bt::VOID), {}, n->sourceMeta);
-	}
-
-	if (mod->ast->stage != ResolutionStage::INTERNAL_TYPES &&
-		mod->ast->stage != ResolutionStage::EXTERNAL_TYPES) {
-		try {
-			TypeRef* returnType = nullptr;
-			for (auto& c : n->content) resolveLocalContent(c, &returnType);
-			if (!n->actualReturnType) n->actualReturnType = returnType;
-		} catch (RecursiveResolutionException& e) {
-		}
-	}
+	resolveFunctionSignature(n);
+
+	// Bodies which still determine the return type are resolved right away
+	if (!isTypeStage(mod->ast->stage) && n->contentQuery != QueryState::DONE &&
+		(!n->actualReturnType || !deferBody(n)))
+		runQuery(n->contentQuery, [&]() { resolveFunctionBody(n); });
 
 	popScope();
-	popSymbol();
+}
+
+void Resolver::resolveFunctionBody(Function* n) {
+	try {
+		TypeRef* returnType = nullptr;
+		for (auto& c : n->content) resolveLocalContent(c, &returnType);
+		if (!n->actualReturnType) n->actualReturnType = returnType;
+	} catch (RecursiveResolutionException& e) {
+		postponed++;
+	}
 }
 
 void Resolver::resolveGenericType(GenericType* n) {
@@ -822,7 +877,7 @@ void Resolver::resolveGenericType(GenericType* n) {
 		n->actualParentType = n->declaredParentType;
 	} else {
 		n->actualParentType = tb::base(const_cast<bt::InvariantType*>(bt::ANY),
-									   {}, n->sourceMeta);
+									   {});
 	}
 }
 
@@ -834,8 +889,7 @@ static bool hasGenericType(const List<GenericType*>& list, const String& id) {
 }
 
 static TypeRef* generateGenericType(List<GenericType*>& dest,
-									const SourceMeta& typeMeta,
-									const SourceMeta& refMeta) {
+									const SourceMeta& typeMeta) {
 	int suffix = 1;
 	String id = "T";
 	while (hasGenericType(dest, id)) {
@@ -848,7 +902,7 @@ static TypeRef* generateGenericType(List<GenericType*>& dest,
 		new GenericType(new Token(TokenType::ID, id, typeMeta), nullptr);
 	dest.push_back(type);
 
-	return tb::base(type, {}, refMeta);
+	return tb::base(type, {});
 }
 
 void Resolver::resolveParameter(Parameter* n, TypeRef* intendedType) {
@@ -860,21 +914,20 @@ void Resolver::resolveParameter(Parameter* n, TypeRef* intendedType) {
 		n->actualType = n->declaredType;
 	} else if (intendedType) {
 		// We have to "copy" the intended type because we don't want the
-		// parameter to delete the original intended type when it's type to
+		// parameter to delete the original intended type when it's time to
 		// delete the parameter
 		n->actualType =
-			tb::base(intendedType->actualType, {}, intendedType->sourceMeta);
-		n->actualType->actualGenerics = intendedType->actualGenerics;
+			tb::base(intendedType->actualType, intendedType->actualGenerics);
 	} else if (Function* f = dynamic_cast<Function*>(peekScope())) {
 		n->actualType =
-			generateGenericType(f->generics, f->sourceMeta, n->sourceMeta);
+			generateGenericType(f->generics, f->sourceMeta);
 	} else {
-		n->actualType = tb::base(const_cast<bt::InvariantType*>(bt::ANY), {},
-								 n->sourceMeta);
+		n->actualType = tb::base(const_cast<bt::InvariantType*>(bt::ANY), {});
 	}
 }
 
 void Resolver::resolveLocalContent(Node* n, TypeRef** destReturnType) {
+	ScratchArena::Frame frame(scratch);
 	try {
 		if (Variable* e = dynamic_cast<Variable*>(n))
 			resolveVariable(e);
@@ -909,6 +962,7 @@ void Resolver::resolveLocalContent(Node* n, TypeRef** destReturnType) {
 		}
 	} catch (UnresolvedSymbolException& e) {
 		if (mod->ast->stage == ResolutionStage::RESOLVED) throw e;
+		postponed++;
 	}
 }
 
@@ -920,14 +974,12 @@ void Resolver::resolveFunctionBlock(FunctionBlock* n,
 }
 
 void Resolver::resolveIfBlock(IfBlock* n, TypeRef** destReturnType) {
-	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {},
-							bt::BOOL->sourceMeta);
+	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 
 	pushScope(n->block, true);
 
 	resolveExpression(n->condition);
 	if (!type::canCastTo(n->condition->valueType, boolRef)) {
-		delete boolRef;
 		diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, n->condition->sourceMeta,
 						   1, "Expected Bool type for if-block condition");
 		throw AcceleException();
@@ -941,7 +993,6 @@ void Resolver::resolveIfBlock(IfBlock* n, TypeRef** destReturnType) {
 		pushScope(elif->block, true);
 		resolveExpression(elif->condition);
 		if (!type::canCastTo(elif->condition->valueType, boolRef)) {
-			delete boolRef;
 			diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH,
 							   n->condition->sourceMeta, 1,
 							   "Expected Bool type for elif-block condition");
@@ -956,18 +1007,15 @@ void Resolver::resolveIfBlock(IfBlock* n, TypeRef** destReturnType) {
 		resolveFunctionBlock(n->elseBlock, destReturnType);
 	}
 
-	delete boolRef;
 }
 
 void Resolver::resolveWhileBlock(WhileBlock* n, TypeRef** destReturnType) {
-	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {},
-							bt::BOOL->sourceMeta);
+	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 
 	pushScope(n->block, true);
 
 	resolveExpression(n->condition);
 	if (!type::canCastTo(n->condition->valueType, boolRef)) {
-		delete boolRef;
 		diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, n->condition->sourceMeta,
 						   1, "Expected Bool type for while-block condition");
 		throw AcceleException();
@@ -977,18 +1025,15 @@ void Resolver::resolveWhileBlock(WhileBlock* n, TypeRef** destReturnType) {
 
 	popScope();
 
-	delete boolRef;
 }
 
 void Resolver::resolveRepeatBlock(RepeatBlock* n, TypeRef** destReturnType) {
-	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {},
-							bt::BOOL->sourceMeta);
+	auto boolRef = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 
 	pushScope(n->block, true);
 
 	resolveExpression(n->condition);
 	if (!type::canCastTo(n->condition->valueType, boolRef)) {
-		delete boolRef;
 		diagnoser.diagnose(ec::ARGUMENT_TYPE_MISMATCH, n->condition->sourceMeta,
 						   1, "Expected Bool type for repeat-block condition");
 		throw AcceleException();
@@ -998,7 +1043,6 @@ void Resolver::resolveRepeatBlock(RepeatBlock* n, TypeRef** destReturnType) {
 
 	popScope();
 
-	delete boolRef;
 }
 
 void Resolver::resolveForBlock(ForBlock* n, TypeRef** destReturnType) {
@@ -1036,7 +1080,7 @@ void Resolver::resolveTryBlock(TryBlock* n, TypeRef** destReturnType) {
 
 void Resolver::resolveReturnStatement(ReturnStatement* n,
 									  TypeRef** destReturnType) {
-	auto f = getOwningFunction(peekScope());
+	auto f = peekScope()->getInfo().owningFunction;
 
 	TypeRef* returnType = nullptr;
 
@@ -1049,21 +1093,22 @@ void Resolver::resolveReturnStatement(ReturnStatement* n,
 				if (mod->ast->stage != ResolutionStage::INTERNAL_ALL &&
 					mod->ast->stage != ResolutionStage::RESOLVED)
 					throw e;
+
+				// The value is resolved again in the next stage
+				postponed++;
 				if (Function* func = dynamic_cast<Function*>(f)) {
-					auto g = generateGenericType(
-						func->generics, func->sourceMeta, n->sourceMeta);
+					auto g =
+						generateGenericType(func->generics, func->sourceMeta);
 					returnType = g;
 				} else {
 					returnType =
-						tb::base(const_cast<bt::InvariantType*>(bt::ANY), {},
-								 n->sourceMeta);
+						tb::base(const_cast<bt::InvariantType*>(bt::ANY), {});
 				}
 			}
 		} else
 			returnType = n->value->valueType;
 	} else {
-		returnType = tb::base(const_cast<bt::InvariantType*>(bt::VOID), {},
-							  n->sourceMeta);
+		returnType = tb::base(const_cast<bt::InvariantType*>(bt::VOID), {});
 	}
 
 	if (Function* func = dynamic_cast<Function*>(f)) {
@@ -1100,8 +1145,10 @@ void Resolver::resolveThrowStatement(ThrowStatement* n) {
 #endif
 
 void Resolver::resolveTypeRef(TypeRef* n) {
-	// We don't want to resolve the same thing more than once
-	if (n->actualType) return;
+	// We don't want to resolve the same thing more than once. Canonical refs
+	// (such as the implicit Any parent of every type) are resolved when they
+	// are built and are shared, so they must never be written to.
+	if (n->actualType || n->canonical) return;
 
 	if (SimpleTypeRef* c = dynamic_cast<SimpleTypeRef*>(n))
 		resolveSimpleTypeRef(c);
@@ -1135,9 +1182,11 @@ void Resolver::resolveSimpleTypeRef(SimpleTypeRef* n) {
 		{SearchTarget::TYPE},
 		true,
 		false};
-	List<resolve::SearchResult> results;
+	ScratchArena::Frame frame(scratch);
+	resolve::SearchResults results(&scratch);
 	resolveSymbol(results, scope, n->id, searchCriteria.recursive,
 				  searchCriteria.allowExternal, searchCriteria.targets);
+	for (auto& r : results) requireSignature(r.symbol, r.owningScope);
 	n->referent = getSymbolReferent(results, n->generics, searchCriteria, n->id,
 									getLexicalScope(), diagnoser);
 
@@ -1160,9 +1209,11 @@ Scope* Resolver::resolveSimpleTypeRefParent(SimpleTypeRef* n) {
 		{SearchTarget::TYPE, SearchTarget::NAMESPACE},
 		true,
 		false};
-	List<resolve::SearchResult> results;
+	ScratchArena::Frame frame(scratch);
+	resolve::SearchResults results(&scratch);
 	resolveSymbol(results, scope, n->id, searchCriteria.recursive,
 				  searchCriteria.allowExternal, searchCriteria.targets);
+	for (auto& r : results) requireSignature(r.symbol, r.owningScope);
 	n->referent = getSymbolReferent(results, n->generics, searchCriteria, n->id,
 									getLexicalScope(), diagnoser);
 
@@ -1312,7 +1363,7 @@ void Resolver::resolveFunctionCallExpression(
 		}
 
 		// Make sure arguments are compatible
-		validateFunctionCallArgs(f->paramTypes, argTypes, n->sourceMeta,
+		validateFunctionCallArgs(f->paramTypes, n->args, n->sourceMeta,
 								 diagnoser);
 
 		n->valueType = f->returnType;
@@ -1322,9 +1373,8 @@ void Resolver::resolveFunctionCallExpression(
 void Resolver::resolveTernaryExpression(TernaryExpression* n) {
 	resolveExpression(n->arg0);
 	auto boolRef =
-		tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {}, n->sourceMeta);
+		tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 	if (!type::canCastTo(n->arg0->valueType, boolRef)) {
-		delete boolRef;
 		diagnoser.diagnose(
 			ec::ARGUMENT_TYPE_MISMATCH, n->arg0->sourceMeta, 1,
 			"Expected Bool type for ternary expression condition");
@@ -1337,7 +1387,6 @@ void Resolver::resolveTernaryExpression(TernaryExpression* n) {
 	TypeRef* a = n->arg1->valueType;
 	TypeRef* b = n->arg2->valueType;
 
-	delete boolRef;
 
 	n->valueType = const_cast<TypeRef*>(type::getMinCommonType(a, b));
 }
@@ -1370,11 +1419,9 @@ void Resolver::resolveAccessExpression(BinaryExpression* n,
 		resolveExpression0(n->left, &leftCriteria, nullptr);
 		pushScope(getScopeFromExpression(n->left), false);
 
-		List<SearchTarget> actualTargets;
+		SearchTargets actualTargets;
 		if (searchCriteria)
-			actualTargets.insert(actualTargets.end(),
-								 searchCriteria->targets.begin(),
-								 searchCriteria->targets.end());
+			actualTargets = searchCriteria->targets;
 		else {
 			actualTargets.push_back(SearchTarget::NAMESPACE);
 			actualTargets.push_back(SearchTarget::VARIABLE);
@@ -1407,11 +1454,9 @@ void Resolver::resolveAccessExpression(BinaryExpression* n,
 
 		pushScope(getScopeFromTypeRef(s->type), false);
 
-		List<SearchTarget> actualTargets;
+		SearchTargets actualTargets;
 		if (searchCriteria)
-			actualTargets.insert(actualTargets.end(),
-								 searchCriteria->targets.begin(),
-								 searchCriteria->targets.end());
+			actualTargets = searchCriteria->targets;
 		else {
 			actualTargets.push_back(SearchTarget::NAMESPACE);
 			actualTargets.push_back(SearchTarget::VARIABLE);
@@ -1457,11 +1502,9 @@ void Resolver::resolveIdentifierExpression(IdentifierExpression* n,
 	if (dest) *dest = n;
 	for (auto& g : n->generics) resolveTypeRef(g);
 
-	List<SearchTarget> actualTargets;
+	SearchTargets actualTargets;
 	if (searchCriteria)
-		actualTargets.insert(actualTargets.end(),
-							 searchCriteria->targets.begin(),
-							 searchCriteria->targets.end());
+		actualTargets = searchCriteria->targets;
 	else {
 		actualTargets.push_back(SearchTarget::TYPE);
 		actualTargets.push_back(SearchTarget::VARIABLE);
@@ -1473,9 +1516,11 @@ void Resolver::resolveIdentifierExpression(IdentifierExpression* n,
 		searchCriteria ? searchCriteria->requireExactMatch : true,
 		searchCriteria ? searchCriteria->modifiable : false};
 
-	List<resolve::SearchResult> results;
+	ScratchArena::Frame frame(scratch);
+	resolve::SearchResults results(&scratch);
 	resolveSymbol(results, peekScope(), n->value, actualCriteria.recursive,
 				  actualCriteria.allowExternal, actualCriteria.targets);
+	for (auto& r : results) requireSignature(r.symbol, r.owningScope);
 	if (results.empty()) {
 		throw UnresolvedSymbolException(n->value);
 	}
@@ -1483,9 +1528,9 @@ void Resolver::resolveIdentifierExpression(IdentifierExpression* n,
 		n->referent = getSymbolReferent(results, n->generics, actualCriteria,
 										n->value, getLexicalScope(), diagnoser);
 		n->valueType = getSymbolReturnType(n->referent, n->sourceMeta);
-	} else
-		n->possibleReferents.insert(n->possibleReferents.end(), results.begin(),
-									results.end());
+	} else {
+		for (auto& r : results) n->possibleReferents.push_back(r);
+	}
 }
 
 void Resolver::resolveArrayLiteralExpression(ArrayLiteralExpression* n) {
@@ -1536,30 +1581,23 @@ void Resolver::resolveTupleLiteralExpression(TupleLiteralExpression* n) {
 
 void Resolver::resolveLiteralExpression(LiteralExpression* n) {
 	if (n->value->type == TokenType::FLOAT_LITERAL)
-		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::DOUBLE), {},
-								n->sourceMeta);
+		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::DOUBLE), {});
 	else if (n->value->type == TokenType::BOOLEAN_LITERAL)
-		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {},
-								n->sourceMeta);
+		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 	else if (n->value->type == TokenType::INTEGER_LITERAL ||
 			 n->value->type == TokenType::BINARY_LITERAL ||
 			 n->value->type == TokenType::OCTAL_LITERAL ||
 			 n->value->type == TokenType::HEX_LITERAL)
-		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::INT), {},
-								n->sourceMeta);
+		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::INT), {});
 	else if (n->value->type == TokenType::NIL_LITERAL)
 		n->valueType = tb::unwrappedOptional(tb::base(
-			const_cast<bt::InvariantType*>(bt::ANY), {}, n->sourceMeta));
+			const_cast<bt::InvariantType*>(bt::ANY), {}));
 	else if (n->value->type == TokenType::STRING_LITERAL)
-		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::STRING), {},
-								n->sourceMeta);
+		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::STRING), {});
 	else if (n->value->type == TokenType::SELF) {
-		Scope* currentScope = peekScope();
-		while (isFunctionScope(currentScope))
-			currentScope = currentScope->parentScope;
-
-		Type* t = dynamic_cast<Type*>(currentScope);
-		if (!t || isStaticContext(peekScope())) {
+		const auto& info = peekScope()->getInfo();
+		Type* t = info.selfType;
+		if (!t || info.staticContext) {
 			diagnoser.diagnose(ec::STATIC_SELF, n->sourceMeta,
 							   n->value->data.length(),
 							   "Cannot reference \"self\" in a static context");
@@ -1568,17 +1606,14 @@ void Resolver::resolveLiteralExpression(LiteralExpression* n) {
 
 		List<TypeRef*> generics;
 		for (auto& g : t->generics) {
-			generics.push_back(tb::base(g, {}, n->sourceMeta));
+			generics.push_back(tb::base(g, {}));
 		}
 
-		n->valueType = tb::base(t, generics, n->sourceMeta);
+		n->valueType = tb::base(t, generics);
 	} else if (n->value->type == TokenType::SUPER) {
-		Scope* currentScope = peekScope();
-		while (isFunctionScope(currentScope))
-			currentScope = currentScope->parentScope;
-
-		Type* t = dynamic_cast<Type*>(currentScope);
-		if (!t || isStaticContext(peekScope())) {
+		const auto& info = peekScope()->getInfo();
+		Type* t = info.selfType;
+		if (!t || info.staticContext) {
 			diagnoser.diagnose(
 				ec::STATIC_SUPER, n->sourceMeta, n->value->data.length(),
 				"Cannot reference \"super\" in a static context");
@@ -1587,7 +1622,7 @@ void Resolver::resolveLiteralExpression(LiteralExpression* n) {
 
 		List<TypeRef*> generics;
 		for (auto& g : t->generics) {
-			generics.push_back(tb::base(g, {}, n->sourceMeta));
+			generics.push_back(tb::base(g, {}));
 		}
 
 		n->valueType = new SuperTypeRef(n->sourceMeta, t);
@@ -1620,8 +1655,7 @@ void Resolver::resolveCastingExpression(CastingExpression* n) {
 	resolveTypeRef(n->right);
 
 	if (n->op->type == TokenType::IS) {
-		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {},
-								n->sourceMeta);
+		n->valueType = tb::base(const_cast<bt::InvariantType*>(bt::BOOL), {});
 	} else if (n->op->type == TokenType::AS) {
 		n->valueType = n->right;
 	} else if (n->op->type == TokenType::AS_OPTIONAL) {
@@ -1643,28 +1677,129 @@ void Resolver::resolveCastingExpression(CastingExpression* n) {
 #pragma region HelperFunctions
 #endif
 
+// Symbols of other modules are resolved lazily by whichever resolver needs them
+// first, and modules (as well as the bodies within a module) may be resolved in
+// parallel
+static std::recursive_mutex sharedResolutionMutex;
+
+std::unique_lock<std::recursive_mutex> Resolver::lockSharedSymbol(
+	const Symbol* symbol) {
+	if (!sharedModule && symbol->sourceMeta.getModuleInfo() == &mod->moduleInfo)
+		return {};
+	return std::unique_lock<std::recursive_mutex>(sharedResolutionMutex);
+}
+
+void resolveOnDemand(Module* m) {
+	m->ast->stage = ResolutionStage::INTERNAL_ALL;
+	m->ast->onDemand = true;
+}
+
+void Resolver::requireSignature(Symbol* symbol, Scope* owningScope) {
+	const Module* owner = mod;
+	if (symbol->sourceMeta.getModuleInfo() != &mod->moduleInfo)
+		owner = ctx.findModule(symbol->sourceMeta.getModuleInfo());
+	if (!owner) return;
+
+	if (owner != dependent) {
+		auto name = getQualifiedName(owningScope, symbol);
+		if (name.empty())
+			dependent->addUntrackedDependency();
+		else
+			dependent->addDependency(owner->moduleInfo.path, name);
+	}
+
+	if (!owner->ast->onDemand) return;
+
+	// Several modules may need the same symbols
+	std::lock_guard<std::recursive_mutex> lock(sharedResolutionMutex);
+	if (symbol->signatureQuery == QueryState::DONE) return;
+
+	// Signatures may refer to the symbols the owner imports, so its imports
+	// are resolved along with the first signature that is needed
+	auto m = const_cast<Module*>(owner);
+	// The missing imports have already been reported
+	if (m->failed) throw AcceleException();
+	if (m->ast->stage == ResolutionStage::INTERNAL_ALL) {
+		resolveImports(m);
+		m->ast->stage = ResolutionStage::EXTERNAL_NON_RECURSIVE;
+	}
+
+	Profiler::Span span(ctx.profiler, getStagePhase(m->ast->stage),
+						m->moduleInfo.path);
+	Resolver resolver = Resolver(ctx, m, ResolutionStage::INTERNAL_ALL);
+	resolver.sharedModule = true;
+	resolver.dependent = dependent;
+	resolver.diagnoser.setDest(&diagnoser.getDest());
+	resolver.resolveSignature(symbol, owningScope);
+}
+
+void Resolver::resolveSignature(Symbol* symbol, Scope* owningScope) {
+	List<Scope*> owners;
+	for (auto s = owningScope; s; s = s->parentScope) owners.push_back(s);
+	for (auto it = owners.rbegin(); it != owners.rend(); it++)
+		pushScope(*it, true);
+
+	try {
+		// The content of a symbol is only needed if it determines its type
+		if (Function* n = dynamic_cast<Function*>(symbol)) {
+			pushScope(n, true);
+			resolveFunctionSignature(n);
+			if (!n->actualReturnType)
+				runQuery(n->contentQuery, [&]() { resolveFunctionBody(n); });
+			popScope();
+		} else if (Variable* n = dynamic_cast<Variable*>(symbol)) {
+			resolveVariableSignature(n);
+			if (!n->actualType) resolveVariable(n);
+		} else if (Constructor* n = dynamic_cast<Constructor*>(symbol)) {
+			pushScope(n, true);
+			resolveConstructorSignature(n);
+			popScope();
+		} else if (Alias* n = dynamic_cast<Alias*>(symbol)) {
+			resolveAlias(n);
+		} else if (GenericType* n = dynamic_cast<GenericType*>(symbol)) {
+			resolveGenericType(n);
+		} else if (Type* n = dynamic_cast<Type*>(symbol)) {
+			pushScope(dynamic_cast<Scope*>(n), true);
+			resolveTypeSignature(n);
+			popScope();
+		} else if (Namespace* n = dynamic_cast<Namespace*>(symbol)) {
+			runQuery(n->signatureQuery, [&]() {
+				for (auto& g : n->generics) resolveGenericType(g);
+			});
+		}
+	} catch (UnresolvedSymbolException& e) {
+		// Just like resolving the module up to its internal stages, which
+		// leaves whatever it can't resolve to the importers
+	}
+
+	for (std::size_t i = 0; i < owners.size(); i++) scopes.pop_back();
+}
+
 TypeRef* Resolver::getSymbolReturnType(Symbol* symbol,
 									   const SourceMeta& refererMeta) {
 	if (Variable* n = dynamic_cast<Variable*>(symbol)) {
 		if (!n->actualType) {
-			if (stackContainsSymbol(n)) {
+			auto lock = lockSharedSymbol(n);
+			if (!n->actualType && isQueryActive(n)) {
 				diagnoser.diagnose(
 					ec::UNDEFINED_SYMBOL, refererMeta,
 					symbol->id->data.length(),
 					"Cannot reference a symbol before it is defined");
 				throw AcceleException();
 			}
-			resolveVariable(n);
+			if (!n->actualType) resolveVariable(n);
 		}
 		return n->actualType;
 	}
 	if (Parameter* n = dynamic_cast<Parameter*>(symbol)) return n->actualType;
 	if (EnumCase* n = dynamic_cast<EnumCase*>(symbol))
-		return tb::base(n->enumType, {}, symbol->sourceMeta);
+		return tb::base(n->enumType, {});
 	if (Function* n = dynamic_cast<Function*>(symbol)) {
 		if (!n->actualReturnType) {
-			if (stackContainsSymbol(n)) throw RecursiveResolutionException();
-			resolveFunction(n);
+			auto lock = lockSharedSymbol(n);
+			if (!n->actualReturnType && isQueryActive(n))
+				throw RecursiveResolutionException();
+			if (!n->actualReturnType) resolveFunction(n);
 		}
 		List<TypeRef*> paramTypes;
 		for (auto& p : n->parameters) paramTypes.push_back(p->actualType);
@@ -1679,17 +1814,19 @@ TypeRef* Resolver::getSymbolReturnType(Symbol* symbol,
 	throw AcceleException();
 }
 
-void Resolver::getFunctionCallCandidateType(
-	Symbol* symbol, List<std::pair<Symbol*, FunctionTypeRef*>>& refs,
-	const SourceMeta& callerMeta) {
+void Resolver::getFunctionCallCandidateType(Symbol* symbol,
+											CandidateTypes& refs,
+											const SourceMeta& callerMeta) {
 	if (dynamic_cast<Variable*>(symbol) || dynamic_cast<Parameter*>(symbol)) {
 		refs.push_back(std::make_pair(
 			symbol, dynamic_cast<FunctionTypeRef*>(
 						getSymbolReturnType(symbol, callerMeta))));
 	} else if (Function* f = dynamic_cast<Function*>(symbol)) {
 		if (!f->actualReturnType) {
-			if (stackContainsSymbol(f)) throw RecursiveResolutionException();
-			resolveFunction(f);
+			auto lock = lockSharedSymbol(f);
+			if (!f->actualReturnType && isQueryActive(f))
+				throw RecursiveResolutionException();
+			if (!f->actualReturnType) resolveFunction(f);
 		}
 		List<TypeRef*> paramTypes;
 		for (auto& p : f->parameters) paramTypes.push_back(p->actualType);
@@ -1701,12 +1838,12 @@ void Resolver::getFunctionCallCandidateType(
 			"Enum cases cannot be the caller of a function call expression");
 		throw AcceleException();
 	} else if (Constructor* c = dynamic_cast<Constructor*>(symbol)) {
+		requireSignature(c, c->parentScope);
 		Type* owningType = dynamic_cast<Type*>(c->parentScope);
 		List<TypeRef*> paramTypes;
 		for (auto& p : c->parameters) paramTypes.push_back(p->actualType);
 		refs.push_back(std::make_pair(
-			symbol, tb::function(paramTypes, tb::base(owningType, {},
-													  symbol->sourceMeta))));
+			symbol, tb::function(paramTypes, tb::base(owningType, {}))));
 	} else if (Type* t = dynamic_cast<Type*>(symbol)) {
 		return getFcctForType(t, refs, callerMeta);
 	} else {
@@ -1716,15 +1853,91 @@ void Resolver::getFunctionCallCandidateType(
 	}
 }
 
-void Resolver::getFunctionCallCandidateTypes(
-	const List<resolve::SearchResult>& candidates,
-	List<List<std::pair<Symbol*, FunctionTypeRef*>>>& candidateTypes,
-	const SourceMeta& callerMeta) {
-	for (auto& c : candidates) {
-		List<std::pair<Symbol*, FunctionTypeRef*>> refs;
-		getFunctionCallCandidateType(c.symbol, refs, callerMeta);
-		candidateTypes.push_back(refs);
+OverloadSet::OverloadSet() : complete(false) {}
+
+OverloadSet& Resolver::getOverloadSet(IdentifierExpression* idexpr,
+									 const SourceMeta& callerMeta) {
+	List<Symbol*> key;
+	for (auto& r : idexpr->possibleReferents) key.push_back(r.symbol);
+
+	auto existing = overloadSets.find(key);
+	if (existing != overloadSets.end() && existing->second.complete)
+		return existing->second;
+
+	// The set is only stored once all of its candidates were gathered, so
+	// that a candidate whose type can't be determined doesn't leave a partial
+	// set behind
+	ScratchArena::Frame frame(scratch);
+	OverloadSet set;
+	set.complete = true;
+	for (std::size_t i = 0; i < idexpr->possibleReferents.size(); i++) {
+		CandidateTypes candidateTypes(&scratch);
+		getFunctionCallCandidateType(idexpr->possibleReferents[i].symbol,
+									 candidateTypes, callerMeta);
+		for (auto& c : candidateTypes) {
+			FunctionTypeRef* f = std::get<1>(c);
+			if (!f || !f->returnType) set.complete = false;
+			if (!f) continue;
+
+			bool variadic = false;
+			unsigned arity = getRequiredArity(f->paramTypes, variadic);
+			auto index = set.candidates.size();
+			set.candidates.push_back(
+				{i, std::get<0>(c), f, arity, variadic});
+			if (variadic)
+				set.variadic.push_back(index);
+			else
+				set.fixedArity[arity].push_back(index);
+		}
+	}
+
+	auto& result = overloadSets[key];
+	result = std::move(set);
+	return result;
+}
+
+std::size_t Resolver::selectOverload(OverloadSet& set,
+									 const List<TypeRef*>& args) {
+	// Argument types that haven't been resolved yet can't be memoized
+	bool cacheable = true;
+	for (auto& a : args)
+		if (!a || !a->actualType) cacheable = false;
+
+	if (cacheable) {
+		auto it = set.selections.find(args);
+		if (it != set.selections.end()) return it->second;
+	}
+
+	// Variadic candidates are only considered if none of the fixed-arity
+	// candidates accept the arguments
+	std::size_t result = OverloadSet::NO_MATCH;
+	int bestScore = -1;
+	auto fixed = set.fixedArity.find(args.size());
+	if (fixed != set.fixedArity.end()) {
+		for (auto& i : fixed->second) {
+			int score = getFunctionArgsScore(set.candidates[i].type->paramTypes,
+											 args);
+			if (score != -1 && (bestScore == -1 || score < bestScore)) {
+				result = i;
+				bestScore = score;
+			}
+		}
 	}
+
+	if (result == OverloadSet::NO_MATCH) {
+		for (auto& i : set.variadic) {
+			if (set.candidates[i].arity > args.size()) continue;
+			int score = getFunctionArgsScore(set.candidates[i].type->paramTypes,
+											 args);
+			if (score != -1 && (bestScore == -1 || score < bestScore)) {
+				result = i;
+				bestScore = score;
+			}
+		}
+	}
+
+	if (cacheable && set.complete) set.selections[args] = result;
+	return result;
 }
 
 Symbol* Resolver::getBestCallerForArgs(IdentifierExpression* idexpr,
@@ -1733,60 +1946,40 @@ Symbol* Resolver::getBestCallerForArgs(IdentifierExpression* idexpr,
 									   Scope* lexicalScope,
 									   const SearchCriteria& searchCriteria,
 									   TypeRef** destReturnType) {
-	List<List<std::pair<Symbol*, FunctionTypeRef*>>> candidateTypes;
-	getFunctionCallCandidateTypes(idexpr->possibleReferents, candidateTypes,
-								  callerMeta);
-
-	List<List<FCCandidate>> candidateScores;
-	getFunctionCallCandidateScores(candidateTypes, args, candidateScores,
-								   callerMeta);
+	auto& set = getOverloadSet(idexpr, callerMeta);
+	auto index = selectOverload(set, args);
 
-	List<std::pair<int, int>> indices;
-	sortFccScores(candidateScores, indices);
-
-	Symbol* result = nullptr;
-	for (auto& e : indices) {
-		if (candidateScores[std::get<0>(e)][std::get<1>(e)].score == -1)
-			continue;
-		else {
-			Token t = {TokenType::EOF_TOKEN, " ", callerMeta};
-			bool hasProblems = findSymbolCandidateProblems(
-				getFccSearchResult(
-					idexpr->possibleReferents[std::get<0>(e)],
-					std::get<0>(
-						candidateTypes[std::get<0>(e)][std::get<1>(e)])),
-				idexpr->generics, searchCriteria, &t, lexicalScope, diagnoser);
-
-			if (hasProblems) {
-				throw UnresolvedSymbolException(&t);
-			}
-
-			result =
-				std::get<0>(candidateTypes[std::get<0>(e)][std::get<1>(e)]);
-			*destReturnType =
-				std::get<1>(candidateTypes[std::get<0>(e)][std::get<1>(e)])
-					->returnType;
-			break;
-		}
-	}
-
-	if (!result) {
+	if (index == OverloadSet::NO_MATCH) {
 		diagnoser.diagnose(ec::INVALID_FUNCTION_CALLER, callerMeta, 1,
 						   "There are no candidate functions or function-like "
 						   "objects that accept the provided arguments");
 		throw AcceleException();
 	}
 
-	return result;
+	const auto& candidate = set.candidates[index];
+	// The token outlives this call if it ends up in the exception
+	auto t = new Token(TokenType::EOF_TOKEN, " ", callerMeta);
+	bool hasProblems = findSymbolCandidateProblems(
+		getFccSearchResult(idexpr->possibleReferents[candidate.referent],
+						   candidate.symbol),
+		idexpr->generics, searchCriteria, t, lexicalScope, diagnoser);
+
+	if (hasProblems) {
+		throw UnresolvedSymbolException(t);
+	}
+	delete t;
+
+	*destReturnType = candidate.type->returnType;
+	return candidate.symbol;
 }
 
-void Resolver::getFcctForType(Type* type,
-							  List<std::pair<Symbol*, FunctionTypeRef*>>& refs,
+void Resolver::getFcctForType(Type* type, CandidateTypes& refs,
 							  const SourceMeta& callerMeta) {
+	ScratchArena::Frame frame(scratch);
 	if (Class* n = dynamic_cast<Class*>(type)) {
 		for (auto& s : n->symbols) {
 			if (Constructor* c = dynamic_cast<Constructor*>(s)) {
-				List<std::pair<Symbol*, FunctionTypeRef*>> tmprefs;
+				CandidateTypes tmprefs(&scratch);
 				getFunctionCallCandidateType(c, tmprefs, callerMeta);
 				refs.push_back(tmprefs[0]);
 			}
@@ -1794,7 +1987,7 @@ void Resolver::getFcctForType(Type* type,
 	} else if (Struct* n = dynamic_cast<Struct*>(type)) {
 		for (auto& s : n->symbols) {
 			if (Constructor* c = dynamic_cast<Constructor*>(s)) {
-				List<std::pair<Symbol*, FunctionTypeRef*>> tmprefs;
+				CandidateTypes tmprefs(&scratch);
 				getFunctionCallCandidateType(c, tmprefs, callerMeta);
 				refs.push_back(tmprefs[0]);
 			}
@@ -1806,7 +1999,7 @@ void Resolver::getFcctForType(Type* type,
 	} else if (Enum* n = dynamic_cast<Enum*>(type)) {
 		for (auto& s : n->symbols) {
 			if (Constructor* c = dynamic_cast<Constructor*>(s)) {
-				List<std::pair<Symbol*, FunctionTypeRef*>> tmprefs;
+				CandidateTypes tmprefs(&scratch);
 				getFunctionCallCandidateType(c, tmprefs, callerMeta);
 				refs.push_back(tmprefs[0]);
 			}
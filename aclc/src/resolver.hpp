@@ -1,6 +1,10 @@
 #pragma once
 
 #include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
 
 #include "ast.hpp"
 #include "common.hpp"
@@ -8,28 +12,129 @@
 namespace acl {
 enum class SearchTarget { VARIABLE, TYPE, NAMESPACE };
 
+// There are only three kinds of targets, so the list never allocates
+using SearchTargets = SmallList<SearchTarget, 3>;
+
 struct SearchCriteria {
 	bool recursive;
 	bool allowExternal;
-	List<SearchTarget> targets;
+	SearchTargets targets;
 	bool requireExactMatch;
 
 	// For when you're searching for an lvalue as opposed to an rvalue
 	bool modifiable;
 };
 
+struct PointerListHash {
+	template <typename T>
+	std::size_t operator()(const List<T*>& list) const {
+		std::size_t result = list.size();
+		for (const auto& e : list)
+			result ^= std::hash<const T*>()(e) + 0x9e3779b9 + (result << 6) +
+					  (result >> 2);
+		return result;
+	}
+};
+
+// The function types of a candidate caller, of which a type has one for each
+// of its constructors
+using CandidateTypes = SmallList<std::pair<Symbol*, FunctionTypeRef*>, 2>;
+
+struct OverloadCandidate {
+	// Index of the search result this candidate came from
+	std::size_t referent;
+	Symbol* symbol;
+	FunctionTypeRef* type;
+	unsigned arity;
+	bool variadic;
+};
+
+/*
+The flattened candidates of an overloaded caller, bucketed by arity so that a
+call only scores the candidates that can accept its number of arguments. The
+chosen candidate for each argument type tuple is memoized in "selections"; this
+relies on equal argument type ref pointers always denoting equal types (see
+type_builder.hpp). Equal types with different pointers only miss the memo.
+
+A set is rebuilt on the next lookup if any candidate's type was still unknown
+when it was built.
+*/
+struct OverloadSet {
+	static constexpr std::size_t NO_MATCH = static_cast<std::size_t>(-1);
+
+	List<OverloadCandidate> candidates;
+	Map<unsigned, List<std::size_t>> fixedArity;
+	List<std::size_t> variadic;
+	std::unordered_map<List<TypeRef*>, std::size_t, PointerListHash>
+		selections;
+	bool complete;
+
+	OverloadSet();
+};
+
+/*
+A function or constructor body whose resolution was deferred during the final
+resolution stage so that it can be resolved on a worker thread. It carries a
+copy of the resolver state at the point where the body would have been
+resolved, along with the diagnostics the body produces. Bodies are only
+deferred once their signatures are known, so no other body depends on them.
+
+The resolver which defers the bodies records its own diagnostics in entries
+without a body, so that the diagnostics of every entry taken in order are in
+source order.
+*/
+struct DeferredBody {
+	Scope* body;
+	std::deque<Scope*> scopes;
+	std::deque<Scope*> lexicalScopes;
+	List<Diagnostic> diagnostics;
+	std::exception_ptr error;
+
+	DeferredBody(Scope* body);
+};
+
+/*
+Marks an imported module to be resolved on demand, as if it had been resolved
+up to ResolutionStage::INTERNAL_ALL. Only the signatures of the symbols other
+modules look up are resolved, along with whatever those signatures depend on
+(and the content of a symbol if its type is inferred from it). The imports of
+the module are resolved along with the first signature, so signatures can refer
+to imported symbols.
+*/
+void resolveOnDemand(Module* m);
+
 class Resolver {
 	std::deque<Scope*> scopes;
 	std::deque<Scope*> lexicalScopes;
 	CompilerContext& ctx;
 	Module* mod;
 	ResolutionStage maxStage;
-	List<Symbol*> symbolStack;
 	Diagnoser diagnoser;
+	std::unordered_map<List<Symbol*>, OverloadSet, PointerListHash>
+		overloadSets;
+
+	// Only set while the final stage of a module defers its bodies
+	List<std::unique_ptr<DeferredBody>>* deferredBodies;
+
+	// True if other resolvers may be working on the same module
+	bool sharedModule;
+
+	// The module that the symbols of other modules are recorded as
+	// dependencies of, which differs from "mod" while resolving the signatures
+	// another module needs
+	Module* dependent;
+
+	// The number of failures left for a later stage, which keeps the queries
+	// that ran into them from completing
+	std::size_t postponed;
+
+	// Holds the temporaries of lookups. Every function which fills a list in it
+	// holds a frame, as does every statement, so the arena is reset once the
+	// outermost of them is done.
+	ScratchArena scratch;
 
-	void pushSymbol(Symbol* symbol);
-	void popSymbol();
-	bool stackContainsSymbol(Symbol* symbol);
+	void runQuery(QueryState& query, const std::function<void()>& resolve);
+	void runMembersQuery(Symbol* n, const std::function<void()>& resolve);
 
 	void pushScope(Scope* scope, bool isLexicalScope);
 	Scope* peekScope();
@@ -44,17 +149,29 @@ class Resolver {
    private:
 	// ----- General ----- //
 	void resolveGlobalScope();
+	void resolveImports(Module* m);
+	void requireSignature(Symbol* symbol, Scope* owningScope);
+	void resolveSignature(Symbol* symbol, Scope* owningScope);
+	void resolveGlobalScopeInParallel();
+	bool deferBody(Scope* body);
+	void resolveDeferredBody(DeferredBody& body);
 	void resolveNonLocalContent(Node* n);
+	void resolveTypeSignature(Type* n);
 	void resolveClass(Class* n);
 	void resolveStruct(Struct* n);
 	void resolveTemplate(Template* n);
 	void resolveEnum(Enum* n);
 	void resolveNamespace(Namespace* n);
 	void resolveAlias(Alias* n);
+	void resolveConstructorSignature(Constructor* n);
 	void resolveConstructor(Constructor* n);
+	void resolveVariableSignature(Variable* n);
 	void resolveVariable(Variable* n);
 	void resolveEnumCase(EnumCase* n);
+	void resolveFunctionSignature(Function* n);
 	void resolveFunction(Function* n);
+	void resolveFunctionBody(Function* n);
+	void resolveConstructorBody(Constructor* n);
 	void resolveGenericType(GenericType* n);
 
 	// "intendedType" is for things like for-loops
@@ -107,6 +224,8 @@ class Resolver {
 	void resolveCastingExpression(CastingExpression* n);
 
    private:
+	std::unique_lock<std::recursive_mutex> lockSharedSymbol(
+		const Symbol* symbol);
 	TypeRef* getSymbolReturnType(Symbol* symbol, const SourceMeta& refererMeta);
 	Symbol* getBestCallerForArgs(IdentifierExpression* idexpr,
 								 const List<TypeRef*>& args,
@@ -114,15 +233,12 @@ class Resolver {
 								 Scope* lexicalScope,
 								 const SearchCriteria& searchCriteria,
 								 TypeRef** destReturnType);
-	void getFunctionCallCandidateTypes(
-		const List<resolve::SearchResult>& candidates,
-		List<List<std::pair<Symbol*, FunctionTypeRef*>>>& candidateTypes,
-		const SourceMeta& callerMeta);
-	void getFunctionCallCandidateType(
-		Symbol* symbol, List<std::pair<Symbol*, FunctionTypeRef*>>& refs,
-		const SourceMeta& callerMeta);
-	void getFcctForType(Type* type,
-						List<std::pair<Symbol*, FunctionTypeRef*>>& refs,
+	OverloadSet& getOverloadSet(IdentifierExpression* idexpr,
+								const SourceMeta& callerMeta);
+	std::size_t selectOverload(OverloadSet& set, const List<TypeRef*>& args);
+	void getFunctionCallCandidateType(Symbol* symbol, CandidateTypes& refs,
+									  const SourceMeta& callerMeta);
+	void getFcctForType(Type* type, CandidateTypes& refs,
 						const SourceMeta& callerMeta);
 };
 }  // namespace acl
\ No newline at end of file
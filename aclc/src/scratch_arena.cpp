@@ -0,0 +1,42 @@
+#include "scratch_arena.hpp"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace acl {
+ScratchArena::Frame::Frame(ScratchArena& arena) : arena(arena) {
+	arena.depth++;
+}
+
+ScratchArena::Frame::~Frame() {
+	if (--arena.depth == 0) arena.reset();
+}
+
+ScratchArena::ScratchArena() : current(0), used(0), depth(0) {}
+
+void* ScratchArena::allocate(std::size_t size, std::size_t alignment) {
+	while (current < blocks.size()) {
+		auto& block = blocks[current];
+		auto address = reinterpret_cast<std::uintptr_t>(block.data.get());
+		auto offset = (address + used + alignment - 1) / alignment * alignment -
+					  address;
+		if (offset + size <= block.size) {
+			used = offset + size;
+			return block.data.get() + offset;
+		}
+
+		current++;
+		used = 0;
+	}
+
+	// Requests that don't fit into a regular block get a block of their own
+	auto blockSize = std::max(BLOCK_SIZE, size + alignment);
+	blocks.push_back({std::unique_ptr<char[]>(new char[blockSize]), blockSize});
+	return allocate(size, alignment);
+}
+
+void ScratchArena::reset() {
+	current = 0;
+	used = 0;
+}
+}  // namespace acl
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+#include "common.hpp"
+
+namespace acl {
+/*
+Memory for short-lived temporaries, handed out by bumping a pointer through a
+list of blocks and given back all at once. Nothing is freed individually, so
+anything placed in the arena must not need its destructor to run. The blocks
+are kept when the arena is reset, so once an arena has grown to the size its
+user needs it doesn't allocate anymore.
+
+The arena is reset when the outermost of its frames ends (see Frame), which
+lets nested work such as the statements of a block share the arena without any
+of them giving back memory the others still use. An arena is not thread-safe;
+every resolver has its own.
+*/
+class ScratchArena {
+	struct Block {
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+	};
+
+	List<Block> blocks;
+
+	// The block that is currently allocated from and the number of bytes that
+	// are used in it
+	std::size_t current;
+	std::size_t used;
+
+	unsigned depth;
+
+   public:
+	static constexpr std::size_t BLOCK_SIZE = 16 * 1024;
+
+	class Frame {
+		ScratchArena& arena;
+
+	   public:
+		Frame(ScratchArena& arena);
+		~Frame();
+		Frame(const Frame&) = delete;
+		Frame& operator=(const Frame&) = delete;
+	};
+
+	ScratchArena();
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	void* allocate(std::size_t size, std::size_t alignment);
+
+	// Everything that was allocated becomes invalid
+	void reset();
+};
+}  // namespace acl
@@ -0,0 +1,501 @@
+#include "server.hpp"
+
+#include <cstring>
+#include <iostream>
+
+#include "ast.hpp"
+#include "diagnoser.hpp"
+#include "module_cache.hpp"
+#include "module_loader.hpp"
+#include "source_map.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define ACLC_USE_SOCKETS
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#define ACLC_USE_SERVER
+#include <poll.h>
+#include <signal.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+#endif
+
+namespace {
+using namespace acl;
+
+#ifdef ACLC_USE_SOCKETS
+// A response is a sequence of frames, each of which is a type, the size of its
+// payload and the payload. The last frame holds the exit code.
+const char FRAME_OUTPUT = 'o';
+const char FRAME_EXIT = 'x';
+
+#ifdef MSG_NOSIGNAL
+const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+const int SEND_FLAGS = 0;
+#endif
+
+bool sendAll(int fd, const char* data, std::size_t size) {
+	while (size > 0) {
+		auto n = send(fd, data, size, SEND_FLAGS);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		data += n;
+		size -= static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+bool readAll(int fd, char* data, std::size_t size) {
+	while (size > 0) {
+		auto n = read(fd, data, size);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return false;
+		data += n;
+		size -= static_cast<std::size_t>(n);
+	}
+	return true;
+}
+
+void appendU32(String& dest, std::uint32_t value) {
+	for (int i = 0; i < 4; i++)
+		dest.push_back(static_cast<char>((value >> (i * 8)) & 0xff));
+}
+
+std::uint32_t readU32(const char* data) {
+	std::uint32_t result = 0;
+	for (int i = 0; i < 4; i++) {
+		auto byte = static_cast<unsigned char>(data[i]);
+		result |= static_cast<std::uint32_t>(byte) << (i * 8);
+	}
+	return result;
+}
+
+bool readU32(int fd, std::uint32_t& dest) {
+	char data[4];
+	if (!readAll(fd, data, sizeof(data))) return false;
+	dest = readU32(data);
+	return true;
+}
+
+bool sendFrame(int fd, char type, const char* data, std::size_t size) {
+	String header(1, type);
+	appendU32(header, static_cast<std::uint32_t>(size));
+	return sendAll(fd, header.data(), header.length()) &&
+		   sendAll(fd, data, size);
+}
+
+// A request is the number of fields followed by the fields, each of which is
+// its size and its content: the working directory of the client, whether it
+// has an ACCELE_HOME environment variable and its value, followed by the
+// arguments
+const std::size_t REQUEST_HEADER_FIELDS = 3;
+
+// Requests are limited so that a broken client can't exhaust the memory of the
+// server
+const std::uint32_t MAX_REQUEST_FIELDS = 1 << 16;
+const std::uint32_t MAX_FIELD_SIZE = 1 << 20;
+
+bool readRequest(int fd, List<String>& dest) {
+	std::uint32_t count = 0;
+	if (!readU32(fd, count) || count < REQUEST_HEADER_FIELDS ||
+		count > MAX_REQUEST_FIELDS)
+		return false;
+
+	for (std::uint32_t i = 0; i < count; i++) {
+		std::uint32_t size = 0;
+		if (!readU32(fd, size) || size > MAX_FIELD_SIZE) return false;
+		String field(size, '\0');
+		if (!readAll(fd, &field[0], size)) return false;
+		dest.push_back(field);
+	}
+	return true;
+}
+
+int connectTo(const std::filesystem::path& socketPath) {
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	auto path = socketPath.string();
+	if (path.length() >= sizeof(addr.sun_path)) return -1;
+	std::memcpy(addr.sun_path, path.c_str(), path.length());
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) return -1;
+	if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+#endif
+}  // namespace
+
+namespace acl {
+CompileServer::CompileServer(const std::filesystem::path& socketPath,
+							 const String& compilerVersion)
+	: socketPath(socketPath),
+	  compilerVersion(compilerVersion),
+	  listenFd(-1),
+	  inotifyFd(-1),
+	  reportFd(-1) {}
+
+CompileServer::~CompileServer() {
+#ifdef ACLC_USE_SERVER
+	if (listenFd >= 0) {
+		close(listenFd);
+		std::error_code ec;
+		std::filesystem::remove(socketPath, ec);
+	}
+	if (inotifyFd >= 0) close(inotifyFd);
+#endif
+	for (auto& m : modules) delete m;
+}
+
+const List<Module*>& CompileServer::getModules() const { return modules; }
+
+bool CompileServer::run(const Handler& handler) {
+#ifdef ACLC_USE_SERVER
+	sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	auto path = socketPath.string();
+	if (path.length() >= sizeof(addr.sun_path)) return false;
+	std::memcpy(addr.sun_path, path.c_str(), path.length());
+
+	// A socket that is left over from a server that didn't shut down cleanly
+	// is replaced, but not one that another server is still listening on
+	std::error_code ec;
+	if (std::filesystem::is_socket(socketPath, ec)) {
+		int fd = connectTo(socketPath);
+		if (fd >= 0) {
+			close(fd);
+			return false;
+		}
+		std::filesystem::remove(socketPath, ec);
+	}
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listenFd < 0) return false;
+	if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+		close(listenFd);
+		listenFd = -1;
+		return false;
+	}
+	if (listen(listenFd, SOMAXCONN) != 0) return false;
+
+	inotifyFd = inotify_init1(IN_NONBLOCK);
+	if (inotifyFd < 0) return false;
+
+	// The forked processes are reaped automatically
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	// The reports of the requests that are still being compiled
+	Map<int, String> reports;
+
+	while (true) {
+		List<pollfd> fds = {{listenFd, POLLIN, 0}, {inotifyFd, POLLIN, 0}};
+		for (auto& r : reports) fds.push_back({r.first, POLLIN, 0});
+
+		if (poll(fds.data(), fds.size(), -1) < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+
+		// Files may have changed while a request was being compiled, so the
+		// watch events are handled before any of the reports
+		if (fds[1].revents) handleWatchEvents();
+
+		for (std::size_t i = 2; i < fds.size(); i++) {
+			if (!fds[i].revents) continue;
+
+			char data[4096];
+			auto n = read(fds[i].fd, data, sizeof(data));
+			if (n < 0 && errno == EINTR) continue;
+			if (n > 0) {
+				reports[fds[i].fd].append(data, static_cast<std::size_t>(n));
+				continue;
+			}
+
+			close(fds[i].fd);
+			handleReport(reports[fds[i].fd]);
+			reports.erase(fds[i].fd);
+		}
+
+		if (!fds[0].revents) continue;
+
+		int clientFd = ::accept(listenFd, nullptr, nullptr);
+		if (clientFd < 0) continue;
+
+		int report[2];
+		if (pipe(report) != 0) {
+			close(clientFd);
+			continue;
+		}
+
+		// Anything that is still buffered would be written by both processes
+		std::cout.flush();
+		auto pid = fork();
+		if (pid == 0) {
+			close(report[0]);
+			for (auto& r : reports) close(r.first);
+			serve(clientFd, report[1], handler);
+			_exit(0);
+		}
+
+		close(clientFd);
+		close(report[1]);
+		if (pid < 0)
+			close(report[0]);
+		else
+			reports[report[0]] = "";
+	}
+#else
+	return false;
+#endif
+}
+
+void CompileServer::serve(int clientFd, int reportWriteFd,
+						  const Handler& handler) {
+#ifdef ACLC_USE_SERVER
+	// This process waits for the one that compiles, so it has to reap it
+	signal(SIGCHLD, SIG_DFL);
+	close(listenFd);
+	close(inotifyFd);
+
+	List<String> request;
+	if (!readRequest(clientFd, request)) return;
+
+	int output[2];
+	if (pipe(output) != 0) return;
+
+	auto pid = fork();
+	if (pid == 0) {
+		close(output[0]);
+		close(clientFd);
+		dup2(output[1], STDOUT_FILENO);
+		dup2(output[1], STDERR_FILENO);
+		close(output[1]);
+		reportFd = reportWriteFd;
+
+		if (chdir(request[0].c_str()) != 0) {
+			log::error(std::cout, "Invalid working directory \"" + request[0] +
+									  "\" received by the compile server");
+			exit(1);
+		}
+
+		if (request[1] == "1")
+			setenv("ACCELE_HOME", request[2].c_str(), 1);
+		else
+			unsetenv("ACCELE_HOME");
+
+		List<String> args(request.begin() + REQUEST_HEADER_FIELDS,
+						  request.end());
+		auto exitCode = handler(args);
+		std::cout.flush();
+		exit(exitCode);
+	}
+
+	close(output[1]);
+	close(reportWriteFd);
+
+	// The output is passed on even if the client went away, since the
+	// compilation has to finish either way
+	bool connected = pid >= 0;
+	char data[4096];
+	ssize_t n;
+	while (pid >= 0 && (n = read(output[0], data, sizeof(data))) != 0) {
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) break;
+		if (connected)
+			connected = sendFrame(clientFd, FRAME_OUTPUT, data,
+								  static_cast<std::size_t>(n));
+	}
+	close(output[0]);
+
+	int exitCode = 1;
+	int status = 0;
+	if (pid >= 0) {
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+		}
+		if (WIFEXITED(status))
+			exitCode = WEXITSTATUS(status);
+		else if (WIFSIGNALED(status))
+			exitCode = 128 + WTERMSIG(status);
+	}
+
+	String payload;
+	appendU32(payload, static_cast<std::uint32_t>(exitCode));
+	if (connected)
+		sendFrame(clientFd, FRAME_EXIT, payload.data(), payload.length());
+	close(clientFd);
+#endif
+}
+
+void CompileServer::reportModules(const CompilerContext& ctx,
+								  const std::filesystem::path& cacheDir) {
+#ifdef ACLC_USE_SERVER
+	if (reportFd < 0) return;
+
+	// The cache directory comes first, followed by one module path per line
+	String report = std::filesystem::absolute(cacheDir).string() + "\n";
+	{
+		std::lock_guard<std::mutex> lock(ctx.modulesMutex);
+		for (const auto& m : ctx.modules) {
+			if (m->moduleInfo.path.find('\n') != String::npos) continue;
+			report += m->moduleInfo.path + "\n";
+		}
+	}
+
+	std::size_t written = 0;
+	while (written < report.length()) {
+		auto n = write(reportFd, report.data() + written,
+					   report.length() - written);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		written += static_cast<std::size_t>(n);
+	}
+	close(reportFd);
+	reportFd = -1;
+#endif
+}
+
+void CompileServer::handleReport(const String& report) {
+	StringBuffer sb;
+	sb << report;
+
+	String cacheDir;
+	if (!std::getline(sb, cacheDir) || cacheDir.empty()) return;
+
+	String path;
+	while (std::getline(sb, path))
+		if (!path.empty()) loadModule(path, cacheDir);
+}
+
+void CompileServer::loadModule(const std::filesystem::path& path,
+							   const std::filesystem::path& cacheDir) {
+#ifdef ACLC_USE_SERVER
+	if (modulesByPath.find(path.string()) != modulesByPath.end()) return;
+
+	// The file is watched before it is read so that no change goes unnoticed
+	int wd = inotify_add_watch(inotifyFd, path.c_str(),
+							   IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+								   IN_MOVE_SELF | IN_DELETE_SELF);
+	if (wd < 0) return;
+
+	ModuleCache cache(cacheDir, compilerVersion);
+	auto m = loadCachedModule(path, cache);
+	if (!m) {
+		inotify_rm_watch(inotifyFd, wd);
+		return;
+	}
+
+	watches[wd] = path.string();
+	modules.push_back(m);
+	modulesByPath[path.string()] = m;
+#endif
+}
+
+void CompileServer::handleWatchEvents() {
+#ifdef ACLC_USE_SERVER
+	alignas(inotify_event) char data[4096];
+	while (true) {
+		auto n = read(inotifyFd, data, sizeof(data));
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) return;
+
+		for (ssize_t i = 0; i < n;) {
+			auto event = reinterpret_cast<const inotify_event*>(data + i);
+			i += sizeof(inotify_event) + event->len;
+
+			auto it = watches.find(event->wd);
+			if (it == watches.end()) continue;
+
+			auto path = it->second;
+			watches.erase(it);
+			if (!(event->mask & IN_IGNORED))
+				inotify_rm_watch(inotifyFd, event->wd);
+			dropModule(path);
+		}
+	}
+#endif
+}
+
+void CompileServer::dropModule(const String& path) {
+	auto it = modulesByPath.find(path);
+	if (it == modulesByPath.end()) return;
+
+	auto m = it->second;
+	modulesByPath.erase(it);
+	for (auto i = modules.begin(); i != modules.end(); i++) {
+		if (*i != m) continue;
+		modules.erase(i);
+		break;
+	}
+
+	// The server never resolves its modules, so nothing outside of the AST
+	// points into it. The server runs for as long as it is used and reloads
+	// modules on every change, which is why (unlike the compiler) it frees
+	// their ASTs along with the IDs of their locations.
+	delete m->ast;
+	SourceFile::remove(&m->moduleInfo);
+	delete m;
+}
+
+bool sendCompileRequest(const std::filesystem::path& socketPath,
+						const List<String>& args, int& exitCode) {
+#ifdef ACLC_USE_SOCKETS
+	int fd = connectTo(socketPath);
+	if (fd < 0) return false;
+
+	std::error_code ec;
+	auto cwd = std::filesystem::current_path(ec);
+	auto acceleHome = getenv("ACCELE_HOME");
+
+	List<String> fields = {cwd.string(), acceleHome ? "1" : "0",
+						   acceleHome ? acceleHome : ""};
+	fields.insert(fields.end(), args.begin(), args.end());
+
+	String request;
+	appendU32(request, static_cast<std::uint32_t>(fields.size()));
+	for (const auto& f : fields) {
+		appendU32(request, static_cast<std::uint32_t>(f.length()));
+		request.append(f);
+	}
+
+	if (ec || !sendAll(fd, request.data(), request.length())) {
+		close(fd);
+		return false;
+	}
+
+	while (true) {
+		char header[5];
+		if (!readAll(fd, header, sizeof(header))) break;
+
+		String payload(readU32(header + 1), '\0');
+		if (!readAll(fd, &payload[0], payload.length())) break;
+
+		if (header[0] == FRAME_EXIT && payload.length() == 4) {
+			exitCode = static_cast<int>(readU32(payload.data()));
+			close(fd);
+			return true;
+		}
+
+		if (header[0] == FRAME_OUTPUT) std::cout << payload << std::flush;
+	}
+
+	close(fd);
+	log::error(std::cout, "The compile server closed the connection");
+	exitCode = 1;
+	return true;
+#else
+	return false;
+#endif
+}
+}  // namespace acl
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <filesystem>
+#include <functional>
+
+#include "common.hpp"
+
+namespace acl {
+/*
+A long-lived compiler process which compiles on behalf of clients connecting to
+a Unix domain socket (see sendCompileRequest()), so that the compiler starts up
+once and imported modules are loaded once rather than on every invocation.
+
+Each request is compiled by a process forked from the server, which inherits
+the modules the server holds. Compiling changes the ASTs of the modules and may
+end the process on errors, so the server only keeps modules the way they are
+right after loading: once a request that uses the module cache compiles
+successfully, the modules it used are loaded into the server from the module
+cache and module definition files (the server never parses anything itself).
+Their source files are watched with inotify and a module is dropped as soon as
+its file changes. Input modules are always read afresh by the forked process,
+which only resolves them again if the dependencies recorded in the module cache
+have changed.
+
+This is only supported on Linux.
+*/
+class CompileServer {
+	std::filesystem::path socketPath;
+	String compilerVersion;
+	List<Module*> modules;
+	Map<String, Module*> modulesByPath;
+	Map<int, String> watches;
+	int listenFd;
+	int inotifyFd;
+
+	// Only set in the forked process
+	int reportFd;
+
+   public:
+	// Compiles the arguments of a request in the forked process, in the
+	// working directory of the client, and returns the exit code
+	using Handler = std::function<int(const List<String>& args)>;
+
+   private:
+	void serve(int clientFd, int reportWriteFd, const Handler& handler);
+	void handleReport(const String& report);
+	void handleWatchEvents();
+	void loadModule(const std::filesystem::path& path,
+					const std::filesystem::path& cacheDir);
+	void dropModule(const String& path);
+
+   public:
+
+	CompileServer(const std::filesystem::path& socketPath,
+				  const String& compilerVersion);
+	~CompileServer();
+
+	// Serves requests until the process is terminated. Returns false if the
+	// socket can't be set up.
+	bool run(const Handler& handler);
+
+	// The modules held by the server, which the handler registers with its
+	// compiler context (except for its input modules)
+	const List<Module*>& getModules() const;
+
+	// Called by the handler once it has compiled successfully, so that the
+	// server can hold the modules that were used from now on
+	void reportModules(const CompilerContext& ctx,
+					   const std::filesystem::path& cacheDir);
+};
+
+// Sends the arguments to the compile server listening on the socket and writes
+// its output to stdout. Returns false without sending anything if the server
+// can't be reached. Otherwise, "exitCode" is set to the exit code of the
+// compilation.
+bool sendCompileRequest(const std::filesystem::path& socketPath,
+						const List<String>& args, int& exitCode);
+}  // namespace acl
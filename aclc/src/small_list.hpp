@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#include "scratch_arena.hpp"
+
+namespace acl {
+/*
+A list which keeps up to N elements inside of itself and only allocates once it
+grows beyond that, for the short lists that come up all over the resolver. If a
+scratch arena is given, the list takes its memory from there and must not
+outlive the frame of the arena it was filled in. A copy never shares the arena
+of the original, so copying such a list into the AST is always safe.
+
+Elements are never destroyed, so they have to be trivially destructible.
+*/
+template <typename T, std::size_t N>
+class SmallList {
+	static_assert(std::is_trivially_destructible<T>::value,
+				  "SmallList elements must be trivially destructible");
+	static_assert(N > 0, "SmallList must have room for an element");
+
+	T* items;
+	std::size_t count;
+	std::size_t capacity;
+	ScratchArena* arena;
+	typename std::aligned_storage<sizeof(T), alignof(T)>::type inlineItems[N];
+
+	T* getInlineItems() { return reinterpret_cast<T*>(inlineItems); }
+
+	bool isInline() const {
+		return items == reinterpret_cast<const T*>(inlineItems);
+	}
+
+	void grow() {
+		auto newCapacity = capacity * 2;
+		T* newItems = arena ? static_cast<T*>(arena->allocate(
+								  newCapacity * sizeof(T), alignof(T)))
+							: static_cast<T*>(
+								  ::operator new(newCapacity * sizeof(T)));
+		std::uninitialized_copy(items, items + count, newItems);
+		release();
+		items = newItems;
+		capacity = newCapacity;
+	}
+
+	void release() {
+		if (!isInline() && !arena) ::operator delete(items);
+	}
+
+   public:
+	SmallList(ScratchArena* arena = nullptr)
+		: items(getInlineItems()), count(0), capacity(N), arena(arena) {}
+
+	SmallList(std::initializer_list<T> list) : SmallList() {
+		for (const auto& e : list) push_back(e);
+	}
+
+	SmallList(const SmallList& other) : SmallList() {
+		for (const auto& e : other) push_back(e);
+	}
+
+	SmallList& operator=(const SmallList& other) {
+		if (this == &other) return *this;
+		clear();
+		for (const auto& e : other) push_back(e);
+		return *this;
+	}
+
+	~SmallList() { release(); }
+
+	void push_back(const T& e) {
+		if (count == capacity) {
+			// The element may be part of the list itself
+			T copy = e;
+			grow();
+			new (items + count++) T(copy);
+			return;
+		}
+		new (items + count++) T(e);
+	}
+
+	void clear() { count = 0; }
+	std::size_t size() const { return count; }
+	bool empty() const { return count == 0; }
+
+	T& operator[](std::size_t i) { return items[i]; }
+	const T& operator[](std::size_t i) const { return items[i]; }
+	T& back() { return items[count - 1]; }
+	const T& back() const { return items[count - 1]; }
+
+	T* begin() { return items; }
+	T* end() { return items + count; }
+	const T* begin() const { return items; }
+	const T* end() const { return items + count; }
+};
+
+template <typename T, std::size_t N>
+bool listContains(const SmallList<T, N>& list, const T& t) {
+	for (const auto& e : list)
+		if (e == t) return true;
+	return false;
+}
+}  // namespace acl
@@ -0,0 +1,205 @@
+#include "source_map.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <shared_mutex>
+
+namespace {
+using namespace acl;
+
+// ID 0 is the location that points nowhere
+std::uint32_t nextBase = 1;
+
+// The IDs below "nextBase" that were freed by removing sources, as the number
+// of IDs in each range by its first ID. Adjacent ranges are merged.
+std::map<std::uint32_t, std::uint32_t>& getFreeRanges() {
+	static auto* ranges = new std::map<std::uint32_t, std::uint32_t>();
+	return *ranges;
+}
+
+// The registered sources in the order of their bases. Sources are registered
+// by the lexers of every module that is loaded in parallel.
+List<const SourceFile*>& getSourceFiles() {
+	static auto* files = new List<const SourceFile*>();
+	return *files;
+}
+
+std::shared_mutex& getSourceFilesMutex() {
+	static std::shared_mutex mutex;
+	return mutex;
+}
+// Takes the IDs of a source from the first freed range that is large enough
+// before taking new ones. Returns 0 if there are not enough IDs left.
+std::uint32_t takeIds(std::size_t size) {
+	auto& ranges = getFreeRanges();
+	for (auto it = ranges.begin(); it != ranges.end(); it++) {
+		if (size >= it->second) continue;
+		auto base = it->first;
+		auto count = static_cast<std::uint32_t>(size) + 1;
+		if (count < it->second) ranges[base + count] = it->second - count;
+		ranges.erase(it);
+		return base;
+	}
+
+	auto available = std::numeric_limits<std::uint32_t>::max() - nextBase;
+	if (size >= available) return 0;
+
+	auto base = nextBase;
+	nextBase += static_cast<std::uint32_t>(size) + 1;
+	return base;
+}
+
+void freeIds(std::uint32_t base, std::size_t size) {
+	auto& ranges = getFreeRanges();
+	auto count = static_cast<std::uint32_t>(size) + 1;
+
+	auto next = ranges.find(base + count);
+	if (next != ranges.end()) {
+		count += next->second;
+		ranges.erase(next);
+	}
+
+	auto it = ranges.lower_bound(base);
+	if (it != ranges.begin()) {
+		auto prev = std::prev(it);
+		if (prev->first + prev->second == base) {
+			base = prev->first;
+			count += prev->second;
+			ranges.erase(prev);
+		}
+	}
+
+	if (base + count == nextBase)
+		nextBase = base;
+	else
+		ranges[base] = count;
+}
+}  // namespace
+
+namespace acl {
+SourceFile::SourceFile(const ModuleInfo* moduleInfo, std::uint32_t base,
+					   std::size_t size)
+	: moduleInfo(moduleInfo), base(base), size(size) {
+	lineStarts[0] = 1;
+}
+
+SourceFile* SourceFile::add(const ModuleInfo* moduleInfo, std::size_t size) {
+	std::unique_lock<std::shared_mutex> lock(getSourceFilesMutex());
+	auto file = new SourceFile(moduleInfo, takeIds(size), size);
+
+	// Sources without IDs come first and are never found
+	auto& files = getSourceFiles();
+	auto it = std::upper_bound(
+		files.begin(), files.end(), file->base,
+		[](std::uint32_t base, const SourceFile* f) { return base < f->base; });
+	files.insert(it, file);
+	return file;
+}
+
+void SourceFile::remove(const ModuleInfo* moduleInfo) {
+	std::unique_lock<std::shared_mutex> lock(getSourceFilesMutex());
+	auto& files = getSourceFiles();
+	for (auto it = files.begin(); it != files.end();) {
+		auto file = *it;
+		if (file->moduleInfo != moduleInfo) {
+			it++;
+			continue;
+		}
+
+		if (file->base) freeIds(file->base, file->size);
+		delete file;
+		it = files.erase(it);
+	}
+}
+
+const SourceFile* SourceFile::find(std::uint32_t id) {
+	if (id == 0) return nullptr;
+
+	std::shared_lock<std::shared_mutex> lock(getSourceFilesMutex());
+	const auto& files = getSourceFiles();
+
+	// The last source with a base that isn't greater than the ID
+	std::size_t low = 0;
+	std::size_t high = files.size();
+	while (low < high) {
+		auto mid = low + (high - low) / 2;
+		if (files[mid]->base <= id)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	if (low == 0) return nullptr;
+
+	auto file = files[low - 1];
+	return file->base && id - file->base <= file->size ? file : nullptr;
+}
+
+const ModuleInfo* SourceFile::getModuleInfo() const { return moduleInfo; }
+
+std::uint32_t SourceFile::getBase() const { return base; }
+
+std::size_t SourceFile::getSize() const { return size; }
+
+void SourceFile::addLine(FilePos start, int line) {
+	std::lock_guard<std::mutex> lock(mutex);
+	lineStarts[start] = line;
+}
+
+void SourceFile::getLineAndCol(FilePos pos, int& line, int& col) const {
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = --lineStarts.upper_bound(pos);
+	line = it->second;
+	col = static_cast<int>(pos - it->first) + 1;
+}
+
+SourceMeta::SourceMeta() : id(0) {}
+
+SourceMeta::SourceMeta(const SourceFile* file, FilePos pos) : id(0) {
+	if (file && file->getBase() && pos >= 0 &&
+		static_cast<std::size_t>(pos) <= file->getSize())
+		id = file->getBase() + static_cast<std::uint32_t>(pos);
+}
+
+bool SourceMeta::isValid() const { return id != 0; }
+
+const SourceFile* SourceMeta::getFile() const { return SourceFile::find(id); }
+
+const ModuleInfo* SourceMeta::getModuleInfo() const {
+	auto file = getFile();
+	return file ? file->getModuleInfo() : nullptr;
+}
+
+FilePos SourceMeta::getPos() const {
+	auto file = getFile();
+	return file ? id - file->getBase() : -1;
+}
+
+int SourceMeta::getLine() const {
+	auto file = getFile();
+	if (!file) return -1;
+
+	int line = 0;
+	int col = 0;
+	file->getLineAndCol(id - file->getBase(), line, col);
+	return line;
+}
+
+int SourceMeta::getCol() const {
+	auto file = getFile();
+	if (!file) return -1;
+
+	int line = 0;
+	int col = 0;
+	file->getLineAndCol(id - file->getBase(), line, col);
+	return col;
+}
+
+bool SourceMeta::operator==(const SourceMeta& other) const {
+	return id == other.id;
+}
+
+bool SourceMeta::operator!=(const SourceMeta& other) const {
+	return id != other.id;
+}
+}  // namespace acl
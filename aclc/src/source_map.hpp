@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "common.hpp"
+
+namespace acl {
+/*
+A source that locations point into, which owns a range of location IDs starting
+at "base" with one ID for every position up to and including its size. The
+locations of a module can be looked up until its sources are removed, which
+frees their IDs for the sources registered after them.
+
+Only the lines that locations point into have to be known: the lexer records
+every line it starts, and a module read from its serialized interface records
+the lines of the locations it reads.
+*/
+class SourceFile {
+	const ModuleInfo* moduleInfo;
+	std::uint32_t base;
+	std::size_t size;
+
+	// The line number of every known line by the position it starts at
+	std::map<FilePos, int> lineStarts;
+	mutable std::mutex mutex;
+
+	SourceFile(const ModuleInfo* moduleInfo, std::uint32_t base,
+			   std::size_t size);
+
+   public:
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+
+	// Registers a source of the specified size. Its base is 0 (so that all of
+	// its locations point nowhere) if there are not enough IDs left.
+	static SourceFile* add(const ModuleInfo* moduleInfo, std::size_t size);
+
+	// Frees all sources registered for the module. This may only be done once
+	// nothing points into them anymore (i.e. the AST of the module has been
+	// freed), as their IDs are handed out again.
+	static void remove(const ModuleInfo* moduleInfo);
+
+	// Returns nullptr if the ID doesn't belong to any source
+	static const SourceFile* find(std::uint32_t id);
+
+	const ModuleInfo* getModuleInfo() const;
+	std::uint32_t getBase() const;
+	std::size_t getSize() const;
+
+	// Line 1 always starts at position 0
+	void addLine(FilePos start, int line);
+
+	void getLineAndCol(FilePos pos, int& line, int& col) const;
+};
+}  // namespace acl
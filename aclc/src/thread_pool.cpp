@@ -0,0 +1,107 @@
+#include "thread_pool.hpp"
+
+namespace acl {
+ThreadPool::ThreadPool(unsigned jobs) : activeTasks(0), stopping(false) {
+	// The thread calling wait() counts as one of the jobs
+	for (unsigned i = 1; i < jobs; i++)
+		workers.push_back(std::thread(&ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	taskAvailable.notify_all();
+	for (auto& w : workers) w.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+	}
+	taskAvailable.notify_one();
+}
+
+void ThreadPool::runTask(std::unique_lock<std::mutex>& lock) {
+	auto task = std::move(tasks.front());
+	tasks.pop_front();
+	activeTasks++;
+	lock.unlock();
+
+	try {
+		task();
+	} catch (...) {
+		std::lock_guard<std::mutex> errorLock(mutex);
+		if (!error) error = std::current_exception();
+	}
+
+	lock.lock();
+	activeTasks--;
+	taskFinished.notify_all();
+}
+
+void ThreadPool::work() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (true) {
+		taskAvailable.wait(lock, [this] { return stopping || !tasks.empty(); });
+		if (tasks.empty()) return;
+		runTask(lock);
+	}
+}
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!tasks.empty() || activeTasks > 0) {
+		if (!tasks.empty())
+			runTask(lock);
+		else
+			taskFinished.wait(lock);
+	}
+
+	if (error) {
+		auto e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+void ThreadPool::run(const List<std::function<void()>>& group) {
+	auto pending = group.size();
+	std::exception_ptr groupError;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (const auto& t : group) {
+			tasks.push_back([this, &t, &pending, &groupError]() {
+				std::exception_ptr e;
+				try {
+					t();
+				} catch (...) {
+					e = std::current_exception();
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (e && !groupError) groupError = e;
+				pending--;
+			});
+		}
+	}
+	taskAvailable.notify_all();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	while (pending > 0) {
+		if (!tasks.empty())
+			runTask(lock);
+		else
+			taskFinished.wait(lock);
+	}
+
+	if (groupError) std::rethrow_exception(groupError);
+}
+
+unsigned ThreadPool::getDefaultJobs() {
+	auto result = std::thread::hardware_concurrency();
+	return result ? result : 1;
+}
+}  // namespace acl
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common.hpp"
+
+namespace acl {
+/*
+A fixed-size pool of worker threads which run tasks in the order they were
+submitted. Tasks may submit further tasks, or run a group of tasks and wait for
+it (see run()). The thread calling wait() also runs tasks until the queue is
+drained, so a pool created with a single job runs everything on the calling
+thread.
+
+If a task throws, the remaining tasks are still run and the first exception is
+rethrown from wait().
+*/
+class ThreadPool {
+	List<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+	std::mutex mutex;
+	std::condition_variable taskAvailable;
+	std::condition_variable taskFinished;
+	std::size_t activeTasks;
+	bool stopping;
+	std::exception_ptr error;
+
+	void work();
+	void runTask(std::unique_lock<std::mutex>& lock);
+
+   public:
+	ThreadPool(unsigned jobs);
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+
+	// Blocks until every submitted task (including tasks submitted by other
+	// tasks) has finished
+	void wait();
+
+	// Submits the tasks and blocks until they have finished, running queued
+	// tasks (not just these) on the calling thread in the meantime. Unlike
+	// wait(), this may be called from a task. The first exception thrown by
+	// one of the tasks is rethrown.
+	void run(const List<std::function<void()>>& group);
+
+	// The number of jobs to use when none is specified
+	static unsigned getDefaultJobs();
+};
+}  // namespace acl
@@ -1,71 +1,142 @@
 #include "type_builder.hpp"
 
+#include <functional>
+#include <mutex>
+
 #include "invariant_types.hpp"
 
-namespace acl {
-namespace tb {
-TypeRef* base(Type* referent, const List<TypeRef*>& generics,
-			  const SourceMeta& meta) {
-	auto result = new SimpleTypeRef(
-		meta,
-		new Token(referent->id->type, referent->id->data, referent->id->meta),
-		generics, nullptr);
-	result->referent = referent;
-	result->actualType = referent;
-	result->actualGenerics = generics;
-	return result;
+namespace {
+using namespace acl;
+
+enum class TypeRefKind {
+	BASE,
+	OPTIONAL,
+	UNWRAPPED_OPTIONAL,
+	POINTER,
+	ARRAY,
+	MAP,
+	TUPLE,
+	FUNCTION
+};
+
+struct TypeKey {
+	TypeRefKind kind;
+	const Type* type;
+	List<const TypeRef*> children;
+
+	bool operator==(const TypeKey& other) const {
+		return kind == other.kind && type == other.type &&
+			   children == other.children;
+	}
+};
+
+struct TypeKeyHash {
+	std::size_t operator()(const TypeKey& key) const {
+		std::size_t result = std::hash<int>()(static_cast<int>(key.kind));
+		result = result * 31 + std::hash<const Type*>()(key.type);
+		for (const auto& c : key.children)
+			result = result * 31 + std::hash<const TypeRef*>()(c);
+		return result;
+	}
+};
+
+// Canonical type refs live for the remainder of the compilation, just like the
+// invariant types they are built from
+std::unordered_map<TypeKey, TypeRef*, TypeKeyHash>& getCanonicalRefs() {
+	static auto* refs =
+		new std::unordered_map<TypeKey, TypeRef*, TypeKeyHash>();
+	return *refs;
 }
 
-TypeRef* optional(TypeRef* content) {
-	auto result = new SuffixTypeRef(
-		content->sourceMeta, content,
-		new Token(TokenType::QUESTION_MARK, "?", content->sourceMeta));
+// Type refs may be built by several resolvers at once when modules are
+// compiled in parallel
+std::mutex& getCanonicalRefsMutex() {
+	static std::mutex mutex;
+	return mutex;
+}
+
+const SourceMeta CANONICAL_META;
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::OPTIONAL);
-	result->actualGenerics.push_back(content);
+template <typename F>
+TypeRef* intern(TypeKey&& key, F create) {
+	std::lock_guard<std::mutex> lock(getCanonicalRefsMutex());
+	auto& refs = getCanonicalRefs();
+	auto it = refs.find(key);
+	if (it != refs.end()) return it->second;
 
+	TypeRef* result = create();
+	result->canonical = true;
+	refs.emplace(std::move(key), result);
 	return result;
 }
 
-TypeRef* unwrappedOptional(TypeRef* content) {
-	auto result = new SuffixTypeRef(
-		content->sourceMeta, content,
-		new Token(TokenType::EXCLAMATION_POINT, "!", content->sourceMeta));
+TypeRef* suffix(TypeRefKind kind, TypeRef* content, TokenType suffixType,
+				const String& suffixData, const bt::InvariantType* type) {
+	return intern({kind, type, {content}}, [&]() {
+		auto result = new SuffixTypeRef(
+			CANONICAL_META, content,
+			new Token(suffixType, suffixData, CANONICAL_META));
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::UNWRAPPED_OPTIONAL);
-	result->actualGenerics.push_back(content);
+		result->actualType = const_cast<bt::InvariantType*>(type);
+		result->actualGenerics.push_back(content);
 
-	return result;
+		return result;
+	});
 }
+}  // namespace
 
-TypeRef* pointer(TypeRef* content) {
-	auto result = new SuffixTypeRef(
-		content->sourceMeta, content,
-		new Token(TokenType::ASTERISK, "*", content->sourceMeta));
+namespace acl {
+namespace tb {
+TypeRef* base(Type* referent, const List<TypeRef*>& generics) {
+	List<const TypeRef*> children(generics.begin(), generics.end());
+	return intern({TypeRefKind::BASE, referent, children}, [&]() {
+		auto result = new SimpleTypeRef(
+			CANONICAL_META,
+			new Token(referent->id->type, referent->id->data, CANONICAL_META),
+			generics, nullptr);
+		result->referent = referent;
+		result->actualType = referent;
+		result->actualGenerics = generics;
+		return result;
+	});
+}
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::POINTER);
-	result->actualGenerics.push_back(content);
+TypeRef* optional(TypeRef* content) {
+	return suffix(TypeRefKind::OPTIONAL, content, TokenType::QUESTION_MARK,
+				  "?", bt::OPTIONAL);
+}
 
-	return result;
+TypeRef* unwrappedOptional(TypeRef* content) {
+	return suffix(TypeRefKind::UNWRAPPED_OPTIONAL, content,
+				  TokenType::EXCLAMATION_POINT, "!", bt::UNWRAPPED_OPTIONAL);
+}
+
+TypeRef* pointer(TypeRef* content) {
+	return suffix(TypeRefKind::POINTER, content, TokenType::ASTERISK, "*",
+				  bt::POINTER);
 }
 
 TypeRef* array(TypeRef* content) {
-	auto result = new ArrayTypeRef(content->sourceMeta, content);
+	return intern({TypeRefKind::ARRAY, bt::ARRAY, {content}}, [&]() {
+		auto result = new ArrayTypeRef(CANONICAL_META, content);
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::ARRAY);
-	result->actualGenerics.push_back(content);
+		result->actualType = const_cast<bt::InvariantType*>(bt::ARRAY);
+		result->actualGenerics.push_back(content);
 
-	return result;
+		return result;
+	});
 }
 
 TypeRef* map(TypeRef* key, TypeRef* value) {
-	auto result = new MapTypeRef(key->sourceMeta, key, value);
+	return intern({TypeRefKind::MAP, bt::MAP, {key, value}}, [&]() {
+		auto result = new MapTypeRef(CANONICAL_META, key, value);
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::MAP);
-	result->actualGenerics.push_back(key);
-	result->actualGenerics.push_back(value);
+		result->actualType = const_cast<bt::InvariantType*>(bt::MAP);
+		result->actualGenerics.push_back(key);
+		result->actualGenerics.push_back(value);
 
-	return result;
+		return result;
+	});
 }
 
 TypeRef* tuple(std::initializer_list<TypeRef*> types) {
@@ -75,13 +146,16 @@ TypeRef* tuple(std::initializer_list<TypeRef*> types) {
 }
 
 TypeRef* tuple(const List<TypeRef*>& types) {
-	auto result = new TupleTypeRef(types[0]->sourceMeta, types);
+	List<const TypeRef*> children(types.begin(), types.end());
+	return intern({TypeRefKind::TUPLE, bt::TUPLE, children}, [&]() {
+		auto result = new TupleTypeRef(CANONICAL_META, types);
 
-	result->actualType = const_cast<bt::InvariantType*>(bt::TUPLE);
-	result->actualGenerics.insert(result->actualGenerics.end(), types.begin(),
-								  types.end());
+		result->actualType = const_cast<bt::InvariantType*>(bt::TUPLE);
+		result->actualGenerics.insert(result->actualGenerics.end(),
+									  types.begin(), types.end());
 
-	return result;
+		return result;
+	});
 }
 
 FunctionTypeRef* function(std::initializer_list<TypeRef*> paramTypes,
@@ -93,15 +167,25 @@ FunctionTypeRef* function(std::initializer_list<TypeRef*> paramTypes,
 
 FunctionTypeRef* function(const List<TypeRef*>& paramTypes,
 						  TypeRef* returnType) {
-	auto result =
-		new FunctionTypeRef(returnType->sourceMeta, paramTypes, returnType);
-
-	result->actualType = const_cast<bt::InvariantType*>(bt::FUNCTION);
-	result->actualGenerics.push_back(returnType);
-	result->actualGenerics.insert(result->actualGenerics.end(),
-								  paramTypes.begin(), paramTypes.end());
+	List<const TypeRef*> children;
+	children.push_back(returnType);
+	children.insert(children.end(), paramTypes.begin(), paramTypes.end());
+	return static_cast<FunctionTypeRef*>(
+		intern({TypeRefKind::FUNCTION, bt::FUNCTION, children}, [&]() {
+			auto result =
+				new FunctionTypeRef(CANONICAL_META, paramTypes, returnType);
+
+			result->actualType = const_cast<bt::InvariantType*>(bt::FUNCTION);
+			result->actualGenerics.push_back(returnType);
+			result->actualGenerics.insert(result->actualGenerics.end(),
+										  paramTypes.begin(), paramTypes.end());
+
+			return result;
+		}));
+}
 
-	return result;
+void release(TypeRef* ref) {
+	if (ref && !ref->canonical) delete ref;
 }
 }  // namespace tb
-}  // namespace acl
\ No newline at end of file
+}  // namespace acl
@@ -4,10 +4,22 @@
 
 #include "ast.hpp"
 
+/*
+The type builder produces canonical type refs. Type refs of the same kind with
+the same actual type and the same generic argument pointers are hash-consed
+into a single immutable instance, so two refs produced by the type builder that
+are the same pointer denote the same type. The converse doesn't hold: the refs
+passed to the type builder (such as parsed ones) are used as they are, so
+structurally identical types can still have different pointers, and a memo
+keyed on these pointers may miss.
+
+Canonical type refs are owned by the type builder and must never be deleted or
+modified by their users. They do not carry a source location.
+*/
+
 namespace acl {
 namespace tb {
-TypeRef* base(Type* referent, const List<TypeRef*>& generics,
-			  const SourceMeta& meta);
+TypeRef* base(Type* referent, const List<TypeRef*>& generics);
 TypeRef* optional(TypeRef* content);
 TypeRef* unwrappedOptional(TypeRef* content);
 TypeRef* pointer(TypeRef* content);
@@ -19,5 +31,8 @@ FunctionTypeRef* function(std::initializer_list<TypeRef*> paramTypes,
 						  TypeRef* returnType);
 FunctionTypeRef* function(const List<TypeRef*>& paramTypes,
 						  TypeRef* returnType);
+
+// Deletes the specified type ref unless it is a canonical instance
+void release(TypeRef* ref);
 }  // namespace tb
-}  // namespace acl
\ No newline at end of file
+}  // namespace acl
@@ -0,0 +1,72 @@
+#!/bin/bash
+# Checks that the ASTs come back unchanged when read from their dumps.
+#
+# Usage: ast_roundtrip.sh <path to aclc>
+#
+# Takes the "main.accele" of every case below "cases" and of "syntax", which
+# uses most of the syntax. Its AST is dumped as loadable JSON and as binary,
+# each dump is read back in with --load-ast and dumped as loadable JSON again,
+# and the result must be identical to the first JSON dump. Only the parser and
+# the loader matter here, so the exit code of the compiler is ignored, and
+# inputs that don't parse are skipped.
+
+if [ $# -ne 1 ]; then
+	echo "Usage: $0 <path to aclc>"
+	exit 2
+fi
+
+aclc=$(realpath "$1")
+testsDir=$(dirname "$(realpath "$0")")
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+failures=0
+skipped=0
+count=0
+
+# Runs the compiler on the input in the directory with the given arguments
+compile() {
+	local dir=$1
+	shift
+	(cd "$dir" && "$aclc" -G "$dir" --no-cache "$@" main.accele 2>&1)
+}
+
+for dir in "$testsDir"/cases/*/ "$testsDir"/syntax/; do
+	dir=${dir%/}
+	name=$(basename "$dir")
+	count=$((count + 1))
+	out=$work/$name
+	mkdir -p "$out/json" "$out/binary" "$out/fromJson" "$out/fromBinary"
+
+	compile "$dir" --dump-ast "$out/json" --loadable-ast > /dev/null
+	if [ ! -f "$out/json/main.ast.json" ]; then
+		skipped=$((skipped + 1))
+		echo "SKIP: $name"
+		continue
+	fi
+	compile "$dir" --dump-ast "$out/binary" --binary-ast > /dev/null
+
+	failed=""
+	[ -f "$out/binary/main.ast" ] || failed+="  no binary dump"$'\n'
+	for format in json binary; do
+		[ "$format" = json ] && dest=$out/fromJson || dest=$out/fromBinary
+		output=$(compile "$dir" --load-ast "$out/$format" --dump-ast "$dest" \
+			--loadable-ast --time-report)
+		# Without this the AST could have been parsed again after all
+		grep -q "load AST" <<< "$output" ||
+			failed+="  the $format dump wasn't loaded"$'\n'
+		diff -r "$out/json" "$dest" > "$out/$format.diff" ||
+			failed+="$(sed 's/^/  /' "$out/$format.diff")"$'\n'
+	done
+
+	if [ -n "$failed" ]; then
+		failures=$((failures + 1))
+		echo "FAIL: $name"
+		printf "%s" "$failed"
+	else
+		echo "PASS: $name"
+	fi
+done
+
+echo "$((count - failures - skipped)) of $((count - skipped)) ASTs survived" \
+	"the round trip, $skipped skipped"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,71 @@
+#!/bin/bash
+# Compiles every case below "cases" and checks the result.
+#
+# Usage: run.sh <path to aclc>
+#
+# A case is a directory holding "main.accele" (along with any modules it
+# imports, which are found through the case directory as the global import
+# directory) and an "expected" file. Each line of the expected file is one of
+#   exit <code>   The exit code of the compiler
+#   not <text>    Text that must not appear in the output
+#   <text>        Text that must appear in the output
+# Lines starting with "#" are ignored. An optional "args" file holds further
+# arguments for the compiler, one per line.
+
+if [ $# -ne 1 ]; then
+	echo "Usage: $0 <path to aclc>"
+	exit 2
+fi
+
+aclc=$(realpath "$1")
+casesDir=$(dirname "$(realpath "$0")")/cases
+failures=0
+count=0
+
+for dir in "$casesDir"/*/; do
+	dir=${dir%/}
+	name=$(basename "$dir")
+	count=$((count + 1))
+
+	args=()
+	if [ -f "$dir/args" ]; then
+		while IFS= read -r arg; do
+			[ -n "$arg" ] && args+=("$arg")
+		done < "$dir/args"
+	fi
+
+	output=$(cd "$dir" && "$aclc" -G "$dir" --no-cache "${args[@]}" \
+		main.accele 2>&1)
+	code=$?
+
+	failed=""
+	while IFS= read -r line; do
+		case "$line" in
+			"" | "#"*) ;;
+			"exit "*)
+				[ "$code" -eq "${line#exit }" ] ||
+					failed+="  expected exit code ${line#exit }, got $code"$'\n'
+				;;
+			"not "*)
+				! grep -qF -- "${line#not }" <<< "$output" ||
+					failed+="  unexpected \"${line#not }\""$'\n'
+				;;
+			*)
+				grep -qF -- "$line" <<< "$output" ||
+					failed+="  missing \"$line\""$'\n'
+				;;
+		esac
+	done < "$dir/expected"
+
+	if [ -n "$failed" ]; then
+		failures=$((failures + 1))
+		echo "FAIL: $name"
+		printf "%s" "$failed"
+		printf "%s\n" "$output" | sed 's/^/  | /'
+	else
+		echo "PASS: $name"
+	fi
+done
+
+echo "$((count - failures)) of $count cases passed"
+[ "$failures" -eq 0 ]